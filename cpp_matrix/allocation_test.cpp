@@ -0,0 +1,194 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+/**
+ *  Counts heap allocations to show that the in-place operations allocate
+ *  nothing: the Markov chain iteration of markov_iteration.cpp, with a
+ *  600-state Matrix and gemm() into existing storage, allocates only while
+ *  warming up. At that size the products, sums and norms are blocked and
+ *  split over a pool of four threads. Then LU solves through a transposed
+ *  view, and temporaries of user code, take their work space from the
+ *  per-thread arena of allocator.hpp, which stops allocating once it has
+ *  grown to fit. Last, an arena matrix is mapped in place, multiplied by
+ *  an arena vector and used as the operator of CG. Exits with status 1 if
+ *  a steady-state iteration allocates or the arena results differ.
+ */
+
+static std::atomic<std::size_t> allocations{0};
+
+void *operator new(std::size_t size) {
+  allocations++;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc{};
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+// Matrix storage is aligned, so it comes through these.
+void *operator new(std::size_t size, std::align_val_t align) {
+  allocations++;
+  std::size_t a = static_cast<std::size_t>(align);
+  if (void *p = std::aligned_alloc(a, (size / a + 1) * a))
+    return p;
+  throw std::bad_alloc{};
+}
+void *operator new[](std::size_t size, std::align_val_t align) {
+  return operator new(size, align);
+}
+// Kept out of line, or GCC pairs the aligned new above with free() and warns.
+[[gnu::noinline]] void operator delete(void *p, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+int main() {
+  // Starting the pool's threads allocates; running batches on them doesn't.
+  matrix::set_num_threads(4);
+  unsigned n = 600;
+  matrix::Matrix<double> m{n, n};
+  for (unsigned i = 0; i < n; i++) {
+    double sum = 0;
+    for (unsigned j = 0; j < n; j++)
+      sum += m(i, j) = 1 + (i * 7 + j * 3) % 11;
+    for (unsigned j = 0; j < n; j++)
+      m(i, j) /= sum;
+  }
+
+  double tolerance = 1.0E-12;
+  matrix::Matrix<double> curr{m};
+  matrix::Matrix<double> prev{m};
+  std::size_t steady = 0;
+
+  for (unsigned c = 0;; c++) {
+    // The first product sets up gemm's packing buffers.
+    std::size_t before = allocations;
+    prev = curr;
+    matrix::gemm(1.0, prev, m, 0.0, curr);
+    double norm_delta = matrix::infNorm(curr - prev);
+    if (c > 0)
+      steady += allocations - before;
+    if (norm_delta < tolerance) {
+      std::cout << "Markov iteration converged after " << c + 1
+                << " iterations." << std::endl;
+      break;
+    }
+  }
+  std::cout << "Allocations in steady-state iterations: " << steady
+            << std::endl;
+
+  // In-place vector updates, long enough to be split over threads.
+  matrix::Vector<double> x(n * n), y(n * n);
+  for (unsigned i = 0; i < n * n; i++)
+    x[i] = i;
+  std::size_t before = allocations;
+  matrix::axpy(2.0, x, y);
+  y += x;
+  y -= 0.5 * x;
+  y *= 2.0;
+  x = y;
+  std::cout << "Allocations in axpy, +=, -=, *= and =: "
+            << allocations - before << std::endl;
+  steady += allocations - before;
+  std::cout << "y[3] = " << y[3] << std::endl;
+
+  // A value-returning expression allocates its result once, and moving it
+  // allocates nothing.
+  before = allocations;
+  matrix::Vector<double> z = 2.0 * x;
+  std::cout << "Allocations in z = 2 * x: " << allocations - before
+            << std::endl;
+  before = allocations;
+  matrix::Vector<double> w{std::move(z)};
+  std::cout << "Allocations in moving z: " << allocations - before
+            << std::endl;
+
+  bool aligned = reinterpret_cast<std::uintptr_t>(w.ptr()) % 64 == 0;
+  std::cout << "Storage aligned to 64 bytes: "
+            << (test::expect(aligned) ? "yes" : "no") << std::endl;
+
+  // Solving in a transposed view, by dense, banded or tridiagonal LU,
+  // makes a contiguous copy of it in the arena; so does the arena matrix
+  // t, and so do applying Q^T and the blocked reflectors' work space. All
+  // reuse the arena's memory. The 128 right-hand sides are solved in
+  // column chunks on separate threads, and the workers' arenas are reused
+  // as well.
+  matrix::Matrix<double> a{m};
+  for (unsigned i = 0; i < n; i++)
+    a(i, i) += 1;
+  matrix::LUFactorization<double> lu{a};
+  matrix::QRFactorization<double> qr{a};
+  matrix::BandedMatrix<double> ab{n, 2, 2};
+  for (unsigned i = 0; i < n; i++)
+    for (unsigned j = i > 2 ? i - 2 : 0; j < n && j <= i + 2; j++)
+      ab(i, j) = a(i, j);
+  matrix::BandedLUFactorization<double> band{ab};
+  matrix::TridiagonalMatrix<double> tri{std::vector<double>(n - 1, -1),
+                                        std::vector<double>(n, 4),
+                                        std::vector<double>(n - 1, -1)};
+  matrix::Matrix<double> bt{128, n}, c_qr{n, 128};
+  for (unsigned c = 0; c < 10; c++) {
+    before = allocations;
+    lu.solve_in_place(bt.transpose());
+    band.solve_in_place(bt.transpose());
+    matrix::solve_tridiagonal_in_place(tri, bt.transpose());
+    qr.apply_qt(c_qr);
+    {
+      matrix::ArenaScope scope;
+      matrix::Matrix<double, matrix::ArenaAllocator<double>> t{
+          n, n, matrix::uninitialized};
+      matrix::gemm(1.0, m, a, 0.0, t);
+    }
+    if (c > 0)
+      steady += allocations - before;
+  }
+  std::cout << "Allocations in steady-state solves with arena temporaries: "
+            << steady << std::endl;
+  test::expect(steady == 0);
+
+  // Arena matrices take the same products and maps as the default ones.
+  bool same;
+  {
+    matrix::ArenaScope scope;
+    matrix::Matrix<double, matrix::ArenaAllocator<double>> t{a};
+    matrix::Vector<double, matrix::ArenaAllocator<double>> v(n);
+    for (unsigned i = 0; i < n; i++)
+      v[i] = x[i];
+    matrix::map_in_place([](double e) { return 2 * e; }, t);
+    same = matrix::infNorm(t * v - 2.0 * (a * matrix::Vector<double>{v})) == 0;
+
+    // And CG takes one as its operator: t + t^T is symmetric, and positive
+    // definite since a is diagonally dominant.
+    matrix::Matrix<double, matrix::ArenaAllocator<double>> s{t};
+    for (unsigned i = 0; i < n; i++)
+      for (unsigned j = 0; j < n; j++)
+        s(i, j) += t(j, i);
+    matrix::Vector<double> b(n);
+    for (unsigned i = 0; i < n; i++)
+      b[i] = 1;
+    matrix::IterativeOptions opts;
+    opts.tol = 1e-10;
+    matrix::IterativeResult<double> r = matrix::cg(s, b, opts);
+    same = same && r.converged &&
+           matrix::infNorm(s * r.x - b) < 1e-8 * matrix::infNorm(b) * n;
+  }
+  std::cout << "Arena matrices multiply vectors, map and solve by CG like "
+               "default ones: "
+            << (test::expect(same) ? "yes" : "no") << std::endl;
+
+  return test::exit_status();
+}
@@ -0,0 +1,107 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+/**
+ *  Banded and tridiagonal solves, checked against the dense solver, and a
+ *  batch of tridiagonal systems checked against solving each alone.
+ */
+
+int main() {
+  // The D block of diff_eq/poisson_eqn/poisson_setup.py, for M = 8.
+  unsigned m = 6;
+  matrix::TridiagonalMatrix<double> D{std::vector<double>(m - 1, 1),
+                                      std::vector<double>(m, -4),
+                                      std::vector<double>(m - 1, 1)};
+  std::cout << "D = " << std::endl
+            << std::string(D.to_dense()) << std::endl
+            << std::endl;
+
+  matrix::Vector<double> b{1, 2, 3, 3, 2, 1};
+  matrix::Vector<double> x = matrix::solve_tridiagonal(D, b);
+  std::cout << "Solution of Dx = b by the Thomas algorithm:" << std::endl
+            << std::string(x) << std::endl;
+  matrix::Matrix<double> x_dense =
+      matrix::solve_partial_pivot(D.to_dense(), matrix::Matrix<double>{b});
+  std::cout << "Difference from dense LU: " << test::close(x, x_dense)
+            << std::endl
+            << std::endl;
+
+  // A banded matrix with a zero diagonal entry needs the row swaps.
+  // clang-format off
+  matrix::Matrix<double> dense{
+    {0, 2, 1, 0, 0},
+    {1, 1, 3, 1, 0},
+    {2, 1, 1, 2, 1},
+    {0, 4, 1, 2, 1},
+    {0, 0, 1, 1, 3}
+  };
+  // clang-format on
+  matrix::BandedMatrix<double> B{dense, 2, 2};
+  std::cout << "B has " << B.lower_bandwidth() << " subdiagonals and "
+            << B.upper_bandwidth() << " superdiagonals." << std::endl;
+
+  matrix::Matrix<double> rhs{{1, 0}, {0, 1}, {1, 1}, {2, 0}, {0, 2}};
+  matrix::BandedLUFactorization<double> lu{B};
+  matrix::Matrix<double> y = lu.solve(rhs);
+  std::cout << "Solution of By = rhs:" << std::endl
+            << std::string(y) << std::endl;
+  std::cout << "Residual of B y - rhs: " << test::close(B * y, rhs)
+            << std::endl
+            << std::endl;
+
+  // One implicit diffusion step along the columns of a grid, as in ADI:
+  // each column is its own system, and all of them are solved together.
+  unsigned n = 5, cols = 4;
+  double r = 0.5;
+  matrix::TridiagonalMatrix<double> step{std::vector<double>(n - 1, -r),
+                                         std::vector<double>(n, 1 + 2 * r),
+                                         std::vector<double>(n - 1, -r)};
+  matrix::Matrix<double> u{n, cols};
+  for (unsigned j = 0; j < cols; j++)
+    u(n / 2, j) = j + 1;
+  matrix::Matrix<double> u0{u};
+  matrix::solve_tridiagonal_in_place(step, u.view());
+  std::cout << "Columns after one implicit diffusion step:" << std::endl
+            << std::string(u) << std::endl;
+  std::cout << "Difference from dense LU: "
+            << test::close(u, matrix::solve_partial_pivot(step.to_dense(), u0))
+            << std::endl
+            << std::endl;
+
+  // A batch of different systems, one per column, against solving each
+  // on its own.
+  std::size_t k = 9;
+  matrix::Matrix<double> lower{n, k}, diag{n, k}, upper{n, k}, z{n, k};
+  for (std::size_t i = 0; i < n; i++)
+    for (std::size_t s = 0; s < k; s++) {
+      lower(i, s) = static_cast<double>((i + s) % 3) - 1;
+      upper(i, s) = static_cast<double>((2 * i + s) % 5) / 4;
+      diag(i, s) = 3 + static_cast<double>(s % 4);
+      z(i, s) = static_cast<double>((i * 7 + s) % 11) - 5;
+    }
+  matrix::Matrix<double> z_batch = z;
+  matrix::solve_tridiagonal_batch(lower, diag, upper, z_batch.view());
+  double batch_diff = 0;
+  for (std::size_t s = 0; s < k; s++) {
+    std::vector<double> a(n - 1), d(n), c(n - 1);
+    for (std::size_t i = 0; i < n; i++) {
+      d[i] = diag(i, s);
+      if (i > 0)
+        a[i - 1] = lower(i, s);
+      if (i + 1 < n)
+        c[i] = upper(i, s);
+    }
+    matrix::TridiagonalMatrix<double> T{a, d, c};
+    matrix::Vector<double> zs =
+        matrix::solve_tridiagonal(T, matrix::Vector<double>{z.col(s)});
+    for (std::size_t i = 0; i < n; i++)
+      batch_diff = std::max(batch_diff, std::abs(zs[i] - z_batch(i, s)));
+  }
+  std::cout << "Batch of " << k << " systems, difference from solving "
+            << "each alone: " << test::below(batch_diff) << std::endl;
+  return test::exit_status();
+}
@@ -0,0 +1,92 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+/**
+ *  Fused elementwise expressions against the same arithmetic written out
+ *  entry by entry: norms of unevaluated differences, nested sums and scalar
+ *  multiples, in-place updates, expressions over views, and an expression
+ *  that reads the matrix it is assigned to. The matrices are large enough
+ *  for the fused loops to be split over the thread pool.
+ */
+
+using matrix::Matrix;
+using matrix::Vector;
+
+int main() {
+  matrix::set_num_threads(4);
+  std::size_t m = 400, n = 300;
+  Matrix<double> A{m, n}, B{m, n}, C{m, n};
+  for (std::size_t i = 0; i < m; i++)
+    for (std::size_t j = 0; j < n; j++) {
+      A(i, j) = std::sin(0.1 * i + 0.7 * j);
+      B(i, j) = std::cos(0.3 * i - 0.2 * j);
+      C(i, j) = static_cast<double>((i * 7 + j) % 13) - 6;
+    }
+
+  // infNorm(A - B), with no temporary for A - B.
+  double norm = 0;
+  for (std::size_t i = 0; i < m; i++) {
+    double row = 0;
+    for (std::size_t j = 0; j < n; j++)
+      row += std::abs(A(i, j) - B(i, j));
+    norm = std::max(norm, row);
+  }
+  std::cout << "infNorm(A - B): "
+            << test::below(std::abs(matrix::infNorm(A - B) - norm) / norm)
+            << std::endl;
+
+  // Nested nodes, evaluated in one loop.
+  Matrix<double> D = 2.0 * (A + B) - C, expected{m, n};
+  for (std::size_t i = 0; i < m; i++)
+    for (std::size_t j = 0; j < n; j++)
+      expected(i, j) = 2 * (A(i, j) + B(i, j)) - C(i, j);
+  std::cout << "2 * (A + B) - C: " << test::close(D, expected) << std::endl;
+
+  // In place, with the scalar on either side.
+  Matrix<double> E{A};
+  E += B * 2.0;
+  E -= 0.5 * C;
+  E *= 3.0;
+  for (std::size_t i = 0; i < m; i++)
+    for (std::size_t j = 0; j < n; j++)
+      expected(i, j) = 3 * (A(i, j) + B(i, j) * 2 - 0.5 * C(i, j));
+  std::cout << "A += B * 2, -= 0.5 C, *= 3: " << test::close(E, expected)
+            << std::endl;
+
+  // The destination may appear in the expression at the entry it assigns.
+  Matrix<double> F{A};
+  F = 2.0 * F + B - F;
+  std::cout << "F = 2 F + B - F: " << test::close(F, A + B) << std::endl;
+
+  // Views: a transposed block minus a plain one, added to a block of G.
+  Matrix<double> G{C};
+  G.block(10, 20, 50, 60) +=
+      A.block(5, 7, 60, 50).transpose() - B.block(0, 0, 50, 60);
+  for (std::size_t i = 0; i < m; i++)
+    for (std::size_t j = 0; j < n; j++) {
+      bool inside = i >= 10 && i < 60 && j >= 20 && j < 80;
+      expected(i, j) =
+          C(i, j) + (inside ? A(5 + j - 20, 7 + i - 10) - B(i - 10, j - 20)
+                            : 0);
+    }
+  std::cout << "Block += transposed block - block: "
+            << test::close(G, expected) << std::endl;
+
+  // Vectors.
+  Vector<double> x(m * n), y(m * n), z(m * n);
+  double vnorm = 0;
+  for (std::size_t i = 0; i < x.rows; i++) {
+    x[i] = std::sin(0.01 * i);
+    y[i] = std::cos(0.02 * i);
+    vnorm = std::max(vnorm, std::abs(3 * x[i] - y[i]));
+  }
+  z = 3.0 * x - y;
+  std::cout << "infNorm(3 x - y), stored and unevaluated: "
+            << test::below(std::abs(matrix::infNorm(z) - vnorm)) << ", "
+            << test::below(std::abs(matrix::infNorm(3.0 * x - y) - vnorm))
+            << std::endl;
+  return test::exit_status();
+}
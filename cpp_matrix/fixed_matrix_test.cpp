@@ -0,0 +1,54 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <iostream>
+
+/**
+ *  Fixed-size matrices: stack storage, shapes checked at compile time.
+ */
+
+using matrix::FixedMatrix;
+using matrix::FixedVector;
+
+int main() {
+  // clang-format off
+  FixedMatrix<double, 3, 3> A{
+    {0.1, 5, 4  },
+    {1,   3, 2.3},
+    {23,  0.1, 2}
+  };
+  // clang-format on
+  FixedVector<double, 3> b{1, 2, 3};
+
+  std::cout << "Matrix A = " << std::endl
+            << std::string(A) << std::endl
+            << std::endl;
+  std::cout << "Vector b = " << std::endl
+            << std::string(b) << std::endl
+            << std::endl;
+
+  FixedVector<double, 3> x = matrix::solve_partial_pivot(A, b);
+  std::cout << "Solution x of Ax = b: " << std::endl
+            << std::string(x) << std::endl
+            << std::endl;
+  std::cout << "Residual inf norm: " << test::below(matrix::infNorm(A * x - b))
+            << std::endl
+            << std::endl;
+
+  FixedMatrix<double, 2, 3> B{{1, 2, 3}, {4, 5, 6}};
+  FixedMatrix<double, 2, 2> BBt = B * B.transpose();
+  std::cout << "B * B^T = " << std::endl
+            << std::string(BBt) << std::endl
+            << "Difference from expected: "
+            << test::close(BBt, FixedMatrix<double, 2, 2>{{14, 32}, {32, 77}})
+            << std::endl
+            << std::endl;
+
+  // Fixed and dynamic matrices mix; the dynamic side is checked at runtime.
+  matrix::Matrix<double> D = matrix::ident<double>(3);
+  matrix::Matrix<double> AD = A * D + 2.0 * A;
+  std::cout << "A * I + 2A = " << std::endl
+            << std::string(AD) << std::endl
+            << "Difference from 3A: " << test::close(AD, 3.0 * A)
+            << std::endl;
+  return test::exit_status();
+}
@@ -1,6 +1,14 @@
 #include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
 #include <iostream>
 
+/**
+ *  Elementwise map, zip and reduce, on a small integer matrix and on one
+ *  large enough to be split over the thread pool, written into a matrix,
+ *  a block and a transposed view. Each is checked against the same
+ *  function applied entry by entry.
+ */
+
 int f(const int &x) { return 2 * (x * x) - 1; }
 
 int main() {
@@ -24,6 +32,82 @@ int main() {
   std::cout << "F(m) = " << std::endl
             << std::string(F_of_m) << std::endl
             << std::endl;
+  bool mapped = true;
+  for (unsigned i = 0; i < m.rows; i++)
+    for (unsigned j = 0; j < m.cols; j++)
+      mapped = mapped && F_of_m(i, j) == f(m(i, j));
+  test::expect(mapped);
   std::cout << "inf norm of F(m) is: " << matrix::infNorm(F_of_m) << std::endl
             << std::endl;
+
+  // Any callable works; a lambda is inlined into the evaluation loop.
+  matrix::Matrix<int> clamped{m};
+  matrix::map_in_place([](int x) { return std::min(std::max(x, 0), 5); },
+                       clamped);
+  std::cout << "m clamped to [0, 5] = " << std::endl
+            << std::string(clamped) << std::endl
+            << std::endl;
+  test::expect(clamped(1, 0) == 5 && clamped(2, 1) == 0 && clamped(0, 1) == 2);
+
+  matrix::Matrix<int> prod =
+      matrix::zip([](int a, int b) { return a * b; }, m, clamped);
+  std::cout << "m times clamped m, entrywise = " << std::endl
+            << std::string(prod) << std::endl
+            << std::endl;
+  test::expect(prod(1, 0) == 125 && prod(2, 1) == 0 && prod(2, 0) == 35);
+
+  int max_entry = matrix::reduce(
+      m, m(0, 0), [](int a, int b) { return std::max(a, b); });
+  std::cout << "Largest entry of m is: " << max_entry << std::endl
+            << std::endl;
+  test::expect(max_entry == 25);
+
+  // Past parallel_grain_ entries, the maps are split over four threads.
+  matrix::set_num_threads(4);
+  const std::size_t n = 500;
+  matrix::Matrix<double> a{n, n}, expected{n, n};
+  for (std::size_t i = 0; i < n; i++)
+    for (std::size_t j = 0; j < n; j++) {
+      a(i, j) = static_cast<double>((i * 7 + j * 3) % 13) - 6;
+      expected(i, j) = 0.5 * a(i, j) * a(i, j) + 1;
+    }
+  auto g = [](double x) { return 0.5 * x * x + 1; };
+
+  matrix::Matrix<double> into{n, n};
+  matrix::map_into(g, a, into);
+  std::cout << "n = " << n << ", map_into a matrix: "
+            << test::close(into, expected)
+            << std::endl;
+
+  // Into a transposed view, and into a block, whose rows are strided.
+  matrix::Matrix<double> into_t{n, n}, wide{n, n + 7};
+  matrix::map_into(g, a, into_t.transpose());
+  std::cout << "map_into a transposed view: "
+            << test::close(into_t.transpose(), expected)
+            << std::endl;
+  matrix::map_into(g, a, wide.block(0, 3, n, n));
+  std::cout << "map_into a block: "
+            << test::close(wide.block(0, 3, n, n), expected)
+            << std::endl;
+
+  matrix::Matrix<double> in_place{a};
+  matrix::map_in_place(g, in_place.transpose());
+  std::cout << "map_in_place through a transposed view: "
+            << test::close(in_place, expected)
+            << std::endl;
+
+  matrix::Matrix<double> sum = matrix::zip(
+      [](double x, double y) { return x + 2 * y; }, a, expected);
+  std::cout << "zip: " << test::close(sum, a + 2.0 * expected) << std::endl;
+
+  double largest = 0;
+  for (std::size_t i = 0; i < n; i++)
+    for (std::size_t j = 0; j < n; j++)
+      largest = std::max(largest, expected(i, j));
+  double reduced = matrix::reduce(
+      expected, 0.0, [](double x, double y) { return std::max(x, y); });
+  std::cout << "reduce to the largest entry: "
+            << (test::expect(reduced == largest) ? "yes" : "no")
+            << std::endl;
+  return test::exit_status();
 }
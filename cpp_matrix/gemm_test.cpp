@@ -0,0 +1,97 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <cmath>
+#include <iostream>
+
+/**
+ *  The packed GEMM kernel against a naive triple loop, in double and float.
+ *  The shapes run from below gemm_small_size_ to past gemm_parallel_size_,
+ *  KC in depth and NC in width. None of m, n and k is a multiple of MR, NR
+ *  or KC, so every edge case of the packing and the micro-kernel is hit.
+ *  The operands are matrices, transposes and blocks of larger matrices,
+ *  and the product goes both into a new matrix and, through gemm(), into a
+ *  block of an existing one.
+ */
+
+using matrix::Matrix;
+
+template <typename T>
+Matrix<T> filled(std::size_t rows, std::size_t cols, double seed) {
+  Matrix<T> A{rows, cols};
+  for (std::size_t i = 0; i < rows; i++)
+    for (std::size_t j = 0; j < cols; j++)
+      A(i, j) = static_cast<T>(std::sin(0.7 * i + 1.3 * j + seed));
+  return A;
+}
+
+// alpha A B + beta C, summed in double, through any views.
+template <typename T, typename L, typename R, typename C>
+Matrix<T> naive(T alpha, const L &A, const R &B, T beta, const C &Cin) {
+  Matrix<T> result{A.rows, B.cols};
+  for (std::size_t i = 0; i < A.rows; i++)
+    for (std::size_t j = 0; j < B.cols; j++) {
+      double sum = 0;
+      for (std::size_t p = 0; p < A.cols; p++)
+        sum += static_cast<double>(A(i, p)) * B(p, j);
+      result(i, j) = static_cast<T>(alpha * sum + beta * Cin(i, j));
+    }
+  return result;
+}
+
+template <typename T> void run(const char *type, double tol) {
+  struct Shape {
+    std::size_t m, n, k;
+  };
+  // Below the small-product cutoff, just past it, past the parallel
+  // threshold, deeper than KC, and wider than NC.
+  const Shape shapes[] = {{5, 7, 3},
+                           {50, 47, 49},
+                           {131, 127, 135},
+                           {301, 257, 517},
+                           {13, 4101, 61}};
+
+  std::cout << type << " on " << matrix::num_threads()
+            << (matrix::num_threads() == 1 ? " thread:" : " threads:")
+            << std::endl;
+  for (const Shape &s : shapes) {
+    Matrix<T> A = filled<T>(s.m, s.k, 0.1), B = filled<T>(s.k, s.n, 0.2);
+    Matrix<T> zero{s.m, s.n};
+    std::cout << "  " << s.m << " x " << s.n << " x " << s.k << ", A * B: "
+              << test::close(A * B, naive(T{1}, A, B, T{}, zero), tol);
+
+    // A^T * B, reading A^T in place from a k x m matrix.
+    Matrix<T> At = filled<T>(s.k, s.m, 0.3);
+    std::cout << ", A^T * B: "
+              << test::close(At.transpose() * B,
+                             naive(T{1}, At.transpose(), B, T{}, zero), tol);
+
+    // Blocks of larger matrices, with row strides unlike their widths.
+    Matrix<T> big_A = filled<T>(s.m + 3, s.k + 5, 0.4),
+              big_B = filled<T>(s.k + 2, s.n + 7, 0.5);
+    auto a = big_A.block(2, 3, s.m, s.k);
+    auto b = big_B.block(1, 4, s.k, s.n);
+    std::cout << ", blocks: "
+              << test::close(a * b, naive(T{1}, a, b, T{}, zero), tol);
+
+    // C = 0.5 B^T A^T - 2 C into a block of C, whose border stays put.
+    Matrix<T> C = filled<T>(s.n + 2, s.m + 3, 0.6), C0{C};
+    auto c = C.block(1, 2, s.n, s.m);
+    Matrix<T> expected = naive(T{0.5}, B.transpose(), A.transpose(), T{-2},
+                               C0.block(1, 2, s.n, s.m));
+    matrix::gemm(T{0.5}, B.transpose(), A.transpose(), T{-2}, c);
+    std::cout << ", into a block: " << test::close(c, expected, tol);
+    C.block(1, 2, s.n, s.m) = C0.block(1, 2, s.n, s.m);
+    test::expect(matrix::infNorm(C - C0) == 0);
+    std::cout << std::endl;
+  }
+}
+
+int main() {
+  for (unsigned threads : {1, 4}) {
+    matrix::set_num_threads(threads);
+    run<double>("double", 1e-12);
+    run<float>("float", 1e-4);
+    std::cout << std::endl;
+  }
+  return test::exit_status();
+}
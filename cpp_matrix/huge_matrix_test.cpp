@@ -0,0 +1,96 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <cstdint>
+#include <iostream>
+#include <new>
+#include <set>
+#include <thread>
+#include <vector>
+
+/**
+ *  Indexes a matrix with more than 2^32 entries, which 32-bit offsets
+ *  would wrap around. The matrix is left uninitialized, so only the pages
+ *  written here are ever backed by memory; where even its address space
+ *  can't be had, that part is skipped. Then places a matrix with
+ *  FirstTouchAllocator, and checks that large copies and zero fills, which
+ *  run in parallel, give the same entries as small ones, and that parallel
+ *  loops over the same storage put each chunk on the same thread.
+ */
+
+int main() {
+  typedef unsigned char byte;
+  const std::size_t n = 65537; // n * n > 2^32.
+  try {
+    matrix::Matrix<byte> m{n, n, matrix::uninitialized};
+    m(0, 0) = 1;
+    m(n - 1, n - 1) = 2;
+    m(n - 1, 0) = 3;
+    matrix::MatrixView<byte> last = m.row(n - 1);
+    std::cout << "Entries: " << n * n << " (2^32 = " << (std::size_t{1} << 32)
+              << ")" << std::endl;
+    std::cout << "m(0, 0) = " << int{m(0, 0)}
+              << ", m(n - 1, n - 1) = " << int{m(n - 1, n - 1)}
+              << ", row(n - 1)[0] = " << int{last(0, 0)} << std::endl;
+
+    // Wrapped 32-bit offsets would still give three distinct entries, so
+    // check the offsets themselves.
+    std::size_t last_offset = &m(n - 1, n - 1) - m.ptr();
+    std::size_t row_offset = &last(0, 0) - m.ptr();
+    test::expect(last_offset == n * n - 1 && row_offset == (n - 1) * n &&
+                 m(0, 0) == 1 && m(n - 1, n - 1) == 2 && last(0, 0) == 3);
+    std::cout << "Offset of m(n - 1, n - 1): " << last_offset
+              << " (n * n - 1 = " << n * n - 1 << ")" << std::endl;
+  } catch (const std::bad_alloc &) {
+    std::cout << "Skipped the 65537 x 65537 matrix: not enough memory."
+              << std::endl;
+  }
+
+  // 32 MiB each: well past the size from which storage is touched in
+  // parallel.
+  const std::size_t rows = 2048, cols = 2048;
+  matrix::Matrix<double, matrix::FirstTouchAllocator<double>> a{
+      rows, cols, matrix::uninitialized};
+  bool aligned = reinterpret_cast<std::uintptr_t>(a.ptr()) % 4096 == 0;
+  std::cout << "FirstTouchAllocator storage page aligned: "
+            << (test::expect(aligned) ? "yes" : "no") << std::endl;
+  for (std::size_t i = 0; i < rows; i++)
+    for (std::size_t j = 0; j < cols; j++)
+      a(i, j) = static_cast<double>((i * 31 + j * 17) % 101);
+
+  matrix::Matrix<double> b{a}, zero{rows, cols};
+  bool same = true, zeroed = true;
+  for (std::size_t i = 0; i < rows; i++)
+    for (std::size_t j = 0; j < cols; j++) {
+      same = same && b(i, j) == a(i, j);
+      zeroed = zeroed && zero(i, j) == 0;
+    }
+  b = zero;
+  std::cout << "Parallel copy matches: " << (test::expect(same) ? "yes" : "no")
+            << std::endl;
+  std::cout << "Parallel zero fill: " << (test::expect(zeroed) ? "yes" : "no")
+            << std::endl;
+  std::cout << "Max norm after assigning zeros: " << matrix::infNorm(b)
+            << std::endl;
+  test::expect(matrix::infNorm(b) == 0);
+
+  // First touch and later kernels split storage alike, so each quarter
+  // must be read, by a parallel loop over the entries, on the thread that
+  // touched it, and all threads must take part.
+  matrix::set_num_threads(4);
+  const std::size_t entries = rows * cols, bytes = entries * sizeof(double);
+  std::vector<std::thread::id> touched(4), read(4);
+  matrix::internal::first_touch_(bytes, [&](std::size_t lo, std::size_t) {
+    touched[lo * 4 / bytes] = std::this_thread::get_id();
+  });
+  matrix::parallel_for(0, entries, matrix::internal::parallel_grain_,
+                       [&](std::size_t lo, std::size_t) {
+                         read[lo * 4 / entries] = std::this_thread::get_id();
+                       });
+  std::set<std::thread::id> distinct(touched.begin(), touched.end());
+  bool placed = touched == read && distinct.size() == 4;
+  std::cout << "Chunks on the same thread each time, over " << distinct.size()
+            << " threads: " << (test::expect(placed) ? "yes" : "no")
+            << std::endl;
+
+  return test::exit_status();
+}
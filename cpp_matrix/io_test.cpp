@@ -0,0 +1,97 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
+/**
+ *  Writes matrices in the binary format of io.hpp, with save() and with a
+ *  streaming MatrixWriter, and reads them back with load() and through
+ *  memory mappings. Solves a system whose matrix is only mapped, fills a
+ *  mapped file in place, and shows the errors for files of the wrong type.
+ */
+
+int main() {
+  const std::size_t n = 300;
+  matrix::Matrix<double> a{n, n};
+  for (std::size_t i = 0; i < n; i++) {
+    for (std::size_t j = 0; j < n; j++)
+      a(i, j) = static_cast<double>((i * 7 + j * 13) % 17) / 17;
+    a(i, i) += n;
+  }
+
+  // Round trip through save() and load(), of a matrix and of a transpose.
+  matrix::save("io_test_a.mtx", a);
+  matrix::Matrix<double> b = matrix::load<double>("io_test_a.mtx");
+  std::cout << "load(save(a)) == a: "
+            << (test::expect(infNorm(a - b) == 0) ? "yes" : "no") << std::endl;
+  matrix::save("io_test_at.mtx", a.transpose());
+  b = matrix::load<double>("io_test_at.mtx");
+  std::cout << "load(save(a^T)) == a^T: "
+            << (test::expect(infNorm(a.transpose() - b) == 0) ? "yes" : "no")
+            << std::endl;
+
+  // Stream the same matrix out 64 rows at a time.
+  {
+    matrix::MatrixWriter<double> writer{"io_test_s.mtx", n, n};
+    for (std::size_t i = 0; i < n; i += 64)
+      writer.write(a.block(i, 0, std::min<std::size_t>(64, n - i), n));
+    writer.close();
+  }
+
+  // Solve with a matrix read straight from the mapping.
+  matrix::MappedMatrix<double> mapped =
+      matrix::MappedMatrix<double>::open("io_test_s.mtx");
+  bool aligned = reinterpret_cast<std::uintptr_t>(mapped.ptr()) % 4096 == 0;
+  std::cout << "Mapped " << mapped.rows() << " x " << mapped.cols()
+            << ", page aligned: " << (test::expect(aligned) ? "yes" : "no")
+            << std::endl;
+  matrix::Vector<double> x(n);
+  for (std::size_t i = 0; i < n; i++)
+    x[i] = static_cast<double>(i % 5);
+  matrix::Vector<double> rhs = mapped.view() * x;
+  matrix::LUFactorization<double> lu{mapped.view()};
+  std::cout << "Error of a solve with the mapped matrix: "
+            << test::below(infNorm(lu.solve(rhs) - x)) << std::endl;
+
+  // Fill a new file through a writable mapping.
+  {
+    matrix::MappedMatrix<double> out =
+        matrix::MappedMatrix<double>::create("io_test_c.mtx", n, n);
+    matrix::MatrixView<double> c = out.mutable_view();
+    c = 2.0 * mapped.view();
+    c.block(0, 0, 1, n) += a.block(0, 0, 1, n);
+    out.flush();
+  }
+  b = matrix::load<double>("io_test_c.mtx");
+  bool written = b(0, 0) == 3 * a(0, 0) && b(n - 1, 0) == 2 * a(n - 1, 0);
+  std::cout << "Mapped writes reach the file: "
+            << (test::expect(written) ? "yes" : "no") << std::endl;
+
+  try {
+    matrix::MappedMatrix<float>::open("io_test_a.mtx");
+    test::expect(false);
+  } catch (const std::runtime_error &e) {
+    std::cout << "Error: " << e.what() << std::endl;
+  }
+  try {
+    mapped.mutable_view();
+    test::expect(false);
+  } catch (const std::runtime_error &e) {
+    std::cout << "Error: " << e.what() << std::endl;
+  }
+  try {
+    matrix::MatrixWriter<double> writer{"io_test_p.mtx", n, n};
+    writer.write(a.block(0, 0, 10, n));
+    writer.close();
+    test::expect(false);
+  } catch (const std::runtime_error &e) {
+    std::cout << "Error: " << e.what() << std::endl;
+  }
+
+  for (const char *f : {"io_test_a.mtx", "io_test_at.mtx", "io_test_s.mtx",
+                        "io_test_c.mtx", "io_test_p.mtx"})
+    std::remove(f);
+  return test::exit_status();
+}
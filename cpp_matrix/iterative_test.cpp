@@ -0,0 +1,89 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <iostream>
+
+/**
+ *  Krylov solvers on the 5-point Laplacian (negated, so it's positive
+ *  definite), with and without preconditioners.
+ */
+
+using matrix::SparseMatrix;
+using matrix::Vector;
+
+// -Laplacian on an m x m grid of interior points, plus an optional
+// first-order term that makes it nonsymmetric.
+SparseMatrix<double> operator_2d(unsigned m, double convection) {
+  matrix::SparseBuilder<double> builder{m * m, m * m};
+  for (unsigned i = 0; i < m; i++)
+    for (unsigned j = 0; j < m; j++) {
+      unsigned r = i * m + j;
+      builder.add(r, r, 4);
+      if (j > 0)
+        builder.add(r, r - 1, -1 - convection);
+      if (j + 1 < m)
+        builder.add(r, r + 1, -1 + convection);
+      if (i > 0)
+        builder.add(r, r - m, -1);
+      if (i + 1 < m)
+        builder.add(r, r + m, -1);
+    }
+  return builder.build();
+}
+
+template <typename T>
+void report(const std::string &name, const matrix::IterativeResult<T> &r) {
+  test::expect(r.converged);
+  std::cout << name << ": " << (r.converged ? "converged" : "stopped")
+            << " after " << r.iterations << " iterations, relative residual "
+            << test::below(r.residual, 1e-8) << std::endl;
+}
+
+int main() {
+  unsigned m = 50;
+  SparseMatrix<double> A = operator_2d(m, 0);
+  Vector<double> b(m * m);
+  for (unsigned i = 0; i < b.rows; i++)
+    b[i] = 1;
+
+  std::cout << "Symmetric positive definite, " << A.rows << " unknowns:"
+            << std::endl;
+  report("CG", matrix::cg(A, b));
+  report("CG + Jacobi", matrix::cg(A, b, matrix::JacobiPreconditioner{A}));
+  report("CG + IC(0)", matrix::cg(A, b, matrix::IC0Preconditioner{A}));
+  report("BiCGSTAB + ILU(0)",
+         matrix::bicgstab(A, b, matrix::ILU0Preconditioner{A}));
+  std::cout << std::endl;
+
+  SparseMatrix<double> C = operator_2d(m, 0.5);
+  std::cout << "Nonsymmetric, " << C.rows << " unknowns:" << std::endl;
+  report("BiCGSTAB", matrix::bicgstab(C, b));
+  report("BiCGSTAB + ILU(0)",
+         matrix::bicgstab(C, b, matrix::ILU0Preconditioner{C}));
+  report("GMRES(30)", matrix::gmres(C, b));
+  report("GMRES(30) + ILU(0)",
+         matrix::gmres(C, b, matrix::ILU0Preconditioner{C}));
+
+  // Matrix-free: any callable that overwrites y with C x.
+  auto apply_C = [&](const Vector<double> &x, Vector<double> &y) {
+    matrix::multiply_into(y, C, x);
+  };
+  report("GMRES(30), matrix-free", matrix::gmres(apply_C, b));
+  std::cout << std::endl;
+
+  // A small dense system, checked against the direct solver.
+  // clang-format off
+  matrix::Matrix<double> D{
+    {4,  1,  0.5},
+    {1,  3,  0.2},
+    {0.5, 0.2, 2}
+  };
+  // clang-format on
+  Vector<double> d{1, 2, 3};
+  matrix::IterativeResult<double> r = matrix::cg(D, d);
+  std::cout << "Dense 3 x 3 system, CG solution x = " << std::endl
+            << std::string(r.x) << std::endl
+            << "Difference from solve_partial_pivot: "
+            << test::close(r.x, matrix::solve_partial_pivot(D, d), 1e-8)
+            << std::endl;
+  return test::exit_status();
+}
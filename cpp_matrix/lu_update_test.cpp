@@ -0,0 +1,93 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <iostream>
+
+/**
+ *  An updatable LU: rows, columns and a rank-2 correction change between
+ *  solves, and each solve is checked against a fresh factorization of the
+ *  changed matrix. With max_rank = 3, the rank-2 correction takes the total
+ *  rank of the changes past it, so the matrix is refactored. On a larger
+ *  matrix, rank-4 corrections accumulate in the Woodbury terms without a
+ *  refactor, and a replaced row that makes the matrix nearly singular
+ *  raises the probe error enough to force one.
+ */
+
+// Also checks the rank of the changes and the number of refactors against
+// the expected ones.
+void report(const matrix::UpdatableLU<double> &lu,
+            const matrix::Matrix<double> &b, unsigned rank,
+            unsigned refactors) {
+  test::expect(lu.rank() == rank && lu.refactors() == refactors);
+  std::cout << "  rank of the changes: " << lu.rank()
+            << ", refactors: " << lu.refactors()
+            << ", difference from a fresh LU: "
+            << test::close(lu.solve(b),
+                           matrix::solve_partial_pivot(lu.matrix(), b))
+            << std::endl;
+}
+
+int main() {
+  // clang-format off
+  matrix::Matrix<double> A{
+    {4, 1, 0, 0, 1},
+    {1, 4, 1, 0, 0},
+    {0, 1, 4, 1, 0},
+    {0, 0, 1, 4, 1},
+    {1, 0, 0, 1, 4}
+  };
+  // clang-format on
+  matrix::Matrix<double> b{{1}, {2}, {3}, {4}, {5}};
+
+  matrix::LUUpdateOptions opts;
+  opts.max_rank = 3;
+  matrix::UpdatableLU<double> lu{A, opts};
+  std::cout << "Initial factorization:" << std::endl;
+  report(lu, b, 0, 0);
+
+  std::cout << "Row 2 replaced:" << std::endl;
+  lu.replace_row(2, matrix::Matrix<double>{{2, 0, 5, 0, 1}});
+  report(lu, b, 1, 0);
+
+  std::cout << "Column 0 replaced:" << std::endl;
+  lu.replace_col(0, matrix::Vector<double>{6, 1, 0, 2, 1});
+  report(lu, b, 2, 0);
+
+  std::cout << "Rank-2 correction u v^T:" << std::endl;
+  matrix::Matrix<double> u{{1, 0}, {0, 1}, {1, 0}, {0, 1}, {1, 0}};
+  matrix::Matrix<double> v{{0.5, 0}, {0, 0}, {0, 0.5}, {0, 0}, {0.5, 0.5}};
+  lu.update(u, v);
+  report(lu, b, 0, 1);
+
+  std::cout << "The current matrix:" << std::endl
+            << std::string(lu.matrix()) << std::endl;
+
+  const std::size_t n = 200;
+  matrix::Matrix<double> A2{n, n}, b2{n, 2}, u4{n, 4}, v4{n, 4};
+  for (std::size_t i = 0; i < n; i++) {
+    for (std::size_t j = 0; j < n; j++)
+      A2(i, j) = static_cast<double>((i * 7 + j * 3) % 11) / 11;
+    A2(i, i) += n / 4;
+    b2(i, 0) = 1;
+    b2(i, 1) = static_cast<double>(i % 5);
+    for (std::size_t j = 0; j < 4; j++) {
+      u4(i, j) = static_cast<double>((i + 3 * j) % 7) / 7;
+      v4(i, j) = static_cast<double>((2 * i + j) % 5) / 50;
+    }
+  }
+  matrix::UpdatableLU<double> big{A2};
+  std::cout << "n = " << n << ", one rank-4 correction:" << std::endl;
+  big.update(u4, v4);
+  report(big, b2, 4, 0);
+  std::cout << "n = " << n << ", another:" << std::endl;
+  big.update(v4, u4);
+  report(big, b2, 8, 0);
+
+  // Row 0 becomes row 1 but for 1e-6 in its first entry.
+  std::cout << "n = " << n << ", row 0 replaced by nearly row 1:" << std::endl;
+  matrix::Matrix<double> r{1, n};
+  for (std::size_t j = 0; j < n; j++)
+    r(0, j) = big.matrix()(1, j) + (j == 0 ? 1e-6 : 0);
+  big.replace_row(0, r);
+  report(big, b2, 0, 1);
+  return test::exit_status();
+}
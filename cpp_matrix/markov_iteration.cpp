@@ -6,8 +6,9 @@ int main() {
   std::string header{"Markov chain steady-state iteration:"};
   std::cout << header << std::endl << std::endl;
 
+  // Small enough to live on the stack; see fixed_matrix.hpp.
   // clang-format off
-  matrix::Matrix<double> m{
+  matrix::FixedMatrix<double, 3, 3> m{
     {0.4, 0.5, 0.1},
     {0.3, 0.3, 0.4},
     {0.1, 0.2, 0.7}
@@ -22,16 +23,15 @@ int main() {
             << std::endl;
 
   double tolerance = 1.0E-12;
-  matrix::Matrix<double> curr{m};
-  matrix::Matrix<double> prev{m};
+  matrix::FixedMatrix<double, 3, 3> curr{m};
+  matrix::FixedMatrix<double, 3, 3> prev{m};
   unsigned num_iter = 0;
 
   for (unsigned c = 0;; c++) {
-    prev = std::move(curr);
+    prev = curr;
     curr = prev * m;
 
-    matrix::Matrix<double> delta = curr + (-1.0 * prev);
-    double norm_delta = matrix::infNorm(delta);
+    double norm_delta = matrix::infNorm(curr - prev);
     if (norm_delta < tolerance) {
       num_iter = c + 1;
       break;
@@ -45,5 +45,27 @@ int main() {
             << std::endl
             << std::endl;
   std::cout << "Approximate 1 * π for steady state π: " << std::endl
-            << std::string(curr) << std::endl;
+            << std::string(curr) << std::endl
+            << std::endl;
+
+  // The stationary-distribution solvers of markov.hpp work on pi alone,
+  // with a sparse P, so they scale to chains with millions of states.
+  matrix::Matrix<double> p{m};
+  matrix::MarkovChain<double> chain{p};
+  matrix::IterativeOptions opts;
+  opts.tol = tolerance;
+
+  std::pair<const char *, matrix::IterativeResult<double>> results[] = {
+      {"Power iteration", chain.power(opts)},
+      {"Gauss-Seidel", chain.gauss_seidel(opts)},
+      {"GMRES", chain.gmres(opts)},
+      {"Repeated squaring", matrix::stationary_squaring(p, opts)}};
+  for (const auto &r : results)
+    std::cout << r.first << ": " << r.second.iterations << " iterations, "
+              << "||πP - π|| "
+              << (r.second.residual < tolerance ? "< 1e-12" : "too large")
+              << std::endl
+              << "π = " << std::string(matrix::Matrix<double>{
+                               r.second.x.transpose()})
+              << std::endl;
 }
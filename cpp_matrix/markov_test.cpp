@@ -0,0 +1,145 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <iostream>
+#include <vector>
+
+/**
+ *  Stationary distributions from every solver of markov.hpp, checked
+ *  against pi found independently: by a dense solve for a small chain, and
+ *  in closed form for random walks on a weighted graph, where pi_i is
+ *  proportional to the total weight at state i. The walk on a bipartite
+ *  graph is periodic, which only GMRES copes with.
+ */
+
+using matrix::Vector;
+
+// Require convergence and a pi within 1e-8 of `expected` in the 1-norm.
+void check(const std::string &name, const matrix::IterativeResult<double> &r,
+           const Vector<double> &expected) {
+  double error = 0;
+  for (unsigned i = 0; i < expected.rows; i++)
+    error += std::abs(r.x[i] - expected[i]);
+  test::expect(r.converged && r.residual < 1e-8);
+  std::cout << name << ": " << (r.converged ? "converged" : "stopped")
+            << " after " << r.iterations << " iterations, error in π "
+            << test::below(error, 1e-8) << std::endl;
+}
+
+// Random walk on a bipartite graph of n states: each of the last 3n/4 has
+// three edges to the first n/4, of weight 1 + (i + j) % 5, and each state
+// has a self-loop of weight `self`. Without self-loops the walk has
+// period 2, and started from the uniform distribution, a quarter of the
+// mass moves back and forth against the half that pi puts on either side.
+// pi, of size n, gets the stationary distribution.
+matrix::SparseMatrix<double> graph_walk(unsigned n, double self,
+                                        Vector<double> &pi) {
+  unsigned hubs = n / 4;
+  auto hub = [hubs](unsigned j, unsigned e) {
+    return e == 0 ? j % hubs : e == 1 ? (j + 1) % hubs : (7 * j + 3) % hubs;
+  };
+  std::vector<double> weight(n, self);
+  for (unsigned j = hubs; j < n; j++)
+    for (unsigned e = 0; e < 3; e++) {
+      unsigned i = hub(j, e);
+      weight[i] += 1 + (i + j) % 5;
+      weight[j] += 1 + (i + j) % 5;
+    }
+
+  matrix::SparseBuilder<double> builder{n, n};
+  if (self > 0)
+    for (unsigned i = 0; i < n; i++)
+      builder.add(i, i, self / weight[i]);
+  for (unsigned j = hubs; j < n; j++)
+    for (unsigned e = 0; e < 3; e++) {
+      unsigned i = hub(j, e);
+      double w = 1 + (i + j) % 5;
+      builder.add(i, j, w / weight[i]);
+      builder.add(j, i, w / weight[j]);
+    }
+
+  double total = 0;
+  for (unsigned i = 0; i < n; i++)
+    total += weight[i];
+  for (unsigned i = 0; i < n; i++)
+    pi[i] = weight[i] / total;
+  return builder.build();
+}
+
+int main() {
+  matrix::IterativeOptions opts;
+  opts.tol = 1e-12;
+
+  // The chain of markov_iteration.cpp. pi solves (I - P^T) pi^T = 0 with
+  // the last equation replaced by sum(pi) = 1.
+  // clang-format off
+  matrix::Matrix<double> P{
+    {0.4, 0.5, 0.1},
+    {0.3, 0.3, 0.4},
+    {0.1, 0.2, 0.7}
+  };
+  // clang-format on
+  matrix::Matrix<double> A{3, 3}, b{3, 1};
+  for (unsigned i = 0; i < 3; i++)
+    for (unsigned j = 0; j < 3; j++)
+      A(i, j) = i == 2 ? 1 : (i == j ? 1 : 0) - P(j, i);
+  b(2, 0) = 1;
+  matrix::Matrix<double> x = matrix::solve_partial_pivot(A, b);
+  Vector<double> pi(3);
+  for (unsigned i = 0; i < 3; i++)
+    pi[i] = x(i, 0);
+
+  matrix::MarkovChain<double> chain{P};
+  std::cout << "3 states:" << std::endl;
+  check("Power iteration", chain.power(opts), pi);
+  check("Gauss-Seidel", chain.gauss_seidel(opts), pi);
+  check("GMRES", chain.gmres(opts), pi);
+  check("Repeated squaring", matrix::stationary_squaring(P, opts), pi);
+  std::cout << std::endl;
+
+  // A lazy walk, so aperiodic.
+  unsigned n = 2000;
+  Vector<double> walk_pi(n);
+  opts.max_iter = 10000;
+  matrix::MarkovChain<double> walk{graph_walk(n, 2, walk_pi)};
+  std::cout << "Lazy walk on a graph, " << walk.states()
+            << " states:" << std::endl;
+  check("Power iteration", walk.power(opts), walk_pi);
+  check("Gauss-Seidel", walk.gauss_seidel(opts), walk_pi);
+  check("GMRES", walk.gmres(opts), walk_pi);
+  std::cout << std::endl;
+
+  // Without self-loops power iteration never settles, and must say so.
+  matrix::MarkovChain<double> periodic{graph_walk(n, 0, walk_pi)};
+  std::cout << "Periodic walk on a graph, " << periodic.states()
+            << " states:" << std::endl;
+  opts.max_iter = 1000;
+  matrix::IterativeResult<double> r = periodic.power(opts);
+  test::expect(!r.converged);
+  std::cout << "Power iteration: "
+            << (r.converged ? "converged, wrongly" : "did not converge")
+            << std::endl;
+  check("GMRES", periodic.gmres(opts), walk_pi);
+  std::cout << std::endl;
+
+  // Rows that are not probability distributions.
+  // clang-format off
+  matrix::Matrix<double> bad_sum{
+    {0.5, 0.4},
+    {0.5, 0.5}
+  };
+  matrix::Matrix<double> negative{
+    {1.5, -0.5},
+    {0.5, 0.5}
+  };
+  // clang-format on
+  for (const matrix::Matrix<double> *bad : {&bad_sum, &negative}) {
+    try {
+      matrix::MarkovChain<double>{*bad};
+      test::expect(false);
+      std::cout << "Invalid transition matrix accepted" << std::endl;
+    } catch (const std::domain_error &e) {
+      std::cout << "Invalid transition matrix: " << e.what() << std::endl;
+    }
+  }
+  return test::exit_status();
+}
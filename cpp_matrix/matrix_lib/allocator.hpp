@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+namespace matrix {
+
+/**
+ *  Storage policies for Matrix and Vector, the second template parameter
+ *  of both. Each is a stateless standard allocator, so it also works with
+ *  std::vector.
+ *
+ *    - AlignedAllocator<T> (the default) aligns every buffer to 64 bytes,
+ *      a cache line and a full AVX-512 register, so SIMD loads of a row's
+ *      start never split a line.
+ *    - ArenaAllocator<T> bump-allocates from a per-thread arena. Inside an
+ *      ArenaScope, allocating costs a few instructions, freeing costs
+ *      nothing, and everything allocated in the scope is released in bulk
+ *      when it closes. The arena's chunks stay reserved for the next scope,
+ *      so a thread that keeps solving stops calling the global allocator,
+ *      and concurrent solves on many threads don't contend for it. Outside
+ *      any scope, ArenaAllocator falls back to the aligned heap.
+ *    - FirstTouchAllocator<T> aligns buffers to pages and has the thread
+ *      pool touch every page as soon as it is allocated, each thread a
+ *      contiguous share, for Matrix(rows, cols, uninitialized) buffers
+ *      that would otherwise be placed by whichever thread writes first.
+ *
+ *  Storage drawn from an arena must be freed on the thread that allocated
+ *  it, and must not outlive its ArenaScope. So arena matrices suit
+ *  temporaries such as the work space of a solve, not results.
+ *
+ *  Matrix(rows, cols) zero-fills its entries. Matrix(rows, cols,
+ *  uninitialized) leaves entries of trivial types unset, for a buffer that
+ *  is about to be overwritten in full.
+ *
+ *  Operating systems place a page on the NUMA node of the thread that first
+ *  writes to it. So Matrix zeroes and copies buffers of more than a few
+ *  MiB in parallel, split into contiguous ranges the way the row-parallel
+ *  kernels split them, rather than leaving every page on the node of the
+ *  constructing thread, where all threads would contend for one memory
+ *  controller. The pool schedules chunks statically, range c always on
+ *  thread c, so a kernel that later splits the same storage the same way
+ *  reads each range from the thread that first touched it. Threads are not
+ *  pinned to cores, though, so that thread is on the node holding its pages
+ *  only to the extent that the OS keeps threads where they are.
+ */
+
+constexpr std::size_t storage_alignment = 64;
+
+// Tag for constructors that leave entries uninitialized.
+struct Uninitialized {};
+constexpr Uninitialized uninitialized{};
+
+template <typename T> class AlignedAllocator {
+public:
+  typedef T value_type;
+
+  AlignedAllocator() = default;
+  template <typename U> AlignedAllocator(const AlignedAllocator<U> &) {}
+
+  T *allocate(std::size_t n) {
+    return static_cast<T *>(::operator new(
+        n * sizeof(T), std::align_val_t{alignment_()}));
+  }
+  void deallocate(T *p, std::size_t) {
+    ::operator delete(p, std::align_val_t{alignment_()});
+  }
+
+  template <typename U> bool operator==(const AlignedAllocator<U> &) const {
+    return true;
+  }
+  template <typename U> bool operator!=(const AlignedAllocator<U> &) const {
+    return false;
+  }
+
+private:
+  static constexpr std::size_t alignment_() {
+    return std::max(storage_alignment, alignof(T));
+  }
+};
+
+/* ---- First-touch placement. ---- */
+
+namespace internal {
+
+constexpr std::size_t page_size_ = 4096;
+
+// Bytes a thread touches at least when storage is first touched in
+// parallel: 2 MiB, a huge page.
+constexpr std::size_t first_touch_grain_ = std::size_t{1} << 21;
+
+// Call f(lo, hi) on byte ranges covering [0, bytes), one contiguous range
+// per thread of the pool. Range c runs on thread c, as chunk c of any
+// parallel_for does, so a kernel that later splits the storage over the
+// same threads reads each part on the thread, and node, that placed it.
+template <typename F> void first_touch_(std::size_t bytes, F &&f) {
+  parallel_for(0, bytes, first_touch_grain_, std::forward<F>(f));
+}
+
+} // namespace internal
+
+template <typename T> class FirstTouchAllocator {
+public:
+  typedef T value_type;
+
+  FirstTouchAllocator() = default;
+  template <typename U> FirstTouchAllocator(const FirstTouchAllocator<U> &) {}
+
+  T *allocate(std::size_t n) {
+    std::size_t bytes = n * sizeof(T);
+    char *p = static_cast<char *>(
+        ::operator new(bytes, std::align_val_t{alignment_()}));
+    internal::first_touch_(bytes, [p](std::size_t lo, std::size_t hi) {
+      const std::size_t page = internal::page_size_;
+      for (std::size_t b = (lo + page - 1) / page * page; b < hi; b += page)
+        p[b] = 0;
+    });
+    return reinterpret_cast<T *>(p);
+  }
+  void deallocate(T *p, std::size_t) {
+    ::operator delete(p, std::align_val_t{alignment_()});
+  }
+
+  template <typename U>
+  bool operator==(const FirstTouchAllocator<U> &) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const FirstTouchAllocator<U> &) const {
+    return false;
+  }
+
+private:
+  static constexpr std::size_t alignment_() {
+    return std::max(internal::page_size_, alignof(T));
+  }
+};
+
+/* ---- Per-thread arena. ---- */
+
+namespace internal {
+
+class Arena {
+  struct Chunk {
+    char *base;
+    std::size_t size;
+  };
+
+  std::vector<Chunk> chunks;
+  std::size_t cur = 0;    // Chunk being carved up.
+  std::size_t offset = 0; // First free byte in it.
+  unsigned depth = 0;     // Number of open scopes.
+
+  static constexpr std::size_t min_chunk_ = std::size_t{1} << 20;
+
+public:
+  struct Mark {
+    std::size_t chunk, offset;
+  };
+
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena() {
+    for (const Chunk &c : chunks)
+      ::operator delete(c.base, std::align_val_t{storage_alignment});
+  }
+
+  void *allocate(std::size_t bytes) {
+    if (depth == 0)
+      return ::operator new(bytes, std::align_val_t{storage_alignment});
+
+    // Keep every block aligned by rounding sizes up.
+    bytes = (bytes + storage_alignment - 1) & ~(storage_alignment - 1);
+    while (cur < chunks.size() && offset + bytes > chunks[cur].size) {
+      cur++;
+      offset = 0;
+    }
+    if (cur == chunks.size()) {
+      std::size_t size = std::max(
+          {bytes, min_chunk_, chunks.empty() ? 0 : 2 * chunks.back().size});
+      chunks.push_back({static_cast<char *>(::operator new(
+                            size, std::align_val_t{storage_alignment})),
+                        size});
+    }
+    void *p = chunks[cur].base + offset;
+    offset += bytes;
+    return p;
+  }
+
+  // Arena blocks are released by closing their scope.
+  void deallocate(void *p) {
+    for (const Chunk &c : chunks)
+      if (p >= c.base && p < c.base + c.size)
+        return;
+    ::operator delete(p, std::align_val_t{storage_alignment});
+  }
+
+  Mark open() {
+    depth++;
+    return {cur, offset};
+  }
+  void close(Mark m) {
+    depth--;
+    cur = m.chunk;
+    offset = m.offset;
+  }
+
+  // Bytes held in chunks, whether in use or not.
+  std::size_t reserved() const {
+    std::size_t total = 0;
+    for (const Chunk &c : chunks)
+      total += c.size;
+    return total;
+  }
+};
+
+inline Arena &thread_arena_() {
+  thread_local Arena arena;
+  return arena;
+}
+
+} // namespace internal
+
+// Route ArenaAllocator storage on this thread to the arena until the end
+// of the enclosing block. Scopes nest; each releases only its own blocks.
+class ArenaScope {
+  internal::Arena &arena;
+  internal::Arena::Mark mark;
+
+public:
+  ArenaScope() : arena{internal::thread_arena_()}, mark{arena.open()} {}
+  ArenaScope(const ArenaScope &) = delete;
+  ArenaScope &operator=(const ArenaScope &) = delete;
+  ~ArenaScope() { arena.close(mark); }
+
+  // Bytes this thread's arena holds for reuse.
+  static std::size_t reserved() { return internal::thread_arena_().reserved(); }
+};
+
+template <typename T> class ArenaAllocator {
+public:
+  typedef T value_type;
+
+  ArenaAllocator() = default;
+  template <typename U> ArenaAllocator(const ArenaAllocator<U> &) {}
+
+  T *allocate(std::size_t n) {
+    static_assert(alignof(T) <= storage_alignment,
+                  "Arena blocks are only aligned to storage_alignment.");
+    return static_cast<T *>(internal::thread_arena_().allocate(n * sizeof(T)));
+  }
+  void deallocate(T *p, std::size_t) {
+    internal::thread_arena_().deallocate(p);
+  }
+
+  template <typename U> bool operator==(const ArenaAllocator<U> &) const {
+    return true;
+  }
+  template <typename U> bool operator!=(const ArenaAllocator<U> &) const {
+    return false;
+  }
+};
+
+namespace internal {
+
+// Work space for a kernel that opens an ArenaScope.
+template <typename T> using arena_vector_ = std::vector<T, ArenaAllocator<T>>;
+
+} // namespace internal
+
+/* ---- Forward declarations. ---- */
+
+template <typename T, typename Alloc = AlignedAllocator<T>> class Matrix;
+template <typename T, typename Alloc = AlignedAllocator<T>> class Vector;
+
+} // namespace matrix
+
+#endif
@@ -0,0 +1,589 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "allocator.hpp"
+#include "matrix.hpp"
+#include "thread_pool.hpp"
+#include "vector.hpp"
+#include "view.hpp"
+
+#ifndef BANDED_H
+#define BANDED_H
+
+namespace matrix {
+
+/**
+ *  Square banded and tridiagonal matrices.
+ *
+ *  A BandedMatrix<T> with kl subdiagonals and ku superdiagonals stores only
+ *  its n (kl + ku + 1) band entries, in LAPACK's band layout: column j is
+ *  stored contiguously, with A(i, j) at band()[ku + i - j + j * band_ld()].
+ *  Entries outside the band are zero and can't be written.
+ *
+ *  BandedLUFactorization does LU with partial pivoting in O(n kl (kl + ku))
+ *  time (the pivoting widens U to kl + ku superdiagonals) and solves in
+ *  O(n (2 kl + ku)) per right-hand side, instead of the O(n^3) and O(n^2)
+ *  of a dense LUFactorization.
+ *
+ *  A TridiagonalMatrix<T> keeps its three diagonals as separate arrays and
+ *  is solved by the Thomas algorithm, i.e. Gaussian elimination without
+ *  pivoting: 8n flops and no extra storage per right-hand side. That is
+ *  stable for diagonally dominant or symmetric positive definite matrices;
+ *  for anything else, use to_banded() and a BandedLUFactorization.
+ *
+ *  Neither is an expression, like SparseMatrix; use to_dense() to get a
+ *  Matrix<T>.
+ */
+
+template <typename T> class BandedMatrix {
+  std::size_t kl, ku;
+  std::vector<T> ab;
+
+public:
+  typedef T value_type;
+
+  const std::size_t rows;
+  const std::size_t cols;
+
+  // All zero n x n matrix with the given bandwidths.
+  BandedMatrix(std::size_t n, std::size_t kl, std::size_t ku);
+  // The band of a square dense matrix; throws if it has nonzero entries
+  // outside the band.
+  BandedMatrix(const Matrix<T> &, std::size_t kl, std::size_t ku);
+
+  std::size_t lower_bandwidth() const { return kl; }
+  std::size_t upper_bandwidth() const { return ku; }
+
+  bool in_band(std::size_t row, std::size_t col) const {
+    return col <= row + ku && row <= col + kl;
+  }
+
+  // Writable entries must be in the band.
+  T &operator()(std::size_t row, std::size_t col) {
+    assert(in_band(row, col));
+    return ab[ku + row - col + col * band_ld()];
+  }
+  T operator()(std::size_t row, std::size_t col) const {
+    return in_band(row, col)
+               ? ab[ku + row - col + col * band_ld()]
+               : T{};
+  }
+
+  // LAPACK band storage, e.g. for dgbmv.
+  T *band() { return ab.data(); }
+  const T *band() const { return ab.data(); }
+  std::size_t band_ld() const { return kl + ku + 1; }
+
+  Matrix<T> to_dense() const;
+};
+
+template <typename T> class TridiagonalMatrix {
+  std::vector<T> sub, dia, sup;
+
+public:
+  typedef T value_type;
+
+  const std::size_t rows;
+  const std::size_t cols;
+
+  // All zero n x n matrix.
+  explicit TridiagonalMatrix(std::size_t n);
+  // Subdiagonal, diagonal and superdiagonal, of lengths n - 1, n, n - 1.
+  TridiagonalMatrix(std::vector<T> lower, std::vector<T> diag,
+                    std::vector<T> upper);
+
+  // lower()[i] = A(i + 1, i), diag()[i] = A(i, i), upper()[i] = A(i, i + 1).
+  T *lower() { return sub.data(); }
+  T *diag() { return dia.data(); }
+  T *upper() { return sup.data(); }
+  const T *lower() const { return sub.data(); }
+  const T *diag() const { return dia.data(); }
+  const T *upper() const { return sup.data(); }
+
+  T &operator()(std::size_t row, std::size_t col);
+  T operator()(std::size_t row, std::size_t col) const;
+
+  BandedMatrix<T> to_banded() const;
+  Matrix<T> to_dense() const;
+};
+
+/* ---- BandedMatrix implementation. ---- */
+
+template <typename T>
+BandedMatrix<T>::BandedMatrix(std::size_t n, std::size_t kl, std::size_t ku)
+    : kl{kl}, ku{ku}, ab(n * (std::size_t(kl) + ku + 1)), rows{n}, cols{n} {
+}
+
+template <typename T>
+BandedMatrix<T>::BandedMatrix(const Matrix<T> &A, std::size_t kl,
+                              std::size_t ku)
+    : BandedMatrix(A.rows, kl, ku) {
+  if (A.rows != A.cols)
+    throw std::domain_error("Banded matrix must be square.");
+  for (std::size_t i = 0; i < rows; i++)
+    for (std::size_t j = 0; j < cols; j++) {
+      if (in_band(i, j))
+        (*this)(i, j) = A(i, j);
+      else if (A(i, j) != T{})
+        throw std::domain_error("Matrix has nonzero entries outside the "
+                                "given band.");
+    }
+}
+
+template <typename T> Matrix<T> BandedMatrix<T>::to_dense() const {
+  Matrix<T> A{rows, cols};
+  for (std::size_t j = 0; j < cols; j++) {
+    std::size_t i0 = j > ku ? j - ku : 0;
+    std::size_t i1 = std::min(rows - 1, j + kl);
+    for (std::size_t i = i0; i <= i1; i++)
+      A(i, j) = (*this)(i, j);
+  }
+  return A;
+}
+
+/* ---- TridiagonalMatrix implementation. ---- */
+
+template <typename T>
+TridiagonalMatrix<T>::TridiagonalMatrix(std::size_t n)
+    : sub(n > 0 ? n - 1 : 0), dia(n), sup(n > 0 ? n - 1 : 0), rows{n},
+      cols{n} {}
+
+template <typename T>
+TridiagonalMatrix<T>::TridiagonalMatrix(std::vector<T> lower,
+                                        std::vector<T> diag,
+                                        std::vector<T> upper)
+    : sub{std::move(lower)}, dia{std::move(diag)}, sup{std::move(upper)},
+      rows{dia.size()}, cols{dia.size()} {
+  std::size_t off = dia.empty() ? 0 : dia.size() - 1;
+  if (sub.size() != off || sup.size() != off)
+    throw std::invalid_argument("Off-diagonals of a tridiagonal matrix must "
+                                "have one entry less than the diagonal.");
+}
+
+template <typename T>
+T &TridiagonalMatrix<T>::operator()(std::size_t row, std::size_t col) {
+  assert(row <= col + 1 && col <= row + 1);
+  if (row == col)
+    return dia[row];
+  return row > col ? sub[col] : sup[row];
+}
+
+template <typename T>
+T TridiagonalMatrix<T>::operator()(std::size_t row, std::size_t col) const {
+  if (row == col)
+    return dia[row];
+  if (row == col + 1)
+    return sub[col];
+  if (col == row + 1)
+    return sup[row];
+  return T{};
+}
+
+template <typename T> BandedMatrix<T> TridiagonalMatrix<T>::to_banded() const {
+  BandedMatrix<T> B{rows, 1, 1};
+  for (std::size_t i = 0; i < rows; i++) {
+    B(i, i) = dia[i];
+    if (i + 1 < rows) {
+      B(i + 1, i) = sub[i];
+      B(i, i + 1) = sup[i];
+    }
+  }
+  return B;
+}
+
+template <typename T> Matrix<T> TridiagonalMatrix<T>::to_dense() const {
+  return to_banded().to_dense();
+}
+
+/* ---- Banded products. ---- */
+
+namespace internal {
+
+// Y = A X for X and Y with k columns and row strides ldx and ldy.
+template <typename T>
+void gbmm_(const BandedMatrix<T> &A, const T *x, std::size_t ldx,
+           std::size_t k, T *y, std::size_t ldy) {
+  std::size_t n = A.rows, kl = A.lower_bandwidth(),
+              ku = A.upper_bandwidth();
+  const T *ab = A.band();
+  std::size_t ld = A.band_ld();
+  std::size_t grain = parallel_grain_ / ((kl + ku + 1) * k) + 1;
+  parallel_for(0, n, grain, [&](std::size_t lo, std::size_t hi) {
+    for (std::size_t i = lo; i < hi; i++) {
+      T *yi = y + i * ldy;
+      std::fill(yi, yi + k, T{});
+      std::size_t j0 = i > kl ? i - kl : 0, j1 = std::min(n - 1, i + ku);
+      for (std::size_t j = j0; j <= j1; j++) {
+        T a = ab[ku + i - j + j * ld];
+        const T *xj = x + j * ldx;
+        for (std::size_t c = 0; c < k; c++)
+          yi[c] += a * xj[c];
+      }
+    }
+  });
+}
+
+} // namespace internal
+
+template <typename T>
+Vector<T> operator*(const BandedMatrix<T> &lhs, const Vector<T> &rhs) {
+  if (lhs.cols != rhs.rows)
+    throw std::domain_error("Matrix and vector shapes do not match.");
+  Vector<T> result(lhs.rows);
+  internal::gbmm_(lhs, rhs.ptr(), 1, 1, result.ptr(), 1);
+  return result;
+}
+
+template <typename T>
+Matrix<T> operator*(const BandedMatrix<T> &lhs, const Matrix<T> &rhs) {
+  if (lhs.cols != rhs.rows)
+    throw std::domain_error("Matrix shapes do not match.");
+  Matrix<T> result{lhs.rows, rhs.cols};
+  internal::gbmm_(lhs, rhs.ptr(), rhs.cols, rhs.cols, result.ptr(),
+                  result.cols);
+  return result;
+}
+
+/**
+ *  LU w/ partial pivoting of a banded matrix, as in LAPACK's dgbtf2.
+ *
+ *  Each column is stored with kl extra entries above its band for the
+ *  fill-in that row swaps bring into U. L's multipliers stay below the
+ *  diagonal of their column, and the row swaps are applied to the
+ *  right-hand side as the forward substitution goes, so L is never
+ *  permuted.
+ */
+
+template <typename T> class BandedLUFactorization {
+  std::size_t n, kl, ku, ld;
+  std::vector<T> lu;
+  std::vector<std::size_t> p;
+
+  // Entry (i, j) of the factors: U on and above the diagonal, with up to
+  // kl + ku superdiagonals, L's multipliers below.
+  T &at_(std::size_t i, std::size_t j) { return lu[kl + ku + i - j + j * ld]; }
+  T at_(std::size_t i, std::size_t j) const {
+    return lu[kl + ku + i - j + j * ld];
+  }
+
+  void check_nonsingular_() const;
+
+public:
+  explicit BandedLUFactorization(const BandedMatrix<T> &A);
+
+  std::size_t size() const { return n; }
+  bool singular() const;
+
+  // Overwrite b, a matrix or a view into one, with the solution x of Ax = b.
+  void solve_in_place(MatrixView<T> b) const;
+
+  Matrix<T> solve(const Matrix<T> &b) const;
+  Vector<T> solve(const Vector<T> &b) const;
+};
+
+template <typename T>
+BandedLUFactorization<T>::BandedLUFactorization(const BandedMatrix<T> &A)
+    : n{A.rows}, kl{A.lower_bandwidth()}, ku{A.upper_bandwidth()},
+      ld{2 * kl + ku + 1}, lu(n * ld), p(n) {
+  // Copy the band below the kl rows of fill-in space.
+  for (std::size_t j = 0; j < n; j++)
+    std::copy(A.band() + j * A.band_ld(), A.band() + (j + 1) * A.band_ld(),
+              lu.begin() + j * ld + kl);
+
+  // Last column that any row swap so far has reached.
+  std::size_t ju = 0;
+  for (std::size_t j = 0; j < n; j++) {
+    std::size_t km = std::min(kl, n - 1 - j);
+
+    std::size_t l = j;
+    for (std::size_t i = j + 1; i <= j + km; i++)
+      if (std::abs(at_(i, j)) > std::abs(at_(l, j)))
+        l = i;
+    p[j] = l;
+
+    if (at_(l, j) == T{})
+      continue; // Singular; solve() will throw.
+
+    ju = std::max(ju, std::min(n - 1, l + ku));
+    if (l != j)
+      for (std::size_t c = j; c <= ju; c++)
+        std::swap(at_(j, c), at_(l, c));
+
+    T pivot = at_(j, j);
+    for (std::size_t i = j + 1; i <= j + km; i++)
+      at_(i, j) /= pivot;
+
+    // Rank-1 update of the trailing block; within a column the rows
+    // j + 1 .. j + km are contiguous.
+    for (std::size_t c = j + 1; c <= ju; c++) {
+      T u = at_(j, c);
+      if (u == T{})
+        continue;
+      T *col = &at_(j + 1, c);
+      const T *mult = &at_(j + 1, j);
+      for (std::size_t t = 0; t < km; t++)
+        col[t] -= mult[t] * u;
+    }
+  }
+}
+
+template <typename T> bool BandedLUFactorization<T>::singular() const {
+  for (std::size_t k = 0; k < n; k++)
+    if (at_(k, k) == T{})
+      return true;
+  return false;
+}
+
+template <typename T>
+void BandedLUFactorization<T>::check_nonsingular_() const {
+  if (singular())
+    throw std::domain_error(
+        "Matrix is A singular; cannot guarantee solution exists.");
+}
+
+template <typename T>
+void BandedLUFactorization<T>::solve_in_place(MatrixView<T> b) const {
+  assert(b.rows == n);
+  check_nonsingular_();
+
+  // Rows of b must be contiguous; solve anything else in a copy.
+  if (!b.unit_rows()) {
+    ArenaScope scope;
+    Matrix<T, ArenaAllocator<T>> x{b};
+    solve_in_place(x);
+    b = x;
+    return;
+  }
+
+  std::size_t k = b.cols;
+  std::size_t ldb = b.row_stride();
+  T *y = b.ptr();
+
+  // Solve Ly = Pb, swapping rows as they are reached.
+  for (std::size_t j = 0; j + 1 < n; j++) {
+    T *yj = y + j * ldb;
+    if (p[j] != j)
+      std::swap_ranges(yj, yj + k, y + p[j] * ldb);
+    std::size_t km = std::min(kl, n - 1 - j);
+    for (std::size_t t = 1; t <= km; t++) {
+      T l = at_(j + t, j);
+      T *yi = y + (j + t) * ldb;
+      for (std::size_t c = 0; c < k; c++)
+        yi[c] -= l * yj[c];
+    }
+  }
+
+  // Solve Ux = y, U with kl + ku superdiagonals.
+  for (std::size_t r = 0; r < n; r++) {
+    std::size_t i = n - 1 - r;
+    T *yi = y + i * ldb;
+    std::size_t last = std::min(n - 1, i + kl + ku);
+    for (std::size_t c = i + 1; c <= last; c++) {
+      T u = at_(i, c);
+      const T *yc = y + c * ldb;
+      for (std::size_t s = 0; s < k; s++)
+        yi[s] -= u * yc[s];
+    }
+    T d = at_(i, i);
+    for (std::size_t s = 0; s < k; s++)
+      yi[s] /= d;
+  }
+}
+
+template <typename T>
+Matrix<T> BandedLUFactorization<T>::solve(const Matrix<T> &b) const {
+  Matrix<T> x{b};
+  solve_in_place(x);
+  return x;
+}
+
+template <typename T>
+Vector<T> BandedLUFactorization<T>::solve(const Vector<T> &b) const {
+  Vector<T> x{b};
+  solve_in_place(x);
+  return x;
+}
+
+// Banded counterpart of solve_partial_pivot in solvers.hpp.
+template <typename T>
+Matrix<T> solve_partial_pivot(const BandedMatrix<T> &A, const Matrix<T> &b) {
+  return BandedLUFactorization<T>{A}.solve(b);
+}
+
+/* ---- Thomas algorithm. ---- */
+
+/**
+ *  The solvers below take the right-hand sides as the columns of b, n x k,
+ *  and work down all k columns together: each step of the elimination is
+ *  one contiguous loop over a row of b, which the compiler vectorizes, so
+ *  the SIMD lanes (and, for wide b, the threads) go across systems rather
+ *  than along one. This is the layout ADI time-stepping needs: to solve
+ *  along the rows of a grid instead, pass its transpose.
+ *
+ *  solve_tridiagonal() solves one matrix against many right-hand sides;
+ *  its multipliers are computed once. solve_tridiagonal_batch() solves k
+ *  different systems, with the coefficients of system s in column s of
+ *  lower, diag and upper (all n x k; row 0 of lower and row n - 1 of
+ *  upper are not used).
+ */
+
+namespace internal {
+
+// Columns [c0, c1) of a batch. lower, diag and upper have row stride ldc;
+// cp (row stride ldw) receives the modified superdiagonal.
+template <typename T>
+void thomas_cols_(std::size_t n, const T *lower, const T *diag,
+                  const T *upper, std::size_t ldc, T *cp, std::size_t ldw,
+                  T *x, std::size_t ldx, std::size_t c0, std::size_t c1) {
+  bool zero_pivot = false;
+  for (std::size_t s = c0; s < c1; s++) {
+    T d = diag[s];
+    zero_pivot |= d == T{};
+    x[s] /= d;
+    cp[s] = upper[s] / d;
+  }
+  for (std::size_t i = 1; i < n; i++) {
+    const T *a = lower + i * ldc, *d = diag + i * ldc, *c = upper + i * ldc;
+    T *xi = x + i * ldx;
+    const T *xp = xi - ldx;
+    T *cpi = cp + i * ldw;
+    const T *cpp = cpi - ldw;
+#pragma GCC ivdep
+    for (std::size_t s = c0; s < c1; s++) {
+      T piv = d[s] - a[s] * cpp[s];
+      zero_pivot |= piv == T{};
+      T inv = 1 / piv;
+      xi[s] = (xi[s] - a[s] * xp[s]) * inv;
+      cpi[s] = c[s] * inv;
+    }
+  }
+  for (std::size_t r = 1; r < n; r++) {
+    std::size_t i = n - 1 - r;
+    T *xi = x + i * ldx;
+    const T *xn = xi + ldx;
+    const T *cpi = cp + i * ldw;
+#pragma GCC ivdep
+    for (std::size_t s = c0; s < c1; s++)
+      xi[s] -= cpi[s] * xn[s];
+  }
+
+  if (zero_pivot)
+    throw std::domain_error("Zero pivot in tridiagonal solve; use a "
+                            "BandedLUFactorization, which pivots.");
+}
+
+// Same coefficients for all columns: forward elimination only needs the
+// multipliers and inverse pivots, which don't depend on the right-hand
+// side.
+template <typename T>
+void thomas_shared_(const TridiagonalMatrix<T> &A, T *x, std::size_t ldx,
+                    std::size_t k) {
+  std::size_t n = A.rows;
+  const T *a = A.lower(), *d = A.diag(), *c = A.upper();
+  ArenaScope scope;
+  Matrix<T, ArenaAllocator<T>> work{2, n, uninitialized};
+  T *cp = work.ptr(), *inv = cp + n;
+  for (std::size_t i = 0; i < n; i++) {
+    T piv = d[i] - (i > 0 ? a[i - 1] * cp[i - 1] : T{});
+    if (piv == T{})
+      throw std::domain_error("Zero pivot in tridiagonal solve; use a "
+                              "BandedLUFactorization, which pivots.");
+    inv[i] = 1 / piv;
+    cp[i] = i + 1 < n ? c[i] * inv[i] : T{};
+  }
+
+  std::size_t grain = parallel_grain_ / n + 1;
+  parallel_for(0, k, grain, [&](std::size_t c0, std::size_t c1) {
+    for (std::size_t s = c0; s < c1; s++)
+      x[s] *= inv[0];
+    for (std::size_t i = 1; i < n; i++) {
+      T *xi = x + i * ldx;
+      const T *xp = xi - ldx;
+      T ai = a[i - 1], invi = inv[i];
+      for (std::size_t s = c0; s < c1; s++)
+        xi[s] = (xi[s] - ai * xp[s]) * invi;
+    }
+    for (std::size_t r = 1; r < n; r++) {
+      std::size_t i = n - 1 - r;
+      T *xi = x + i * ldx;
+      const T *xn = xi + ldx;
+      T ci = cp[i];
+      for (std::size_t s = c0; s < c1; s++)
+        xi[s] -= ci * xn[s];
+    }
+  });
+}
+
+} // namespace internal
+
+template <typename T>
+void solve_tridiagonal_in_place(
+    const TridiagonalMatrix<T> &A,
+    MatrixView<typename TridiagonalMatrix<T>::value_type> b) {
+  if (b.rows != A.rows)
+    throw std::domain_error("Matrix and right-hand side shapes do not "
+                            "match.");
+  if (b.rows == 0)
+    return;
+  if (!b.unit_rows()) {
+    ArenaScope scope;
+    Matrix<T, ArenaAllocator<T>> x{b};
+    solve_tridiagonal_in_place(A, x.view());
+    b = x;
+    return;
+  }
+  internal::thomas_shared_(A, b.ptr(), b.row_stride(), b.cols);
+}
+
+template <typename T>
+Matrix<T> solve_tridiagonal(const TridiagonalMatrix<T> &A,
+                            const Matrix<T> &b) {
+  Matrix<T> x{b};
+  solve_tridiagonal_in_place(A, x.view());
+  return x;
+}
+
+template <typename T>
+Vector<T> solve_tridiagonal(const TridiagonalMatrix<T> &A,
+                            const Vector<T> &b) {
+  Vector<T> x{b};
+  solve_tridiagonal_in_place(A, x.view());
+  return x;
+}
+
+template <typename T>
+void solve_tridiagonal_batch(const Matrix<T> &lower, const Matrix<T> &diag,
+                             const Matrix<T> &upper,
+                             MatrixView<typename Matrix<T>::value_type> x) {
+  std::size_t n = x.rows, k = x.cols;
+  for (const Matrix<T> *m : {&lower, &diag, &upper})
+    if (m->rows != n || m->cols != k)
+      throw std::domain_error("Coefficient and right-hand side shapes do "
+                              "not match.");
+  if (n == 0 || k == 0)
+    return;
+  if (!x.unit_rows()) {
+    ArenaScope scope;
+    Matrix<T, ArenaAllocator<T>> y{x};
+    solve_tridiagonal_batch(lower, diag, upper, y.view());
+    x = y;
+    return;
+  }
+
+  ArenaScope scope;
+  Matrix<T, ArenaAllocator<T>> cp{n, k, uninitialized};
+  std::size_t grain = internal::parallel_grain_ / n + 1;
+  parallel_for(0, k, grain, [&](std::size_t c0, std::size_t c1) {
+    internal::thomas_cols_(n, lower.ptr(), diag.ptr(), upper.ptr(), k,
+                           cp.ptr(), k, x.ptr(), x.row_stride(), c0, c1);
+  });
+}
+
+} // namespace matrix
+
+#endif
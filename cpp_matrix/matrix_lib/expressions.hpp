@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+#include "allocator.hpp"
+#include "thread_pool.hpp"
+
+#ifndef EXPRESSIONS_H
+#define EXPRESSIONS_H
+
+namespace matrix {
+
+/**
+ *  Expression templates for elementwise arithmetic.
+ *
+ *  Sums, differences, scalar multiples and elementwise maps (MatrixFunctor,
+ *  map() and zip() in utils.hpp) return lightweight expression nodes instead
+ *  of new matrices. A node only records its operands; the entries are
+ *  computed in a single fused loop when the expression is assigned to a
+ *  Matrix, used to construct one, or passed to a reduction such as infNorm().
+ *  So `infNorm(curr - prev)` reads each operand once and allocates nothing.
+ *
+ *  Matrix and Vector operands are held by reference, and nested nodes by
+ *  value. As with any expression template library, an expression must not
+ *  outlive the matrices it refers to, so avoid storing one in an `auto`
+ *  variable when an operand is a temporary, e.g. `auto e = A * B + C;`.
+ *
+ *  Every node has `rows`, `cols`, a `value_type` and an entry accessor
+ *  `operator()(i, j) const`, the same interface as Matrix itself.
+ */
+
+// CRTP base of Matrix and of every expression node.
+template <typename E> struct MatrixExpr {
+  const E &self() const { return static_cast<const E &>(*this); }
+};
+
+namespace internal {
+
+// Matrices are stored by reference in a node; nodes by value.
+template <typename E> struct expr_ref_ {
+  typedef const E type;
+};
+
+template <typename T, typename A> struct expr_ref_<Matrix<T, A>> {
+  typedef const Matrix<T, A> &type;
+};
+
+template <typename T, typename A> struct expr_ref_<Vector<T, A>> {
+  typedef const Vector<T, A> &type;
+};
+
+struct add_op_ {
+  template <typename T> T operator()(const T &a, const T &b) const {
+    return a + b;
+  }
+};
+
+struct sub_op_ {
+  template <typename T> T operator()(const T &a, const T &b) const {
+    return a - b;
+  }
+};
+
+} // namespace internal
+
+/* ---- Expression nodes. ---- */
+
+template <typename L, typename R, typename Op>
+class BinaryExpr : public MatrixExpr<BinaryExpr<L, R, Op>> {
+  typename internal::expr_ref_<L>::type lhs;
+  typename internal::expr_ref_<R>::type rhs;
+
+public:
+  typedef typename L::value_type value_type;
+  const std::size_t rows;
+  const std::size_t cols;
+
+  BinaryExpr(const L &lhs, const R &rhs)
+      : lhs{lhs}, rhs{rhs}, rows{lhs.rows}, cols{lhs.cols} {
+    if (lhs.rows != rhs.rows || lhs.cols != rhs.cols)
+      throw std::domain_error(
+          "Dimensions must match to add or subtract matrices.");
+  }
+
+  value_type operator()(std::size_t i, std::size_t j) const {
+    return Op{}(lhs(i, j), rhs(i, j));
+  }
+};
+
+template <typename E> class ScaledExpr : public MatrixExpr<ScaledExpr<E>> {
+public:
+  typedef typename E::value_type value_type;
+
+private:
+  value_type a;
+  typename internal::expr_ref_<E>::type m;
+
+public:
+  const std::size_t rows;
+  const std::size_t cols;
+
+  ScaledExpr(const value_type &a, const E &m)
+      : a{a}, m{m}, rows{m.rows}, cols{m.cols} {}
+
+  value_type operator()(std::size_t i, std::size_t j) const {
+    return a * m(i, j);
+  }
+};
+
+template <typename E, typename F>
+class MapExpr : public MatrixExpr<MapExpr<E, F>> {
+  typename internal::expr_ref_<E>::type m;
+  F func;
+
+public:
+  typedef typename E::value_type value_type;
+  const std::size_t rows;
+  const std::size_t cols;
+
+  MapExpr(const E &m, F func)
+      : m{m}, func{func}, rows{m.rows}, cols{m.cols} {}
+
+  value_type operator()(std::size_t i, std::size_t j) const {
+    return func(m(i, j));
+  }
+};
+
+template <typename L, typename R, typename F>
+class ZipExpr : public MatrixExpr<ZipExpr<L, R, F>> {
+  typename internal::expr_ref_<L>::type lhs;
+  typename internal::expr_ref_<R>::type rhs;
+  F func;
+
+public:
+  typedef typename L::value_type value_type;
+  const std::size_t rows;
+  const std::size_t cols;
+
+  ZipExpr(const L &lhs, const R &rhs, F func)
+      : lhs{lhs}, rhs{rhs}, func{func}, rows{lhs.rows}, cols{lhs.cols} {
+    if (lhs.rows != rhs.rows || lhs.cols != rhs.cols)
+      throw std::domain_error(
+          "Dimensions must match to combine matrices elementwise.");
+  }
+
+  value_type operator()(std::size_t i, std::size_t j) const {
+    return func(lhs(i, j), rhs(i, j));
+  }
+};
+
+/* ---- Evaluation. ---- */
+
+namespace internal {
+
+// Write the entries of expression e into dst, with the given row and column
+// strides, in one pass, splitting rows over the thread pool for large
+// matrices. An entry of dst may only be read by e at its own position (see
+// view.hpp), so the rows carry no dependences and are vectorized.
+template <typename E>
+void evaluate_(typename E::value_type *dst, std::ptrdiff_t rs,
+               std::ptrdiff_t cs, const E &e) {
+  std::size_t cols = e.cols;
+  std::size_t grain = parallel_grain_ / std::max<std::size_t>(cols, 1) + 1;
+
+  parallel_for(0, e.rows, grain, [&](std::size_t lo, std::size_t hi) {
+    for (std::size_t i = lo; i < hi; i++) {
+      typename E::value_type *row = dst + i * rs;
+      if (cs == 1)
+#pragma GCC ivdep
+        for (std::size_t j = 0; j < cols; j++)
+          row[j] = e(i, j);
+      else
+        for (std::size_t j = 0; j < cols; j++)
+          row[j * cs] = e(i, j);
+    }
+  });
+}
+
+} // namespace internal
+
+} // namespace matrix
+
+#endif
@@ -1,6 +1,22 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "allocator.hpp"
+#include "gemm.hpp"
 #include "matrix.hpp"
+#include "task_graph.hpp"
 #include "utils.hpp"
 #include "vector.hpp"
+#include "view.hpp"
+
+#ifndef FACTORIZATIONS_H
+#define FACTORIZATIONS_H
 
 namespace matrix {
 
@@ -8,31 +24,29 @@ namespace matrix {
  *  Most basic LU factorization.
  *  Later we will improve it; first with pivoting.
  *
- *  We could also define higher-level functions to use.
- *  For example, we could define submatrix views that allow
- *  access by reference to submatrices of a given Matrix
- *  object, perhaps as special derived classes of Matrix.
+ *  The factorizations accept any expression or view (e.g. a block of a
+ *  larger matrix) and factor a copy of it.
  */
 
-template <typename T>
-std::pair<Matrix<T>, Matrix<T>> LUFactor(const Matrix<T> &A) {
-  assert(A.rows == A.cols);
-  unsigned int n = A.rows;
+template <typename E, typename T = typename E::value_type>
+std::pair<Matrix<T>, Matrix<T>> LUFactor(const MatrixExpr<E> &A) {
+  Matrix<T> U{A.self()};
+  assert(U.rows == U.cols);
+  std::size_t n = U.rows;
 
   Matrix<T> L = ident<T>(n);
-  Matrix<T> U{A};
 
   // Do the factorization.
-  for (unsigned k = 0; k < n - 1; k++) {
+  for (std::size_t k = 0; k < n - 1; k++) {
     if (U(k, k) == 0)
       throw std::domain_error(
           "This LU factorization doesn't handle singular matrices.");
 
-    for (unsigned l = k + 1; l < n; l++) {
+    for (std::size_t l = k + 1; l < n; l++) {
       T tau = U(l, k) / U(k, k);
       L(l, k) = tau;
 
-      for (unsigned r = k; r < n; r++)
+      for (std::size_t r = k; r < n; r++)
         U(l, r) = U(l, r) - (U(k, r) * tau);
     }
   }
@@ -47,72 +61,1274 @@ std::pair<Matrix<T>, Matrix<T>> LUFactor(const Matrix<T> &A) {
  *
  *  Does not explicitly return L of A = LU, but it can be obtained from
  *  return value (see Golub and Van Loan).
+ *
+ *  The factorization is blocked (right-looking, Golub and Van Loan 3.2.11):
+ *  each panel of lu_block_ columns is factored by lu_panel_rec_,
+ *  the block row to its right is updated by a unit lower triangular solve,
+ *  and the trailing submatrix gets a single GEMM update. So most of the
+ *  flops run in the cache-blocked GEMM kernel instead of streaming the
+ *  trailing matrix through memory once per column.
  */
 
 namespace internal {
 
-template <typename T> unsigned next_row_(const Matrix<T> &m, unsigned step) {
-  unsigned next = step;
-  T max_val = m(step, step);
+// Panel width of the blocked LU, and the width below which a panel is
+// factored by the unblocked algorithm rather than split in two.
+constexpr std::size_t lu_block_ = 128;
+constexpr std::size_t lu_leaf_ = 8;
 
-  for (unsigned i = step; i < m.rows; i++) {
-    T abs_val = std::abs(m(i, step));
-    if (abs_val > max_val) {
-      max_val = abs_val;
-      next = i;
+// B = L^-1 B, with L the nb x nb unit lower triangle at l and B nb x nc.
+// Works a row at a time so the inner loop runs along contiguous memory.
+template <typename T>
+void lu_row_solve_(const T *l, std::size_t ldl, std::size_t nb, T *b,
+                   std::size_t ldb, std::size_t nc) {
+  for (std::size_t i = 1; i < nb; i++) {
+    T *row_i = b + i * ldb;
+    for (std::size_t k = 0; k < i; k++) {
+      T tau = l[i * ldl + k];
+      const T *row_k = b + k * ldb;
+      for (std::size_t j = 0; j < nc; j++)
+        row_i[j] -= tau * row_k[j];
     }
   }
-  return next;
-} // Return index of largest entry in m(k:n, k).
+}
+
+/**
+ *  LU w/ partial pivoting of the m x w row-major panel at P, m >= w, in
+ *  the recursive form of LAPACK's dgetrf2 (Toledo): factor the left half,
+ *  update the right half by a triangular solve and a GEMM, and factor
+ *  that. Most of the panel's flops then run in GEMM rather than in rank-1
+ *  updates. Row k was swapped with row piv[k], across all w columns.
+ */
 
 template <typename T>
-void exchange_row_tails_(Matrix<T> &m, unsigned k, unsigned n) {
-  for (unsigned j = k; j < m.cols; j++) {
-    T tmp = m(n, j);
-    m(n, j) = m(k, j);
-    m(k, j) = tmp;
+void lu_panel_rec_(T *P, std::size_t ld, std::size_t m, std::size_t w,
+                   unsigned *piv) {
+  if (w <= lu_leaf_) {
+    for (std::size_t k = 0; k < w; k++) {
+      // Largest entry of column k on or below the diagonal.
+      std::size_t r = k;
+      T max_val = std::abs(P[k * ld + k]);
+      for (std::size_t i = k + 1; i < m; i++)
+        if (std::abs(P[i * ld + k]) > max_val) {
+          max_val = std::abs(P[i * ld + k]);
+          r = i;
+        }
+      piv[k] = static_cast<unsigned>(r);
+      if (r != k)
+        std::swap_ranges(P + k * ld, P + k * ld + w, P + r * ld);
+
+      T pivot = P[k * ld + k];
+      if (pivot == 0)
+        continue;
+      const T *row_k = P + k * ld;
+      for (std::size_t i = k + 1; i < m; i++) {
+        T *row_i = P + i * ld;
+        row_i[k] = row_i[k] / pivot;
+        for (std::size_t j = k + 1; j < w; j++)
+          row_i[j] -= row_i[k] * row_k[j];
+      }
+    }
+    return;
   }
-} // Swap tails of rows in-place.
 
-} // namespace internal
+  std::size_t h = w / 2;
+  lu_panel_rec_(P, ld, m, h, piv);
+  for (std::size_t k = 0; k < h; k++)
+    if (piv[k] != k)
+      std::swap_ranges(P + k * ld + h, P + k * ld + w, P + piv[k] * ld + h);
+
+  // A12 = L11^-1 A12, A22 = A22 - A21 A12.
+  lu_row_solve_(P, ld, h, P + h, ld, w - h);
+  gemm<T>(m - h, w - h, h, T{-1}, P + h * ld, ld, 1, P + h, ld, 1, T{1},
+          P + h * ld + h, ld, 1);
+
+  lu_panel_rec_(P + h * ld + h, ld, m - h, w - h, piv + h);
+  for (std::size_t k = h; k < w; k++) {
+    piv[k] += static_cast<unsigned>(h);
+    if (piv[k] != k)
+      std::swap_ranges(P + k * ld, P + k * ld + h, P + piv[k] * ld);
+  }
+}
 
+// Factor the panel M(k0:n, k0:k0+nb) in a contiguous copy, so its rows
+// are nb apart instead of n, then apply its row swaps to the columns on
+// either side of it, swapping whole rows as the unblocked algorithm does.
 template <typename T>
-std::pair<Matrix<T>, Matrix<unsigned>> LUPartialPivot(const Matrix<T> &A) {
-  assert(A.rows == A.cols);
-  unsigned int n = A.rows;
+void lu_panel_(Matrix<T> &M, Matrix<unsigned> &p, std::size_t k0,
+               std::size_t nb) {
+  std::size_t n = M.rows, m = n - k0;
+  T *a = M.ptr() + std::size_t{k0} * n + k0;
+
+  ArenaScope scope;
+  arena_vector_<T> panel(m * nb);
+  arena_vector_<unsigned> piv(nb);
+  for (std::size_t i = 0; i < m; i++)
+    std::copy(a + i * n, a + i * n + nb, panel.data() + i * nb);
+  lu_panel_rec_(panel.data(), nb, m, nb, piv.data());
+  for (std::size_t i = 0; i < m; i++)
+    std::copy(panel.data() + i * nb, panel.data() + (i + 1) * nb, a + i * n);
+
+  T *rows = M.ptr();
+  for (std::size_t k = 0; k < nb && k0 + k + 1 < n; k++) {
+    std::size_t i = k0 + k, l = k0 + piv[k];
+    p(i, 0) = static_cast<unsigned>(l);
+    if (l == i)
+      continue;
+    std::swap_ranges(rows + i * n, rows + i * n + k0, rows + l * n);
+    std::swap_ranges(rows + i * n + k0 + nb, rows + (i + 1) * n,
+                     rows + l * n + k0 + nb);
+  }
+}
+
+// Blocked factorization of M in place, in the LAPACK layout: whole rows
+// are swapped, so the multipliers end up permuted by every later pivot and
+// PA = LU holds with P the product of the swaps in p.
+template <typename T>
+void lu_in_place_(Matrix<T> &M, Matrix<unsigned> &p) {
+  std::size_t n = M.rows;
+  constexpr std::size_t nb = lu_block_;
+  T *a = M.ptr();
+
+  for (std::size_t k0 = 0; k0 + 1 < n; k0 += nb) {
+    std::size_t kb = std::min(nb, n - k0);
+    lu_panel_(M, p, k0, kb);
+
+    std::size_t k1 = k0 + kb;
+    if (k1 < n) {
+      // U12 = L11^-1 A12.
+      lu_row_solve_(a + std::size_t{k0} * n + k0, n, kb,
+                    a + std::size_t{k0} * n + k1, n, n - k1);
+
+      // A22 = A22 - L21 * U12.
+      std::size_t m2 = n - k1;
+      gemm<T>(m2, m2, kb, T{-1}, a + std::size_t{k1} * n + k0, n, 1,
+              a + std::size_t{k0} * n + k1, n, 1, T{1},
+              a + std::size_t{k1} * n + k1, n, 1);
+    }
+  }
+}
+
+} // namespace internal
+
+template <typename E, typename T = typename E::value_type>
+std::pair<Matrix<T>, Matrix<unsigned>> LUPartialPivot(const MatrixExpr<E> &A) {
+  Matrix<T> M{A.self()};
+  assert(M.rows == M.cols);
+  std::size_t n = M.rows;
 
   Matrix<unsigned> p{n - 1, 1};
-  Matrix<T> M{A};
+  T *a = M.ptr();
 
   // Do the factorization.
-  for (unsigned k = 0; k < n - 1; k++) {
-    p(k, 0) = internal::next_row_(M, k);
-    internal::exchange_row_tails_(M, k, p(k, 0));
+  internal::lu_in_place_(M, p);
 
-    if (M(k, k) != 0) {
-      for (unsigned l = k + 1; l < n; l++)
-        M(l, k) = M(l, k) / M(k, k);
+  // Whole-row swaps left each multiplier column permuted by every later
+  // pivot. Undo that so column k of L holds the Gauss vector of step k, as
+  // in the unblocked algorithm.
+  for (std::size_t k = n - 1; k-- > 1;) {
+    unsigned l = p(k, 0);
+    if (l != k)
+      std::swap_ranges(a + std::size_t{k} * n, a + std::size_t{k} * n + k,
+                       a + std::size_t{l} * n);
+  }
+
+  return std::pair<Matrix<T>, Matrix<unsigned>>{std::move(M), std::move(p)};
+}
+
+/**
+ *  Householder QR, A = QR or, with column pivoting, AP = QR, as in LAPACK's
+ *  dgeqrf and dgeqp3. Q is never formed: each reflector H = I - tau v v^T
+ *  is kept as v below the diagonal of its column, with v = 1 on the
+ *  diagonal implied, and R overwrites the upper triangle.
+ *
+ *  The factorization is blocked in the compact WY form of Schreiber and Van
+ *  Loan (Golub and Van Loan 5.2.3): the reflectors of a panel of qr_block_
+ *  columns are combined as I - V T V^T with T upper triangular, and the
+ *  trailing columns are updated by GEMM. The panel itself is factored a
+ *  column at a time along contiguous rows.
+ *
+ *  Panels taller than qr_rows_ would be streamed through memory once per
+ *  column, so they are factored a block of rows at a time instead, as in
+ *  the sequential TSQR of Demmel, Grigori, Hoemmen and Langou: the first
+ *  block as usual, then each further block stacked under the panel's
+ *  current R, with reflectors that are the identity on R's rows apart from
+ *  their diagonal (as LAPACK's dtpqrt). Each block is factored and applied
+ *  to its own rows of the trailing columns while they are in cache, so a
+ *  tall panel costs one pass over memory.
+ *
+ *  With pivoting the column of largest remaining norm is moved to the front
+ *  at each step. Its norm is downdated rather than recomputed, and the
+ *  trailing update is deferred to one GEMM per panel (Quintana-Orti, Sun
+ *  and Bischof); only the products A^T v stay matrix-vector.
+ */
+
+namespace internal {
+
+// Panel width of the blocked QR, and rows per block of a tall panel.
+constexpr std::size_t qr_block_ = 32;
+constexpr std::size_t qr_rows_ = 4096;
+
+// Column chunk of the panel updates; a whole number of SIMD registers.
+constexpr std::size_t qr_chunk_ = 8;
+
+// One block reflector I - V T V^T: the kb reflectors of columns j0:j0+kb,
+// acting on rows j0:j0+kb and r0:r1, with T (kb x kb) at offset toff of the
+// T storage. An ordinary panel has r0 == j0 and V unit lower trapezoidal;
+// for a stacked block, r0 >= j0 + kb and rows j0:j0+kb of V are the
+// identity.
+struct qr_step_ {
+  std::size_t j0, kb, r0, r1, toff;
+};
+
+// Reflector H = I - tau v v^T with v(0) = 1 mapping (alpha, x) to (beta, 0),
+// from alpha and ||x||^2, as LAPACK's dlarfg. Overwrites alpha with beta,
+// sets the factor to scale x by to get v, and returns tau.
+template <typename T> T householder_(T &alpha, T xnorm2, T &scale) {
+  scale = 1;
+  if (xnorm2 == T{})
+    return T{};
+  T beta = -std::copysign(std::sqrt(alpha * alpha + xnorm2), alpha);
+  T tau = (beta - alpha) / beta;
+  scale = 1 / (alpha - beta);
+  alpha = beta;
+  return tau;
+}
 
-      for (unsigned l = k + 1; l < n; l++)
-        for (unsigned j = k + 1; j < n; j++)
-          M(l, j) = M(l, j) - M(l, k) * M(k, j);
+// Sum of squares of a(r0:r1, j).
+template <typename T>
+T column_norm2_(const T *a, std::size_t lda, std::size_t r0, std::size_t r1,
+                std::size_t j) {
+  return parallel_reduce(
+      r0, r1, parallel_grain_, T{},
+      [&](std::size_t lo, std::size_t hi) {
+        T s{};
+        for (std::size_t i = lo; i < hi; i++)
+          s += a[i * lda + j] * a[i * lda + j];
+        return s;
+      },
+      [](T x, T y) { return x + y; });
+}
+
+// sum(0:w) = the sum over rows [begin, end) of what f(lo, hi, s) adds into
+// the zeroed row s, reduced as by parallel_reduce. Each chunk's partial sum
+// takes a row of work, which holds reduce_chunks_ rows of w.
+template <typename T, typename F>
+void parallel_row_sum_(std::size_t begin, std::size_t end, std::size_t grain,
+                       std::size_t w, T *work, T *sum, F &&f) {
+  std::atomic<unsigned> next{0};
+  std::fill(sum, sum + w, T{});
+  parallel_reduce(
+      begin, end, grain, sum,
+      [&](std::size_t lo, std::size_t hi) {
+        T *s = work + next++ * w;
+        std::fill(s, s + w, T{});
+        f(lo, hi, s);
+        return s;
+      },
+      [w](T *acc, const T *s) {
+        for (std::size_t c = 0; c < w; c++)
+          acc[c] += s[c];
+        return acc;
+      });
+}
+
+// The triangular factor T of step s, from tau(j0:j0+kb), as LAPACK's
+// dlarft. T has row stride kb.
+template <typename T>
+void qr_block_factor_(const T *a, std::size_t lda, const qr_step_ &s,
+                      const T *tau, T *t) {
+  std::size_t kb = s.kb, rest = std::max(s.r0, s.j0 + kb);
+  const T *v = a + s.j0 * lda + s.j0;
+  const T *vr = a + rest * lda + s.j0;
+
+  // G = V^T V: the rows below the top kb x kb block by GEMM, then the unit
+  // lower triangle on top of an ordinary panel.
+  ArenaScope scope;
+  arena_vector_<T> g(kb * kb);
+  gemm<T>(kb, kb, s.r1 - rest, T{1}, vr, 1, lda, vr, lda, 1, T{}, g.data(),
+          kb, 1);
+  if (s.r0 == s.j0)
+    for (std::size_t j = 0; j < kb; j++)
+      for (std::size_t r = 0; r < j; r++) {
+        T sum = v[j * lda + r];
+        for (std::size_t i = j + 1; i < kb; i++)
+          sum += v[i * lda + r] * v[i * lda + j];
+        g[r * kb + j] += sum;
+      }
+
+  // T(0:j, j) = -tau_j T(0:j, 0:j) V(:, 0:j)^T v_j.
+  for (std::size_t j = 0; j < kb; j++) {
+    T tj = tau[s.j0 + j];
+    for (std::size_t r = j + 1; r < kb; r++)
+      t[r * kb + j] = T{};
+    t[j * kb + j] = tj;
+    for (std::size_t r = 0; r < j; r++) {
+      T sum{};
+      for (std::size_t q = r; q < j; q++)
+        sum += t[r * kb + q] * g[q * kb + j];
+      t[r * kb + j] = -tj * sum;
     }
   }
+}
+
+// Apply step s, I - V T V^T, or its transpose if trans, to nc columns of
+// c, which points at row j0 and has row stride ldc; as LAPACK's dlarfb. T
+// has row stride ldt.
+template <typename T>
+void qr_block_apply_(bool trans, const T *a, std::size_t lda,
+                     const qr_step_ &s, const T *t, std::size_t ldt, T *c,
+                     std::size_t ldc, std::size_t nc) {
+  std::size_t kb = s.kb, rest = std::max(s.r0, s.j0 + kb);
+  bool unit_lower = s.r0 == s.j0;
+  const T *v = a + s.j0 * lda + s.j0;
+  const T *vr = a + rest * lda + s.j0;
+  T *cr = c + (rest - s.j0) * ldc;
+  ArenaScope scope;
+  arena_vector_<T> w(kb * nc), w2(kb * nc);
+
+  // W = V^T C.
+  for (std::size_t r = 0; r < kb; r++) {
+    T *wr = w.data() + r * nc;
+    std::copy(c + r * ldc, c + r * ldc + nc, wr);
+    for (std::size_t i = r + 1; unit_lower && i < kb; i++) {
+      T vir = v[i * lda + r];
+      const T *ci = c + i * ldc;
+      for (std::size_t q = 0; q < nc; q++)
+        wr[q] += vir * ci[q];
+    }
+  }
+  gemm<T>(kb, nc, s.r1 - rest, T{1}, vr, 1, lda, cr, ldc, 1, T{1}, w.data(),
+          nc, 1);
+
+  // W = op(T) W.
+  gemm<T>(kb, nc, kb, T{1}, t, trans ? 1 : ldt, trans ? ldt : 1, w.data(),
+          nc, 1, T{}, w2.data(), nc, 1);
 
-  return std::pair<Matrix<T>, Matrix<unsigned>>{M, p};
+  // C -= V W.
+  gemm<T>(s.r1 - rest, nc, kb, T{-1}, vr, lda, 1, w2.data(), nc, 1, T{1}, cr,
+          ldc, 1);
+  for (std::size_t i = 0; i < kb; i++) {
+    T *ci = c + i * ldc;
+    const T *wi = w2.data() + i * nc;
+    for (std::size_t q = 0; q < nc; q++)
+      ci[q] -= wi[q];
+    for (std::size_t r = 0; unit_lower && r < i; r++) {
+      T vir = v[i * lda + r];
+      const T *wr = w2.data() + r * nc;
+      for (std::size_t q = 0; q < nc; q++)
+        ci[q] -= vir * wr[q];
+    }
+  }
 }
 
-template <typename T> unsigned rank(const Matrix<T> &A) {
-  std::pair<Matrix<double>, Matrix<unsigned>> factorization =
-      matrix::LUPartialPivot(A);
-  Matrix<double> M = std::move(factorization.first);
+// QR of the panel of step s over its rows, writing its T (row stride kb).
+// The rows are copied to a buffer qr_block_ wide and zero padded: rows
+// j0:r1 of an ordinary panel, or the upper triangle R in rows j0:j0+kb
+// stacked on rows r0:r1, whose zeros below the diagonal stay zero, as do
+// the reflectors' entries there. Each column takes two passes over the
+// buffer. With a fixed row width the sums of a pass stay in registers, and
+// the first pass also gives the V^T v that T is built from (dlarft).
+template <typename T>
+void qr_panel_(T *a, std::size_t lda, const qr_step_ &s, T *t) {
+  constexpr std::size_t nb = qr_block_;
+  std::size_t kb = s.kb, top = s.r0 == s.j0 ? 0 : kb;
+  std::size_t mp = top + s.r1 - s.r0;
+  auto row = [&](std::size_t i) {
+    return a + (i < top ? s.j0 + i : s.r0 + i - top) * lda + s.j0;
+  };
+
+  ArenaScope scope;
+  arena_vector_<T> p(mp * nb);
+  for (std::size_t i = 0; i < mp; i++) {
+    std::size_t c0 = i < top ? i : 0;
+    std::copy(row(i) + c0, row(i) + kb, p.data() + i * nb + c0);
+  }
+
+  T norm2{};
+  for (std::size_t i = 1; i < mp; i++)
+    norm2 += p[i * nb] * p[i * nb];
+
+  for (std::size_t j = 0; j < kb; j++) {
+    T scale;
+    T tj = householder_(p[j * nb + j], norm2, scale);
+
+    // Scale x to v, and form z = p^T v with v = 1 in row j: the columns
+    // right of j give the update, the ones left of it V^T v. (v is stored
+    // after the row is read, so the loads don't wait on the store.)
+    T z[nb];
+    std::copy(p.data() + j * nb, p.data() + (j + 1) * nb, z);
+    for (std::size_t i = j + 1; i < mp; i++) {
+      T *pi = p.data() + i * nb;
+      T vi = pi[j] * scale;
+      for (std::size_t c = 0; c < nb; c++)
+        z[c] += vi * pi[c];
+      pi[j] = vi;
+    }
+
+    // T(0:j, j) = -tau_j T(0:j, 0:j) V(:, 0:j)^T v_j.
+    for (std::size_t r = 0; r < j; r++) {
+      T sum{};
+      for (std::size_t q = r; q < j; q++)
+        sum += t[r * kb + q] * z[q];
+      t[r * kb + j] = -tj * sum;
+      t[j * kb + r] = T{};
+    }
+    t[j * kb + j] = tj;
+
+    // Columns right of j -= tau v z^T, from the chunk of qr_chunk_ columns
+    // holding column j + 1 on, summing the squares of column j + 1.
+    T w[nb];
+    for (std::size_t c = 0; c < nb; c++)
+      w[c] = c > j ? tj * z[c] : T{};
+    for (std::size_t c = 0; c < nb; c++)
+      p[j * nb + c] -= w[c];
+    norm2 = T{};
+    std::size_t next = std::min(j + 1, nb - 1);
+    std::size_t c0 = next / qr_chunk_ * qr_chunk_;
+    for (std::size_t i = j + 1; i < mp; i++) {
+      T *pi = p.data() + i * nb;
+      T vi = pi[j];
+      for (std::size_t cc = c0; cc < nb; cc += qr_chunk_)
+        for (std::size_t c = cc; c < cc + qr_chunk_; c++)
+          pi[c] -= vi * w[c];
+      if (i > j + 1)
+        norm2 += pi[next] * pi[next];
+    }
+  }
 
+  for (std::size_t i = 0; i < mp; i++) {
+    std::size_t c0 = i < top ? i : 0;
+    std::copy(p.data() + i * nb + c0, p.data() + i * nb + kb, row(i) + c0);
+  }
+}
+
+// Record step s and build its T from tau.
+template <typename T>
+const qr_step_ &qr_add_step_(const Matrix<T> &M, std::vector<qr_step_> &steps,
+                             std::vector<T> &t, qr_step_ s, const T *tau) {
+  s.toff = t.size();
+  steps.push_back(s);
+  t.resize(t.size() + s.kb * s.kb);
+  qr_block_factor_(M.ptr(), M.cols, s, tau, t.data() + s.toff);
+  return steps.back();
+}
+
+// Apply the steps of a factorization of an m x n matrix a to nc columns of
+// the m x nc matrix c: Q^T c if trans, else Q c.
+template <typename T>
+void qr_apply_(bool trans, const T *a, std::size_t lda,
+               const std::vector<qr_step_> &steps, const std::vector<T> &t,
+               T *c, std::size_t ldc, std::size_t nc) {
+  // Q is the product of the steps in order, so Q^T applies them in order.
+  for (std::size_t i = 0; i < steps.size(); i++) {
+    const qr_step_ &s = trans ? steps[i] : steps[steps.size() - 1 - i];
+    qr_block_apply_(trans, a, lda, s, t.data() + s.toff, s.kb, c + s.j0 * ldc,
+                    ldc, nc);
+  }
+}
+
+// Blocked QR of M in place.
+template <typename T>
+void qr_in_place_(Matrix<T> &M, std::vector<qr_step_> &steps,
+                  std::vector<T> &t) {
+  std::size_t m = M.rows, n = M.cols, k = std::min(m, n);
+  T *a = M.ptr();
+
+  for (std::size_t j0 = 0; j0 < k; j0 += qr_block_) {
+    std::size_t kb = std::min(qr_block_, k - j0), j1 = j0 + kb;
+    for (std::size_t r0 = j0; r0 < m;) {
+      std::size_t r1 = std::min(m, r0 + qr_rows_);
+      qr_step_ s{j0, kb, r0, r1, t.size()};
+      t.resize(t.size() + kb * kb);
+      qr_panel_(a, n, s, t.data() + s.toff);
+      if (j1 < n)
+        qr_block_apply_(true, a, n, s, t.data() + s.toff, kb, a + j0 * n + j1,
+                        n, n - j1);
+      steps.push_back(s);
+      r0 = r1;
+    }
+  }
+}
+
+// One panel of the pivoted QR, as LAPACK's dlaqps: factors up to nb columns
+// from j0 on, choosing each pivot by the partial column norms vn1 (vn2 holds
+// the norms they were last computed exactly at). The trailing update is
+// kept as A(rk:m, :) -= V F^T and applied by one GEMM at the end. Stops
+// early when a downdated norm has lost too many digits, and returns the
+// number of columns factored.
+template <typename T>
+std::size_t qr_pivot_panel_(T *a, std::size_t lda, std::size_t m,
+                            std::size_t n, std::size_t j0, std::size_t nb,
+                            T *tau, unsigned *jpvt, std::vector<T> &vn1,
+                            std::vector<T> &vn2) {
+  std::size_t nf = n - j0, last_rk = std::min(m, n);
+  std::size_t grain = parallel_grain_ / (nf + 1) + 1;
+  ArenaScope scope;
+  arena_vector_<T> f(nf * nb), z(nf), work(reduce_chunks_ * nf);
+  arena_vector_<std::size_t> stale;
+  stale.reserve(nf);
+  const T tol3z = std::sqrt(std::numeric_limits<T>::epsilon());
+
+  std::size_t k = 0;
+  for (; k < nb && stale.empty(); k++) {
+    std::size_t rk = j0 + k, col = j0 + k;
+
+    std::size_t pvt =
+        std::max_element(vn1.begin() + col, vn1.end()) - vn1.begin();
+    if (pvt != col) {
+      for (std::size_t i = 0; i < m; i++)
+        std::swap(a[i * lda + pvt], a[i * lda + col]);
+      std::swap_ranges(f.data() + (pvt - j0) * nb,
+                       f.data() + (pvt - j0) * nb + k, f.data() + k * nb);
+      std::swap(jpvt[pvt], jpvt[col]);
+      vn1[pvt] = vn1[col];
+      vn2[pvt] = vn2[col];
+    }
+
+    // Bring column col up to date: a(rk:m, col) -= a(rk:m, j0:col) F(k, :)^T.
+    const T *fk = f.data() + k * nb;
+    T norm2 = parallel_reduce(
+        rk, m, grain, T{},
+        [&](std::size_t lo, std::size_t hi) {
+          T s{};
+          for (std::size_t i = lo; i < hi; i++) {
+            T *row = a + i * lda;
+            T d{};
+            for (std::size_t r = 0; r < k; r++)
+              d += row[j0 + r] * fk[r];
+            row[col] -= d;
+            if (i > rk)
+              s += row[col] * row[col];
+          }
+          return s;
+        },
+        [](T x, T y) { return x + y; });
+
+    T scale;
+    T akk = a[rk * lda + col];
+    tau[col] = householder_(akk, norm2, scale);
+    a[rk * lda + col] = 1;
+
+    // Scale x to v, and form z = a(rk:m, j0:n)^T v.
+    parallel_row_sum_(rk, m, grain, nf, work.data(), z.data(),
+                      [&](std::size_t lo, std::size_t hi, T *s) {
+                        for (std::size_t i = lo; i < hi; i++) {
+                          T *row = a + i * lda;
+                          T vi = i > rk ? row[col] *= scale : T{1};
+                          for (std::size_t c = 0; c < nf; c++)
+                            s[c] += vi * row[j0 + c];
+                        }
+                      });
+
+    // F(:, k) = tau (A^T v - F V^T v), with only the trailing columns of
+    // A^T v and the panel's own columns of V^T v.
+    for (std::size_t c = 0; c < nf; c++)
+      f[c * nb + k] = c > k ? tau[col] * z[c] : T{};
+    for (std::size_t r = 0; r < k; r++) {
+      T aux = -tau[col] * z[r];
+      for (std::size_t c = 0; c < nf; c++)
+        f[c * nb + k] += f[c * nb + r] * aux;
+    }
+
+    // Bring row rk up to date: a(rk, col+1:n) -= a(rk, j0:col+1) F^T.
+    T *ark = a + rk * lda + j0;
+    for (std::size_t c = k + 1; c < nf; c++) {
+      T d{};
+      for (std::size_t r = 0; r <= k; r++)
+        d += ark[r] * f[c * nb + r];
+      ark[c] -= d;
+    }
+
+    // Downdate the norms of the trailing columns.
+    if (rk + 1 < last_rk)
+      for (std::size_t j = col + 1; j < n; j++) {
+        if (vn1[j] == T{})
+          continue;
+        T s = std::abs(a[rk * lda + j]) / vn1[j];
+        s = std::max(T{}, (1 + s) * (1 - s));
+        T ratio = vn1[j] / vn2[j];
+        if (s * ratio * ratio <= tol3z)
+          stale.push_back(j);
+        else
+          vn1[j] *= std::sqrt(s);
+      }
+    a[rk * lda + col] = akk;
+  }
+
+  // A(rk:m, j0+k:n) -= A(rk:m, j0:j0+k) F(k:nf, :)^T.
+  std::size_t rk = j0 + k;
+  if (k < std::min(nf, m - j0))
+    gemm<T>(m - rk, nf - k, k, T{-1}, a + rk * lda + j0, lda, 1,
+            f.data() + k * nb, 1, nb, T{1}, a + rk * lda + j0 + k, lda, 1);
+
+  for (std::size_t j : stale)
+    vn1[j] = vn2[j] = std::sqrt(column_norm2_(a, lda, rk, m, j));
+  return k;
+}
+
+// QR with column pivoting of M in place; column j of AP is column p(j, 0)
+// of A.
+template <typename T>
+void qr_pivot_in_place_(Matrix<T> &M, Matrix<unsigned> &p,
+                        std::vector<qr_step_> &steps, std::vector<T> &t) {
+  std::size_t m = M.rows, n = M.cols, k = std::min(m, n);
+  T *a = M.ptr();
+  std::vector<T> tau(k);
+  for (std::size_t j = 0; j < n; j++)
+    p(j, 0) = static_cast<unsigned>(j);
+
+  std::vector<T> vn1(n);
+  {
+    ArenaScope scope;
+    arena_vector_<T> work(reduce_chunks_ * n);
+    parallel_row_sum_(0, m, parallel_grain_ / (n + 1) + 1, n, work.data(),
+                      vn1.data(), [&](std::size_t lo, std::size_t hi, T *s) {
+                        for (std::size_t i = lo; i < hi; i++)
+                          for (std::size_t j = 0; j < n; j++)
+                            s[j] += a[i * n + j] * a[i * n + j];
+                      });
+  }
+  for (T &x : vn1)
+    x = std::sqrt(x);
+  std::vector<T> vn2 = vn1;
+
+  for (std::size_t j = 0; j < k;)
+    j += qr_pivot_panel_(a, n, m, n, j, std::min(qr_block_, k - j),
+                         tau.data(), p.ptr(), vn1, vn2);
+
+  for (std::size_t j0 = 0; j0 < k; j0 += qr_block_) {
+    std::size_t kb = std::min(qr_block_, k - j0);
+    qr_add_step_(M, steps, t, qr_step_{j0, kb, j0, m, 0}, tau.data());
+  }
+}
+
+// The min(m, n) x n upper trapezoid of M.
+template <typename T> Matrix<T> qr_upper_(const Matrix<T> &M) {
+  std::size_t n = M.cols;
+  Matrix<T> R{std::min(M.rows, M.cols), M.cols};
+  for (std::size_t i = 0; i < R.rows; i++)
+    std::copy(M.ptr() + i * n + i, M.ptr() + (i + 1) * n, R.ptr() + i * n + i);
+  return R;
+}
+
+// Number of diagonal entries of R larger than tol in absolute value. A
+// negative tol means dim eps |R(0, 0)|, with dim the larger dimension of
+// the factored matrix, as in MATLAB's rank().
+template <typename T>
+unsigned qr_rank_(const Matrix<T> &R, T tol, std::size_t dim) {
+  std::size_t k = std::min(R.rows, R.cols);
+  if (k == 0)
+    return 0;
+  if (tol < T{})
+    tol = dim * std::numeric_limits<T>::epsilon() * std::abs(R(0, 0));
   unsigned rank = 0;
-  for (unsigned i = 0; i < M.cols; i++)
-    if (M(i, i) != 0.0)
+  for (std::size_t i = 0; i < k; i++)
+    if (std::abs(R(i, i)) > tol)
       rank++;
-
   return rank;
 }
 
+// Rank of M from its pivoted QR, overwriting M.
+template <typename T>
+unsigned qr_pivot_rank_(Matrix<T> &M, T tol, std::size_t dim) {
+  Matrix<unsigned> p{M.cols, 1};
+  std::vector<qr_step_> steps;
+  std::vector<T> t;
+  qr_pivot_in_place_(M, p, steps, t);
+  return qr_rank_(M, tol, dim);
+}
+
+} // namespace internal
+
+/**
+ *  Numerical rank of A from a column-pivoted QR: the number of diagonal
+ *  entries of R above tol in absolute value. The default tolerance is
+ *  max(m, n) eps |R(0, 0)|. Works for any shape; a matrix at least twice as
+ *  tall as it is wide is reduced to its n x n R by the unpivoted QR first,
+ *  which has the same singular values and is much cheaper to pivot.
+ */
+
+template <typename E, typename T = typename E::value_type>
+unsigned rank(const MatrixExpr<E> &A, T tol = T{-1}) {
+  Matrix<T> M{A.self()};
+  std::size_t dim = std::max(M.rows, M.cols);
+  if (M.rows < 2 * M.cols)
+    return internal::qr_pivot_rank_(M, tol, dim);
+
+  std::vector<internal::qr_step_> steps;
+  std::vector<T> t;
+  internal::qr_in_place_(M, steps, t);
+  Matrix<T> R = internal::qr_upper_(M);
+  return internal::qr_pivot_rank_(R, tol, dim);
+}
+
+/**
+ *  LDL^T factorization of a symmetric matrix with Bunch-Kaufman pivoting,
+ *  as in LAPACK's dsytrf: P A P^T = L D L^T, with L unit lower triangular
+ *  and D block diagonal with 1 x 1 and 2 x 2 blocks. Works for indefinite
+ *  matrices, where Cholesky fails, with half the flops of LU, and reads
+ *  only the lower triangle of A.
+ *
+ *  The columns are factored in panels of ldlt_block_ as in dlasyf: each
+ *  column of a panel is brought up to date only when it is reached, and
+ *  the trailing matrix is then updated once per panel through GEMM.
+ *
+ *  Returns (M, p) in LAPACK's layout: D and the multipliers of L in the
+ *  lower triangle of M (the upper triangle is left as it was). p(k, 0) = l
+ *  >= 0 means a 1 x 1 block at k after swapping rows and columns k and l;
+ *  p(k, 0) = p(k + 1, 0) = -(l + 1) means a 2 x 2 block at k, k + 1 after
+ *  swapping k + 1 and l.
+ */
+
+namespace internal {
+
+// Panel width of the blocked LDL^T.
+constexpr std::size_t ldlt_block_ = 64;
+
+// Columns k0:n, one 1 x 1 or 2 x 2 pivot at a time, as in dsytf2. Only
+// columns k0 and up are read or written.
+template <typename T>
+void ldlt_unblocked_(Matrix<T> &M, Matrix<int> &p, std::size_t k0) {
+  std::size_t n = M.rows;
+  T *a = M.ptr();
+  auto at = [=](std::size_t i, std::size_t j) -> T & { return a[i * n + j]; };
+  const T alpha = (1 + std::sqrt(T{17})) / 8;
+
+  // Columns k and k + 1 of the trailing block, contiguous.
+  std::vector<T> w1(n), w2(n);
+  std::size_t grain = parallel_grain_ / (n + 1) + 1;
+
+  for (std::size_t k = k0; k < n;) {
+    std::size_t kstep = 1, kp = k;
+    T absakk = std::abs(at(k, k)), colmax = 0;
+    std::size_t imax = k;
+    for (std::size_t i = k + 1; i < n; i++)
+      if (std::abs(at(i, k)) > colmax) {
+        colmax = std::abs(at(i, k));
+        imax = i;
+      }
+
+    if (std::max(absakk, colmax) == T{}) {
+      p(k, 0) = static_cast<int>(k); // Zero column: D(k, k) = 0, singular.
+      k++;
+      continue;
+    }
+
+    if (absakk < alpha * colmax) {
+      // Largest off-diagonal entry in row/column imax of the trailing block.
+      T rowmax = 0;
+      for (std::size_t j = k; j < imax; j++)
+        rowmax = std::max(rowmax, std::abs(at(imax, j)));
+      for (std::size_t i = imax + 1; i < n; i++)
+        rowmax = std::max(rowmax, std::abs(at(i, imax)));
+
+      if (absakk >= alpha * colmax * (colmax / rowmax))
+        kp = k;
+      else if (std::abs(at(imax, imax)) >= alpha * rowmax)
+        kp = imax;
+      else {
+        kp = imax;
+        kstep = 2;
+      }
+    }
+
+    // Symmetric swap of kk and kp in the trailing block's lower triangle.
+    std::size_t kk = k + kstep - 1;
+    if (kp != kk) {
+      for (std::size_t i = kp + 1; i < n; i++)
+        std::swap(at(i, kk), at(i, kp));
+      for (std::size_t j = kk + 1; j < kp; j++)
+        std::swap(at(j, kk), at(kp, j));
+      std::swap(at(kk, kk), at(kp, kp));
+      if (kstep == 2)
+        std::swap(at(k + 1, k), at(kp, k));
+    }
+
+    if (kstep == 1) {
+      // A22 -= l d l^T, then l = column / d.
+      T d = 1 / at(k, k);
+      for (std::size_t i = k + 1; i < n; i++)
+        w1[i] = at(i, k);
+      parallel_for(k + 1, n, grain, [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t i = lo; i < hi; i++) {
+          T t = w1[i] * d;
+          T *row = a + i * n;
+          for (std::size_t j = k + 1; j <= i; j++)
+            row[j] -= t * w1[j];
+          row[k] = t;
+        }
+      });
+    } else {
+      // A22 -= [l1 l2] D [l1 l2]^T with the 2 x 2 block D, written so as
+      // not to form D^{-1} explicitly (as in dsytf2).
+      T d21 = at(k + 1, k);
+      T d11 = at(k + 1, k + 1) / d21;
+      T d22 = at(k, k) / d21;
+      T t = 1 / (d11 * d22 - 1);
+      d21 = t / d21;
+      for (std::size_t j = k + 2; j < n; j++) {
+        T ak = at(j, k), ak1 = at(j, k + 1);
+        w1[j] = d21 * (d11 * ak - ak1);
+        w2[j] = d21 * (d22 * ak1 - ak);
+      }
+      parallel_for(k + 2, n, grain, [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t i = lo; i < hi; i++) {
+          T *row = a + i * n;
+          T ak = row[k], ak1 = row[k + 1];
+          for (std::size_t j = k + 2; j <= i; j++)
+            row[j] -= ak * w1[j] + ak1 * w2[j];
+          row[k] = w1[i];
+          row[k + 1] = w2[i];
+        }
+      });
+    }
+
+    if (kstep == 1)
+      p(k, 0) = static_cast<int>(kp);
+    else
+      p(k, 0) = p(k + 1, 0) = -static_cast<int>(kp) - 1;
+    k += kstep;
+  }
+}
+
+// Factor columns k0, k0 + 1, ... as dlasyf does, until nb - 1 or nb of
+// them are done, and update the trailing matrix with them. Returns the
+// number of columns factored.
+//
+// W = L D holds the panel's columns as updated when they were pivoted, so
+// A22 - L D L^T = A22 - L W^T. W and a copy of the panel's columns of L are
+// kept column by column, so that bringing a column up to date is a series
+// of contiguous axpys. Rows swapped within the panel are swapped in both,
+// and in the panel's columns of M, so the trailing update sees them in
+// their final order; the swaps in M are undone at the end to keep dsytf2's
+// layout of L.
+template <typename T>
+std::size_t ldlt_panel_(Matrix<T> &M, Matrix<int> &p, std::size_t k0,
+                        std::size_t nb) {
+  std::size_t n = M.rows, m = n - k0;
+  T *a = M.ptr();
+  auto at = [=](std::size_t i, std::size_t j) -> T & { return a[i * n + j]; };
+  const T alpha = (1 + std::sqrt(T{17})) / 8;
+
+  ArenaScope scope;
+  arena_vector_<T> w_cols(m * nb), l_cols(m * nb), diag(nb * nb);
+  // Entry i of column c of W (and L) is at W(c)[i], for i >= k0.
+  auto W = [&](std::size_t c) { return w_cols.data() + c * m - k0; };
+  auto L = [&](std::size_t c) { return l_cols.data() + c * m - k0; };
+
+  // Rows k:n of column c of W: column col of the trailing matrix, less the
+  // panel columns to the left of c.
+  auto update_column = [&](std::size_t k, std::size_t col, std::size_t c) {
+    std::size_t kc = k - k0;
+    T *w = W(c);
+    std::size_t grain = parallel_grain_ / (kc + 1) + 1;
+    parallel_for(k, n, grain, [&](std::size_t lo, std::size_t hi) {
+      for (std::size_t i = lo; i < hi; i++)
+        w[i] = i < col ? at(col, i) : at(i, col);
+      for (std::size_t q = 0; q < kc; q++) {
+        T f = W(q)[col];
+        const T *l = L(q);
+        for (std::size_t i = lo; i < hi; i++)
+          w[i] -= l[i] * f;
+      }
+    });
+  };
+
+  std::size_t k = k0;
+  while (k - k0 + 1 < nb) {
+    std::size_t c = k - k0;
+    std::size_t kstep = 1, kp = k;
+    update_column(k, k, c);
+    T *w0 = W(c), *w1 = W(c + 1);
+
+    T absakk = std::abs(w0[k]), colmax = 0;
+    std::size_t imax = k;
+    for (std::size_t i = k + 1; i < n; i++)
+      if (std::abs(w0[i]) > colmax) {
+        colmax = std::abs(w0[i]);
+        imax = i;
+      }
+
+    if (std::max(absakk, colmax) == T{}) {
+      // Zero column: D(k, k) = 0, singular.
+      for (std::size_t i = k; i < n; i++)
+        at(i, k) = L(c)[i] = w0[i];
+      p(k, 0) = static_cast<int>(k);
+      k++;
+      continue;
+    }
+
+    if (absakk < alpha * colmax) {
+      update_column(k, imax, c + 1);
+      T rowmax = 0;
+      for (std::size_t i = k; i < n; i++)
+        if (i != imax)
+          rowmax = std::max(rowmax, std::abs(w1[i]));
+
+      if (absakk >= alpha * colmax * (colmax / rowmax))
+        kp = k;
+      else if (std::abs(w1[imax]) >= alpha * rowmax) {
+        kp = imax;
+        std::copy(w1 + k, w1 + n, w0 + k);
+      } else {
+        kp = imax;
+        kstep = 2;
+      }
+    }
+
+    // Move the not yet updated column kk of the trailing matrix to kp, and
+    // swap rows kk and kp of the panel.
+    std::size_t kk = k + kstep - 1;
+    if (kp != kk) {
+      at(kp, kp) = at(kk, kk);
+      for (std::size_t i = kk + 1; i < kp; i++)
+        at(kp, i) = at(i, kk);
+      for (std::size_t i = kp + 1; i < n; i++)
+        at(i, kp) = at(i, kk);
+      std::swap_ranges(a + kk * n + k0, a + kk * n + k, a + kp * n + k0);
+      for (std::size_t q = 0; q < c; q++)
+        std::swap(L(q)[kk], L(q)[kp]);
+      for (std::size_t q = 0; q <= kk - k0; q++)
+        std::swap(W(q)[kk], W(q)[kp]);
+    }
+
+    if (kstep == 1) {
+      T d = w0[k];
+      T *l = L(c);
+      at(k, k) = d;
+      for (std::size_t i = k + 1; i < n; i++)
+        at(i, k) = l[i] = w0[i] / d;
+    } else {
+      // As in the unblocked code, without forming D^{-1}.
+      T d21 = w0[k + 1];
+      T d11 = w1[k + 1] / d21;
+      T d22 = w0[k] / d21;
+      T t = 1 / (d11 * d22 - 1);
+      d21 = t / d21;
+      T *l0 = L(c), *l1 = L(c + 1);
+      for (std::size_t j = k + 2; j < n; j++) {
+        at(j, k) = l0[j] = d21 * (d11 * w0[j] - w1[j]);
+        at(j, k + 1) = l1[j] = d21 * (d22 * w1[j] - w0[j]);
+      }
+      at(k, k) = w0[k];
+      at(k + 1, k) = w0[k + 1];
+      at(k + 1, k + 1) = w1[k + 1];
+    }
+
+    if (kstep == 1)
+      p(k, 0) = static_cast<int>(kp);
+    else
+      p(k, 0) = p(k + 1, 0) = -static_cast<int>(kp) - 1;
+    k += kstep;
+  }
+  std::size_t kb = k - k0;
+
+  // Lower triangle of A22 -= L21 W21^T, by block columns: the diagonal
+  // block through a scratch product, the rest straight into M.
+  for (std::size_t j = k; j < n; j += nb) {
+    std::size_t jb = std::min(nb, n - j);
+    gemm<T>(jb, jb, kb, T{1}, L(0) + j, 1, m, W(0) + j, m, 1, T{},
+            diag.data(), jb, 1);
+    for (std::size_t i = 0; i < jb; i++)
+      for (std::size_t l = 0; l <= i; l++)
+        at(j + i, j + l) -= diag[i * jb + l];
+    if (j + jb < n)
+      gemm<T>(n - j - jb, jb, kb, T{-1}, L(0) + j + jb, 1, m, W(0) + j, m, 1,
+              T{1}, a + (j + jb) * n + j, n, 1);
+  }
+
+  // Undo the swaps of each block in the panel columns to its left.
+  for (std::size_t j = k; j > k0;) {
+    std::size_t jj = j - 1, jp;
+    if (p(jj, 0) < 0) {
+      jp = static_cast<std::size_t>(-p(jj, 0) - 1);
+      j -= 2;
+    } else {
+      jp = static_cast<std::size_t>(p(jj, 0));
+      j -= 1;
+    }
+    if (jp != jj && j > k0)
+      std::swap_ranges(a + jj * n + k0, a + jj * n + j, a + jp * n + k0);
+  }
+
+  return kb;
+}
+
+template <typename T> void ldlt_in_place_(Matrix<T> &M, Matrix<int> &p) {
+  std::size_t n = M.rows, k = 0;
+  while (n - k > ldlt_block_)
+    k += ldlt_panel_(M, p, k, ldlt_block_);
+  ldlt_unblocked_(M, p, k);
+}
+
+} // namespace internal
+
+template <typename E, typename T = typename E::value_type>
+std::pair<Matrix<T>, Matrix<int>> LDLTBunchKaufman(const MatrixExpr<E> &A) {
+  Matrix<T> M{A.self()};
+  assert(M.rows == M.cols);
+  Matrix<int> p{M.rows, 1};
+  internal::ldlt_in_place_(M, p);
+  return std::pair<Matrix<T>, Matrix<int>>{std::move(M), std::move(p)};
+}
+
+/**
+ *  Tiled factorizations, scheduled as a task graph (see task_graph.hpp).
+ *
+ *  The matrix is split into square tiles and each step of the blocked
+ *  algorithm becomes one task per tile (panel, row swaps + triangular solve,
+ *  GEMM update). The tasks run as soon as the tiles they read are final, so
+ *  the serial panel factorization of one step overlaps with the trailing
+ *  updates of the previous step instead of leaving cores idle at the end of
+ *  every fork-join phase.
+ *
+ *  LUPartialPivotTiled returns the same (M, p) pair as LUPartialPivot.
+ *  CholeskyTiled returns the lower triangular L with A = L * L^T, reading
+ *  only the lower triangle of A.
+ */
+
+namespace internal {
+
+// Tile width of the tiled factorizations. Cholesky's tiles are wider: its
+// tasks do half the work of LU's, and 128 wide tiles leave its GEMMs too
+// small to run at full speed.
+constexpr unsigned tile_size_ = 128;
+constexpr unsigned chol_tile_size_ = 192;
+
+// Unblocked LU of the panel a(c0:n, c0:c1), swapping rows only within the
+// panel; pivots go to p[c0:c1].
+template <typename T>
+void lu_tile_panel_(T *a, std::size_t n, std::size_t c0, std::size_t c1,
+                    unsigned *p) {
+  for (std::size_t k = c0; k < std::min(c1, n - 1); k++) {
+    std::size_t piv = k;
+    T max_val = std::abs(a[k * n + k]);
+    for (std::size_t i = k + 1; i < n; i++)
+      if (std::abs(a[i * n + k]) > max_val) {
+        max_val = std::abs(a[i * n + k]);
+        piv = i;
+      }
+    p[k] = static_cast<unsigned>(piv);
+    if (piv != k)
+      std::swap_ranges(a + k * n + c0, a + k * n + c1, a + piv * n + c0);
+
+    if (a[k * n + k] != 0) {
+      const T *row_k = a + k * n;
+      for (std::size_t l = k + 1; l < n; l++) {
+        T *row_l = a + l * n;
+        T tau = row_l[k] = row_l[k] / row_k[k];
+        for (std::size_t j = k + 1; j < c1; j++)
+          row_l[j] -= tau * row_k[j];
+      }
+    }
+  }
+}
+
+// Apply the pivots of panel c0:c1 to columns j0:j1, then solve the block
+// row against the panel's unit lower triangle.
+template <typename T>
+void lu_tile_swap_solve_(T *a, std::size_t n, std::size_t c0, std::size_t c1,
+                         std::size_t j0, std::size_t j1, const unsigned *p) {
+  for (std::size_t k = c0; k < std::min(c1, n - 1); k++)
+    if (p[k] != k)
+      std::swap_ranges(a + k * n + j0, a + k * n + j1, a + p[k] * n + j0);
+
+  for (std::size_t i = c0 + 1; i < c1; i++) {
+    T *row_i = a + i * n;
+    for (std::size_t l = c0; l < i; l++) {
+      T tau = row_i[l];
+      const T *row_l = a + l * n;
+      for (std::size_t j = j0; j < j1; j++)
+        row_i[j] -= tau * row_l[j];
+    }
+  }
+}
+
+// Cholesky factor of the diagonal tile a(c0:c1, c0:c1), in place, in
+// column blocks whose updates from the blocks to their left go through
+// GEMM. This also writes the tile's upper triangle, which CholeskyTiled
+// clears at the end.
+template <typename T>
+void chol_tile_potrf_(T *a, std::size_t n, std::size_t c0, std::size_t c1) {
+  constexpr std::size_t nb = 32;
+  for (std::size_t j0 = c0; j0 < c1; j0 += nb) {
+    std::size_t j1 = std::min(c1, j0 + nb);
+    if (j0 > c0)
+      gemm<T>(c1 - j0, j1 - j0, j0 - c0, T{-1}, a + j0 * n + c0, n, 1,
+              a + j0 * n + c0, 1, n, T{1}, a + j0 * n + j0, n, 1);
+
+    for (std::size_t j = j0; j < j1; j++) {
+      T *row_j = a + j * n;
+      T d = row_j[j];
+      for (std::size_t l = j0; l < j; l++)
+        d -= row_j[l] * row_j[l];
+      if (!(d > 0))
+        throw std::domain_error("Matrix is not positive definite.");
+      row_j[j] = std::sqrt(d);
+
+      for (std::size_t i = j + 1; i < c1; i++) {
+        T *row_i = a + i * n;
+        T t = row_i[j];
+        for (std::size_t l = j0; l < j; l++)
+          t -= row_i[l] * row_j[l];
+        row_i[j] = t / row_j[j];
+      }
+    }
+  }
+}
+
+// a(r0:r1, c0:c1) = a(r0:r1, c0:c1) * L^-T, with L the factored diagonal
+// tile a(c0:c1, c0:c1). This is solved as L X^T = A^T in a transposed
+// copy, so the substitution runs along contiguous rows, and all but its
+// diagonal blocks through GEMM.
+template <typename T>
+void chol_tile_trsm_(T *a, std::size_t n, std::size_t r0, std::size_t r1,
+                     std::size_t c0, std::size_t c1) {
+  constexpr std::size_t nb = 32;
+  std::size_t m = r1 - r0, w = c1 - c0;
+  const T *L = a + c0 * n + c0;
+
+  ArenaScope scope;
+  arena_vector_<T> xt(w * m);
+  for (std::size_t i = 0; i < m; i++)
+    for (std::size_t j = 0; j < w; j++)
+      xt[j * m + i] = a[(r0 + i) * n + c0 + j];
+
+  for (std::size_t j0 = 0; j0 < w; j0 += nb) {
+    std::size_t j1 = std::min(w, j0 + nb);
+    if (j0 > 0)
+      gemm<T>(j1 - j0, m, j0, T{-1}, L + j0 * n, n, 1, xt.data(), m, 1, T{1},
+              xt.data() + j0 * m, m, 1);
+    for (std::size_t j = j0; j < j1; j++) {
+      T *x_j = xt.data() + j * m;
+      for (std::size_t l = j0; l < j; l++) {
+        T tau = L[j * n + l];
+        const T *x_l = xt.data() + l * m;
+        for (std::size_t i = 0; i < m; i++)
+          x_j[i] -= tau * x_l[i];
+      }
+      T d = L[j * n + j];
+      for (std::size_t i = 0; i < m; i++)
+        x_j[i] /= d;
+    }
+  }
+
+  for (std::size_t i = 0; i < m; i++)
+    for (std::size_t j = 0; j < w; j++)
+      a[(r0 + i) * n + c0 + j] = xt[j * m + i];
+}
+
+} // namespace internal
+
+template <typename E, typename T = typename E::value_type>
+std::pair<Matrix<T>, Matrix<unsigned>>
+LUPartialPivotTiled(const MatrixExpr<E> &A,
+                    unsigned tile_size = internal::tile_size_) {
+  Matrix<T> M{A.self()};
+  assert(M.rows == M.cols);
+  assert(tile_size > 0);
+  std::size_t n = M.rows;
+  std::size_t nt = (n + tile_size - 1) / tile_size;
+
+  Matrix<unsigned> p{M.rows - 1, 1};
+  T *a = M.ptr();
+  unsigned *piv = p.ptr();
+
+  // Keys: tile (i, j) is i * nt + j, the pivots of panel k are nt^2 + k.
+  auto tile = [=](std::size_t i, std::size_t j) { return i * nt + j; };
+  auto lo = [=](std::size_t t) { return t * tile_size; };
+  auto hi = [=](std::size_t t) { return std::min(n, (t + 1) * tile_size); };
+
+  TaskGraph graph;
+  for (std::size_t k = 0; k < nt && lo(k) + 1 < n; k++) {
+    std::vector<TaskGraph::key_t> panel;
+    for (std::size_t i = k; i < nt; i++)
+      panel.push_back(tile(i, k));
+    panel.push_back(nt * nt + k);
+    graph.add([=] { internal::lu_tile_panel_(a, n, lo(k), hi(k), piv); }, {},
+              panel);
+
+    for (std::size_t j = k + 1; j < nt; j++) {
+      std::vector<TaskGraph::key_t> column;
+      for (std::size_t i = k; i < nt; i++)
+        column.push_back(tile(i, j));
+      graph.add(
+          [=] {
+            internal::lu_tile_swap_solve_(a, n, lo(k), hi(k), lo(j), hi(j),
+                                          piv);
+          },
+          {nt * nt + k, tile(k, k)}, column);
+
+      for (std::size_t i = k + 1; i < nt; i++)
+        graph.add(
+            [=] {
+              internal::gemm<T>(hi(i) - lo(i), hi(j) - lo(j), hi(k) - lo(k),
+                                T{-1}, a + lo(i) * n + lo(k), n, 1,
+                                a + lo(k) * n + lo(j), n, 1, T{1},
+                                a + lo(i) * n + lo(j), n, 1);
+            },
+            {tile(i, k), tile(k, j)}, {tile(i, j)});
+    }
+  }
+  graph.run();
+
+  // Each panel swapped whole panel rows; restore the Gauss-vector layout of
+  // the multipliers as in LUPartialPivot.
+  for (std::size_t k = n - 1; k-- > 1;) {
+    std::size_t c0 = (k / tile_size) * tile_size;
+    if (piv[k] != k)
+      std::swap_ranges(a + k * n + c0, a + k * n + k, a + piv[k] * n + c0);
+  }
+
+  return std::pair<Matrix<T>, Matrix<unsigned>>{std::move(M), std::move(p)};
+}
+
+template <typename E, typename T = typename E::value_type>
+Matrix<T> CholeskyTiled(const MatrixExpr<E> &A,
+                        unsigned tile_size = internal::chol_tile_size_) {
+  Matrix<T> L{A.self()};
+  assert(L.rows == L.cols);
+  assert(tile_size > 0);
+  std::size_t n = L.rows;
+  std::size_t nt = (n + tile_size - 1) / tile_size;
+
+  T *a = L.ptr();
+
+  auto tile = [=](std::size_t i, std::size_t j) { return i * nt + j; };
+  auto lo = [=](std::size_t t) { return t * tile_size; };
+  auto hi = [=](std::size_t t) { return std::min(n, (t + 1) * tile_size); };
+
+  TaskGraph graph;
+  for (std::size_t k = 0; k < nt; k++) {
+    graph.add([=] { internal::chol_tile_potrf_(a, n, lo(k), hi(k)); }, {},
+              {tile(k, k)});
+
+    for (std::size_t i = k + 1; i < nt; i++)
+      graph.add(
+          [=] { internal::chol_tile_trsm_(a, n, lo(i), hi(i), lo(k), hi(k)); },
+          {tile(k, k)}, {tile(i, k)});
+
+    // Trailing update of the lower triangle: A(i, j) -= L(i, k) L(j, k)^T.
+    for (std::size_t j = k + 1; j < nt; j++)
+      for (std::size_t i = j; i < nt; i++)
+        graph.add(
+            [=] {
+              internal::gemm<T>(hi(i) - lo(i), hi(j) - lo(j), hi(k) - lo(k),
+                                T{-1}, a + lo(i) * n + lo(k), n, 1,
+                                a + lo(j) * n + lo(k), 1, n, T{1},
+                                a + lo(i) * n + lo(j), n, 1);
+            },
+            {tile(i, k), tile(j, k)}, {tile(i, j)});
+  }
+  graph.run();
+
+  for (std::size_t i = 0; i < n; i++)
+    std::fill(a + i * n + i + 1, a + (i + 1) * n, T{});
+
+  return L;
+}
+
 } // namespace matrix
+
+#endif
@@ -0,0 +1,325 @@
+#include <cassert>
+#include <cmath>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "expressions.hpp"
+#include "matrix.hpp"
+#include "view.hpp"
+
+#ifndef FIXED_MATRIX_H
+#define FIXED_MATRIX_H
+
+namespace matrix {
+
+/**
+ *  Small matrices with a compile-time shape, stored inline.
+ *
+ *  A FixedMatrix<T, R, C> holds its R x C entries in the object itself, so
+ *  creating one (e.g. on the stack, or inside a std::vector of them) never
+ *  allocates, and the shape of every operation is checked by the compiler
+ *  instead of at runtime. FixedVector<T, N> is the N x 1 case.
+ *
+ *  +, - and scalar * between fixed matrices are eager and return a fixed
+ *  matrix, as do products, transpose() and the LU solves below. All their
+ *  loops have constant trip counts and are fully unrolled for the 2 x 2 to
+ *  8 x 8 sizes this is meant for.
+ *
+ *  A FixedMatrix is an expression, so it mixes with Matrix<T>, views and the
+ *  lazy elementwise operators, and a Matrix<T> can be built from one. Going
+ *  the other way needs the explicit constructor, which checks the shape.
+ */
+
+// Unroll loops of up to 8 iterations completely.
+#define MATRIX_FIXED_UNROLL _Pragma("GCC unroll 8")
+
+template <typename T, unsigned R, unsigned C>
+class FixedMatrix : public MatrixExpr<FixedMatrix<T, R, C>> {
+  static_assert(R > 0 && C > 0, "FixedMatrix must have nonzero shape.");
+
+  // Store row-major.
+  T data[R * C];
+
+public:
+  typedef T value_type;
+
+  static constexpr unsigned rows = R;
+  static constexpr unsigned cols = C;
+
+  // All entries zero.
+  FixedMatrix() : data{} {}
+
+  FixedMatrix(std::initializer_list<std::initializer_list<T>>);
+  // Entries in row-major order, e.g. FixedVector<double, 3>{1, 2, 3}.
+  FixedMatrix(std::initializer_list<T>);
+
+  // Copy a dynamic matrix, view or expression of the same shape.
+  template <typename E> explicit FixedMatrix(const MatrixExpr<E> &);
+
+  static FixedMatrix<T, R, C> identity();
+
+  T &operator()(unsigned row, unsigned col) { return data[row * C + col]; }
+  T operator()(unsigned row, unsigned col) const {
+    return data[row * C + col];
+  }
+
+  // For FixedVector.
+  T &operator[](unsigned i) {
+    static_assert(C == 1, "Subscript is only defined for FixedVector.");
+    return data[i];
+  }
+  T operator[](unsigned i) const {
+    static_assert(C == 1, "Subscript is only defined for FixedVector.");
+    return data[i];
+  }
+
+  T *ptr() { return data; }
+  const T *ptr() const { return data; }
+
+  MatrixView<T> view() { return {data, R, C, C}; }
+  ConstMatrixView<T> view() const { return {data, R, C, C}; }
+
+  FixedMatrix<T, C, R> transpose() const;
+
+  explicit operator std::string() const {
+    return std::string(Matrix<T>{*this});
+  }
+};
+
+template <typename T, unsigned N> using FixedVector = FixedMatrix<T, N, 1>;
+
+/* ---- FixedMatrix implementation. ---- */
+
+template <typename T, unsigned R, unsigned C>
+FixedMatrix<T, R, C>::FixedMatrix(
+    std::initializer_list<std::initializer_list<T>> init)
+    : data{} {
+  assert(init.size() == R);
+  unsigned i = 0;
+  for (auto row : init) {
+    assert(row.size() == C);
+    unsigned j = 0;
+    for (T entry : row)
+      data[i * C + j++] = entry;
+    i++;
+  }
+}
+
+template <typename T, unsigned R, unsigned C>
+FixedMatrix<T, R, C>::FixedMatrix(std::initializer_list<T> init) : data{} {
+  assert(init.size() == R * C);
+  unsigned i = 0;
+  for (T entry : init)
+    data[i++] = entry;
+}
+
+template <typename T, unsigned R, unsigned C>
+template <typename E>
+FixedMatrix<T, R, C>::FixedMatrix(const MatrixExpr<E> &expr) {
+  const E &e = expr.self();
+  if (e.rows != R || e.cols != C)
+    throw std::domain_error("Dimensions of assigned matrix must match "
+                            "dimensions of destination matrix.");
+  for (unsigned i = 0; i < R; i++)
+    for (unsigned j = 0; j < C; j++)
+      data[i * C + j] = e(i, j);
+}
+
+template <typename T, unsigned R, unsigned C>
+FixedMatrix<T, R, C> FixedMatrix<T, R, C>::identity() {
+  static_assert(R == C, "Identity matrix must be square.");
+  FixedMatrix<T, R, C> I;
+  MATRIX_FIXED_UNROLL
+  for (unsigned i = 0; i < R; i++)
+    I(i, i) = 1;
+  return I;
+}
+
+template <typename T, unsigned R, unsigned C>
+FixedMatrix<T, C, R> FixedMatrix<T, R, C>::transpose() const {
+  FixedMatrix<T, C, R> result;
+  MATRIX_FIXED_UNROLL
+  for (unsigned i = 0; i < R; i++)
+    MATRIX_FIXED_UNROLL
+    for (unsigned j = 0; j < C; j++)
+      result(j, i) = data[i * C + j];
+  return result;
+}
+
+/* ---- FixedMatrix operations. ---- */
+
+// These are exact matches for fixed operands, so they are chosen over the
+// lazy MatrixExpr operators.
+
+template <typename T, unsigned R, unsigned C>
+FixedMatrix<T, R, C> operator+(const FixedMatrix<T, R, C> &lhs,
+                               const FixedMatrix<T, R, C> &rhs) {
+  FixedMatrix<T, R, C> result;
+  MATRIX_FIXED_UNROLL
+  for (unsigned i = 0; i < R * C; i++)
+    result.ptr()[i] = lhs.ptr()[i] + rhs.ptr()[i];
+  return result;
+}
+
+template <typename T, unsigned R, unsigned C>
+FixedMatrix<T, R, C> operator-(const FixedMatrix<T, R, C> &lhs,
+                               const FixedMatrix<T, R, C> &rhs) {
+  FixedMatrix<T, R, C> result;
+  MATRIX_FIXED_UNROLL
+  for (unsigned i = 0; i < R * C; i++)
+    result.ptr()[i] = lhs.ptr()[i] - rhs.ptr()[i];
+  return result;
+}
+
+// The scalar is not deduced from, so e.g. 2 * A works for double A.
+template <typename T, unsigned R, unsigned C>
+FixedMatrix<T, R, C>
+operator*(const typename FixedMatrix<T, R, C>::value_type &scalar,
+          const FixedMatrix<T, R, C> &mat) {
+  FixedMatrix<T, R, C> result;
+  MATRIX_FIXED_UNROLL
+  for (unsigned i = 0; i < R * C; i++)
+    result.ptr()[i] = scalar * mat.ptr()[i];
+  return result;
+}
+
+template <typename T, unsigned R, unsigned K, unsigned C>
+FixedMatrix<T, R, C> operator*(const FixedMatrix<T, R, K> &lhs,
+                               const FixedMatrix<T, K, C> &rhs) {
+  FixedMatrix<T, R, C> result;
+  MATRIX_FIXED_UNROLL
+  for (unsigned i = 0; i < R; i++)
+    MATRIX_FIXED_UNROLL
+    for (unsigned k = 0; k < K; k++) {
+      T a = lhs(i, k);
+      MATRIX_FIXED_UNROLL
+      for (unsigned j = 0; j < C; j++)
+        result(i, j) += a * rhs(k, j);
+    }
+  return result;
+}
+
+/**
+ *  LU w/ partial pivoting of a fixed square matrix, for solving many small
+ *  systems without allocating.
+ *
+ *  Like LUFactorization (solvers.hpp), L and U are packed into one matrix
+ *  in the row order left by the pivots, and p(k) is the row swapped with
+ *  row k at step k.
+ */
+
+template <typename T, unsigned N> class FixedLUFactorization {
+  FixedMatrix<T, N, N> M;
+  unsigned p[N];
+
+  void check_nonsingular_() const;
+
+public:
+  explicit FixedLUFactorization(const FixedMatrix<T, N, N> &A);
+
+  bool singular() const;
+
+  // Each column of b is a right-hand side.
+  template <unsigned K>
+  FixedMatrix<T, N, K> solve(const FixedMatrix<T, N, K> &b) const;
+};
+
+template <typename T, unsigned N>
+FixedLUFactorization<T, N>::FixedLUFactorization(const FixedMatrix<T, N, N> &A)
+    : M{A} {
+  MATRIX_FIXED_UNROLL
+  for (unsigned k = 0; k < N; k++) {
+    unsigned l = k;
+    for (unsigned i = k + 1; i < N; i++)
+      if (std::abs(M(i, k)) > std::abs(M(l, k)))
+        l = i;
+    p[k] = l;
+
+    if (l != k)
+      MATRIX_FIXED_UNROLL
+      for (unsigned j = 0; j < N; j++)
+        std::swap(M(k, j), M(l, j));
+
+    if (M(k, k) == T{})
+      continue; // Singular; solve() will throw.
+
+    MATRIX_FIXED_UNROLL
+    for (unsigned i = k + 1; i < N; i++) {
+      T tau = M(i, k) /= M(k, k);
+      MATRIX_FIXED_UNROLL
+      for (unsigned j = k + 1; j < N; j++)
+        M(i, j) -= tau * M(k, j);
+    }
+  }
+}
+
+template <typename T, unsigned N>
+bool FixedLUFactorization<T, N>::singular() const {
+  for (unsigned k = 0; k < N; k++)
+    if (M(k, k) == T{})
+      return true;
+  return false;
+}
+
+template <typename T, unsigned N>
+void FixedLUFactorization<T, N>::check_nonsingular_() const {
+  if (singular())
+    throw std::domain_error(
+        "Matrix is A singular; cannot guarantee solution exists.");
+}
+
+template <typename T, unsigned N>
+template <unsigned K>
+FixedMatrix<T, N, K>
+FixedLUFactorization<T, N>::solve(const FixedMatrix<T, N, K> &b) const {
+  check_nonsingular_();
+  FixedMatrix<T, N, K> x{b};
+
+  // Apply permutation to RHS.
+  MATRIX_FIXED_UNROLL
+  for (unsigned k = 0; k < N; k++)
+    if (p[k] != k)
+      MATRIX_FIXED_UNROLL
+      for (unsigned j = 0; j < K; j++)
+        std::swap(x(k, j), x(p[k], j));
+
+  // Solve Ly = Pb, L unit lower triangular.
+  MATRIX_FIXED_UNROLL
+  for (unsigned i = 1; i < N; i++)
+    MATRIX_FIXED_UNROLL
+    for (unsigned l = 0; l < i; l++)
+      MATRIX_FIXED_UNROLL
+      for (unsigned j = 0; j < K; j++)
+        x(i, j) -= M(i, l) * x(l, j);
+
+  // Solve Ux = y.
+  MATRIX_FIXED_UNROLL
+  for (unsigned r = 0; r < N; r++) {
+    unsigned i = N - 1 - r;
+    MATRIX_FIXED_UNROLL
+    for (unsigned l = i + 1; l < N; l++)
+      MATRIX_FIXED_UNROLL
+      for (unsigned j = 0; j < K; j++)
+        x(i, j) -= M(i, l) * x(l, j);
+    MATRIX_FIXED_UNROLL
+    for (unsigned j = 0; j < K; j++)
+      x(i, j) /= M(i, i);
+  }
+
+  return x;
+}
+
+// Fixed-size counterpart of solve_partial_pivot in solvers.hpp.
+template <typename T, unsigned N, unsigned K>
+FixedMatrix<T, N, K> solve_partial_pivot(const FixedMatrix<T, N, N> &A,
+                                         const FixedMatrix<T, N, K> &b) {
+  return FixedLUFactorization<T, N>{A}.solve(b);
+}
+
+#undef MATRIX_FIXED_UNROLL
+
+} // namespace matrix
+
+#endif
@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "allocator.hpp"
+#include "thread_pool.hpp"
+
+#ifndef GEMM_H
+#define GEMM_H
+
+namespace matrix {
+
+/**
+ *  Packed, cache-blocked general matrix product C = alpha * A * B + beta * C,
+ *  following the Goto / BLIS layering:
+ *
+ *    - B is packed in KC x NC blocks that stay in the L3 cache,
+ *    - A is packed in MC x KC blocks that stay in the L2 cache,
+ *    - a register-tiled MR x NR micro-kernel streams through both.
+ *
+ *  Operands are given as raw pointers with a row stride and a column stride,
+ *  so the same routine works on any row-major or column-major block of a
+ *  larger buffer. Float and double use a micro-kernel written with GCC vector
+ *  extensions; other scalar types fall back to a plain scalar micro-kernel
+ *  with the same blocking.
+ */
+
+namespace internal {
+
+/* ---- Register-tile shapes. ---- */
+
+#if defined(__AVX512F__)
+constexpr std::size_t simd_bytes_ = 64;
+#elif defined(__AVX__)
+constexpr std::size_t simd_bytes_ = 32;
+#else
+constexpr std::size_t simd_bytes_ = 16;
+#endif
+
+template <typename T> struct gemm_traits_ {
+  static constexpr bool simd = false;
+  static constexpr std::size_t lanes = 1;
+  static constexpr std::size_t MR = 4;
+  static constexpr std::size_t NR = 4;
+  static constexpr std::size_t MC = 64;
+  static constexpr std::size_t KC = 256;
+  static constexpr std::size_t NC = 1024;
+};
+
+template <> struct gemm_traits_<double> {
+  typedef double vec_t __attribute__((vector_size(simd_bytes_)));
+  static constexpr bool simd = true;
+  static constexpr std::size_t lanes = simd_bytes_ / sizeof(double);
+  static constexpr std::size_t MR = 6;
+  static constexpr std::size_t NR = 2 * lanes;
+  static constexpr std::size_t MC = 72;
+  static constexpr std::size_t KC = 256;
+  static constexpr std::size_t NC = 4080;
+};
+
+template <> struct gemm_traits_<float> {
+  typedef float vec_t __attribute__((vector_size(simd_bytes_)));
+  static constexpr bool simd = true;
+  static constexpr std::size_t lanes = simd_bytes_ / sizeof(float);
+  static constexpr std::size_t MR = 6;
+  static constexpr std::size_t NR = 2 * lanes;
+  static constexpr std::size_t MC = 144;
+  static constexpr std::size_t KC = 256;
+  static constexpr std::size_t NC = 4080;
+};
+
+// Below this many multiply-adds packing costs more than it saves.
+constexpr std::size_t gemm_small_size_ = 48 * 48 * 48;
+
+// Below this many multiply-adds the product stays on the calling thread.
+constexpr std::size_t gemm_parallel_size_ = 128 * 128 * 128;
+
+// Per-thread packing buffers, reused across calls. Slot 0 holds A blocks,
+// slot 1 holds B blocks. Both are aligned, so micro-panels start on cache
+// lines.
+template <typename T, int slot> T *pack_buffer_(std::size_t size) {
+  thread_local std::vector<T, AlignedAllocator<T>> buf;
+  if (buf.size() < size)
+    buf.resize(size);
+  return buf.data();
+}
+
+/* ---- Packing. ---- */
+
+// Copy an mc x kc block of A into MR-row micro-panels, zero-padding the
+// last panel so the micro-kernel never needs an edge case.
+template <typename T>
+void pack_A_(std::size_t mc, std::size_t kc, const T *A, std::ptrdiff_t rsa,
+             std::ptrdiff_t csa, T *Ap) {
+  constexpr std::size_t MR = gemm_traits_<T>::MR;
+  for (std::size_t ir = 0; ir < mc; ir += MR) {
+    std::size_t mr = std::min(MR, mc - ir);
+    const T *a = A + ir * rsa;
+    for (std::size_t p = 0; p < kc; p++) {
+      for (std::size_t i = 0; i < mr; i++)
+        Ap[i] = a[i * rsa + p * csa];
+      for (std::size_t i = mr; i < MR; i++)
+        Ap[i] = T{};
+      Ap += MR;
+    }
+  }
+}
+
+// Copy a kc x nc block of B into NR-column micro-panels.
+template <typename T>
+void pack_B_(std::size_t kc, std::size_t nc, const T *B, std::ptrdiff_t rsb,
+             std::ptrdiff_t csb, T *Bp) {
+  constexpr std::size_t NR = gemm_traits_<T>::NR;
+  for (std::size_t jr = 0; jr < nc; jr += NR) {
+    std::size_t nr = std::min(NR, nc - jr);
+    const T *b = B + jr * csb;
+    for (std::size_t p = 0; p < kc; p++) {
+      if (csb == 1 && nr == NR)
+        std::memcpy(Bp, b + p * rsb, NR * sizeof(T));
+      else {
+        for (std::size_t j = 0; j < nr; j++)
+          Bp[j] = b[p * rsb + j * csb];
+        for (std::size_t j = nr; j < NR; j++)
+          Bp[j] = T{};
+      }
+      Bp += NR;
+    }
+  }
+}
+
+/* ---- Micro-kernels. ---- */
+
+// Both kernels compute the MR x NR product of one packed micro-panel pair
+// into the row-major buffer AB.
+
+template <typename T, bool = gemm_traits_<T>::simd> struct micro_kernel_ {
+  static void run(std::size_t kc, const T *Ap, const T *Bp, T *AB) {
+    constexpr std::size_t MR = gemm_traits_<T>::MR;
+    constexpr std::size_t NR = gemm_traits_<T>::NR;
+    T c[MR * NR]{};
+    for (std::size_t p = 0; p < kc; p++) {
+      for (std::size_t i = 0; i < MR; i++)
+        for (std::size_t j = 0; j < NR; j++)
+          c[i * NR + j] += Ap[i] * Bp[j];
+      Ap += MR;
+      Bp += NR;
+    }
+    std::copy(c, c + MR * NR, AB);
+  }
+};
+
+template <typename T> struct micro_kernel_<T, true> {
+  static void run(std::size_t kc, const T *Ap, const T *Bp, T *AB) {
+    typedef typename gemm_traits_<T>::vec_t vec_t;
+    constexpr std::size_t MR = gemm_traits_<T>::MR;
+    constexpr std::size_t L = gemm_traits_<T>::lanes;
+    constexpr std::size_t NV = gemm_traits_<T>::NR / L;
+
+    vec_t c[MR][NV];
+    for (std::size_t i = 0; i < MR; i++)
+      for (std::size_t v = 0; v < NV; v++)
+        c[i][v] = vec_t{};
+
+    for (std::size_t p = 0; p < kc; p++) {
+      vec_t b[NV];
+      for (std::size_t v = 0; v < NV; v++)
+        std::memcpy(&b[v], Bp + v * L, sizeof(vec_t));
+      for (std::size_t i = 0; i < MR; i++)
+        for (std::size_t v = 0; v < NV; v++)
+          c[i][v] += Ap[i] * b[v];
+      Ap += MR;
+      Bp += NV * L;
+    }
+
+    for (std::size_t i = 0; i < MR; i++)
+      for (std::size_t v = 0; v < NV; v++)
+        std::memcpy(AB + i * NV * L + v * L, &c[i][v], sizeof(vec_t));
+  }
+};
+
+/* ---- Blocked driver. ---- */
+
+// C(0:mr, 0:nr) = alpha * AB + beta * C, reading C only if beta != 0.
+template <typename T>
+inline void update_tile_(std::size_t mr, std::size_t nr, T alpha, const T *AB,
+                         T beta, T *C, std::ptrdiff_t rsc,
+                         std::ptrdiff_t csc) {
+  constexpr std::size_t NR = gemm_traits_<T>::NR;
+  for (std::size_t i = 0; i < mr; i++) {
+    T *c = C + i * rsc;
+    const T *ab = AB + i * NR;
+    if (beta == T{})
+      for (std::size_t j = 0; j < nr; j++)
+        c[j * csc] = alpha * ab[j];
+    else
+      for (std::size_t j = 0; j < nr; j++)
+        c[j * csc] = alpha * ab[j] + beta * c[j * csc];
+  }
+}
+
+// Multiply packed blocks Ap (mc x kc) and Bp (kc x nc) into C.
+template <typename T>
+void macro_kernel_(std::size_t mc, std::size_t nc, std::size_t kc, T alpha,
+                   const T *Ap, const T *Bp, T beta, T *C, std::ptrdiff_t rsc,
+                   std::ptrdiff_t csc) {
+  constexpr std::size_t MR = gemm_traits_<T>::MR;
+  constexpr std::size_t NR = gemm_traits_<T>::NR;
+  T AB[MR * NR];
+
+  for (std::size_t jr = 0; jr < nc; jr += NR) {
+    std::size_t nr = std::min(NR, nc - jr);
+    for (std::size_t ir = 0; ir < mc; ir += MR) {
+      std::size_t mr = std::min(MR, mc - ir);
+      micro_kernel_<T>::run(kc, Ap + ir * kc, Bp + jr * kc, AB);
+      update_tile_(mr, nr, alpha, AB, beta, C + ir * rsc + jr * csc, rsc,
+                   csc);
+    }
+  }
+}
+
+// Straightforward i-p-j loop for small products.
+template <typename T>
+void gemm_small_(std::size_t m, std::size_t n, std::size_t k, T alpha,
+                 const T *A, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+                 const T *B, std::ptrdiff_t rsb, std::ptrdiff_t csb, T beta,
+                 T *C, std::ptrdiff_t rsc, std::ptrdiff_t csc) {
+  for (std::size_t i = 0; i < m; i++) {
+    T *c = C + i * rsc;
+    for (std::size_t j = 0; j < n; j++)
+      c[j * csc] = (beta == T{}) ? T{} : beta * c[j * csc];
+
+    for (std::size_t p = 0; p < k; p++) {
+      T a = alpha * A[i * rsa + p * csa];
+      const T *b = B + p * rsb;
+      for (std::size_t j = 0; j < n; j++)
+        c[j * csc] += a * b[j * csb];
+    }
+  }
+}
+
+template <typename T>
+void gemm(std::size_t m, std::size_t n, std::size_t k, T alpha, const T *A,
+          std::ptrdiff_t rsa, std::ptrdiff_t csa, const T *B,
+          std::ptrdiff_t rsb, std::ptrdiff_t csb, T beta, T *C,
+          std::ptrdiff_t rsc, std::ptrdiff_t csc) {
+  typedef gemm_traits_<T> tr;
+  if (m == 0 || n == 0)
+    return;
+
+  if (k == 0 || m * n * k <= gemm_small_size_) {
+    gemm_small_(m, n, k, alpha, A, rsa, csa, B, rsb, csb, beta, C, rsc, csc);
+    return;
+  }
+
+  std::size_t kc_max = std::min(tr::KC, k);
+  std::size_t mc_max = std::min(tr::MC, m);
+  std::size_t nc_max = std::min(tr::NC, n);
+  T *Bp =
+      pack_buffer_<T, 1>(((nc_max + tr::NR - 1) / tr::NR) * tr::NR * kc_max);
+
+  // Large products split each KC x NC step over jobs of one MC row block
+  // times a range of NR column panels; every job packs its own A block.
+  bool parallel = m * n * k >= gemm_parallel_size_;
+  unsigned threads = parallel ? num_threads() : 1;
+
+  for (std::size_t jc = 0; jc < n; jc += tr::NC) {
+    std::size_t nc = std::min(tr::NC, n - jc);
+    std::size_t num_panels = (nc + tr::NR - 1) / tr::NR;
+    std::size_t row_blocks = (m + tr::MC - 1) / tr::MC;
+    std::size_t col_splits = std::min(
+        num_panels, (2 * threads + row_blocks - 1) / row_blocks);
+    std::size_t panels_per_split = (num_panels + col_splits - 1) / col_splits;
+
+    for (std::size_t pc = 0; pc < k; pc += tr::KC) {
+      std::size_t kc = std::min(tr::KC, k - pc);
+      T beta_p = (pc == 0) ? beta : T{1};
+
+      const T *B_blk = B + pc * rsb + jc * csb;
+      parallel_for(0, num_panels, parallel ? 16 : num_panels,
+                   [&](std::size_t lo, std::size_t hi) {
+                     std::size_t jr = lo * tr::NR;
+                     std::size_t nr = std::min(hi * tr::NR, nc) - jr;
+                     pack_B_(kc, nr, B_blk + jr * csb, rsb, csb, Bp + jr * kc);
+                   });
+
+      auto job = [&](unsigned idx) {
+        std::size_t ic = (idx / col_splits) * tr::MC;
+        std::size_t jr = (idx % col_splits) * panels_per_split * tr::NR;
+        if (jr >= nc)
+          return;
+        std::size_t mc = std::min(tr::MC, m - ic);
+        std::size_t ncj = std::min(panels_per_split * tr::NR, nc - jr);
+
+        T *Ap = pack_buffer_<T, 0>(((mc_max + tr::MR - 1) / tr::MR) * tr::MR *
+                                   kc_max);
+        pack_A_(mc, kc, A + ic * rsa + pc * csa, rsa, csa, Ap);
+        macro_kernel_(mc, ncj, kc, alpha, Ap, Bp + jr * kc, beta_p,
+                      C + ic * rsc + (jc + jr) * csc, rsc, csc);
+      };
+
+      unsigned num_jobs = static_cast<unsigned>(row_blocks * col_splits);
+      if (parallel)
+        thread_pool().run(num_jobs, job);
+      else
+        for (unsigned idx = 0; idx < num_jobs; idx++)
+          job(idx);
+    }
+  }
+}
+
+} // namespace internal
+
+} // namespace matrix
+
+#endif
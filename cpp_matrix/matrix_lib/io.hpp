@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "matrix.hpp"
+#include "view.hpp"
+
+#ifndef IO_H
+#define IO_H
+
+namespace matrix {
+
+/**
+ *  A binary file format for dense matrices, and memory-mapped access to it.
+ *
+ *  A file is a 128-byte FileHeader (magic, version, byte order, element
+ *  type and size, layout, shape), zero padding up to data_offset, and then
+ *  the raw entries. data_offset is a multiple of the page size, so mapped
+ *  entries are page aligned, which also satisfies storage_alignment.
+ *  Entries are stored in the writer's byte order; readers check it and
+ *  reject files written on a machine of the other endianness.
+ *
+ *    - save() writes a matrix or expression; load() reads a file back into
+ *      a Matrix.
+ *    - MatrixWriter streams a file out in blocks of rows, for matrices
+ *      assembled piece by piece, or too large to hold in memory at once.
+ *    - MappedMatrix maps a file's entries into memory instead of reading
+ *      them. Opening costs a few system calls whatever the size of the
+ *      file; pages are read on first access, and evicted under memory
+ *      pressure. Its view() works anywhere a view does, e.g. in products
+ *      and solves. Read-only mappings are shared, so processes on one node
+ *      that open the same file hold its pages in memory once.
+ *
+ *  The mapping is POSIX mmap(). Errors opening, reading or writing a file,
+ *  and malformed files, throw std::runtime_error.
+ */
+
+enum class DType : std::uint32_t { f32 = 1, f64 = 2, i32 = 3, i64 = 4, u8 = 5 };
+
+// Row-major files have tile_rows = tile_cols = 0. Tiled files, those of
+// TiledMatrix (out_of_core.hpp), store tile_rows x tile_cols row-major
+// tiles in row-major order, edge tiles padded with zeros to full size.
+enum class Layout : std::uint32_t { row_major = 0, tiled = 1 };
+
+struct FileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order; // 0x01020304 as written.
+  std::uint32_t dtype;
+  std::uint32_t elem_size;
+  std::uint32_t layout;
+  std::uint32_t reserved0;
+  std::uint64_t rows;
+  std::uint64_t cols;
+  std::uint64_t tile_rows;
+  std::uint64_t tile_cols;
+  std::uint64_t data_offset;
+  std::uint8_t reserved[56];
+};
+
+static_assert(sizeof(FileHeader) == 128, "FileHeader must be 128 bytes.");
+
+/* ---- Headers. ---- */
+
+namespace internal {
+
+constexpr char file_magic_[8] = {'M', 'A', 'T', 'R', 'I', 'X', 'B', '\0'};
+constexpr std::uint32_t file_version_ = 1;
+constexpr std::uint32_t byte_order_ = 0x01020304;
+constexpr std::uint64_t file_data_offset_ = 4096;
+
+template <typename T> constexpr DType dtype_() {
+  static_assert(std::is_same<T, float>::value ||
+                    std::is_same<T, double>::value ||
+                    std::is_same<T, std::int32_t>::value ||
+                    std::is_same<T, std::int64_t>::value ||
+                    std::is_same<T, std::uint8_t>::value,
+                "Matrix files hold float, double, int32, int64 or uint8.");
+  if (std::is_same<T, float>::value)
+    return DType::f32;
+  if (std::is_same<T, double>::value)
+    return DType::f64;
+  if (std::is_same<T, std::int32_t>::value)
+    return DType::i32;
+  if (std::is_same<T, std::int64_t>::value)
+    return DType::i64;
+  return DType::u8;
+}
+
+[[noreturn]] inline void io_error_(const std::string &what,
+                                   const std::string &path) {
+  throw std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+// A row-major header, or a tiled one for a nonzero tile size.
+template <typename T>
+FileHeader make_header_(std::size_t rows, std::size_t cols,
+                        std::size_t tile = 0) {
+  FileHeader h{};
+  std::memcpy(h.magic, file_magic_, sizeof h.magic);
+  h.version = file_version_;
+  h.byte_order = byte_order_;
+  h.dtype = static_cast<std::uint32_t>(dtype_<T>());
+  h.elem_size = sizeof(T);
+  h.layout = static_cast<std::uint32_t>(tile ? Layout::tiled
+                                              : Layout::row_major);
+  h.rows = rows;
+  h.cols = cols;
+  h.tile_rows = tile;
+  h.tile_cols = tile;
+  h.data_offset = file_data_offset_;
+  return h;
+}
+
+// Check that h describes a file of T entries in the given layout that
+// fits in file_size bytes.
+template <typename T>
+void check_header_(const FileHeader &h, std::uint64_t file_size,
+                   const std::string &path,
+                   Layout layout = Layout::row_major) {
+  auto fail = [&](const std::string &why) {
+    throw std::runtime_error(path + ": " + why);
+  };
+  if (std::memcmp(h.magic, file_magic_, sizeof h.magic) != 0)
+    fail("not a matrix file.");
+  if (h.version != file_version_)
+    fail("unsupported matrix file version.");
+  if (h.byte_order != byte_order_)
+    fail("matrix file has the wrong byte order.");
+  if (h.dtype != static_cast<std::uint32_t>(dtype_<T>()) ||
+      h.elem_size != sizeof(T))
+    fail("matrix file holds a different element type.");
+  if (h.layout != static_cast<std::uint32_t>(layout))
+    fail(layout == Layout::tiled ? "matrix file is not tiled."
+                                 : "matrix file is not row-major.");
+  std::uint64_t rows = h.rows, cols = h.cols;
+  if (layout == Layout::tiled) {
+    if (h.tile_rows == 0 || h.tile_rows != h.tile_cols)
+      fail("matrix file has unsupported tiles.");
+    rows = (rows + h.tile_rows - 1) / h.tile_rows * h.tile_rows;
+    cols = (cols + h.tile_cols - 1) / h.tile_cols * h.tile_cols;
+  }
+  if (h.data_offset < sizeof(FileHeader) ||
+      h.data_offset % alignof(T) != 0)
+    fail("matrix file has a bad data offset.");
+  std::uint64_t data_size = file_size - std::min(file_size, h.data_offset);
+  if (cols != 0 && rows > data_size / sizeof(T) / cols)
+    fail("matrix file is truncated.");
+}
+
+} // namespace internal
+
+/* ---- Streaming writer. ---- */
+
+template <typename T> class MatrixWriter {
+  std::ofstream out;
+  std::string path;
+  std::size_t num_rows, num_cols;
+  std::size_t written = 0;
+  std::vector<T> row_buf; // For rows that aren't contiguous.
+
+public:
+  // Start a rows x cols file; its rows follow through write().
+  MatrixWriter(const std::string &path, std::size_t rows, std::size_t cols);
+  // Closes without checking; call close() to find out about errors.
+  ~MatrixWriter() = default;
+
+  MatrixWriter(const MatrixWriter &) = delete;
+  MatrixWriter &operator=(const MatrixWriter &) = delete;
+
+  // Append the rows of a block with the file's number of columns.
+  void write(ConstMatrixView<T> block);
+  // Flush and close the file; throws if rows are missing or I/O failed.
+  void close();
+
+  std::size_t rows_written() const { return written; }
+};
+
+template <typename T>
+MatrixWriter<T>::MatrixWriter(const std::string &path, std::size_t rows,
+                              std::size_t cols)
+    : out{path, std::ios::binary | std::ios::trunc}, path{path},
+      num_rows{rows}, num_cols{cols} {
+  if (!out)
+    internal::io_error_("Cannot create", path);
+  FileHeader h = internal::make_header_<T>(rows, cols);
+  out.write(reinterpret_cast<const char *>(&h), sizeof h);
+  std::vector<char> pad(h.data_offset - sizeof h, 0);
+  out.write(pad.data(), static_cast<std::streamsize>(pad.size()));
+  if (!out)
+    internal::io_error_("Cannot write", path);
+}
+
+template <typename T> void MatrixWriter<T>::write(ConstMatrixView<T> block) {
+  if (block.cols != num_cols || written + block.rows > num_rows)
+    throw std::domain_error("Matrix shapes do not match.");
+
+  const std::streamsize row_bytes =
+      static_cast<std::streamsize>(num_cols * sizeof(T));
+  if (block.col_stride() == 1 &&
+      block.row_stride() == static_cast<std::ptrdiff_t>(num_cols)) {
+    // Contiguous rows go out in one piece.
+    out.write(reinterpret_cast<const char *>(block.ptr()),
+              row_bytes * static_cast<std::streamsize>(block.rows));
+  } else {
+    for (std::size_t i = 0; i < block.rows; i++) {
+      const T *row = block.ptr() + i * block.row_stride();
+      if (block.col_stride() != 1) {
+        row_buf.resize(num_cols);
+        for (std::size_t j = 0; j < num_cols; j++)
+          row_buf[j] = block(i, j);
+        row = row_buf.data();
+      }
+      out.write(reinterpret_cast<const char *>(row), row_bytes);
+    }
+  }
+  if (!out)
+    internal::io_error_("Cannot write", path);
+  written += block.rows;
+}
+
+template <typename T> void MatrixWriter<T>::close() {
+  if (written != num_rows)
+    throw std::runtime_error(path + ": closed after " +
+                             std::to_string(written) + " of " +
+                             std::to_string(num_rows) + " rows.");
+  out.close();
+  if (!out)
+    internal::io_error_("Cannot write", path);
+}
+
+/* ---- Whole matrices. ---- */
+
+template <typename E> void save(const std::string &path, const E &m) {
+  typedef typename E::value_type T;
+  MatrixWriter<T> writer{path, m.rows, m.cols};
+  if constexpr (std::is_convertible<const E &, ConstMatrixView<T>>::value) {
+    writer.write(m);
+  } else {
+    // Evaluate other expressions a block of rows at a time.
+    const std::size_t block_rows =
+        std::max<std::size_t>(1, (std::size_t{1} << 16) / (m.cols + 1));
+    for (std::size_t i = 0; i < m.rows; i += block_rows) {
+      std::size_t nb = std::min(block_rows, m.rows - i);
+      Matrix<T> block{nb, m.cols, uninitialized};
+      for (std::size_t r = 0; r < nb; r++)
+        for (std::size_t j = 0; j < m.cols; j++)
+          block(r, j) = m(i + r, j);
+      writer.write(block);
+    }
+  }
+  writer.close();
+}
+
+template <typename T> Matrix<T> load(const std::string &path) {
+  std::ifstream in{path, std::ios::binary | std::ios::ate};
+  if (!in)
+    internal::io_error_("Cannot open", path);
+  std::uint64_t file_size = static_cast<std::uint64_t>(in.tellg());
+  FileHeader h{};
+  in.seekg(0);
+  in.read(reinterpret_cast<char *>(&h), sizeof h);
+  if (!in)
+    throw std::runtime_error(path + ": not a matrix file.");
+  internal::check_header_<T>(h, file_size, path);
+
+  Matrix<T> m{h.rows, h.cols, uninitialized};
+  in.seekg(static_cast<std::streamoff>(h.data_offset));
+  in.read(reinterpret_cast<char *>(m.ptr()),
+          static_cast<std::streamsize>(h.rows * h.cols * sizeof(T)));
+  if (!in)
+    internal::io_error_("Cannot read", path);
+  return m;
+}
+
+/* ---- Memory-mapped matrices. ---- */
+
+enum class MapMode { read_only, read_write };
+
+template <typename T> class MappedMatrix {
+  void *base = nullptr;
+  std::size_t length = 0;
+  T *data = nullptr;
+  std::size_t num_rows = 0, num_cols = 0;
+  bool writable = false;
+
+  MappedMatrix() = default;
+  // Map all of an open file, and close it.
+  void map_(int fd, std::size_t size, MapMode mode, const std::string &path);
+  void unmap_();
+
+public:
+  // Map an existing file.
+  static MappedMatrix open(const std::string &path,
+                           MapMode mode = MapMode::read_only);
+  // Create, or truncate, a file for a rows x cols matrix of zeros, and map
+  // it for writing. Pages are allocated on disk as they are written.
+  static MappedMatrix create(const std::string &path, std::size_t rows,
+                             std::size_t cols);
+
+  MappedMatrix(MappedMatrix &&other) noexcept;
+  MappedMatrix &operator=(MappedMatrix &&other) noexcept;
+  MappedMatrix(const MappedMatrix &) = delete;
+  MappedMatrix &operator=(const MappedMatrix &) = delete;
+  ~MappedMatrix() { unmap_(); }
+
+  std::size_t rows() const { return num_rows; }
+  std::size_t cols() const { return num_cols; }
+  const T *ptr() const { return data; }
+
+  ConstMatrixView<T> view() const {
+    return {data, num_rows, num_cols, static_cast<std::ptrdiff_t>(num_cols)};
+  }
+  // Throws unless mapped read_write. Writes reach the file by the time it
+  // is unmapped, or after flush().
+  MatrixView<T> mutable_view();
+
+  // Write changed pages back to the file, and wait for them.
+  void flush();
+};
+
+template <typename T>
+void MappedMatrix<T>::map_(int fd, std::size_t size, MapMode mode,
+                           const std::string &path) {
+  writable = mode == MapMode::read_write;
+  int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+  void *p = ::mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+  int err = errno;
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    errno = err;
+    internal::io_error_("Cannot map", path);
+  }
+  base = p;
+  length = size;
+}
+
+template <typename T> void MappedMatrix<T>::unmap_() {
+  if (base)
+    ::munmap(base, length);
+  base = nullptr;
+  data = nullptr;
+}
+
+template <typename T>
+MappedMatrix<T> MappedMatrix<T>::open(const std::string &path,
+                                      MapMode mode) {
+  int fd = ::open(path.c_str(), mode == MapMode::read_only ? O_RDONLY : O_RDWR);
+  if (fd < 0)
+    internal::io_error_("Cannot open", path);
+  struct stat st;
+  FileHeader h{};
+  if (::fstat(fd, &st) != 0 ||
+      ::pread(fd, &h, sizeof h, 0) != static_cast<ssize_t>(sizeof h)) {
+    ::close(fd);
+    throw std::runtime_error(path + ": not a matrix file.");
+  }
+  try {
+    internal::check_header_<T>(h, static_cast<std::uint64_t>(st.st_size),
+                               path);
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+
+  MappedMatrix m;
+  m.map_(fd, static_cast<std::size_t>(st.st_size), mode, path);
+  m.data = reinterpret_cast<T *>(static_cast<char *>(m.base) + h.data_offset);
+  m.num_rows = h.rows;
+  m.num_cols = h.cols;
+  return m;
+}
+
+template <typename T>
+MappedMatrix<T> MappedMatrix<T>::create(const std::string &path,
+                                        std::size_t rows, std::size_t cols) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    internal::io_error_("Cannot create", path);
+  FileHeader h = internal::make_header_<T>(rows, cols);
+  std::size_t size = h.data_offset + rows * cols * sizeof(T);
+  if (::pwrite(fd, &h, sizeof h, 0) != static_cast<ssize_t>(sizeof h) ||
+      ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    int err = errno;
+    ::close(fd);
+    errno = err;
+    internal::io_error_("Cannot write", path);
+  }
+
+  MappedMatrix m;
+  m.map_(fd, size, MapMode::read_write, path);
+  m.data = reinterpret_cast<T *>(static_cast<char *>(m.base) + h.data_offset);
+  m.num_rows = rows;
+  m.num_cols = cols;
+  return m;
+}
+
+template <typename T>
+MappedMatrix<T>::MappedMatrix(MappedMatrix &&other) noexcept
+    : base{other.base}, length{other.length}, data{other.data},
+      num_rows{other.num_rows}, num_cols{other.num_cols},
+      writable{other.writable} {
+  other.base = nullptr;
+  other.data = nullptr;
+}
+
+template <typename T>
+MappedMatrix<T> &MappedMatrix<T>::operator=(MappedMatrix &&other) noexcept {
+  if (&other != this) {
+    unmap_();
+    std::swap(base, other.base);
+    std::swap(data, other.data);
+    length = other.length;
+    num_rows = other.num_rows;
+    num_cols = other.num_cols;
+    writable = other.writable;
+  }
+  return *this;
+}
+
+template <typename T> MatrixView<T> MappedMatrix<T>::mutable_view() {
+  if (!writable)
+    throw std::runtime_error("Matrix file is mapped read-only.");
+  return {data, num_rows, num_cols, static_cast<std::ptrdiff_t>(num_cols)};
+}
+
+template <typename T> void MappedMatrix<T>::flush() {
+  if (base && writable && ::msync(base, length, MS_SYNC) != 0)
+    throw std::runtime_error(std::string{"Cannot write mapped matrix: "} +
+                             std::strerror(errno));
+}
+
+} // namespace matrix
+
+#endif
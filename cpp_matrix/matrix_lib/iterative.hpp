@@ -0,0 +1,607 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "matrix.hpp"
+#include "operations.hpp"
+#include "sparse.hpp"
+#include "thread_pool.hpp"
+#include "vector.hpp"
+
+#ifndef ITERATIVE_H
+#define ITERATIVE_H
+
+namespace matrix {
+
+/**
+ *  Krylov subspace solvers for Ax = b: conjugate gradients (CG) for
+ *  symmetric positive definite A, and BiCGSTAB and restarted GMRES(m) for
+ *  general A.
+ *
+ *  A is any linear operator: a dense Matrix<T>, a SparseMatrix<T>, or a
+ *  callable f(x, y) that overwrites the Vector<T> y with A x, so the matrix
+ *  never has to be formed. Each iteration costs one or two applications of
+ *  A plus O(n) vector work, instead of the O(n^3) of a dense LU.
+ *
+ *  A preconditioner M approximates A^{-1} and is applied as M.apply(r, z),
+ *  z = M r. Jacobi, ILU(0) and IC(0) (incomplete Cholesky) are provided
+ *  below for sparse matrices. CG and BiCGSTAB precondition on the left,
+ *  GMRES on the right; all of them stop on the true relative residual
+ *  ||b - Ax|| / ||b|| (up to rounding), not a preconditioned one.
+ *
+ *  The solvers start from x = 0 and return the solution with the iteration
+ *  count and, unless turned off, the relative residual after every
+ *  iteration.
+ */
+
+struct IterativeOptions {
+  double tol = 1e-8;        // Relative residual to stop at.
+  unsigned max_iter = 1000; // Total, over all GMRES restarts.
+  unsigned restart = 30;    // GMRES subspace dimension m.
+  bool history = true;      // Record the residual of every iteration.
+};
+
+template <typename T> struct IterativeResult {
+  Vector<T> x;
+  bool converged;
+  unsigned iterations;
+  double residual; // Final relative residual.
+  // Relative residual before the first and after each iteration.
+  std::vector<double> history;
+};
+
+/* ---- Preconditioners. ---- */
+
+// M = I.
+struct IdentityPreconditioner {
+  template <typename T> void apply(const Vector<T> &r, Vector<T> &z) const {
+    std::copy(r.ptr(), r.ptr() + r.rows, z.ptr());
+  }
+};
+
+// M = diag(A)^{-1}.
+template <typename T> class JacobiPreconditioner {
+  std::vector<T> inv_diag;
+
+  void invert_();
+
+public:
+  explicit JacobiPreconditioner(const Matrix<T> &A);
+  explicit JacobiPreconditioner(const SparseMatrix<T> &A);
+
+  void apply(const Vector<T> &r, Vector<T> &z) const;
+};
+
+/**
+ *  Incomplete LU with no fill-in: L and U keep exactly the sparsity pattern
+ *  of A, so applying M = (LU)^{-1} costs two sparse triangular solves. Every
+ *  diagonal entry must be in the pattern.
+ */
+
+template <typename T> class ILU0Preconditioner {
+  SparseMatrix<T> LU; // Unit L below the diagonal, U on and above it.
+  std::vector<std::size_t> diag;
+
+public:
+  explicit ILU0Preconditioner(const SparseMatrix<T> &A);
+
+  void apply(const Vector<T> &r, Vector<T> &z) const;
+};
+
+/**
+ *  Incomplete Cholesky with no fill-in, for symmetric positive definite A:
+ *  L keeps the pattern of the lower triangle of A, and M = (L L^T)^{-1}.
+ *  Only the lower triangle of A is read. Throws if a pivot is not positive,
+ *  which can happen for SPD matrices that aren't e.g. M-matrices.
+ */
+
+template <typename T> class IC0Preconditioner {
+  SparseMatrix<T> L; // Diagonal entry last in each row.
+
+  static SparseMatrix<T> lower_(const SparseMatrix<T> &A);
+
+public:
+  explicit IC0Preconditioner(const SparseMatrix<T> &A);
+
+  void apply(const Vector<T> &r, Vector<T> &z) const;
+};
+
+/* ---- Solver declarations. ---- */
+
+template <typename Op, typename T, typename Precond>
+IterativeResult<T> cg(const Op &A, const Vector<T> &b, const Precond &M,
+                      const IterativeOptions &opts = {});
+
+template <typename Op, typename T, typename Precond>
+IterativeResult<T> bicgstab(const Op &A, const Vector<T> &b, const Precond &M,
+                            const IterativeOptions &opts = {});
+
+template <typename Op, typename T, typename Precond>
+IterativeResult<T> gmres(const Op &A, const Vector<T> &b, const Precond &M,
+                         const IterativeOptions &opts = {});
+
+// Unpreconditioned.
+
+template <typename Op, typename T>
+IterativeResult<T> cg(const Op &A, const Vector<T> &b,
+                      const IterativeOptions &opts = {}) {
+  return cg(A, b, IdentityPreconditioner{}, opts);
+}
+
+template <typename Op, typename T>
+IterativeResult<T> bicgstab(const Op &A, const Vector<T> &b,
+                            const IterativeOptions &opts = {}) {
+  return bicgstab(A, b, IdentityPreconditioner{}, opts);
+}
+
+template <typename Op, typename T>
+IterativeResult<T> gmres(const Op &A, const Vector<T> &b,
+                         const IterativeOptions &opts = {}) {
+  return gmres(A, b, IdentityPreconditioner{}, opts);
+}
+
+/* ---- Vector kernels and operator application. ---- */
+
+namespace internal {
+
+template <typename T> T dot_(const Vector<T> &x, const Vector<T> &y) {
+  const T *a = x.ptr(), *b = y.ptr();
+  return parallel_reduce(
+      0, x.rows, parallel_grain_, T{},
+      [=](std::size_t lo, std::size_t hi) {
+        T sum{};
+        for (std::size_t i = lo; i < hi; i++)
+          sum += a[i] * b[i];
+        return sum;
+      },
+      [](T s, T t) { return s + t; });
+}
+
+template <typename T> double norm2_(const Vector<T> &x) {
+  return std::sqrt(static_cast<double>(dot_(x, x)));
+}
+
+// y = a x + b y.
+template <typename T>
+void axpby_(T a, const Vector<T> &x, T b, Vector<T> &y) {
+  const T *u = x.ptr();
+  T *v = y.ptr();
+  parallel_for(0, x.rows, parallel_grain_,
+               [&](std::size_t lo, std::size_t hi) {
+                 for (std::size_t i = lo; i < hi; i++)
+                   v[i] = a * u[i] + b * v[i];
+               });
+}
+
+// y = A x.
+template <typename T, typename Alloc>
+void apply_(const Matrix<T, Alloc> &A, const Vector<T> &x, Vector<T> &y) {
+  gemv_(A, x.ptr(), y.ptr());
+}
+
+template <typename T>
+void apply_(const SparseMatrix<T> &A, const Vector<T> &x, Vector<T> &y) {
+  spmm_(A, x.ptr(), 1, 1, y.ptr(), 1);
+}
+
+template <typename F, typename T>
+void apply_(const F &f, const Vector<T> &x, Vector<T> &y) {
+  f(x, y);
+}
+
+template <typename A> void check_square_(const A &a, std::size_t n) {
+  if (a.rows != n || a.cols != n)
+    throw std::domain_error(
+        "Operator must be square and match the right-hand side.");
+}
+
+template <typename T, typename Alloc>
+void check_operator_(const Matrix<T, Alloc> &A, std::size_t n) {
+  check_square_(A, n);
+}
+
+template <typename T>
+void check_operator_(const SparseMatrix<T> &A, std::size_t n) {
+  check_square_(A, n);
+}
+
+// A callable's shape is up to the caller.
+template <typename F> void check_operator_(const F &, std::size_t) {}
+
+// Records the relative residual res and tests it against the tolerance.
+template <typename T>
+bool converged_(IterativeResult<T> &result, const IterativeOptions &opts,
+                double res) {
+  result.residual = res;
+  if (opts.history)
+    result.history.push_back(res);
+  result.converged = res <= opts.tol;
+  return result.converged;
+}
+
+} // namespace internal
+
+/* ---- Preconditioner implementation. ---- */
+
+template <typename T> void JacobiPreconditioner<T>::invert_() {
+  for (T &d : inv_diag) {
+    if (d == T{})
+      throw std::domain_error("Jacobi preconditioner needs a nonzero "
+                              "diagonal.");
+    d = T{1} / d;
+  }
+}
+
+template <typename T>
+JacobiPreconditioner<T>::JacobiPreconditioner(const Matrix<T> &A)
+    : inv_diag(A.rows) {
+  assert(A.rows == A.cols);
+  for (std::size_t i = 0; i < A.rows; i++)
+    inv_diag[i] = A(i, i);
+  invert_();
+}
+
+template <typename T>
+JacobiPreconditioner<T>::JacobiPreconditioner(const SparseMatrix<T> &A)
+    : inv_diag(A.rows) {
+  assert(A.rows == A.cols);
+  for (std::size_t i = 0; i < A.rows; i++)
+    inv_diag[i] = A(i, i);
+  invert_();
+}
+
+template <typename T>
+void JacobiPreconditioner<T>::apply(const Vector<T> &r, Vector<T> &z) const {
+  const T *d = inv_diag.data(), *u = r.ptr();
+  T *v = z.ptr();
+  parallel_for(0, r.rows, internal::parallel_grain_,
+               [&](std::size_t lo, std::size_t hi) {
+                 for (std::size_t i = lo; i < hi; i++)
+                   v[i] = d[i] * u[i];
+               });
+}
+
+template <typename T>
+ILU0Preconditioner<T>::ILU0Preconditioner(const SparseMatrix<T> &A)
+    : LU{A}, diag(A.rows) {
+  assert(A.rows == A.cols);
+  std::size_t n = A.rows;
+  const std::size_t *ptr = LU.row_ptr();
+  const unsigned *idx = LU.col_idx();
+  T *val = LU.values();
+
+  for (std::size_t i = 0; i < n; i++) {
+    const unsigned *end = idx + ptr[i + 1];
+    const unsigned *it = std::lower_bound(idx + ptr[i], end, i);
+    if (it == end || *it != i)
+      throw std::invalid_argument(
+          "ILU(0) needs every diagonal entry in the sparsity pattern.");
+    diag[i] = it - idx;
+  }
+
+  // Row-by-row (IKJ) Gaussian elimination, dropping every update that
+  // falls outside the pattern. pos maps the columns of row i to entries.
+  constexpr std::size_t none = static_cast<std::size_t>(-1);
+  std::vector<std::size_t> pos(n, none);
+  for (std::size_t i = 0; i < n; i++) {
+    for (std::size_t p = ptr[i]; p < ptr[i + 1]; p++)
+      pos[idx[p]] = p;
+
+    for (std::size_t p = ptr[i]; p < diag[i]; p++) {
+      std::size_t k = idx[p];
+      if (val[diag[k]] == T{})
+        throw std::domain_error("Zero pivot in ILU(0).");
+      T l_ik = val[p] /= val[diag[k]];
+      for (std::size_t q = diag[k] + 1; q < ptr[k + 1]; q++)
+        if (pos[idx[q]] != none)
+          val[pos[idx[q]]] -= l_ik * val[q];
+    }
+
+    for (std::size_t p = ptr[i]; p < ptr[i + 1]; p++)
+      pos[idx[p]] = none;
+  }
+
+  for (std::size_t i = 0; i < n; i++)
+    if (val[diag[i]] == T{})
+      throw std::domain_error("Zero pivot in ILU(0).");
+}
+
+template <typename T>
+void ILU0Preconditioner<T>::apply(const Vector<T> &r, Vector<T> &z) const {
+  std::size_t n = LU.rows;
+  const std::size_t *ptr = LU.row_ptr();
+  const unsigned *idx = LU.col_idx();
+  const T *val = LU.values();
+  T *x = z.ptr();
+
+  // Solve Ly = r, then Uz = y.
+  for (std::size_t i = 0; i < n; i++) {
+    T t = r[i];
+    for (std::size_t p = ptr[i]; p < diag[i]; p++)
+      t -= val[p] * x[idx[p]];
+    x[i] = t;
+  }
+  for (std::size_t i = n; i-- > 0;) {
+    T t = x[i];
+    for (std::size_t p = diag[i] + 1; p < ptr[i + 1]; p++)
+      t -= val[p] * x[idx[p]];
+    x[i] = t / val[diag[i]];
+  }
+}
+
+template <typename T>
+SparseMatrix<T> IC0Preconditioner<T>::lower_(const SparseMatrix<T> &A) {
+  assert(A.rows == A.cols);
+  std::vector<std::size_t> ptr(std::size_t{A.rows} + 1, 0);
+  std::vector<unsigned> idx;
+  std::vector<T> val;
+
+  for (std::size_t i = 0; i < A.rows; i++) {
+    for (std::size_t p = A.row_ptr()[i]; p < A.row_ptr()[i + 1]; p++) {
+      if (A.col_idx()[p] > i)
+        break;
+      idx.push_back(A.col_idx()[p]);
+      val.push_back(A.values()[p]);
+    }
+    if (idx.size() == ptr[i] || idx.back() != i)
+      throw std::invalid_argument(
+          "IC(0) needs every diagonal entry in the sparsity pattern.");
+    ptr[i + 1] = idx.size();
+  }
+
+  return SparseMatrix<T>{A.rows, A.cols, std::move(ptr), std::move(idx),
+                         std::move(val)};
+}
+
+template <typename T>
+IC0Preconditioner<T>::IC0Preconditioner(const SparseMatrix<T> &A)
+    : L{lower_(A)} {
+  std::size_t n = L.rows;
+  const std::size_t *ptr = L.row_ptr();
+  const unsigned *idx = L.col_idx();
+  T *val = L.values();
+
+  // L(i, k) = (A(i, k) - sum_{j < k} L(i, j) L(k, j)) / L(k, k), where the
+  // sum runs over the columns both rows have in the pattern.
+  for (std::size_t i = 0; i < n; i++)
+    for (std::size_t p = ptr[i]; p < ptr[i + 1]; p++) {
+      std::size_t k = idx[p];
+      T s = val[p];
+      std::size_t a = ptr[i], b = ptr[k], b_end = ptr[k + 1] - 1;
+      while (a < p && b < b_end) {
+        if (idx[a] < idx[b])
+          a++;
+        else if (idx[b] < idx[a])
+          b++;
+        else
+          s -= val[a++] * val[b++];
+      }
+
+      if (k < i) {
+        val[p] = s / val[b_end];
+      } else {
+        if (!(s > T{}))
+          throw std::domain_error("Matrix is not positive definite.");
+        val[p] = std::sqrt(s);
+      }
+    }
+}
+
+template <typename T>
+void IC0Preconditioner<T>::apply(const Vector<T> &r, Vector<T> &z) const {
+  std::size_t n = L.rows;
+  const std::size_t *ptr = L.row_ptr();
+  const unsigned *idx = L.col_idx();
+  const T *val = L.values();
+  T *x = z.ptr();
+
+  // Solve Ly = r by rows, then L^T z = y by columns of L^T (rows of L).
+  for (std::size_t i = 0; i < n; i++) {
+    T t = r[i];
+    std::size_t d = ptr[i + 1] - 1;
+    for (std::size_t p = ptr[i]; p < d; p++)
+      t -= val[p] * x[idx[p]];
+    x[i] = t / val[d];
+  }
+  for (std::size_t i = n; i-- > 0;) {
+    std::size_t d = ptr[i + 1] - 1;
+    T t = x[i] /= val[d];
+    for (std::size_t p = ptr[i]; p < d; p++)
+      x[idx[p]] -= val[p] * t;
+  }
+}
+
+/* ---- Solver implementation. ---- */
+
+template <typename Op, typename T, typename Precond>
+IterativeResult<T> cg(const Op &A, const Vector<T> &b, const Precond &M,
+                      const IterativeOptions &opts) {
+  std::size_t n = b.rows;
+  internal::check_operator_(A, n);
+  IterativeResult<T> result{Vector<T>(n), false, 0, 0.0, {}};
+  Vector<T> &x = result.x;
+
+  double b_norm = internal::norm2_(b);
+  if (b_norm == 0 || internal::converged_(result, opts, 1.0)) {
+    result.converged = true;
+    return result;
+  }
+
+  Vector<T> r{b}, z(n), p(n), Ap(n);
+  M.apply(r, z);
+  p = z;
+  T rz = internal::dot_(r, z);
+
+  while (result.iterations < opts.max_iter) {
+    internal::apply_(A, p, Ap);
+    T alpha = rz / internal::dot_(p, Ap);
+    internal::axpby_(alpha, p, T{1}, x);
+    internal::axpby_(-alpha, Ap, T{1}, r);
+    result.iterations++;
+    if (internal::converged_(result, opts, internal::norm2_(r) / b_norm))
+      break;
+
+    M.apply(r, z);
+    T rz_next = internal::dot_(r, z);
+    internal::axpby_(T{1}, z, rz_next / rz, p);
+    rz = rz_next;
+  }
+  return result;
+}
+
+template <typename Op, typename T, typename Precond>
+IterativeResult<T> bicgstab(const Op &A, const Vector<T> &b, const Precond &M,
+                            const IterativeOptions &opts) {
+  std::size_t n = b.rows;
+  internal::check_operator_(A, n);
+  IterativeResult<T> result{Vector<T>(n), false, 0, 0.0, {}};
+  Vector<T> &x = result.x;
+
+  double b_norm = internal::norm2_(b);
+  if (b_norm == 0 || internal::converged_(result, opts, 1.0)) {
+    result.converged = true;
+    return result;
+  }
+
+  Vector<T> r{b}, r_hat{b}, p(n), v(n), p_hat(n), s(n), s_hat(n), t(n);
+  T rho{1}, alpha{1}, omega{1};
+
+  while (result.iterations < opts.max_iter) {
+    T rho_next = internal::dot_(r_hat, r);
+    if (rho_next == T{} || omega == T{})
+      break; // Breakdown; restarting from x would be the remedy.
+
+    // p = r + beta (p - omega v).
+    T beta = (rho_next / rho) * (alpha / omega);
+    internal::axpby_(-omega, v, T{1}, p);
+    internal::axpby_(T{1}, r, beta, p);
+    rho = rho_next;
+
+    M.apply(p, p_hat);
+    internal::apply_(A, p_hat, v);
+    alpha = rho / internal::dot_(r_hat, v);
+
+    s = r;
+    internal::axpby_(-alpha, v, T{1}, s);
+    internal::axpby_(alpha, p_hat, T{1}, x);
+    result.iterations++;
+    double s_norm = internal::norm2_(s) / b_norm;
+    if (s_norm <= opts.tol) {
+      internal::converged_(result, opts, s_norm);
+      break;
+    }
+
+    M.apply(s, s_hat);
+    internal::apply_(A, s_hat, t);
+    omega = internal::dot_(t, s) / internal::dot_(t, t);
+    internal::axpby_(omega, s_hat, T{1}, x);
+
+    r = s;
+    internal::axpby_(-omega, t, T{1}, r);
+    if (internal::converged_(result, opts, internal::norm2_(r) / b_norm))
+      break;
+  }
+  return result;
+}
+
+template <typename Op, typename T, typename Precond>
+IterativeResult<T> gmres(const Op &A, const Vector<T> &b, const Precond &M,
+                         const IterativeOptions &opts) {
+  std::size_t n = b.rows;
+  internal::check_operator_(A, n);
+  IterativeResult<T> result{Vector<T>(n), false, 0, 0.0, {}};
+  Vector<T> &x = result.x;
+
+  double b_norm = internal::norm2_(b);
+  if (b_norm == 0 || internal::converged_(result, opts, 1.0)) {
+    result.converged = true;
+    return result;
+  }
+
+  unsigned m = std::max(opts.restart, 1u);
+  Matrix<T> V{m + 1, n}; // Arnoldi basis, one vector per row.
+  Matrix<T> H{m + 1, m}; // Hessenberg matrix, reduced to triangular form.
+  std::vector<T> cs(m), sn(m), g(m + 1);
+  Vector<T> r(n), v(n), z(n), w(n);
+
+  for (;;) {
+    // Restart from the true residual r = b - Ax.
+    internal::apply_(A, x, r);
+    internal::axpby_(T{1}, b, T{-1}, r);
+    T beta = static_cast<T>(internal::norm2_(r));
+    result.residual = beta / b_norm;
+    if (result.residual <= opts.tol || result.iterations >= opts.max_iter)
+      break;
+
+    std::fill(g.begin(), g.end(), T{});
+    g[0] = beta;
+    for (std::size_t i = 0; i < n; i++)
+      V(0, i) = r[i] / beta;
+
+    unsigned j = 0;
+    bool done = false;
+    while (j < m && !done) {
+      // w = A M v_j, orthogonalized against v_0, ..., v_j (modified
+      // Gram-Schmidt).
+      std::copy(V.ptr() + std::size_t{j} * n,
+                V.ptr() + std::size_t{j + 1} * n, v.ptr());
+      M.apply(v, z);
+      internal::apply_(A, z, w);
+      for (std::size_t i = 0; i <= j; i++) {
+        std::copy(V.ptr() + std::size_t{i} * n,
+                  V.ptr() + std::size_t{i + 1} * n, v.ptr());
+        H(i, j) = internal::dot_(w, v);
+        internal::axpby_(-H(i, j), v, T{1}, w);
+      }
+      H(j + 1, j) = static_cast<T>(internal::norm2_(w));
+      if (H(j + 1, j) != T{})
+        for (std::size_t i = 0; i < n; i++)
+          V(j + 1, i) = w[i] / H(j + 1, j);
+
+      // Apply the earlier Givens rotations to column j, then zero H(j+1, j).
+      for (std::size_t i = 0; i < j; i++) {
+        T h = cs[i] * H(i, j) + sn[i] * H(i + 1, j);
+        H(i + 1, j) = -sn[i] * H(i, j) + cs[i] * H(i + 1, j);
+        H(i, j) = h;
+      }
+      T d = std::hypot(H(j, j), H(j + 1, j));
+      cs[j] = H(j, j) / d;
+      sn[j] = H(j + 1, j) / d;
+      H(j, j) = d;
+      H(j + 1, j) = T{};
+      g[j + 1] = -sn[j] * g[j];
+      g[j] = cs[j] * g[j];
+
+      j++;
+      result.iterations++;
+      double res = std::abs(static_cast<double>(g[j])) / b_norm;
+      if (opts.history)
+        result.history.push_back(res);
+      done = res <= opts.tol || result.iterations >= opts.max_iter;
+    }
+
+    // x += M V y, with H y = g solved by back substitution.
+    for (std::size_t i = j; i-- > 0;) {
+      for (std::size_t l = i + 1; l < j; l++)
+        g[i] -= H(i, l) * g[l];
+      g[i] /= H(i, i);
+    }
+    std::fill(v.ptr(), v.ptr() + n, T{});
+    for (std::size_t i = 0; i < j; i++)
+      for (std::size_t l = 0; l < n; l++)
+        v[l] += g[i] * V(i, l);
+    M.apply(v, z);
+    internal::axpby_(T{1}, z, T{1}, x);
+  }
+
+  // The history holds the Arnoldi estimates; the result the true residual.
+  result.converged = result.residual <= opts.tol;
+  return result;
+}
+
+} // namespace matrix
+
+#endif
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "allocator.hpp"
+#include "gemm.hpp"
+#include "matrix.hpp"
+#include "operations.hpp"
+#include "solvers.hpp"
+#include "vector.hpp"
+#include "view.hpp"
+
+#ifndef LU_UPDATE_H
+#define LU_UPDATE_H
+
+namespace matrix {
+
+/**
+ *  An LU factorization that follows low-rank changes to its matrix without
+ *  refactoring it: A = A0 + U V^T, where A0 was factored by
+ *  LUFactorization and U and V are n x K. By the Sherman-Morrison-Woodbury
+ *  formula,
+ *
+ *    A^-1 b = A0^-1 b - W C^-1 V^T A0^-1 b,  W = A0^-1 U,  C = I + V^T W.
+ *
+ *  W is solved for as the columns of U arrive, and the small capacitance
+ *  matrix C is refactored on every change. A rank-k change then costs
+ *  O(n^2 k) instead of the O(n^3) of a new factorization, and a solve costs
+ *  O(n^2 + nK). Row and column replacements are rank-1 changes.
+ *
+ *  The current A is kept too, and factored afresh once the total rank K
+ *  would exceed max_rank, or once the accumulated error has grown. After
+ *  each change a probe z = (1, -1, 1, ...) is solved for from Az, which is
+ *  itself kept up to date in O(nk). A is refactored if the error in z
+ *  exceeds both tol and 100 times its error right after the last refactor.
+ *
+ *  Woodbury is used rather than updating L and U themselves (Bennett),
+ *  which is unstable without pivoting.
+ */
+
+struct LUUpdateOptions {
+  unsigned max_rank = 64; // Total rank of the changes between refactors.
+  double tol = 1e-8;      // Probe error that may trigger a refactor.
+};
+
+template <typename T> class UpdatableLU {
+  Matrix<T> A;
+  LUFactorization<T> base;
+  // The first K columns hold V and W = A0^-1 U. U is only needed to form
+  // W, so it isn't kept.
+  Matrix<T> V, W;
+  // The probe z = (1, -1, 1, ...), and Az.
+  Vector<T> z, az;
+  std::unique_ptr<LUFactorization<T>> cap;
+  LUUpdateOptions opts;
+  unsigned K = 0;
+  unsigned num_refactors = 0;
+  double probe_error0 = 0;
+
+  double probe_error_() const;
+  void add_(const T *u, std::size_t ldu, const T *v, std::size_t ldv,
+            std::size_t k);
+
+public:
+  explicit UpdatableLU(const Matrix<T> &A, const LUUpdateOptions &opts = {});
+  template <typename E>
+  explicit UpdatableLU(const MatrixExpr<E> &A,
+                       const LUUpdateOptions &opts = {})
+      : UpdatableLU(Matrix<T>{A.self()}, opts) {}
+
+  std::size_t size() const { return A.rows; }
+  // The current matrix, with every change applied.
+  const Matrix<T> &matrix() const { return A; }
+  // Total rank of the changes since the last refactor.
+  unsigned rank() const { return K; }
+  unsigned refactors() const { return num_refactors; }
+
+  // A = A + u v^T, for n x k u and v.
+  void update(const Matrix<T> &u, const Matrix<T> &v);
+  // Overwrite row i or column j of A with the n entries of r or c.
+  void replace_row(std::size_t i, const Matrix<T> &r);
+  void replace_col(std::size_t j, const Matrix<T> &c);
+  // Factor the current A from scratch.
+  void refactor();
+
+  void solve_in_place(MatrixView<T> b) const;
+  Matrix<T> solve(const Matrix<T> &b) const;
+  Vector<T> solve(const Vector<T> &b) const;
+};
+
+/* ---- UpdatableLU implementation. ---- */
+
+template <typename T>
+UpdatableLU<T>::UpdatableLU(const Matrix<T> &A_, const LUUpdateOptions &opts)
+    : A{A_}, base{A_}, V{A_.rows, opts.max_rank}, W{A_.rows, opts.max_rank},
+      z(A_.rows), az(A_.rows), opts{opts} {
+  assert(A.rows == A.cols);
+  for (std::size_t i = 0; i < A.rows; i++)
+    z[i] = i % 2 ? T{-1} : T{1};
+  internal::gemv_(A, z.ptr(), az.ptr());
+  if (!base.singular())
+    probe_error0 = probe_error_();
+}
+
+template <typename T> void UpdatableLU<T>::refactor() {
+  base = LUFactorization<T>{A};
+  cap.reset();
+  K = 0;
+  num_refactors++;
+  internal::gemv_(A, z.ptr(), az.ptr());
+  probe_error0 = base.singular() ? 0 : probe_error_();
+}
+
+// Error in the solution z of Az = az.
+template <typename T> double UpdatableLU<T>::probe_error_() const {
+  Vector<T> x = solve(az);
+  double err = 0;
+  for (std::size_t i = 0; i < A.rows; i++)
+    err = std::max(err, static_cast<double>(std::abs(x[i] - z[i])));
+  return err;
+}
+
+// Extend the Woodbury form by the n x k u and v, once A = A + u v^T has
+// been applied, or refactor. Az is updated by u (v^T z) in O(nk).
+template <typename T>
+void UpdatableLU<T>::add_(const T *u, std::size_t ldu, const T *v,
+                          std::size_t ldv, std::size_t k) {
+  std::size_t n = A.rows, ld = opts.max_rank;
+  if (K + k > opts.max_rank || base.singular()) {
+    refactor();
+    return;
+  }
+
+  for (std::size_t c = 0; c < k; c++) {
+    T vz{};
+    for (std::size_t i = 0; i < n; i++)
+      vz += v[i * ldv + c] * z[i];
+    for (std::size_t i = 0; i < n; i++)
+      az[i] += u[i * ldu + c] * vz;
+  }
+  for (std::size_t i = 0; i < n; i++) {
+    std::copy(v + i * ldv, v + i * ldv + k, V.ptr() + i * ld + K);
+    std::copy(u + i * ldu, u + i * ldu + k, W.ptr() + i * ld + K);
+  }
+  base.solve_in_place(W.block(0, K, A.rows, k));
+  K += static_cast<unsigned>(k);
+
+  // C = I + V^T W.
+  Matrix<T> C{K, K};
+  for (std::size_t i = 0; i < K; i++)
+    C(i, i) = T{1};
+  internal::gemm<T>(K, K, n, T{1}, V.ptr(), 1, ld, W.ptr(), ld, 1, T{1},
+                    C.ptr(), K, 1);
+  cap = std::make_unique<LUFactorization<T>>(std::move(C));
+
+  // A singular C means A is singular too; leave that to the solve.
+  if (cap->singular() ||
+      probe_error_() > std::max(opts.tol, 100 * probe_error0))
+    refactor();
+}
+
+template <typename T>
+void UpdatableLU<T>::update(const Matrix<T> &u, const Matrix<T> &v) {
+  if (u.rows != A.rows || v.rows != A.rows || u.cols != v.cols)
+    throw std::domain_error("Matrix shapes do not match.");
+  if (u.cols == 0)
+    return;
+
+  std::size_t n = A.rows;
+  internal::gemm<T>(n, n, u.cols, T{1}, u.ptr(), u.cols, 1, v.ptr(), 1,
+                    v.cols, T{1}, A.ptr(), n, 1);
+  add_(u.ptr(), u.cols, v.ptr(), v.cols, u.cols);
+}
+
+template <typename T>
+void UpdatableLU<T>::replace_row(std::size_t i, const Matrix<T> &r) {
+  std::size_t n = A.rows;
+  if (i >= n || r.rows * r.cols != n)
+    throw std::domain_error("Matrix shapes do not match.");
+
+  // e_i (r - A(i, :)).
+  Matrix<T> u{A.rows, 1}, v{A.rows, 1};
+  u(i, 0) = T{1};
+  for (std::size_t j = 0; j < n; j++) {
+    v.ptr()[j] = r.ptr()[j] - A.ptr()[i * n + j];
+    A.ptr()[i * n + j] = r.ptr()[j];
+  }
+  add_(u.ptr(), 1, v.ptr(), 1, 1);
+}
+
+template <typename T>
+void UpdatableLU<T>::replace_col(std::size_t j, const Matrix<T> &c) {
+  std::size_t n = A.rows;
+  if (j >= n || c.rows * c.cols != n)
+    throw std::domain_error("Matrix shapes do not match.");
+
+  // (c - A(:, j)) e_j^T.
+  Matrix<T> u{A.rows, 1}, v{A.rows, 1};
+  v(j, 0) = T{1};
+  for (std::size_t i = 0; i < n; i++) {
+    u.ptr()[i] = c.ptr()[i] - A.ptr()[i * n + j];
+    A.ptr()[i * n + j] = c.ptr()[i];
+  }
+  add_(u.ptr(), 1, v.ptr(), 1, 1);
+}
+
+template <typename T>
+void UpdatableLU<T>::solve_in_place(MatrixView<T> b) const {
+  assert(b.rows == A.rows);
+  base.solve_in_place(b);
+  if (K == 0)
+    return;
+
+  // b = b - W C^-1 V^T b.
+  std::size_t n = A.rows, ld = opts.max_rank, m = b.cols;
+  ArenaScope scope;
+  Matrix<T, ArenaAllocator<T>> y{K, b.cols, uninitialized};
+  internal::gemm<T>(K, m, n, T{1}, V.ptr(), 1, ld, b.ptr(), b.row_stride(),
+                    b.col_stride(), T{0}, y.ptr(), m, 1);
+  cap->solve_in_place(y);
+  internal::gemm<T>(n, m, K, T{-1}, W.ptr(), ld, 1, y.ptr(), m, 1, T{1},
+                    b.ptr(), b.row_stride(), b.col_stride());
+}
+
+template <typename T>
+Matrix<T> UpdatableLU<T>::solve(const Matrix<T> &b) const {
+  Matrix<T> x{b};
+  solve_in_place(x);
+  return x;
+}
+
+template <typename T>
+Vector<T> UpdatableLU<T>::solve(const Vector<T> &b) const {
+  Vector<T> x{b};
+  solve_in_place(x);
+  return x;
+}
+
+} // namespace matrix
+
+#endif
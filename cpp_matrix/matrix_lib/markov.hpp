@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "gemm.hpp"
+#include "iterative.hpp"
+#include "matrix.hpp"
+#include "sparse.hpp"
+#include "thread_pool.hpp"
+#include "vector.hpp"
+
+#ifndef MARKOV_H
+#define MARKOV_H
+
+namespace matrix {
+
+/**
+ *  Stationary distributions pi = pi P, sum(pi) = 1, of Markov chains with
+ *  a row-stochastic transition matrix P.
+ *
+ *  A MarkovChain keeps P^T in CSR form, so pi P is one multithreaded SpMV
+ *  over rows of P^T and each iteration costs O(nnz), instead of the O(n^3)
+ *  of a dense product of transition matrices. It offers
+ *
+ *    - power(): pi_{k+1} = pi_k P, the simplest, converging at the rate of
+ *      P's second largest eigenvalue modulus (it fails on periodic chains);
+ *    - gauss_seidel(): sweeps over pi (I - P) = 0 that use each new entry
+ *      at once, usually in far fewer iterations, but serially;
+ *    - gmres(): GMRES(m) on (I - P^T) pi^T = 0 with its last equation
+ *      replaced by sum(pi) = 1, which is nonsingular for an irreducible
+ *      chain and copes with slowly mixing or periodic chains.
+ *
+ *  stationary_squaring() instead squares a small dense P until P^(2^k)
+ *  stops changing, which takes O(n^3 log k) time for k steps of the chain.
+ *
+ *  All of them start from the uniform distribution, take IterativeOptions
+ *  and return an IterativeResult with pi as x. Power iteration and
+ *  Gauss-Seidel stop once an iteration changes pi by at most tol in the
+ *  1-norm, GMRES on its relative residual, and squaring once P^(2^k)
+ *  changes by at most tol in the infinity norm. residual is always
+ *  ||pi P - pi||_1 of the returned pi; history holds the stopping measure
+ *  of every iteration.
+ */
+
+template <typename T> class MarkovChain {
+  SparseMatrix<T> Pt;
+
+  // Set pi to pi / sum(pi), returning the 1-norm of its change from prev.
+  static double normalize_(Vector<T> &pi, const Vector<T> &prev);
+
+public:
+  explicit MarkovChain(const SparseMatrix<T> &P);
+  explicit MarkovChain(const Matrix<T> &P) : MarkovChain(SparseMatrix<T>{P}) {}
+
+  std::size_t states() const { return Pt.rows; }
+  // ||pi P - pi||_1.
+  double residual(const Vector<T> &pi) const;
+
+  IterativeResult<T> power(const IterativeOptions &opts = {}) const;
+  IterativeResult<T> gauss_seidel(const IterativeOptions &opts = {}) const;
+  IterativeResult<T> gmres(const IterativeOptions &opts = {}) const;
+};
+
+/* ---- MarkovChain implementation. ---- */
+
+template <typename T>
+MarkovChain<T>::MarkovChain(const SparseMatrix<T> &P) : Pt{P.transpose()} {
+  if (P.rows != P.cols)
+    throw std::domain_error("Transition matrix must be square.");
+
+  // Rows of P are columns of Pt; sum them in one pass over the entries.
+  std::vector<double> sums(P.rows, 0.0);
+  const T *val = P.values();
+  for (std::size_t i = 0; i < P.rows; i++)
+    for (std::size_t k = P.row_ptr()[i]; k < P.row_ptr()[i + 1]; k++) {
+      if (val[k] < T{})
+        throw std::domain_error("Transition probabilities must be >= 0.");
+      sums[i] += static_cast<double>(val[k]);
+    }
+  double tol = std::sqrt(std::numeric_limits<T>::epsilon());
+  for (double s : sums)
+    if (std::abs(s - 1) > tol)
+      throw std::domain_error("Rows of a transition matrix must sum to 1.");
+}
+
+template <typename T>
+double MarkovChain<T>::normalize_(Vector<T> &pi, const Vector<T> &prev) {
+  T *x = pi.ptr();
+  const T *y = prev.ptr();
+  auto add = [](double a, double b) { return a + b; };
+  double sum = parallel_reduce(
+      0, pi.rows, internal::parallel_grain_, 0.0,
+      [=](std::size_t lo, std::size_t hi) {
+        double s = 0;
+        for (std::size_t i = lo; i < hi; i++)
+          s += static_cast<double>(x[i]);
+        return s;
+      },
+      add);
+  T scale = static_cast<T>(1 / sum);
+  return parallel_reduce(
+      0, pi.rows, internal::parallel_grain_, 0.0,
+      [=](std::size_t lo, std::size_t hi) {
+        double d = 0;
+        for (std::size_t i = lo; i < hi; i++) {
+          x[i] *= scale;
+          d += std::abs(static_cast<double>(x[i] - y[i]));
+        }
+        return d;
+      },
+      add);
+}
+
+template <typename T>
+double MarkovChain<T>::residual(const Vector<T> &pi) const {
+  Vector<T> y(Pt.rows);
+  internal::spmm_(Pt, pi.ptr(), 1, 1, y.ptr(), 1);
+  const T *x = pi.ptr(), *z = y.ptr();
+  return parallel_reduce(
+      0, pi.rows, internal::parallel_grain_, 0.0,
+      [=](std::size_t lo, std::size_t hi) {
+        double d = 0;
+        for (std::size_t i = lo; i < hi; i++)
+          d += std::abs(static_cast<double>(z[i] - x[i]));
+        return d;
+      },
+      [](double a, double b) { return a + b; });
+}
+
+template <typename T>
+IterativeResult<T> MarkovChain<T>::power(const IterativeOptions &opts) const {
+  std::size_t n = Pt.rows;
+  IterativeResult<T> result{Vector<T>(n), false, 0, 0.0, {}};
+  std::fill(result.x.ptr(), result.x.ptr() + n, T{1} / n);
+  Vector<T> prev(n);
+
+  while (!result.converged && result.iterations < opts.max_iter) {
+    std::swap_ranges(result.x.ptr(), result.x.ptr() + n, prev.ptr());
+    internal::spmm_(Pt, prev.ptr(), 1, 1, result.x.ptr(), 1);
+    result.iterations++;
+    internal::converged_(result, opts, normalize_(result.x, prev));
+  }
+  result.residual = residual(result.x);
+  return result;
+}
+
+template <typename T>
+IterativeResult<T>
+MarkovChain<T>::gauss_seidel(const IterativeOptions &opts) const {
+  std::size_t n = Pt.rows;
+  IterativeResult<T> result{Vector<T>(n), false, 0, 0.0, {}};
+  T *x = result.x.ptr();
+  std::fill(x, x + n, T{1} / n);
+  Vector<T> prev(n);
+
+  const std::size_t *ptr = Pt.row_ptr();
+  const unsigned *idx = Pt.col_idx();
+  const T *val = Pt.values();
+  std::vector<T> inv_diag(n);
+  for (std::size_t i = 0; i < n; i++) {
+    T d = T{1} - Pt(i, i);
+    if (d <= T{})
+      throw std::domain_error("Gauss-Seidel needs a chain without "
+                              "absorbing states.");
+    inv_diag[i] = T{1} / d;
+  }
+
+  // x_i = sum_{j != i} P_ji x_j / (1 - P_ii), in order of i.
+  while (!result.converged && result.iterations < opts.max_iter) {
+    prev = result.x;
+    for (std::size_t i = 0; i < n; i++) {
+      T sum{};
+      for (std::size_t k = ptr[i]; k < ptr[i + 1]; k++)
+        if (idx[k] != i)
+          sum += val[k] * x[idx[k]];
+      x[i] = sum * inv_diag[i];
+    }
+    result.iterations++;
+    internal::converged_(result, opts, normalize_(result.x, prev));
+  }
+  result.residual = residual(result.x);
+  return result;
+}
+
+template <typename T>
+IterativeResult<T> MarkovChain<T>::gmres(const IterativeOptions &opts) const {
+  std::size_t n = Pt.rows;
+  const SparseMatrix<T> &Pt_ = Pt;
+
+  // y = (I - P^T) x, with its last entry replaced by sum(x).
+  auto op = [&Pt_, n](const Vector<T> &x, Vector<T> &y) {
+    internal::spmm_(Pt_, x.ptr(), 1, 1, y.ptr(), 1);
+    internal::axpby_(T{1}, x, T{-1}, y);
+    T sum{};
+    for (std::size_t i = 0; i < n; i++)
+      sum += x[i];
+    y[n - 1] = sum;
+  };
+  Vector<T> b(n);
+  b[n - 1] = T{1};
+
+  IterativeResult<T> result = matrix::gmres(op, b, opts);
+  Vector<T> zero(n);
+  normalize_(result.x, zero);
+  result.residual = residual(result.x);
+  return result;
+}
+
+/* ---- Repeated squaring. ---- */
+
+template <typename T>
+IterativeResult<T> stationary_squaring(const Matrix<T> &P,
+                                       const IterativeOptions &opts = {}) {
+  if (P.rows != P.cols)
+    throw std::domain_error("Transition matrix must be square.");
+  std::size_t n = P.rows;
+  IterativeResult<T> result{Vector<T>(P.rows), false, 0, 0.0, {}};
+
+  Matrix<T> A{P}, B{P.rows, P.cols};
+  Matrix<T> *cur = &A, *next = &B;
+  while (!result.converged && result.iterations < opts.max_iter) {
+    internal::gemm<T>(n, n, n, T{1}, cur->ptr(), n, 1, cur->ptr(), n, 1, T{},
+                      next->ptr(), n, 1);
+    std::swap(cur, next);
+    result.iterations++;
+    internal::converged_(result, opts, infNorm(*cur - *next));
+  }
+
+  // Every row of P^(2^k) approximates pi; average them.
+  for (std::size_t i = 0; i < n; i++)
+    for (std::size_t j = 0; j < n; j++)
+      result.x[j] += cur->ptr()[i * n + j] / n;
+  result.residual = MarkovChain<T>{P}.residual(result.x);
+  return result;
+}
+
+} // namespace matrix
+
+#endif
@@ -1,86 +1,174 @@
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <type_traits>
 
-namespace matrix {
-
-/* ---- Forward declarations. ---- */
-
-template <typename T> class Matrix;
+#include "allocator.hpp"
+#include "expressions.hpp"
+#include "view.hpp"
 
-template <typename T> Matrix<T> operator*(const T &, const Matrix<T> &);
+namespace matrix {
 
 #ifndef MATRIX_IMPL
 #define MATRIX_IMPL
 
 /* ---- Matrix declaration. ---- */
 
-template <typename T> class Matrix {
+// Alloc is the storage policy; see allocator.hpp.
+template <typename T, typename Alloc>
+class Matrix : public MatrixExpr<Matrix<T, Alloc>> {
 protected:
   // Store row-major.
   T *data;
 
+  static T *allocate_(std::size_t n);
+  static void release_(T *p, std::size_t n);
+
 public:
-  const unsigned rows;
-  const unsigned cols;
+  typedef T value_type;
+
+  const std::size_t rows;
+  const std::size_t cols;
 
 public:
-  Matrix(const unsigned &, const unsigned &);
+  typedef Alloc allocator_type;
+
+  Matrix(std::size_t, std::size_t);
+  // Leave the entries uninitialized, for storage about to be overwritten.
+  Matrix(std::size_t, std::size_t, Uninitialized);
   Matrix(std::initializer_list<std::initializer_list<T>>);
 
+  // Evaluate an elementwise expression; see expressions.hpp.
+  template <typename E> Matrix(const MatrixExpr<E> &);
+
   // Explicit deep copy constructor.
-  Matrix(const Matrix<T> &);
+  Matrix(const Matrix &);
 
   // Explicit move constructor;
-  Matrix(Matrix<T> &&other) noexcept;
+  Matrix(Matrix &&other) noexcept;
 
   ~Matrix();
 
   // See: https://isocpp.org/wiki/faq/operator-overloading#matrix-subscript-op
 
-  T &operator()(unsigned row, unsigned col); // To modify the value.
-  T operator()(unsigned row,
-               unsigned col) const; // For use with const Matrixes.
+  T &operator()(std::size_t row, std::size_t col); // To modify the value.
+  T operator()(std::size_t row,
+               std::size_t col) const; // For use with const Matrixes.
 
-  Matrix<T> &operator=(const Matrix<T> &);
-  Matrix<T> &operator=(Matrix<T> &&);
+  // Raw row-major storage, for kernels that work on contiguous blocks.
+  T *ptr() { return data; }
+  const T *ptr() const { return data; }
 
-  explicit operator std::string() const;
+  // Non-owning views of the storage; see view.hpp.
+  MatrixView<T> view() { return *this; }
+  ConstMatrixView<T> view() const { return *this; }
+  MatrixView<T> block(std::size_t row, std::size_t col,
+                      std::size_t num_rows, std::size_t num_cols) {
+    return view().block(row, col, num_rows, num_cols);
+  }
+  ConstMatrixView<T> block(std::size_t row, std::size_t col,
+                           std::size_t num_rows, std::size_t num_cols) const {
+    return view().block(row, col, num_rows, num_cols);
+  }
+  MatrixView<T> row(std::size_t i) { return view().row(i); }
+  ConstMatrixView<T> row(std::size_t i) const { return view().row(i); }
+  MatrixView<T> col(std::size_t j) { return view().col(j); }
+  ConstMatrixView<T> col(std::size_t j) const { return view().col(j); }
+  MatrixView<T> transpose() { return view().transpose(); }
+  ConstMatrixView<T> transpose() const { return view().transpose(); }
+
+  Matrix &operator=(const Matrix &);
+  Matrix &operator=(Matrix &&);
+  // Evaluates expr entry by entry straight into this matrix, so entry (i, j)
+  // of expr may read entry (i, j) of this matrix, as in `A = 2.0 * A + B`,
+  // but no other entry of it: `A = A.transpose()` overwrites entries it
+  // has yet to read. Copy first, e.g. `A = Matrix<T>{A.transpose()}`.
+  template <typename E> Matrix &operator=(const MatrixExpr<E> &);
+
+  // In place, without allocating; the same aliasing rule as for assignment
+  // applies to expr.
+  template <typename E> Matrix &operator+=(const MatrixExpr<E> &expr) {
+    return *this = BinaryExpr<Matrix, E, internal::add_op_>{*this, expr.self()};
+  }
+  template <typename E> Matrix &operator-=(const MatrixExpr<E> &expr) {
+    return *this = BinaryExpr<Matrix, E, internal::sub_op_>{*this, expr.self()};
+  }
+  Matrix &operator*=(const T &a) {
+    return *this = ScaledExpr<Matrix>{a, *this};
+  }
 
-  friend Matrix<T> operator* <T>(const T &a, const Matrix<T> &m);
+  explicit operator std::string() const;
 };
 
 /* ---- Matrix implementation. ---- */
 
+namespace internal {
+
+// Copy n entries, with memcpy if T allows it. Large copies are split over
+// the thread pool, which first-touches the destination's pages.
+template <typename T>
+void copy_entries_(const T *src, std::size_t n, T *dst) {
+  if constexpr (std::is_trivially_copyable<T>::value) {
+    const char *s = reinterpret_cast<const char *>(src);
+    char *d = reinterpret_cast<char *>(dst);
+    first_touch_(n * sizeof(T), [s, d](std::size_t lo, std::size_t hi) {
+      std::memcpy(d + lo, s + lo, hi - lo);
+    });
+  } else {
+    std::copy(src, src + n, dst);
+  }
+}
+
+// Value-initialize n entries of new storage: zero them, in parallel when
+// there are many, for arithmetic T.
+template <typename T> void zero_entries_(T *dst, std::size_t n) {
+  if constexpr (std::is_arithmetic<T>::value) {
+    char *d = reinterpret_cast<char *>(dst);
+    first_touch_(n * sizeof(T), [d](std::size_t lo, std::size_t hi) {
+      std::memset(d + lo, 0, hi - lo);
+    });
+  } else {
+    std::uninitialized_value_construct_n(dst, n);
+  }
+}
+
+} // namespace internal
+
 // Access operators.
 
-template <typename T> T &Matrix<T>::operator()(unsigned row, unsigned col) {
+template <typename T, typename Alloc>
+T &Matrix<T, Alloc>::operator()(std::size_t row, std::size_t col) {
   // Row-major access.
   return data[col + row * cols];
 }
 
-template <typename T>
-T Matrix<T>::operator()(unsigned row, unsigned col) const {
+template <typename T, typename Alloc>
+T Matrix<T, Alloc>::operator()(std::size_t row, std::size_t col) const {
   // Row-major access.
   return data[col + row * cols];
 }
 
 // Render matrix to string.
 
-template <typename T> Matrix<T>::operator std::string() const {
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::operator std::string() const {
   // Compute max width for alignment.
-  unsigned first_col_max_width = 0;
-  unsigned max_width = 0;
-  for (unsigned i = 0; i < rows; i++) {
-    for (unsigned j = 0; j < cols; j++) {
+  std::size_t first_col_max_width = 0;
+  std::size_t max_width = 0;
+  for (std::size_t i = 0; i < rows; i++) {
+    for (std::size_t j = 0; j < cols; j++) {
       const T &entry = (*this)(i, j);
       std::ostringstream wrd;
       wrd.precision(PRECISION);
       wrd << std::fixed << entry;
 
       std::string as_string = wrd.str();
-      unsigned width = static_cast<unsigned>(as_string.length());
+      std::size_t width = as_string.length();
 
       if (j == 0)
         first_col_max_width =
@@ -93,8 +181,8 @@ template <typename T> Matrix<T>::operator std::string() const {
   // Build string.
   std::stringstream oss{};
   oss << std::fixed << std::setprecision(PRECISION);
-  for (unsigned i = 0; i < rows; i++) {
-    for (unsigned j = 0; j < cols; j++) {
+  for (std::size_t i = 0; i < rows; i++) {
+    for (std::size_t j = 0; j < cols; j++) {
       const T &entry = (*this)(i, j);
       std::string as_string = std::to_string(entry);
 
@@ -110,75 +198,124 @@ template <typename T> Matrix<T>::operator std::string() const {
   return oss.str();
 }
 
+// Storage.
+
+// Allocate room for n entries without constructing them.
+template <typename T, typename Alloc>
+T *Matrix<T, Alloc>::allocate_(std::size_t n) {
+  Alloc alloc;
+  return std::allocator_traits<Alloc>::allocate(alloc, n);
+}
+
+template <typename T, typename Alloc>
+void Matrix<T, Alloc>::release_(T *p, std::size_t n) {
+  if (p == nullptr)
+    return;
+  std::destroy_n(p, n);
+  Alloc alloc;
+  std::allocator_traits<Alloc>::deallocate(alloc, p, n);
+}
+
 // Constructors and destructor.
 
-template <typename T> Matrix<T>::~Matrix() { delete[] data; }
+template <typename T, typename Alloc> Matrix<T, Alloc>::~Matrix() {
+  release_(data, rows * cols);
+}
 
-template <typename T>
-Matrix<T>::Matrix(const unsigned &rows, const unsigned &cols)
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::Matrix(std::size_t rows, std::size_t cols)
+    : rows{rows}, cols{cols} {
+  const std::size_t num_entries = rows * cols;
+  data = allocate_(num_entries);
+  internal::zero_entries_(data, num_entries);
+}
+
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::Matrix(std::size_t rows, std::size_t cols, Uninitialized)
     : rows{rows}, cols{cols} {
-  const unsigned int num_entries = rows * cols;
-  data = new T[num_entries]{};
+  const std::size_t num_entries = rows * cols;
+  data = allocate_(num_entries);
+  std::uninitialized_default_construct_n(data, num_entries);
 }
 
 // Thanks to:
 // https://stackoverflow.com/questions/42068882/list-initialization-for-a-matrix-class
-template <typename T>
-Matrix<T>::Matrix(std::initializer_list<std::initializer_list<T>> init)
-    : Matrix((unsigned)init.size(), (unsigned)(init.begin())->size()) {
-  unsigned rows = init.size();
-  unsigned cols = (init.begin())->size();
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::Matrix(std::initializer_list<std::initializer_list<T>> init)
+    : Matrix(init.size(), init.begin()->size()) {
+  std::size_t rows = init.size();
+  std::size_t cols = (init.begin())->size();
   for (auto row : init) {
-    unsigned row_cols = row.size();
+    std::size_t row_cols = row.size();
     assert(row_cols == cols); // Could improve handling.
   }
 
   // Do assignment.
-  for (unsigned i = 0; i < rows; i++)
-    for (unsigned j = 0; j < cols; j++)
+  for (std::size_t i = 0; i < rows; i++)
+    for (std::size_t j = 0; j < cols; j++)
       data[j + i * cols] = ((init.begin() + i)->begin())[j];
 }
 
-template <typename T>
-Matrix<T>::Matrix(Matrix<T> &&other) noexcept
+template <typename T, typename Alloc>
+template <typename E>
+Matrix<T, Alloc>::Matrix(const MatrixExpr<E> &expr)
+    : Matrix(expr.self().rows, expr.self().cols, uninitialized) {
+  internal::evaluate_(data, cols, 1, expr.self());
+}
+
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::Matrix(Matrix &&other) noexcept
     : data{other.data}, rows{other.rows}, cols{other.cols} {
   other.data = nullptr;
 }
 
-template <typename T>
-Matrix<T>::Matrix(const Matrix<T> &other) : rows{other.rows}, cols{other.cols} {
-  const unsigned int num_entries = rows * cols;
-  data = new T[num_entries]{};
-  for (unsigned i = 0; i < rows; i++)
-    for (unsigned j = 0; j < cols; j++)
-      data[j + i * cols] = other(i, j);
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::Matrix(const Matrix &other)
+    : Matrix(other.rows, other.cols, uninitialized) {
+  internal::copy_entries_(other.data, rows * cols, data);
 }
 
 // Assignment operators.
 
-template <typename T> Matrix<T> &Matrix<T>::operator=(const Matrix<T> &other) {
+template <typename T, typename Alloc>
+Matrix<T, Alloc> &Matrix<T, Alloc>::operator=(const Matrix &other) {
   if (other.rows != rows || other.cols != cols)
     throw std::domain_error("Dimensions of assigned matrix must match "
                             "dimensions of destination matrix.");
 
-  for (unsigned i = 0; i < rows; i++)
-    for (unsigned j = 0; j < cols; j++)
-      data[j + i * cols] = other(i, j);
-
+  if (&other != this)
+    internal::copy_entries_(other.data, rows * cols, data);
   return *this;
 }
 
-template <typename T> Matrix<T> &Matrix<T>::operator=(Matrix<T> &&other) {
+template <typename T, typename Alloc>
+Matrix<T, Alloc> &Matrix<T, Alloc>::operator=(Matrix &&other) {
   if (other.rows != rows || other.cols != cols)
     throw std::domain_error("Dimensions of assigned matrix must match "
                             "dimensions of destination matrix.");
 
-  delete[] data;
+  if (&other == this)
+    return *this;
+  release_(data, rows * cols);
   data = other.data;
   other.data = nullptr;
   return *this;
 }
 
+// Entries only depend on the same entry of each operand, so an expression
+// may safely refer to the matrix it is assigned to.
+template <typename T, typename Alloc>
+template <typename E>
+Matrix<T, Alloc> &Matrix<T, Alloc>::operator=(const MatrixExpr<E> &expr) {
+  const E &e = expr.self();
+  if (e.rows != rows || e.cols != cols)
+    throw std::domain_error("Dimensions of assigned matrix must match "
+                            "dimensions of destination matrix.");
+
+  internal::evaluate_(data, cols, 1, e);
+  return *this;
+}
+
 #endif
 
 } // namespace matrix
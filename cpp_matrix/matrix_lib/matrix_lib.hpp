@@ -4,9 +4,25 @@
 
 #define PRECISION 3 // Precision of floating-point display.
 
+#include "allocator.hpp"
+#include "banded.hpp"
+#include "expressions.hpp"
 #include "factorizations.hpp"
+#include "fixed_matrix.hpp"
+#include "gemm.hpp"
+#include "io.hpp"
+#include "iterative.hpp"
+#include "lu_update.hpp"
+#include "markov.hpp"
 #include "matrix.hpp"
 #include "operations.hpp"
+#include "out_of_core.hpp"
+#include "poisson.hpp"
 #include "solvers.hpp"
+#include "sparse.hpp"
+#include "symmetric.hpp"
+#include "task_graph.hpp"
+#include "thread_pool.hpp"
 #include "utils.hpp"
 #include "vector.hpp"
+#include "view.hpp"
@@ -1,83 +1,161 @@
+#include "gemm.hpp"
+#include "expressions.hpp"
 #include "matrix.hpp"
+#include "thread_pool.hpp"
 #include "vector.hpp"
+#include "view.hpp"
 
-namespace matrix {
+#ifndef OPERATIONS_H
+#define OPERATIONS_H
 
-// Internal helpers
+namespace matrix {
 
-namespace internal {
+/* ---- Scalar products. ---- */
 
-template <typename T>
-inline T prodIK_(const Matrix<T> &lhs, const Matrix<T> &rhs, unsigned i,
-                 unsigned k) {
-  T result{};
-  for (unsigned j = 0; j < lhs.cols; j++)
-    result += lhs(i, j) * rhs(j, k);
+// The scalar is taken as the matrix's value type, so e.g. `2 * m` and
+// `m * 2` work for a Matrix<double> too.
+template <typename E>
+ScaledExpr<E> operator*(const typename E::value_type &a,
+                        const MatrixExpr<E> &m) {
+  return ScaledExpr<E>{a, m.self()};
+}
 
-  return result;
+template <typename E>
+ScaledExpr<E> operator*(const MatrixExpr<E> &m,
+                        const typename E::value_type &a) {
+  return ScaledExpr<E>{a, m.self()};
 }
 
-} // namespace internal
+/* ---- Matrix-Matrix operations. ---- */
 
-/* ---- Scalar products. ---- */
+namespace internal {
 
-template <typename T> Matrix<T> operator*(const T &a, const Matrix<T> &m) {
-  Matrix<T> result{m.rows, m.cols};
-  for (unsigned i = 0; i < m.rows; i++)
-    for (unsigned j = 0; j < m.cols; j++)
-      result(i, j) = a * m(i, j);
+// An operand of a product as a strided view: matrices and views are used
+// in place, other expressions are evaluated into a temporary first.
+template <typename E> struct dense_operand_ {
+  Matrix<typename E::value_type> owned;
+  ConstMatrixView<typename E::value_type> view;
+  explicit dense_operand_(const E &e) : owned{e}, view{owned} {}
+};
+
+template <typename T, typename A> struct dense_operand_<Matrix<T, A>> {
+  ConstMatrixView<T> view;
+  explicit dense_operand_(const Matrix<T, A> &m) : view{m} {}
+};
+
+template <typename T, typename A> struct dense_operand_<Vector<T, A>> {
+  ConstMatrixView<T> view;
+  explicit dense_operand_(const Vector<T, A> &v) : view{v} {}
+};
+
+template <typename T> struct dense_operand_<MatrixView<T>> {
+  ConstMatrixView<T> view;
+  explicit dense_operand_(const MatrixView<T> &v) : view{v} {}
+};
+
+template <typename T> struct dense_operand_<ConstMatrixView<T>> {
+  ConstMatrixView<T> view;
+  explicit dense_operand_(const ConstMatrixView<T> &v) : view{v} {}
+};
 
-  return result; // Returns new Matrix object.
-}
+} // namespace internal
 
-template <typename T> Vector<T> operator*(const T &a, const Vector<T> &m) {
-  Matrix<T> mat{m};
-  Matrix<T> result = a * mat;
-  return static_cast<Vector<T>>(std::move(result));
-}
+/**
+ *  C = alpha A B + beta C, written into C's existing storage, so it
+ *  allocates nothing when A and B are matrices or views. C may be a Matrix
+ *  or any view, e.g. a block of a larger matrix, but must not overlap A or
+ *  B. With beta = 0, C's old entries are never read.
+ */
+template <typename L, typename R>
+void gemm(const typename L::value_type &alpha, const MatrixExpr<L> &A,
+          const MatrixExpr<R> &B, const typename L::value_type &beta,
+          MatrixView<typename L::value_type> C) {
+  typedef typename L::value_type T;
+  internal::dense_operand_<L> a{A.self()};
+  internal::dense_operand_<R> b{B.self()};
+  if (a.view.cols != b.view.rows)
+    throw std::domain_error("LHS #cols must match RHS #rows.");
+  if (C.rows != a.view.rows || C.cols != b.view.cols)
+    throw std::domain_error("Matrix shapes do not match.");
 
-/* ---- Matrix-Matrix operations. ---- */
+  internal::gemm<T>(a.view.rows, b.view.cols, a.view.cols, alpha,
+                    a.view.ptr(), a.view.row_stride(), a.view.col_stride(),
+                    b.view.ptr(), b.view.row_stride(), b.view.col_stride(),
+                    beta, C.ptr(), C.row_stride(), C.col_stride());
+}
 
-template <typename T>
-Matrix<T> operator*(const Matrix<T> &lhs, const Matrix<T> &rhs) {
-  if (lhs.cols != rhs.rows)
+// Works on any mix of matrices, views (e.g. blocks or transposes, without
+// copying them) and elementwise expressions.
+template <typename L, typename R>
+Matrix<typename L::value_type> operator*(const MatrixExpr<L> &lhs,
+                                         const MatrixExpr<R> &rhs) {
+  typedef typename L::value_type T;
+  internal::dense_operand_<L> a{lhs.self()};
+  internal::dense_operand_<R> b{rhs.self()};
+  if (a.view.cols != b.view.rows)
     throw std::domain_error("LHS #cols must match RHS #rows.");
 
-  Matrix<T> result{lhs.rows, rhs.cols};
-  for (unsigned i = 0; i < lhs.rows; i++)
-    for (unsigned k = 0; k < rhs.cols; k++)
-      result(i, k) = internal::prodIK_(lhs, rhs, i, k);
-
+  Matrix<T> result{a.view.rows, b.view.cols, uninitialized};
+  gemm(T{1}, a.view, b.view, T{}, result);
   return result;
-} // Basic algorithm.
+} // Packed, cache-blocked product; see gemm.hpp.
 
-template <typename T>
-Matrix<T> operator+(const Matrix<T> &lhs, const Matrix<T> &rhs) {
-  if (lhs.cols != rhs.cols || lhs.rows != rhs.rows)
-    throw std::domain_error("Dimensions must match to add matrices.");
+/* ---- Elementwise operations. ---- */
 
-  Matrix<T> result{lhs.rows, rhs.cols};
-  for (unsigned i = 0; i < lhs.rows; i++)
-    for (unsigned j = 0; j < rhs.cols; j++)
-      result(i, j) = lhs(i, j) + rhs(i, j);
+// Both return expression nodes, evaluated when assigned; see expressions.hpp.
 
-  return result;
+template <typename L, typename R>
+BinaryExpr<L, R, internal::add_op_> operator+(const MatrixExpr<L> &lhs,
+                                              const MatrixExpr<R> &rhs) {
+  return BinaryExpr<L, R, internal::add_op_>{lhs.self(), rhs.self()};
+}
+
+template <typename L, typename R>
+BinaryExpr<L, R, internal::sub_op_> operator-(const MatrixExpr<L> &lhs,
+                                              const MatrixExpr<R> &rhs) {
+  return BinaryExpr<L, R, internal::sub_op_>{lhs.self(), rhs.self()};
+}
+
+// y = y + alpha x, in place; y may be a Matrix, Vector or view.
+template <typename E>
+void axpy(const typename E::value_type &alpha, const MatrixExpr<E> &x,
+          MatrixView<typename E::value_type> y) {
+  y += ScaledExpr<E>{alpha, x.self()};
 }
 
 /* ---- Matrix-Vector product. ---- */
 
-template <typename T>
-Vector<T> operator*(const Matrix<T> &lhs, const Vector<T> &rhs) {
-  Vector<T> result(lhs.rows);
+namespace internal {
+
+// y = A x for a length-A.cols x and length-A.rows y, split over rows.
+template <typename T, typename Alloc>
+void gemv_(const Matrix<T, Alloc> &A, const T *x, T *y) {
+  std::size_t grain = parallel_grain_ / std::max<std::size_t>(A.cols, 1) + 1;
+
+  parallel_for(0, A.rows, grain, [&](std::size_t lo, std::size_t hi) {
+    for (std::size_t i = lo; i < hi; i++) {
+      const T *row = A.ptr() + i * A.cols;
+      T val{};
+      for (std::size_t j = 0; j < A.cols; j++)
+        val += row[j] * x[j];
+      y[i] = val;
+    }
+  });
+}
 
-  for (unsigned i = 0; i < lhs.rows; i++) {
-    T val{};
-    for (unsigned j = 0; j < lhs.cols; j++)
-      val += lhs(i, j) * rhs[j];
-    result[i] = val;
-  }
+} // namespace internal
 
+template <typename T, typename LAlloc, typename RAlloc>
+Vector<T> operator*(const Matrix<T, LAlloc> &lhs,
+                    const Vector<T, RAlloc> &rhs) {
+  if (lhs.cols != rhs.rows)
+    throw std::domain_error("Matrix #cols must match Vector #rows.");
+
+  Vector<T> result(lhs.rows, uninitialized);
+  internal::gemv_(lhs, rhs.ptr(), result.ptr());
   return result;
 }
 
 } // namespace matrix
+
+#endif
@@ -0,0 +1,734 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "allocator.hpp"
+#include "factorizations.hpp"
+#include "gemm.hpp"
+#include "io.hpp"
+#include "matrix.hpp"
+#include "solvers.hpp"
+#include "vector.hpp"
+#include "view.hpp"
+
+#ifndef OUT_OF_CORE_H
+#define OUT_OF_CORE_H
+
+namespace matrix {
+
+/**
+ *  Matrix products and LU factorizations of matrices larger than memory.
+ *
+ *  A TiledMatrix lives in a file in the tiled layout of io.hpp: square
+ *  tiles of tile x tile entries, each contiguous on disk, so any tile is
+ *  read or written with one system call. Tiles are moved between the file
+ *  and a fixed set of buffers by an I/O thread. The algorithms know their
+ *  whole sequence of tile reads in advance and queue it up front; the I/O
+ *  thread reads ahead as buffers free up, while the compute threads work
+ *  on tiles already in memory, and writes results back behind them. So
+ *  with enough compute per tile, the disk is kept busy throughout.
+ *
+ *  memory_budget bounds the bytes of tiles, panels and I/O buffers the
+ *  algorithms hold, and so how much they can reuse each tile read:
+ *
+ *    - multiply() computes C = AB a b x b block of C tiles at a time, with
+ *      b as large as the budget allows, streaming a block column of A and
+ *      a block row of B past it. A and B are read n / (b tile) times.
+ *    - OutOfCoreLU factors a square TiledMatrix in place with partial
+ *      pivoting, left-looking: each block column is updated in memory by
+ *      all the block columns of L to its left, read back from the file,
+ *      then factored like a panel of the in-core LU, and written once. It
+ *      needs an n x tile panel and four tiles in the budget, and reads
+ *      about n / (3 tile) times the matrix in total. solve() reads the
+ *      factors twice per call.
+ *
+ *  The row interchanges of a block column are not applied to the factors
+ *  to its left: column k of L is stored in the row order of the first k
+ *  interchanges, and solve() applies the interchanges between the block
+ *  columns of L, as the factorization did.
+ *
+ *  E.g. for 200 GB of doubles, n = 158000, on a node with 64 GB, a tile of
+ *  16384 takes a 21 GB panel and 2 GB tiles, and the LU reads the matrix
+ *  about 3 times. Tiles are read through the page cache, which should be
+ *  left room outside the budget.
+ */
+
+struct OutOfCoreOptions {
+  std::size_t memory_budget = std::size_t{1} << 30; // Bytes.
+};
+
+// Bytes moved between the file and memory.
+struct OutOfCoreStats {
+  std::size_t bytes_read = 0;
+  std::size_t bytes_written = 0;
+};
+
+/* ---- Tiled files. ---- */
+
+namespace internal {
+
+inline void pread_all_(int fd, void *buf, std::size_t bytes,
+                       std::uint64_t offset, const std::string &path) {
+  char *p = static_cast<char *>(buf);
+  while (bytes > 0) {
+    ssize_t r = ::pread(fd, p, bytes, static_cast<off_t>(offset));
+    if (r <= 0) {
+      if (r < 0 && errno == EINTR)
+        continue;
+      if (r == 0)
+        errno = EIO;
+      io_error_("Cannot read", path);
+    }
+    p += r;
+    bytes -= static_cast<std::size_t>(r);
+    offset += static_cast<std::uint64_t>(r);
+  }
+}
+
+inline void pwrite_all_(int fd, const void *buf, std::size_t bytes,
+                        std::uint64_t offset, const std::string &path) {
+  const char *p = static_cast<const char *>(buf);
+  while (bytes > 0) {
+    ssize_t r = ::pwrite(fd, p, bytes, static_cast<off_t>(offset));
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      io_error_("Cannot write", path);
+    }
+    p += r;
+    bytes -= static_cast<std::size_t>(r);
+    offset += static_cast<std::uint64_t>(r);
+  }
+}
+
+} // namespace internal
+
+template <typename T> class TiledMatrix {
+  int fd = -1;
+  std::string path;
+  std::size_t num_rows = 0, num_cols = 0, tile_size = 0;
+  std::uint64_t data_offset = 0;
+
+  TiledMatrix() = default;
+
+public:
+  // Open an existing tiled file, or create (or truncate) one of zeros.
+  static TiledMatrix open(const std::string &path,
+                          MapMode mode = MapMode::read_write);
+  static TiledMatrix create(const std::string &path, std::size_t rows,
+                            std::size_t cols, std::size_t tile);
+
+  TiledMatrix(TiledMatrix &&other) noexcept;
+  TiledMatrix(const TiledMatrix &) = delete;
+  TiledMatrix &operator=(const TiledMatrix &) = delete;
+  ~TiledMatrix() {
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  std::size_t rows() const { return num_rows; }
+  std::size_t cols() const { return num_cols; }
+  std::size_t tile() const { return tile_size; }
+  // Number of tiles down and across.
+  std::size_t tile_grid_rows() const {
+    return (num_rows + tile_size - 1) / tile_size;
+  }
+  std::size_t tile_grid_cols() const {
+    return (num_cols + tile_size - 1) / tile_size;
+  }
+  // Rows of tile row I and columns of tile column J, not counting padding.
+  std::size_t tile_rows(std::size_t I) const {
+    return std::min(tile_size, num_rows - I * tile_size);
+  }
+  std::size_t tile_cols(std::size_t J) const {
+    return std::min(tile_size, num_cols - J * tile_size);
+  }
+
+  // Read or write tile (I, J), all tile x tile entries of it with padding,
+  // from or to a row-major buffer.
+  void read_tile(std::size_t I, std::size_t J, T *buf) const;
+  void write_tile(std::size_t I, std::size_t J, const T *buf);
+
+  // Read the whole matrix into memory.
+  Matrix<T> load() const;
+};
+
+template <typename T>
+TiledMatrix<T> TiledMatrix<T>::open(const std::string &path, MapMode mode) {
+  TiledMatrix m;
+  m.path = path;
+  m.fd = ::open(path.c_str(), mode == MapMode::read_only ? O_RDONLY : O_RDWR);
+  if (m.fd < 0)
+    internal::io_error_("Cannot open", path);
+  struct stat st;
+  FileHeader h{};
+  if (::fstat(m.fd, &st) != 0 ||
+      ::pread(m.fd, &h, sizeof h, 0) != static_cast<ssize_t>(sizeof h))
+    throw std::runtime_error(path + ": not a matrix file.");
+  internal::check_header_<T>(h, static_cast<std::uint64_t>(st.st_size), path,
+                             Layout::tiled);
+  m.num_rows = h.rows;
+  m.num_cols = h.cols;
+  m.tile_size = h.tile_rows;
+  m.data_offset = h.data_offset;
+  return m;
+}
+
+template <typename T>
+TiledMatrix<T> TiledMatrix<T>::create(const std::string &path,
+                                      std::size_t rows, std::size_t cols,
+                                      std::size_t tile) {
+  if (tile == 0)
+    throw std::invalid_argument("Tiles must not be empty.");
+  TiledMatrix m;
+  m.path = path;
+  m.fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (m.fd < 0)
+    internal::io_error_("Cannot create", path);
+  m.num_rows = rows;
+  m.num_cols = cols;
+  m.tile_size = tile;
+  FileHeader h = internal::make_header_<T>(rows, cols, tile);
+  m.data_offset = h.data_offset;
+  internal::pwrite_all_(m.fd, &h, sizeof h, 0, path);
+  std::uint64_t size = h.data_offset + m.tile_grid_rows() *
+                                           m.tile_grid_cols() * tile * tile *
+                                           sizeof(T);
+  if (::ftruncate(m.fd, static_cast<off_t>(size)) != 0)
+    internal::io_error_("Cannot write", path);
+  return m;
+}
+
+template <typename T>
+TiledMatrix<T>::TiledMatrix(TiledMatrix &&other) noexcept
+    : fd{other.fd}, path{std::move(other.path)}, num_rows{other.num_rows},
+      num_cols{other.num_cols}, tile_size{other.tile_size},
+      data_offset{other.data_offset} {
+  other.fd = -1;
+}
+
+template <typename T>
+void TiledMatrix<T>::read_tile(std::size_t I, std::size_t J, T *buf) const {
+  std::size_t entries = tile_size * tile_size;
+  internal::pread_all_(
+      fd, buf, entries * sizeof(T),
+      data_offset + (I * tile_grid_cols() + J) * entries * sizeof(T), path);
+}
+
+template <typename T>
+void TiledMatrix<T>::write_tile(std::size_t I, std::size_t J,
+                                const T *buf) {
+  std::size_t entries = tile_size * tile_size;
+  internal::pwrite_all_(
+      fd, buf, entries * sizeof(T),
+      data_offset + (I * tile_grid_cols() + J) * entries * sizeof(T), path);
+}
+
+template <typename T> Matrix<T> TiledMatrix<T>::load() const {
+  Matrix<T> m{num_rows, num_cols, uninitialized};
+  std::vector<T> buf(tile_size * tile_size);
+  for (std::size_t I = 0; I < tile_grid_rows(); I++)
+    for (std::size_t J = 0; J < tile_grid_cols(); J++) {
+      read_tile(I, J, buf.data());
+      for (std::size_t i = 0; i < tile_rows(I); i++)
+        std::copy(buf.data() + i * tile_size,
+                  buf.data() + i * tile_size + tile_cols(J),
+                  m.ptr() + (I * tile_size + i) * num_cols + J * tile_size);
+    }
+  return m;
+}
+
+// Write a matrix or expression to a new tiled file, and return it opened.
+template <typename E, typename T = typename E::value_type>
+TiledMatrix<T> save_tiled(const std::string &path, const MatrixExpr<E> &expr,
+                          std::size_t tile) {
+  const E &m = expr.self();
+  TiledMatrix<T> t = TiledMatrix<T>::create(path, m.rows, m.cols, tile);
+  std::vector<T> buf(tile * tile);
+  for (std::size_t I = 0; I < t.tile_grid_rows(); I++)
+    for (std::size_t J = 0; J < t.tile_grid_cols(); J++) {
+      std::fill(buf.begin(), buf.end(), T{});
+      for (std::size_t i = 0; i < t.tile_rows(I); i++)
+        for (std::size_t j = 0; j < t.tile_cols(J); j++)
+          buf[i * tile + j] = m(I * tile + i, J * tile + j);
+      t.write_tile(I, J, buf.data());
+    }
+  return t;
+}
+
+/* ---- I/O scheduler. ---- */
+
+namespace internal {
+
+/**
+ *  Moves tiles between files and a fixed set of buffers on its own thread.
+ *
+ *  read() queues a tile read; next() returns the tiles in the order they
+ *  were queued, waiting for each to arrive, and release() gives the buffer
+ *  back. At most read_slots tiles are read ahead or held. write_slot()
+ *  hands out one of write_slots buffers to fill, and write() queues it for
+ *  writing. Queued writes go before queued reads, so a read queued after a
+ *  write of the same tile sees the new entries. A tile must not be written
+ *  while a read of it is still queued.
+ */
+
+template <typename T> class TileScheduler {
+  struct ReadOp {
+    const TiledMatrix<T> *m;
+    std::size_t I, J;
+  };
+  struct WriteOp {
+    TiledMatrix<T> *m;
+    std::size_t I, J;
+    T *slot;
+  };
+
+  std::size_t entries; // Per tile.
+  std::vector<T, AlignedAllocator<T>> storage;
+  std::vector<T *> free_reads, free_writes;
+  std::deque<ReadOp> reads;
+  std::deque<WriteOp> writes;
+  std::deque<T *> loaded; // Read, in queued order, but not yet taken.
+  std::size_t pending_writes = 0;
+  bool stop = false;
+  std::exception_ptr error;
+  OutOfCoreStats stats_;
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::thread io;
+
+  void run_();
+
+public:
+  TileScheduler(std::size_t tile, std::size_t read_slots,
+                std::size_t write_slots);
+  TileScheduler(const TileScheduler &) = delete;
+  TileScheduler &operator=(const TileScheduler &) = delete;
+  // Finishes queued writes; drops queued reads.
+  ~TileScheduler();
+
+  void read(const TiledMatrix<T> &m, std::size_t I, std::size_t J);
+  const T *next();
+  void release(const T *tile);
+
+  T *write_slot();
+  void write(TiledMatrix<T> &m, std::size_t I, std::size_t J, T *slot);
+  // Wait for every queued write; rethrows the first I/O error.
+  void drain();
+
+  OutOfCoreStats stats();
+};
+
+template <typename T>
+TileScheduler<T>::TileScheduler(std::size_t tile, std::size_t read_slots,
+                                std::size_t write_slots)
+    : entries{tile * tile}, storage(entries * (read_slots + write_slots)) {
+  for (std::size_t s = 0; s < read_slots; s++)
+    free_reads.push_back(storage.data() + s * entries);
+  for (std::size_t s = read_slots; s < read_slots + write_slots; s++)
+    free_writes.push_back(storage.data() + s * entries);
+  io = std::thread{[this] { run_(); }};
+}
+
+template <typename T> TileScheduler<T>::~TileScheduler() {
+  {
+    std::lock_guard<std::mutex> lock{mtx};
+    stop = true;
+  }
+  cv.notify_all();
+  io.join();
+}
+
+template <typename T> void TileScheduler<T>::run_() {
+  std::unique_lock<std::mutex> lock{mtx};
+  for (;;) {
+    cv.wait(lock, [this] {
+      return stop || !writes.empty() ||
+             (!reads.empty() && !free_reads.empty());
+    });
+    std::exception_ptr e;
+    if (!writes.empty()) {
+      WriteOp op = writes.front();
+      writes.pop_front();
+      lock.unlock();
+      try {
+        op.m->write_tile(op.I, op.J, op.slot);
+      } catch (...) {
+        e = std::current_exception();
+      }
+      lock.lock();
+      free_writes.push_back(op.slot);
+      pending_writes--;
+      stats_.bytes_written += entries * sizeof(T);
+    } else if (stop) {
+      return;
+    } else {
+      ReadOp op = reads.front();
+      reads.pop_front();
+      T *slot = free_reads.back();
+      free_reads.pop_back();
+      lock.unlock();
+      try {
+        op.m->read_tile(op.I, op.J, slot);
+      } catch (...) {
+        e = std::current_exception();
+      }
+      lock.lock();
+      loaded.push_back(slot);
+      stats_.bytes_read += entries * sizeof(T);
+    }
+    if (e && !error)
+      error = e;
+    cv.notify_all();
+  }
+}
+
+template <typename T>
+void TileScheduler<T>::read(const TiledMatrix<T> &m, std::size_t I,
+                            std::size_t J) {
+  {
+    std::lock_guard<std::mutex> lock{mtx};
+    reads.push_back({&m, I, J});
+  }
+  cv.notify_all();
+}
+
+template <typename T> const T *TileScheduler<T>::next() {
+  std::unique_lock<std::mutex> lock{mtx};
+  cv.wait(lock, [this] { return !loaded.empty(); });
+  T *tile = loaded.front();
+  loaded.pop_front();
+  if (error)
+    std::rethrow_exception(error);
+  return tile;
+}
+
+template <typename T> void TileScheduler<T>::release(const T *tile) {
+  {
+    std::lock_guard<std::mutex> lock{mtx};
+    free_reads.push_back(const_cast<T *>(tile));
+  }
+  cv.notify_all();
+}
+
+template <typename T> T *TileScheduler<T>::write_slot() {
+  std::unique_lock<std::mutex> lock{mtx};
+  cv.wait(lock, [this] { return !free_writes.empty(); });
+  if (error)
+    std::rethrow_exception(error);
+  T *slot = free_writes.back();
+  free_writes.pop_back();
+  return slot;
+}
+
+template <typename T>
+void TileScheduler<T>::write(TiledMatrix<T> &m, std::size_t I, std::size_t J,
+                             T *slot) {
+  {
+    std::lock_guard<std::mutex> lock{mtx};
+    writes.push_back({&m, I, J, slot});
+    pending_writes++;
+  }
+  cv.notify_all();
+}
+
+template <typename T> void TileScheduler<T>::drain() {
+  std::unique_lock<std::mutex> lock{mtx};
+  cv.wait(lock, [this] { return pending_writes == 0; });
+  if (error)
+    std::rethrow_exception(error);
+}
+
+template <typename T> OutOfCoreStats TileScheduler<T>::stats() {
+  std::lock_guard<std::mutex> lock{mtx};
+  return stats_;
+}
+
+constexpr std::size_t ooc_write_slots_ = 2;
+
+inline void ooc_budget_error_(const char *what) {
+  throw std::invalid_argument(std::string{"Memory budget too small for "} +
+                              what + ".");
+}
+
+} // namespace internal
+
+/* ---- Product. ---- */
+
+// C = AB, for tiled A, B and C with the same tile size. C must be another
+// file than A and B.
+template <typename T>
+OutOfCoreStats multiply(const TiledMatrix<T> &A, const TiledMatrix<T> &B,
+                        TiledMatrix<T> &C, const OutOfCoreOptions &opts = {}) {
+  if (A.cols() != B.rows() || C.rows() != A.rows() || C.cols() != B.cols())
+    throw std::domain_error("Matrix shapes do not match.");
+  if (A.tile() != B.tile() || A.tile() != C.tile())
+    throw std::invalid_argument("Tiled matrices must have the same tiles.");
+
+  const std::size_t nb = A.tile(), entries = nb * nb;
+  const std::size_t MT = A.tile_grid_rows(), NT = B.tile_grid_cols(),
+                    KT = A.tile_grid_cols();
+  const std::size_t wslots = internal::ooc_write_slots_;
+
+  // A b x b block of C, a block row of B and a tile of A, and as much
+  // again to read ahead.
+  std::size_t slots = opts.memory_budget / (entries * sizeof(T)), b = 0;
+  while ((b + 1) * (b + 1) + 2 * (b + 2) + wslots <= slots)
+    b++;
+  if (b == 0)
+    internal::ooc_budget_error_("multiply: it must hold 7 tiles");
+  std::size_t bi = std::min(b, MT), bj = std::min(b, NT);
+  std::size_t rslots = std::min(slots - bi * bj - wslots,
+                                std::max<std::size_t>(bi + bj, 2) * KT);
+
+  internal::TileScheduler<T> io{nb, rslots, wslots};
+  for (std::size_t I0 = 0; I0 < MT; I0 += bi)
+    for (std::size_t J0 = 0; J0 < NT; J0 += bj)
+      for (std::size_t K = 0; K < KT; K++) {
+        for (std::size_t J = J0; J < std::min(J0 + bj, NT); J++)
+          io.read(B, K, J);
+        for (std::size_t I = I0; I < std::min(I0 + bi, MT); I++)
+          io.read(A, I, K);
+      }
+
+  std::vector<T, AlignedAllocator<T>> c(bi * bj * entries);
+  std::vector<const T *> b_tiles(bj);
+  for (std::size_t I0 = 0; I0 < MT; I0 += bi)
+    for (std::size_t J0 = 0; J0 < NT; J0 += bj) {
+      std::size_t mi = std::min(bi, MT - I0), nj = std::min(bj, NT - J0);
+      std::fill(c.begin(), c.end(), T{});
+      for (std::size_t K = 0; K < KT; K++) {
+        for (std::size_t j = 0; j < nj; j++)
+          b_tiles[j] = io.next();
+        for (std::size_t i = 0; i < mi; i++) {
+          const T *a = io.next();
+          for (std::size_t j = 0; j < nj; j++)
+            internal::gemm<T>(A.tile_rows(I0 + i), B.tile_cols(J0 + j),
+                              A.tile_cols(K), T{1}, a, nb, 1, b_tiles[j], nb,
+                              1, T{1}, c.data() + (i * bj + j) * entries, nb,
+                              1);
+          io.release(a);
+        }
+        for (std::size_t j = 0; j < nj; j++)
+          io.release(b_tiles[j]);
+      }
+
+      for (std::size_t i = 0; i < mi; i++)
+        for (std::size_t j = 0; j < nj; j++) {
+          T *slot = io.write_slot();
+          const T *tile = c.data() + (i * bj + j) * entries;
+          std::copy(tile, tile + entries, slot);
+          io.write(C, I0 + i, J0 + j, slot);
+        }
+    }
+  io.drain();
+  return io.stats();
+}
+
+/* ---- LU. ---- */
+
+template <typename T> class OutOfCoreLU {
+  TiledMatrix<T> &A;
+  // Row k0 + k was swapped with row piv[k0 + k] by block column k0 / tile.
+  std::vector<std::size_t> piv;
+  bool is_singular = false;
+  OutOfCoreOptions opts;
+  OutOfCoreStats stats_;
+
+public:
+  // Factors A in place; A must outlive the factorization.
+  explicit OutOfCoreLU(TiledMatrix<T> &A, const OutOfCoreOptions &opts = {});
+
+  std::size_t size() const { return A.rows(); }
+  bool singular() const { return is_singular; }
+  // I/O of the factorization.
+  const OutOfCoreStats &stats() const { return stats_; }
+
+  // Overwrite b, held in memory, with the solution x of Ax = b.
+  void solve_in_place(MatrixView<T> b) const;
+  Matrix<T> solve(const Matrix<T> &b) const;
+  Vector<T> solve(const Vector<T> &b) const;
+};
+
+template <typename T>
+OutOfCoreLU<T>::OutOfCoreLU(TiledMatrix<T> &A_, const OutOfCoreOptions &opts)
+    : A{A_}, piv(A_.rows()), opts{opts} {
+  if (A.rows() != A.cols())
+    throw std::domain_error("Matrix shapes do not match.");
+
+  const std::size_t n = A.rows(), nb = A.tile(), entries = nb * nb;
+  const std::size_t N = A.tile_grid_rows();
+  const std::size_t tile_bytes = entries * sizeof(T);
+  const std::size_t panel_bytes = N * tile_bytes;
+  const std::size_t wslots = internal::ooc_write_slots_;
+  if (opts.memory_budget < panel_bytes + (2 + wslots) * tile_bytes)
+    internal::ooc_budget_error_("LU: it must hold n x tile entries and "
+                                "4 tiles");
+  std::size_t rslots =
+      std::min((opts.memory_budget - panel_bytes) / tile_bytes - wslots,
+               N * (N + 1));
+
+  // Block column J is read, then updated by block columns K < J of L:
+  // tile (K, K) and the tiles below it, in order of K. The reads of
+  // column J + 1 and of its updates by finished block columns are queued
+  // as soon as those of column J have been; those by column J only once
+  // its tiles are queued for writing, so that they see the factors.
+  internal::TileScheduler<T> io{nb, rslots, wslots};
+  auto queue_updates = [&](std::size_t K) {
+    for (std::size_t I = K; I < N; I++)
+      io.read(A, I, K);
+  };
+  for (std::size_t I = 0; I < N; I++)
+    io.read(A, I, 0);
+
+  // The block column, contiguous: rows of tile I start at row I * nb.
+  std::vector<T, AlignedAllocator<T>> panel(N * entries);
+  T *P = panel.data();
+  std::vector<unsigned> p(nb);
+  for (std::size_t J = 0; J < N; J++) {
+    const std::size_t w = A.tile_cols(J), j0 = J * nb;
+    for (std::size_t I = 0; I < N; I++) {
+      const T *tile = io.next();
+      std::copy(tile, tile + entries, P + I * entries);
+      io.release(tile);
+    }
+    if (J + 1 < N) {
+      for (std::size_t I = 0; I < N; I++)
+        io.read(A, I, J + 1);
+      for (std::size_t K = 0; K < J; K++)
+        queue_updates(K);
+    }
+
+    for (std::size_t K = 0; K < J; K++) {
+      const std::size_t k0 = K * nb, wk = A.tile_cols(K);
+      for (std::size_t k = k0; k < k0 + wk; k++)
+        if (piv[k] != k)
+          std::swap_ranges(P + k * nb, P + k * nb + w, P + piv[k] * nb);
+
+      // U_KJ = L_KK^-1 A_KJ, then A_IJ = A_IJ - L_IK U_KJ below it.
+      const T *l = io.next();
+      internal::lu_row_solve_(l, nb, wk, P + k0 * nb, nb, w);
+      io.release(l);
+      for (std::size_t I = K + 1; I < N; I++) {
+        l = io.next();
+        internal::gemm<T>(A.tile_rows(I), w, wk, T{-1}, l, nb, 1,
+                          P + k0 * nb, nb, 1, T{1}, P + I * entries, nb, 1);
+        io.release(l);
+      }
+    }
+
+    // Factor the rows from j0 down as a panel of the in-core LU.
+    internal::lu_panel_rec_(P + j0 * nb, nb, n - j0, w, p.data());
+    for (std::size_t k = 0; k < w; k++) {
+      piv[j0 + k] = j0 + p[k];
+      is_singular = is_singular || P[(j0 + k) * nb + k] == T{};
+    }
+
+    for (std::size_t I = 0; I < N; I++) {
+      T *slot = io.write_slot();
+      std::copy(P + I * entries, P + (I + 1) * entries, slot);
+      io.write(A, I, J, slot);
+    }
+    if (J + 1 < N)
+      queue_updates(J);
+  }
+  io.drain();
+  stats_ = io.stats();
+}
+
+template <typename T>
+void OutOfCoreLU<T>::solve_in_place(MatrixView<T> b) const {
+  assert(b.rows == A.rows());
+  if (singular())
+    throw std::domain_error(
+        "Matrix is A singular; cannot guarantee solution exists.");
+  if (!b.unit_rows()) {
+    ArenaScope scope;
+    Matrix<T, ArenaAllocator<T>> x{b};
+    solve_in_place(x);
+    b = x;
+    return;
+  }
+
+  const std::size_t nb = A.tile(), N = A.tile_grid_rows(), k = b.cols;
+  const std::size_t ld = b.row_stride();
+  const std::size_t tile_bytes = nb * nb * sizeof(T);
+  T *y = b.ptr();
+
+  // Column K of the factors, from the diagonal down and then up.
+  std::size_t rslots = std::max<std::size_t>(
+      2, std::min(opts.memory_budget / tile_bytes, N * (N + 1)));
+  internal::TileScheduler<T> io{nb, rslots, 0};
+  for (std::size_t K = 0; K < N; K++)
+    for (std::size_t I = K; I < N; I++)
+      io.read(A, I, K);
+  for (std::size_t K = N; K-- > 0;)
+    for (std::size_t I = K + 1; I-- > 0;)
+      io.read(A, I, K);
+
+  // Ly = Pb, applying each block column's interchanges before its L.
+  for (std::size_t K = 0; K < N; K++) {
+    const std::size_t k0 = K * nb, wk = A.tile_cols(K);
+    for (std::size_t i = k0; i < k0 + wk; i++)
+      if (piv[i] != i)
+        std::swap_ranges(y + i * ld, y + i * ld + k, y + piv[i] * ld);
+    const T *l = io.next();
+    internal::trsm_lower_(wk, k, l, nb, true, y + k0 * ld, ld);
+    io.release(l);
+    for (std::size_t I = K + 1; I < N; I++) {
+      l = io.next();
+      internal::gemm<T>(A.tile_rows(I), k, wk, T{-1}, l, nb, 1, y + k0 * ld,
+                        ld, 1, T{1}, y + I * nb * ld, ld, 1);
+      io.release(l);
+    }
+  }
+
+  // Ux = y.
+  for (std::size_t K = N; K-- > 0;) {
+    const std::size_t k0 = K * nb, wk = A.tile_cols(K);
+    const T *u = io.next();
+    internal::trsm_upper_(wk, k, u, nb, false, y + k0 * ld, ld);
+    io.release(u);
+    for (std::size_t I = K; I-- > 0;) {
+      u = io.next();
+      internal::gemm<T>(nb, k, wk, T{-1}, u, nb, 1, y + k0 * ld, ld, 1, T{1},
+                        y + I * nb * ld, ld, 1);
+      io.release(u);
+    }
+  }
+}
+
+template <typename T>
+Matrix<T> OutOfCoreLU<T>::solve(const Matrix<T> &b) const {
+  Matrix<T> x{b};
+  solve_in_place(x);
+  return x;
+}
+
+template <typename T>
+Vector<T> OutOfCoreLU<T>::solve(const Vector<T> &b) const {
+  Vector<T> x{b};
+  solve_in_place(x);
+  return x;
+}
+
+} // namespace matrix
+
+#endif
@@ -0,0 +1,478 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+#include "thread_pool.hpp"
+#include "vector.hpp"
+
+#ifndef POISSON_H
+#define POISSON_H
+
+namespace matrix {
+
+/**
+ *  Matrix-free solvers for the 5-point discrete Poisson equation
+ *
+ *    (u(i-1, j) + u(i+1, j) + u(i, j-1) + u(i, j+1) - 4 u(i, j)) / h^2
+ *      = f(i, j)
+ *
+ *  on a uniform grid stored as a Matrix<T>. The first and last rows and
+ *  columns of u hold the Dirichlet boundary values and are never written;
+ *  the equation holds at every interior point. f has the same shape as u
+ *  and only its interior is read. The operator is applied directly from the
+ *  stencil, so memory is two grids rather than an (n^2 x n^2) matrix.
+ *
+ *  Red-black SOR is simple but needs O(n) sweeps on an n x n grid; the
+ *  multigrid solver further down needs O(1) cycles of O(n^2) work each.
+ */
+
+struct SOROptions {
+  double omega = 0;             // Relaxation; <= 0 picks the optimum.
+  double tol = 1e-10;           // 2-norm of f - (Laplacian of u) to stop at.
+  unsigned max_sweeps = 100000; // One sweep updates every interior point.
+  unsigned check_every = 10;    // Sweeps between residual checks.
+};
+
+struct SORResult {
+  bool converged;
+  unsigned sweeps;
+  double residual; // At the last check.
+};
+
+namespace internal {
+
+/**
+ *  Update the points of one colour, (i + j) % 2 == colour, in rows
+ *  [r0, r1). The four neighbours of a point all have the other colour, so
+ *  the points of a colour are independent: rows can go to different
+ *  threads and the stride-2 inner loop has no dependences.
+ */
+
+template <typename T>
+void sor_colour_rows_(T *u, const T *f, std::size_t ld, std::size_t cols,
+                      T h2, T omega, unsigned colour, std::size_t r0,
+                      std::size_t r1) {
+  const T a = 1 - omega, b = omega / 4;
+  for (std::size_t i = r0; i < r1; i++) {
+    T *__restrict c = u + i * ld;
+    const T *__restrict n = c - ld;
+    const T *__restrict s = c + ld;
+    const T *__restrict fi = f + i * ld;
+    std::size_t j0 = 1 + ((i + 1 + colour) & 1);
+#pragma GCC ivdep
+    for (std::size_t j = j0; j < cols - 1; j += 2)
+      c[j] = a * c[j] + b * (n[j] + s[j] + c[j - 1] + c[j + 1] - h2 * fi[j]);
+  }
+}
+
+// Sum of squared residuals over interior rows [r0, r1).
+template <typename T>
+double residual_rows_(const T *u, const T *f, std::size_t ld,
+                      std::size_t cols, T inv_h2, std::size_t r0,
+                      std::size_t r1) {
+  double sum = 0;
+  for (std::size_t i = r0; i < r1; i++) {
+    const T *c = u + i * ld, *n = c - ld, *s = c + ld, *fi = f + i * ld;
+    T row_sum = 0;
+    for (std::size_t j = 1; j < cols - 1; j++) {
+      T r = fi[j] - inv_h2 * (n[j] + s[j] + c[j - 1] + c[j + 1] - 4 * c[j]);
+      row_sum += r * r;
+    }
+    sum += row_sum;
+  }
+  return sum;
+}
+
+template <typename T>
+void check_poisson_grid_(const Matrix<T> &u, const Matrix<T> &f) {
+  if (u.rows != f.rows || u.cols != f.cols)
+    throw std::domain_error("Solution and right-hand side grids must have "
+                            "the same dimensions.");
+  if (u.rows < 3 || u.cols < 3)
+    throw std::domain_error("Grid must have at least one interior point.");
+}
+
+// Rows per parallel chunk, so each chunk has about parallel_grain_ points.
+inline std::size_t poisson_grain_(std::size_t cols) {
+  return parallel_grain_ / cols + 1;
+}
+
+} // namespace internal
+
+// Optimal SOR relaxation for the model problem on a rows x cols grid,
+// 2 / (1 + sin(pi h)), with h the spacing along the longer side.
+inline double sor_omega(std::size_t rows, std::size_t cols) {
+  const double pi = std::acos(-1.0);
+  double h = 1.0 / static_cast<double>(std::max(rows, cols) - 1);
+  return 2 / (1 + std::sin(pi * h));
+}
+
+// 2-norm of f - (Laplacian of u) over the interior.
+template <typename T>
+double poisson_residual(const Matrix<T> &u, const Matrix<T> &f, T h) {
+  internal::check_poisson_grid_(u, f);
+  const T *pu = u.ptr(), *pf = f.ptr();
+  std::size_t cols = u.cols;
+  T inv_h2 = 1 / (h * h);
+  double sum = parallel_reduce(
+      1, u.rows - 1, internal::poisson_grain_(cols), 0.0,
+      [&](std::size_t lo, std::size_t hi) {
+        return internal::residual_rows_(pu, pf, cols, cols, inv_h2, lo, hi);
+      },
+      [](double x, double y) { return x + y; });
+  return std::sqrt(sum);
+}
+
+namespace internal {
+
+// sor_sweep() below, starting with colour `first` (0 is red). Multigrid
+// post-smoothing runs the colours in the reverse order of pre-smoothing,
+// which keeps the cycle symmetric.
+template <typename T>
+void rb_sweep_(Matrix<T> &u, const Matrix<T> &f, T h, T omega,
+               unsigned first) {
+  T *pu = u.ptr();
+  const T *pf = f.ptr();
+  std::size_t cols = u.cols, n = u.rows - 2;
+  T h2 = h * h;
+
+  unsigned num_blocks = num_chunks_(n, poisson_grain_(cols));
+  std::size_t block = n / num_blocks, extra = n % num_blocks;
+  auto row_range = [&](unsigned b) {
+    std::size_t lo = 1 + b * block + std::min<std::size_t>(b, extra);
+    return std::make_pair(lo, lo + block + (b < extra ? 1 : 0));
+  };
+  auto colour_row = [&](unsigned colour, std::size_t i) {
+    sor_colour_rows_(pu, pf, cols, cols, h2, omega, colour, i, i + 1);
+  };
+
+  thread_pool().run(num_blocks, [&](unsigned b) {
+    auto [lo, hi] = row_range(b);
+    for (std::size_t i = lo; i < hi; i++) {
+      colour_row(first, i);
+      if (i >= lo + 2)
+        colour_row(1 - first, i - 1);
+    }
+  });
+  thread_pool().run(num_blocks, [&](unsigned b) {
+    auto [lo, hi] = row_range(b);
+    colour_row(1 - first, lo);
+    if (hi - 1 > lo)
+      colour_row(1 - first, hi - 1);
+  });
+}
+
+} // namespace internal
+
+/**
+ *  One red-black SOR sweep: all red points ((i + j) even), then all black
+ *  points. With omega = 1 this is red-black Gauss-Seidel.
+ *
+ *  Rather than two passes over the grid, each thread walks its block of
+ *  rows once, updating black row i - 1 right after red row i, while the
+ *  three rows involved are still in cache. The black rows at either end of
+ *  a block also need red rows of the neighbouring blocks, so they are left
+ *  for a second, short parallel step.
+ */
+
+template <typename T>
+void sor_sweep(Matrix<T> &u, const Matrix<T> &f, T h, T omega) {
+  internal::check_poisson_grid_(u, f);
+  internal::rb_sweep_(u, f, h, omega, 0);
+}
+
+/**
+ *  Solve by red-black SOR, starting from the values already in u. The
+ *  residual costs about as much as a sweep, so it is only computed every
+ *  opts.check_every sweeps (and after the last one).
+ */
+
+template <typename T>
+SORResult sor_poisson(Matrix<T> &u, const Matrix<T> &f, T h,
+                      const SOROptions &opts = {}) {
+  internal::check_poisson_grid_(u, f);
+  T omega = static_cast<T>(opts.omega > 0 ? opts.omega
+                                          : sor_omega(u.rows, u.cols));
+  unsigned check_every = std::max(opts.check_every, 1u);
+
+  SORResult result{false, 0, poisson_residual(u, f, h)};
+  while (result.residual >= opts.tol && result.sweeps < opts.max_sweeps) {
+    sor_sweep(u, f, h, omega);
+    result.sweeps++;
+    if (result.sweeps % check_every == 0 || result.sweeps == opts.max_sweeps)
+      result.residual = poisson_residual(u, f, h);
+  }
+  result.converged = result.residual < opts.tol;
+  return result;
+}
+
+/* ---- Geometric multigrid. ---- */
+
+/**
+ *  Multigrid for the same equation. Each level halves the number of
+ *  intervals along both sides, so every coarse point is also a fine point;
+ *  a grid keeps being coarsened while rows - 1 and cols - 1 are both even
+ *  (best when they are divisible by a large power of two, e.g. M = 2^k + 1)
+ *  and the coarse grid still has interior points.
+ *
+ *  A cycle smooths with red-black Gauss-Seidel, moves the residual to the
+ *  next coarser level by full weighting, solves for the correction there
+ *  recursively, and adds it back by bilinear interpolation. The coarsest
+ *  level is solved by SOR. A V-cycle visits each coarser level once; an
+ *  F-cycle does an F-cycle and then a V-cycle on the next level, which
+ *  costs a bit more but takes fewer cycles. Either costs O(N) for an N-point
+ *  grid, and each cycle cuts the residual by a roughly constant factor
+ *  independent of the mesh size. Every smoothing sweep, residual and
+ *  transfer is split over threads by rows. A grid with rows - 1 or cols - 1
+ *  odd can't be coarsened at all, so each of its cycles is a full SOR
+ *  solve: it still converges, but at O(N^1.5) per cycle.
+ *
+ *  A PoissonMultigrid is set up once for a grid shape and spacing. solve()
+ *  repeats cycles to a tolerance. It can also be passed as the
+ *  preconditioner of cg() etc. (iterative.hpp): apply(r, z) does one cycle
+ *  from z = 0 to approximate z = A^{-1} r, where A is the 5-point matrix
+ *  with 4 on the diagonal and -1 off it (i.e. -h^2 times the Laplacian)
+ *  over the interior points in row-major order. With as many pre- as
+ *  post-smoothing sweeps this is symmetric positive definite, as CG needs.
+ *  apply() uses the object's own work grids, so one object can't be used
+ *  from several threads at once.
+ */
+
+enum class Cycle { V, F };
+
+struct MultigridOptions {
+  Cycle cycle = Cycle::V;
+  unsigned pre_smooth = 2;  // Gauss-Seidel sweeps before coarse correction.
+  unsigned post_smooth = 2; // And after.
+  double tol = 1e-10;       // 2-norm of f - (Laplacian of u) to stop at.
+  unsigned max_cycles = 100;
+};
+
+struct MultigridResult {
+  bool converged;
+  unsigned cycles;
+  double residual;
+};
+
+template <typename T> class PoissonMultigrid {
+  struct Level {
+    T h;
+    // Correction and right-hand side; unused (0 x 0) on the finest level,
+    // where the caller's grids are used.
+    Matrix<T> u, f;
+    Matrix<T> r; // Residual, on all but the coarsest level.
+  };
+
+  MultigridOptions opts;
+  mutable std::vector<Level> levels;
+  // Fine-level grids for apply(), allocated on first use.
+  mutable std::vector<Matrix<T>> work;
+
+  void cycle_(unsigned l, Matrix<T> &u, const Matrix<T> &f, Cycle c) const;
+  void coarse_solve_(Matrix<T> &u, const Matrix<T> &f, T h) const;
+
+public:
+  PoissonMultigrid(std::size_t rows, std::size_t cols, T h,
+                   const MultigridOptions &opts = {});
+
+  unsigned num_levels() const { return levels.size(); }
+  std::size_t rows() const { return levels[0].r.rows; }
+  std::size_t cols() const { return levels[0].r.cols; }
+
+  // One cycle of the kind set in the options, improving u in place.
+  void cycle(Matrix<T> &u, const Matrix<T> &f) const;
+
+  // Cycles from the values already in u until the residual is below
+  // opts.tol.
+  MultigridResult solve(Matrix<T> &u, const Matrix<T> &f) const;
+
+  // Preconditioner interface; r and z have (rows - 2)(cols - 2) entries.
+  void apply(const Vector<T> &r, Vector<T> &z) const;
+};
+
+/* ---- Multigrid kernels. ---- */
+
+namespace internal {
+
+// r = f - (Laplacian of u) in the interior; r's boundary stays zero.
+template <typename T>
+void residual_grid_(const Matrix<T> &u, const Matrix<T> &f, T h,
+                    Matrix<T> &r) {
+  const T *pu = u.ptr(), *pf = f.ptr();
+  T *pr = r.ptr();
+  std::size_t cols = u.cols;
+  T inv_h2 = 1 / (h * h);
+  parallel_for(1, u.rows - 1, poisson_grain_(cols),
+               [&](std::size_t lo, std::size_t hi) {
+                 for (std::size_t i = lo; i < hi; i++) {
+                   const T *c = pu + i * cols, *n = c - cols, *s = c + cols;
+                   const T *fi = pf + i * cols;
+                   T *ri = pr + i * cols;
+                   for (std::size_t j = 1; j < cols - 1; j++)
+                     ri[j] = fi[j] - inv_h2 * (n[j] + s[j] + c[j - 1] +
+                                               c[j + 1] - 4 * c[j]);
+                 }
+               });
+}
+
+// Full weighting: each interior coarse point gets the 3 x 3 weighted
+// average (1 2 1; 2 4 2; 1 2 1) / 16 of the fine values around it.
+template <typename T>
+void restrict_(const Matrix<T> &fine, Matrix<T> &coarse) {
+  const T *pf = fine.ptr();
+  T *pc = coarse.ptr();
+  std::size_t fc = fine.cols, cc = coarse.cols;
+  parallel_for(1, coarse.rows - 1, poisson_grain_(fc),
+               [&](std::size_t lo, std::size_t hi) {
+                 for (std::size_t I = lo; I < hi; I++) {
+                   const T *m = pf + 2 * I * fc, *n = m - fc, *s = m + fc;
+                   T *ci = pc + I * cc;
+                   for (std::size_t J = 1; J < cc - 1; J++) {
+                     std::size_t j = 2 * J;
+                     T edge = n[j] + s[j] + m[j - 1] + m[j + 1];
+                     T corner = n[j - 1] + n[j + 1] + s[j - 1] + s[j + 1];
+                     ci[J] = (4 * m[j] + 2 * edge + corner) / 16;
+                   }
+                 }
+               });
+}
+
+// fine += bilinear interpolation of coarse, in the interior of fine.
+template <typename T>
+void prolong_add_(const Matrix<T> &coarse, Matrix<T> &fine) {
+  const T *pc = coarse.ptr();
+  T *pf = fine.ptr();
+  std::size_t fc = fine.cols, cc = coarse.cols;
+  parallel_for(1, fine.rows - 1, poisson_grain_(fc),
+               [&](std::size_t lo, std::size_t hi) {
+                 for (std::size_t i = lo; i < hi; i++) {
+                   // Fine rows between two coarse rows take their mean.
+                   const T *a = pc + (i / 2) * cc;
+                   const T *b = i % 2 ? a + cc : a;
+                   T *fi = pf + i * fc;
+                   for (std::size_t J = 1; J < cc - 1; J++)
+                     fi[2 * J] += (a[J] + b[J]) / 2;
+                   for (std::size_t J = 0; J < cc - 1; J++)
+                     fi[2 * J + 1] +=
+                         (a[J] + b[J] + a[J + 1] + b[J + 1]) / 4;
+                 }
+               });
+}
+
+template <typename T> void fill_zero_(Matrix<T> &m) {
+  std::fill(m.ptr(), m.ptr() + std::size_t(m.rows) * m.cols, T{});
+}
+
+} // namespace internal
+
+/* ---- PoissonMultigrid implementation. ---- */
+
+template <typename T>
+PoissonMultigrid<T>::PoissonMultigrid(std::size_t rows, std::size_t cols, T h,
+                                      const MultigridOptions &opts)
+    : opts{opts} {
+  if (rows < 3 || cols < 3)
+    throw std::domain_error("Grid must have at least one interior point.");
+  levels.push_back({h, Matrix<T>{0, 0}, Matrix<T>{0, 0}, {rows, cols}});
+  while ((rows - 1) % 2 == 0 && (cols - 1) % 2 == 0 && rows >= 5 &&
+         cols >= 5) {
+    rows = (rows - 1) / 2 + 1;
+    cols = (cols - 1) / 2 + 1;
+    h *= 2;
+    levels.push_back({h, {rows, cols}, {rows, cols}, {rows, cols}});
+  }
+}
+
+// Solve the coarsest level well enough that it is not what limits the
+// convergence of the cycle.
+template <typename T>
+void PoissonMultigrid<T>::coarse_solve_(Matrix<T> &u, const Matrix<T> &f,
+                                        T h) const {
+  double r0 = poisson_residual(u, f, h);
+  if (r0 == 0)
+    return;
+  SOROptions sor;
+  sor.tol = 1e-10 * r0;
+  sor.max_sweeps = 20 * std::max(u.rows, u.cols);
+  sor_poisson(u, f, h, sor);
+}
+
+template <typename T>
+void PoissonMultigrid<T>::cycle_(unsigned l, Matrix<T> &u, const Matrix<T> &f,
+                                 Cycle c) const {
+  Level &level = levels[l];
+  if (l + 1 == levels.size()) {
+    coarse_solve_(u, f, level.h);
+    return;
+  }
+
+  for (std::size_t k = 0; k < opts.pre_smooth; k++)
+    internal::rb_sweep_(u, f, level.h, T{1}, 0);
+
+  Level &next = levels[l + 1];
+  internal::residual_grid_(u, f, level.h, level.r);
+  internal::restrict_(level.r, next.f);
+  internal::fill_zero_(next.u);
+  cycle_(l + 1, next.u, next.f, c);
+  if (c == Cycle::F)
+    cycle_(l + 1, next.u, next.f, Cycle::V);
+  internal::prolong_add_(next.u, u);
+
+  for (std::size_t k = 0; k < opts.post_smooth; k++)
+    internal::rb_sweep_(u, f, level.h, T{1}, 1);
+}
+
+template <typename T>
+void PoissonMultigrid<T>::cycle(Matrix<T> &u, const Matrix<T> &f) const {
+  internal::check_poisson_grid_(u, f);
+  if (u.rows != rows() || u.cols != cols())
+    throw std::domain_error("Grid dimensions must match the multigrid "
+                            "hierarchy.");
+  cycle_(0, u, f, opts.cycle);
+}
+
+template <typename T>
+MultigridResult PoissonMultigrid<T>::solve(Matrix<T> &u,
+                                           const Matrix<T> &f) const {
+  T h = levels[0].h;
+  MultigridResult result{false, 0, poisson_residual(u, f, h)};
+  while (result.residual >= opts.tol && result.cycles < opts.max_cycles) {
+    cycle(u, f);
+    result.cycles++;
+    result.residual = poisson_residual(u, f, h);
+  }
+  result.converged = result.residual < opts.tol;
+  return result;
+}
+
+template <typename T>
+void PoissonMultigrid<T>::apply(const Vector<T> &r, Vector<T> &z) const {
+  std::size_t m = rows() - 2, n = cols() - 2;
+  if (r.rows != m * n || z.rows != m * n)
+    throw std::domain_error("Vector length must be the number of interior "
+                            "grid points.");
+  if (work.empty()) {
+    work.emplace_back(rows(), cols());
+    work.emplace_back(rows(), cols());
+  }
+  Matrix<T> &u = work[0], &f = work[1];
+
+  // A z = r is Laplacian(z) = -r / h^2.
+  T h = levels[0].h, scale = -1 / (h * h);
+  internal::fill_zero_(u);
+  for (std::size_t i = 0; i < m; i++)
+    for (std::size_t j = 0; j < n; j++)
+      f(i + 1, j + 1) = scale * r[i * n + j];
+  cycle_(0, u, f, opts.cycle);
+  for (std::size_t i = 0; i < m; i++)
+    for (std::size_t j = 0; j < n; j++)
+      z[i * n + j] = u(i + 1, j + 1);
+}
+
+} // namespace matrix
+
+#endif
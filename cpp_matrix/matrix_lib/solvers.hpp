@@ -1,41 +1,175 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "allocator.hpp"
+#include "factorizations.hpp"
+#include "gemm.hpp"
 #include "matrix.hpp"
+#include "symmetric.hpp"
+#include "thread_pool.hpp"
 #include "vector.hpp"
+#include "view.hpp"
+
+#ifndef SOLVERS_H
+#define SOLVERS_H
 
 namespace matrix {
 
 namespace internal {
 
-template <typename T> Matrix<T> forward_sub(Matrix<T> L, Matrix<T> b) {
-  assert(b.cols == 1);
-  assert(L.rows == b.rows);
-  Matrix<T> v{b.rows, 1};
+// Row block height of the triangular solves, and the narrowest right-hand
+// side for which the off-diagonal blocks go through GEMM.
+constexpr std::size_t trsm_block_ = 64;
+constexpr std::size_t trsm_gemm_cols_ = 2;
 
-  for (unsigned i = 0; i < L.rows; i++) {
-    T t = b(i, 0);
-    for (unsigned l = 0; l < i; l++)
-      t -= L(i, l) * v(l, 0);
+// Column chunk of right-hand sides handed to each thread.
+constexpr std::size_t trsm_col_grain_ = 32;
 
-    v(i, 0) = t / L(i, i);
-  }
+/**
+ *  Triangular solves with many right-hand sides (TRSM): overwrite the
+ *  n x k row-major block B with the solution X of LX = B or UX = B.
+ *
+ *  Each row of the triangle is loaded once per row block and applied to all
+ *  k columns by a contiguous axpy, and with a wide enough B everything off
+ *  the diagonal blocks is a GEMM. Independent column chunks of B are solved
+ *  on separate threads.
+ */
 
-  return v;
+template <typename T>
+void trsm_lower_(std::size_t n, std::size_t k, const T *L, std::size_t ldl,
+                 bool unit, T *B, std::size_t ldb) {
+  parallel_for(0, k, trsm_col_grain_, [&](std::size_t c0, std::size_t c1) {
+    std::size_t w = c1 - c0;
+    T *X = B + c0;
+    bool use_gemm = w >= trsm_gemm_cols_;
+
+    for (std::size_t i0 = 0; i0 < n; i0 += trsm_block_) {
+      std::size_t i1 = std::min(n, i0 + trsm_block_);
+      if (use_gemm && i0 > 0)
+        gemm<T>(i1 - i0, w, i0, T{-1}, L + i0 * ldl, ldl, 1, X, ldb, 1, T{1},
+                X + i0 * ldb, ldb, 1);
+
+      for (std::size_t i = i0; i < i1; i++) {
+        T *x_i = X + i * ldb;
+        if (w == 1) {
+          // A single column is a dot product along the row of L.
+          T t = x_i[0];
+          for (std::size_t l = 0; l < i; l++)
+            t -= L[i * ldl + l] * X[l * ldb];
+          x_i[0] = unit ? t : t / L[i * ldl + i];
+          continue;
+        }
+        for (std::size_t l = use_gemm ? i0 : 0; l < i; l++) {
+          T tau = L[i * ldl + l];
+          const T *x_l = X + l * ldb;
+          for (std::size_t j = 0; j < w; j++)
+            x_i[j] -= tau * x_l[j];
+        }
+        if (!unit)
+          for (std::size_t j = 0; j < w; j++)
+            x_i[j] /= L[i * ldl + i];
+      }
+    }
+  });
 }
 
-template <typename T> Matrix<T> back_sub(Matrix<T> U, Matrix<T> v) {
-  assert(v.cols == 1);
-  assert(U.rows == v.rows);
+template <typename T>
+void trsm_upper_(std::size_t n, std::size_t k, const T *U, std::size_t ldu,
+                 bool unit, T *B, std::size_t ldb) {
+  parallel_for(0, k, trsm_col_grain_, [&](std::size_t c0, std::size_t c1) {
+    std::size_t w = c1 - c0;
+    T *X = B + c0;
+    bool use_gemm = w >= trsm_gemm_cols_;
 
-  unsigned n = U.rows;
-  Matrix<T> x{v.rows, 1};
+    for (std::size_t i1 = n; i1 > 0;) {
+      std::size_t i0 = i1 > trsm_block_ ? i1 - trsm_block_ : 0;
+      if (use_gemm && i1 < n)
+        gemm<T>(i1 - i0, w, n - i1, T{-1}, U + i0 * ldu + i1, ldu, 1,
+                X + i1 * ldb, ldb, 1, T{1}, X + i0 * ldb, ldb, 1);
 
-  for (int i = n - 1; i >= 0; --i) {
-    T t = v(i, 0);
-    for (unsigned l = i + 1; l < n; l++)
-      t -= U(i, l) * x(l, 0);
+      for (std::size_t i = i1; i-- > i0;) {
+        T *x_i = X + i * ldb;
+        if (w == 1) {
+          T t = x_i[0];
+          for (std::size_t l = i + 1; l < n; l++)
+            t -= U[i * ldu + l] * X[l * ldb];
+          x_i[0] = unit ? t : t / U[i * ldu + i];
+          continue;
+        }
+        for (std::size_t l = i + 1; l < (use_gemm ? i1 : n); l++) {
+          T tau = U[i * ldu + l];
+          const T *x_l = X + l * ldb;
+          for (std::size_t j = 0; j < w; j++)
+            x_i[j] -= tau * x_l[j];
+        }
+        if (!unit)
+          for (std::size_t j = 0; j < w; j++)
+            x_i[j] /= U[i * ldu + i];
+      }
+      i1 = i0;
+    }
+  });
+}
 
-    x(i, 0) = t / U(i, i);
-  }
+// Overwrite B with the solution X of L^T X = B, for L lower triangular,
+// without forming L^T. Once row i of X is known, row i of L holds its
+// coefficients in all the equations above i, so L is still read along
+// contiguous rows, and the off-diagonal blocks go through GEMM with L's
+// strides swapped.
+template <typename T>
+void trsm_lower_trans_(std::size_t n, std::size_t k, const T *L,
+                       std::size_t ldl, bool unit, T *B, std::size_t ldb) {
+  parallel_for(0, k, trsm_col_grain_, [&](std::size_t c0, std::size_t c1) {
+    std::size_t w = c1 - c0;
+    T *X = B + c0;
+    bool use_gemm = w >= trsm_gemm_cols_;
 
+    for (std::size_t i1 = n; i1 > 0;) {
+      std::size_t i0 = i1 > trsm_block_ ? i1 - trsm_block_ : 0;
+      if (use_gemm && i1 < n)
+        gemm<T>(i1 - i0, w, n - i1, T{-1}, L + i1 * ldl + i0, 1, ldl,
+                X + i1 * ldb, ldb, 1, T{1}, X + i0 * ldb, ldb, 1);
+
+      for (std::size_t i = i1; i-- > i0;) {
+        T *x_i = X + i * ldb;
+        if (!unit)
+          for (std::size_t j = 0; j < w; j++)
+            x_i[j] /= L[i * ldl + i];
+        for (std::size_t l = use_gemm ? i0 : 0; l < i; l++) {
+          T tau = L[i * ldl + l];
+          T *x_l = X + l * ldb;
+          for (std::size_t j = 0; j < w; j++)
+            x_l[j] -= tau * x_i[j];
+        }
+      }
+      i1 = i0;
+    }
+  });
+}
+
+// Both accept a b with any number of columns, one right-hand side each.
+
+template <typename T>
+Matrix<T> forward_sub(const Matrix<T> &L, const Matrix<T> &b) {
+  assert(L.rows == L.cols);
+  assert(L.rows == b.rows);
+  Matrix<T> v{b};
+  trsm_lower_(L.rows, b.cols, L.ptr(), L.cols, false, v.ptr(), v.cols);
+  return v;
+}
+
+template <typename T>
+Matrix<T> back_sub(const Matrix<T> &U, const Matrix<T> &v) {
+  assert(U.rows == U.cols);
+  assert(U.rows == v.rows);
+  Matrix<T> x{v};
+  trsm_upper_(U.rows, v.cols, U.ptr(), U.cols, false, x.ptr(), x.cols);
   return x;
 }
 
@@ -43,22 +177,21 @@ template <typename T> Matrix<T> back_sub(Matrix<T> U, Matrix<T> v) {
 
 /**
  *  Basic solver for equation Ax = b,
- *  where A is square and b is a column
- *  matrix.
+ *  where A is square and each column
+ *  of b is a right-hand side.
  */
 
-template <typename T>
-Matrix<T> linear_solve(const Matrix<T> &A, const Matrix<T> &b) {
-  assert(b.cols == 1);
-  assert(A.rows == b.rows);
-  assert(A.rows == A.cols);
+template <typename E, typename B, typename T = typename E::value_type>
+Matrix<T> linear_solve(const MatrixExpr<E> &A, const MatrixExpr<B> &b) {
+  assert(A.self().rows == b.self().rows);
+  assert(A.self().rows == A.self().cols);
 
   std::pair<Matrix<T>, Matrix<T>> factorization = matrix::LUFactor(A);
   Matrix<T> L = std::move(factorization.first);
   Matrix<T> U = std::move(factorization.second);
 
   // Solve Lv = b with forward substitution.
-  Matrix<T> v = internal::forward_sub(L, b);
+  Matrix<T> v = internal::forward_sub(L, Matrix<T>{b.self()});
 
   // Solve Ux = v with back substitution.
   Matrix<T> x = internal::back_sub(U, v);
@@ -66,44 +199,831 @@ Matrix<T> linear_solve(const Matrix<T> &A, const Matrix<T> &b) {
   return x;
 }
 
+/**
+ *  Factor-once, solve-many LU w/ partial pivoting.
+ *
+ *  The constructor runs the blocked factorization of LUPartialPivot once
+ *  and keeps L and U packed together in one n x n matrix, with the pivots
+ *  in an (n - 1) x 1 matrix. The rows are kept in the order the pivots leave
+ *  them (PA = LU), so both triangular solves walk along contiguous rows.
+ *  Each solve then costs O(n^2), and solve_in_place() allocates nothing.
+ *
+ *  b may have k columns, each a right-hand side; they are solved together
+ *  by the blocked triangular solves, which is much faster than k solves.
+ */
+
+template <typename T> class LUFactorization {
+  Matrix<T> M;
+  Matrix<unsigned> p;
+
+  void check_nonsingular_() const;
+
+public:
+  explicit LUFactorization(const Matrix<T> &A);
+  // Factors A in place of its own storage, without a copy.
+  explicit LUFactorization(Matrix<T> &&A);
+  // Factors a copy of a view or expression, e.g. a block of a matrix.
+  template <typename E>
+  explicit LUFactorization(const MatrixExpr<E> &A)
+      : LUFactorization(Matrix<T>{A.self()}) {}
+
+  std::size_t size() const { return M.rows; }
+  bool singular() const;
+
+  // Overwrite b, a matrix or a view into one, with the solution x of Ax = b.
+  void solve_in_place(MatrixView<T> b) const;
+
+  Matrix<T> solve(const Matrix<T> &b) const;
+  Vector<T> solve(const Vector<T> &b) const;
+};
+
+/* ---- LUFactorization implementation. ---- */
+
+template <typename T>
+LUFactorization<T>::LUFactorization(const Matrix<T> &A)
+    : LUFactorization(Matrix<T>{A}) {}
+
+template <typename T>
+LUFactorization<T>::LUFactorization(Matrix<T> &&A)
+    : M{std::move(A)}, p{M.rows - 1, 1} {
+  assert(M.rows == M.cols);
+  internal::lu_in_place_(M, p);
+}
+
+template <typename T> bool LUFactorization<T>::singular() const {
+  for (std::size_t k = 0; k < M.rows; k++)
+    if (M(k, k) == 0)
+      return true;
+  return false;
+}
+
+template <typename T> void LUFactorization<T>::check_nonsingular_() const {
+  if (singular())
+    throw std::domain_error(
+        "Matrix is A singular; cannot guarantee solution exists.");
+}
+
+template <typename T>
+void LUFactorization<T>::solve_in_place(MatrixView<T> b) const {
+  assert(b.rows == M.rows);
+  check_nonsingular_();
+
+  // The kernels need unit stride along the rows of b; solve anything else
+  // (e.g. a transposed view) in a copy.
+  if (!b.unit_rows()) {
+    ArenaScope scope;
+    Matrix<T, ArenaAllocator<T>> x{b};
+    solve_in_place(x);
+    b = x;
+    return;
+  }
+
+  std::size_t n = M.rows;
+  std::size_t k = b.cols;
+  std::size_t ld = b.row_stride();
+  T *y = b.ptr();
+
+  // Apply permutation to RHS.
+  for (std::size_t i = 0; i + 1 < n; i++)
+    if (p(i, 0) != i)
+      std::swap_ranges(y + i * ld, y + i * ld + k, y + p(i, 0) * ld);
+
+  // Solve Ly = Pb, L unit lower triangular, then Ux = y.
+  internal::trsm_lower_(n, k, M.ptr(), n, true, y, ld);
+  internal::trsm_upper_(n, k, M.ptr(), n, false, y, ld);
+}
+
+template <typename T>
+Matrix<T> LUFactorization<T>::solve(const Matrix<T> &b) const {
+  Matrix<T> x{b};
+  solve_in_place(x);
+  return x;
+}
+
+template <typename T>
+Vector<T> LUFactorization<T>::solve(const Vector<T> &b) const {
+  Vector<T> x{b};
+  solve_in_place(x);
+  return x;
+}
+
 /**
  *  Partial pivoting algorithm from Golub and Van Loan.
+ *
+ *  Factors A on every call; to solve against right-hand sides that are not
+ *  all known at once, construct an LUFactorization and call its solve().
  */
 
+template <typename E, typename B, typename T = typename E::value_type>
+Matrix<T> solve_partial_pivot(const MatrixExpr<E> &A, const MatrixExpr<B> &b) {
+  assert(A.self().rows == b.self().rows);
+  assert(A.self().rows == A.self().cols);
+
+  return LUFactorization<T>{A}.solve(Matrix<T>{b.self()});
+}
+
+/**
+ *  Mixed-precision LU w/ partial pivoting and iterative refinement, after
+ *  LAPACK's dsgesv.
+ *
+ *  A is factored by LUFactorization<Low>, by default in float: the GEMM
+ *  kernel then holds twice as many entries per register, and the
+ *  factorization moves half the bytes. A solve refines x in T. Each step
+ *  computes the residual r = b - Ax against the copy of A kept in T,
+ *  solves for the correction with the Low factors, and adds it to x. It
+ *  stops once every column has ||r|| <= ||x|| ||A|| sqrt(n) eps, in the
+ *  infinity norm with the eps of T, which is the accuracy of a solve in T.
+ *  While cond(A) is well below 1 / eps of Low, each step gains about that
+ *  many digits, so two or three steps are usually enough.
+ *
+ *  A is refactored in T, and b solved by that factorization, if A has an
+ *  entry too large for Low, if the Low factors are singular, or if
+ *  refinement stalls: the residual fails to halve in a step, or it hasn't
+ *  converged after max_iter steps. The factorization in T is kept for the
+ *  following solves.
+ */
+
+template <typename T> struct RefinementResult {
+  Matrix<T> x;
+  unsigned iterations; // Refinement steps, not counting the first solve.
+                       // After a fallback, the steps taken before it.
+  bool fell_back;      // Solved by the factorization in T instead.
+};
+
+namespace internal {
+
+constexpr unsigned refine_max_iter_ = 30;
+
+// r = b - A x for a square, row-major A and n x k row-major b, x and r.
 template <typename T>
-Matrix<T> solve_partial_pivot(const Matrix<T> &A, const Matrix<T> &b) {
-  assert(b.cols == 1);
-  assert(A.rows == b.rows);
+void residual_(const Matrix<T> &A, const T *x, const T *b, T *r,
+               std::size_t k) {
+  std::size_t n = A.rows;
+  if (k > 1) {
+    std::copy(b, b + n * k, r);
+    gemm<T>(n, k, n, T{-1}, A.ptr(), n, 1, x, k, 1, T{1}, r, k, 1);
+    return;
+  }
+  parallel_for(0, n, parallel_grain_ / (n + 1) + 1,
+               [&](std::size_t lo, std::size_t hi) {
+                 for (std::size_t i = lo; i < hi; i++) {
+                   const T *row = A.ptr() + i * n;
+                   T val{};
+                   for (std::size_t j = 0; j < n; j++)
+                     val += row[j] * x[j];
+                   r[i] = b[i] - val;
+                 }
+               });
+}
+
+} // namespace internal
+
+template <typename T, typename Low = float> class MixedPrecisionLU {
+  Matrix<T> A;
+  T a_norm;
+  unsigned max_iter;
+  std::unique_ptr<LUFactorization<Low>> low;
+  std::unique_ptr<LUFactorization<T>> high;
+
+public:
+  explicit MixedPrecisionLU(const Matrix<T> &A,
+                            unsigned max_iter = internal::refine_max_iter_)
+      : MixedPrecisionLU(Matrix<T>{A}, max_iter) {}
+  explicit MixedPrecisionLU(Matrix<T> &&A,
+                            unsigned max_iter = internal::refine_max_iter_);
+  template <typename E>
+  explicit MixedPrecisionLU(const MatrixExpr<E> &A,
+                            unsigned max_iter = internal::refine_max_iter_)
+      : MixedPrecisionLU(Matrix<T>{A.self()}, max_iter) {}
+
+  std::size_t size() const { return A.rows; }
+  // Whether A has been refactored in T.
+  bool fell_back() const { return high != nullptr; }
+
+  // b may have k columns; they are refined together. Not const, since a
+  // failed refinement refactors A.
+  RefinementResult<T> solve(const Matrix<T> &b);
+};
+
+/* ---- MixedPrecisionLU implementation. ---- */
+
+template <typename T, typename Low>
+MixedPrecisionLU<T, Low>::MixedPrecisionLU(Matrix<T> &&A_, unsigned max_iter)
+    : A{std::move(A_)}, max_iter{max_iter} {
   assert(A.rows == A.cols);
-  unsigned n = A.rows;
-
-  std::pair<Matrix<double>, Matrix<unsigned>> factorization =
-      matrix::LUPartialPivot(A);
-  Matrix<double> M = std::move(factorization.first);
-  Matrix<unsigned> p = std::move(factorization.second);
-
-  Matrix<T> y{b};
-  for (unsigned k = 0; k < n - 1; k++) {
-    // Apply permutation to RHS.
-    T tmp = y(p(k, 0), 0);
-    y(p(k, 0), 0) = y(k, 0);
-    y(k, 0) = tmp;
-    // TODO: Use Vector class here for clarity.
-
-    // Apply row op to RHS.
-    for (unsigned l = k + 1; l < n; l++)
-      y(l, 0) = y(l, 0) - y(k, 0) * M(l, k);
+  std::size_t n = A.rows;
+
+  // Round A to Low, finding ||A|| and the largest entry on the way.
+  Matrix<Low> a_low{A.rows, A.cols, uninitialized};
+  std::pair<T, T> norms = parallel_reduce(
+      0, n, internal::parallel_grain_ / (n + 1) + 1, std::pair<T, T>{},
+      [&](std::size_t lo, std::size_t hi) {
+        std::pair<T, T> acc{};
+        for (std::size_t i = lo; i < hi; i++) {
+          const T *row = A.ptr() + i * n;
+          Low *row_low = a_low.ptr() + i * n;
+          T sum{};
+          for (std::size_t j = 0; j < n; j++) {
+            row_low[j] = static_cast<Low>(row[j]);
+            sum += std::abs(row[j]);
+            acc.second = std::max(acc.second, std::abs(row[j]));
+          }
+          acc.first = std::max(acc.first, sum);
+        }
+        return acc;
+      },
+      [](std::pair<T, T> a, std::pair<T, T> b) {
+        return std::pair<T, T>{std::max(a.first, b.first),
+                               std::max(a.second, b.second)};
+      });
+  a_norm = norms.first;
+
+  if (norms.second <= static_cast<T>(std::numeric_limits<Low>::max())) {
+    low = std::make_unique<LUFactorization<Low>>(std::move(a_low));
+    if (low->singular())
+      low.reset();
   }
+  if (!low)
+    high = std::make_unique<LUFactorization<T>>(A);
+}
 
-  // Check for singular matrix.
-  for (unsigned k = 0; k < n; k++) {
-    if (M(k, k) == 0)
-      throw std::domain_error(
-          "Matrix is A singular; cannot guarantee solution exists.");
+template <typename T, typename Low>
+RefinementResult<T> MixedPrecisionLU<T, Low>::solve(const Matrix<T> &b) {
+  assert(b.rows == A.rows);
+  std::size_t n = A.rows, k = b.cols, size = n * k;
+  RefinementResult<T> result{Matrix<T>{b.rows, b.cols}, 0, false};
+
+  if (!high) {
+    T *x = result.x.ptr();
+    ArenaScope scope;
+    Matrix<T, ArenaAllocator<T>> r{b};
+    Matrix<Low, ArenaAllocator<Low>> d{b.rows, b.cols, uninitialized};
+    T bound = std::sqrt(static_cast<T>(n)) * a_norm *
+              std::numeric_limits<T>::epsilon();
+    T last = std::numeric_limits<T>::infinity();
+
+    // x starts at 0, so the first correction solves Ax = b.
+    for (std::size_t it = 0;; it++) {
+      for (std::size_t i = 0; i < size; i++)
+        d.ptr()[i] = static_cast<Low>(r.ptr()[i]);
+      low->solve_in_place(d);
+      for (std::size_t i = 0; i < size; i++)
+        x[i] += static_cast<T>(d.ptr()[i]);
+      internal::residual_(A, x, b.ptr(), r.ptr(), k);
+
+      // Columnwise test; NaNs from an overflow fail it, and stall.
+      bool converged = true;
+      T r_max{};
+      for (std::size_t j = 0; j < k; j++) {
+        T x_norm{}, r_norm{};
+        for (std::size_t i = 0; i < n; i++) {
+          x_norm = std::max(x_norm, std::abs(x[i * k + j]));
+          r_norm = std::max(r_norm, std::abs(r(i, j)));
+        }
+        if (!(r_norm <= x_norm * bound))
+          converged = false;
+        r_max = std::max(r_max, r_norm);
+      }
+
+      result.iterations = it;
+      if (converged)
+        return result;
+      if (it == max_iter || !(r_max <= last / 2))
+        break;
+      last = r_max;
+    }
+    high = std::make_unique<LUFactorization<T>>(A);
+  }
+
+  result.x = high->solve(b);
+  result.fell_back = true;
+  return result;
+}
+
+/**
+ *  Solve Ax = b once by MixedPrecisionLU, e.g. in float, refined to the
+ *  accuracy of T. The result reports the refinement steps taken.
+ */
+
+template <typename Low = float, typename E, typename B,
+          typename T = typename E::value_type>
+RefinementResult<T> solve_mixed_precision(const MatrixExpr<E> &A,
+                                          const MatrixExpr<B> &b) {
+  assert(A.self().rows == b.self().rows);
+  assert(A.self().rows == A.self().cols);
+
+  return MixedPrecisionLU<T, Low>{A}.solve(Matrix<T>{b.self()});
+}
+
+/**
+ *  Factor-once Householder QR of an m x n matrix, blocked as in
+ *  factorizations.hpp, optionally with column pivoting (AP = QR).
+ *
+ *  Q is kept as its reflectors and block factors, and applied with
+ *  apply_q / apply_qt by the blocked updates rather than formed; Q() forms
+ *  its first min(m, n) columns when they are wanted. solve() returns the
+ *  least squares solution of Ax = b for m >= n. With pivoting,
+ *  rank-deficient and underdetermined systems get the basic solution, which
+ *  uses only the first rank() pivot columns.
+ *
+ *  A pivoted matrix at least twice as tall as it is wide is first reduced
+ *  to its n x n R without pivoting, and R is then factored with pivoting,
+ *  so only the small factorization pays for the matrix-vector products of
+ *  the pivot search.
+ */
+
+template <typename T> class QRFactorization {
+  Matrix<T> M;
+  // Pivoted factorization of the R of a tall M, if any.
+  Matrix<T> S;
+  std::vector<internal::qr_step_> steps, s_steps;
+  std::vector<T> t, s_t;
+  Matrix<unsigned> p;
+  bool pivoted;
+
+  void apply_(bool trans, MatrixView<T> c) const;
+
+public:
+  explicit QRFactorization(const Matrix<T> &A, bool pivot = false)
+      : QRFactorization(Matrix<T>{A}, pivot) {}
+  // Factors A in place of its own storage, without a copy.
+  explicit QRFactorization(Matrix<T> &&A, bool pivot = false);
+  template <typename E>
+  explicit QRFactorization(const MatrixExpr<E> &A, bool pivot = false)
+      : QRFactorization(Matrix<T>{A.self()}, pivot) {}
+
+  std::size_t rows() const { return M.rows; }
+  std::size_t cols() const { return M.cols; }
+
+  // The min(m, n) x n upper trapezoidal factor.
+  Matrix<T> R() const { return internal::qr_upper_(M); }
+  // Column j of AP is column permutation()(j, 0) of A.
+  const Matrix<unsigned> &permutation() const { return p; }
+  // Diagonal entries of R above tol; see rank() in factorizations.hpp.
+  unsigned rank(T tol = T{-1}) const {
+    return internal::qr_rank_(M, tol, std::max(M.rows, M.cols));
   }
 
-  Matrix<T> x = internal::back_sub(M, y);
+  // The first min(m, n) columns of Q.
+  Matrix<T> Q() const;
+  // Overwrite c, which has m rows, with Qc or Q^T c.
+  void apply_q(MatrixView<T> c) const { apply_(false, c); }
+  void apply_qt(MatrixView<T> c) const { apply_(true, c); }
+
+  Matrix<T> solve(const Matrix<T> &b) const;
+  Vector<T> solve(const Vector<T> &b) const;
+};
+
+/* ---- QRFactorization implementation. ---- */
+
+template <typename T>
+QRFactorization<T>::QRFactorization(Matrix<T> &&A, bool pivot)
+    : M{std::move(A)},
+      S{pivot && M.rows >= 2 * M.cols ? M.cols : 0u,
+        pivot && M.rows >= 2 * M.cols ? M.cols : 0u},
+      p{M.cols, 1}, pivoted{pivot} {
+  if (pivot && S.rows == 0) {
+    internal::qr_pivot_in_place_(M, p, steps, t);
+    return;
+  }
+
+  for (std::size_t j = 0; j < M.cols; j++)
+    p(j, 0) = j;
+  internal::qr_in_place_(M, steps, t);
+  if (!pivot)
+    return;
+
+  // A = Q1 R1 and R1 P = Q2 R give AP = Q1 Q2 R.
+  S = internal::qr_upper_(M);
+  internal::qr_pivot_in_place_(S, p, s_steps, s_t);
+  std::size_t n = M.cols;
+  for (std::size_t i = 0; i < n; i++)
+    std::copy(S.ptr() + i * n + i, S.ptr() + (i + 1) * n,
+              M.ptr() + i * n + i);
+}
+
+template <typename T> Matrix<T> QRFactorization<T>::Q() const {
+  Matrix<T> Q{M.rows, std::min(M.rows, M.cols)};
+  for (std::size_t i = 0; i < Q.cols; i++)
+    Q(i, i) = 1;
+  apply_q(Q);
+  return Q;
+}
+
+template <typename T>
+void QRFactorization<T>::apply_(bool trans, MatrixView<T> c) const {
+  if (c.rows != M.rows)
+    throw std::domain_error("Matrix shapes do not match.");
+  if (!c.unit_rows()) {
+    ArenaScope scope;
+    Matrix<T, ArenaAllocator<T>> x{c};
+    apply_(trans, x);
+    c = x;
+    return;
+  }
+
+  // Q = Q1 Q2, with Q2 acting on the first n rows.
+  std::size_t ld = c.row_stride();
+  if (!trans)
+    internal::qr_apply_(false, S.ptr(), S.cols, s_steps, s_t, c.ptr(), ld,
+                        c.cols);
+  internal::qr_apply_(trans, M.ptr(), M.cols, steps, t, c.ptr(), ld, c.cols);
+  if (trans)
+    internal::qr_apply_(true, S.ptr(), S.cols, s_steps, s_t, c.ptr(), ld,
+                        c.cols);
+}
+
+template <typename T>
+Matrix<T> QRFactorization<T>::solve(const Matrix<T> &b) const {
+  if (b.rows != M.rows)
+    throw std::domain_error("Matrix shapes do not match.");
+  unsigned r = rank();
+  if (!pivoted && (r < M.cols || M.rows < M.cols))
+    throw std::domain_error(
+        "Matrix is rank deficient; factor it with column pivoting.");
+
+  // x(p(0:r)) = R(0:r, 0:r)^-1 (Q^T b)(0:r), and 0 elsewhere.
+  ArenaScope scope;
+  Matrix<T, ArenaAllocator<T>> c{b};
+  apply_qt(c);
+  internal::trsm_upper_(r, c.cols, M.ptr(), M.cols, false, c.ptr(), c.cols);
+
+  Matrix<T> x{M.cols, b.cols};
+  for (std::size_t i = 0; i < r; i++)
+    std::copy(&c(i, 0), &c(i, 0) + c.cols, &x(p(i, 0), 0));
+  return x;
+}
+
+template <typename T>
+Vector<T> QRFactorization<T>::solve(const Vector<T> &b) const {
+  return Vector<T>(solve(static_cast<const Matrix<T> &>(b)));
+}
+
+/**
+ *  Least squares solution of the overdetermined system Ax = b, minimizing
+ *  ||Ax - b||_2 over x, by unpivoted Householder QR as in LAPACK's dgels.
+ *  A must have full column rank; for rank-deficient problems, use
+ *  QRFactorization with pivoting.
+ */
+
+template <typename E, typename B, typename T = typename E::value_type>
+Matrix<T> least_squares(const MatrixExpr<E> &A, const MatrixExpr<B> &b) {
+  return QRFactorization<T>{A}.solve(Matrix<T>{b.self()});
+}
+
+namespace internal {
+
+// Row block of the packed Cholesky.
+constexpr std::size_t cholesky_packed_block_ = 64;
+
+/**
+ *  Factor the packed lower triangle a of an n x n matrix in place into L,
+ *  as in LAPACK's dpptrf: L(i, j) = (A(i, j) - L(i, 0:j) . L(j, 0:j)) /
+ *  L(j, j), where both rows are contiguous in the packed layout. Within a
+ *  block of rows, the entries left of the block depend only on rows above
+ *  it, so those rows are computed in parallel before the diagonal block.
+ *  Returns false if A is not positive definite.
+ */
+
+template <typename T> bool cholesky_packed_(T *a, std::size_t n) {
+  auto row = [a](std::size_t i) { return a + i * (i + 1) / 2; };
+  auto dot = [](const T *x, const T *y, std::size_t m) {
+    T t{};
+    for (std::size_t l = 0; l < m; l++)
+      t += x[l] * y[l];
+    return t;
+  };
+  // Columns j0 to j1 - 1 of row i, once its columns left of j0 are done.
+  auto row_part = [&](std::size_t i, std::size_t j0, std::size_t j1) {
+    T *ri = row(i);
+    for (std::size_t j = j0; j < j1; j++)
+      ri[j] = (ri[j] - dot(ri, row(j), j)) / row(j)[j];
+  };
+
+  for (std::size_t i0 = 0; i0 < n; i0 += cholesky_packed_block_) {
+    std::size_t i1 = std::min(n, i0 + cholesky_packed_block_);
+    if (i0 > 0)
+      parallel_for(i0, i1, 1, [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t i = lo; i < hi; i++)
+          row_part(i, 0, i0);
+      });
+    for (std::size_t i = i0; i < i1; i++) {
+      row_part(i, i0, i);
+      T d = row(i)[i] - dot(row(i), row(i), i);
+      if (!(d > T{}))
+        return false;
+      row(i)[i] = std::sqrt(d);
+    }
+  }
+  return true;
+}
+
+// Overwrite the n x k row-major block B with the solution of L L^T X = B,
+// for L packed as above. Column chunks of B are solved on separate threads;
+// the L^T solve reads L by rows, like trsm_lower_trans_.
+template <typename T>
+void cholesky_packed_solve_(std::size_t n, std::size_t k, const T *a, T *B,
+                            std::size_t ldb) {
+  parallel_for(0, k, trsm_col_grain_, [&](std::size_t c0, std::size_t c1) {
+    std::size_t w = c1 - c0;
+    T *X = B + c0;
+    for (std::size_t i = 0; i < n; i++) {
+      const T *li = a + i * (i + 1) / 2;
+      T *x_i = X + i * ldb;
+      for (std::size_t l = 0; l < i; l++) {
+        T tau = li[l];
+        const T *x_l = X + l * ldb;
+        for (std::size_t j = 0; j < w; j++)
+          x_i[j] -= tau * x_l[j];
+      }
+      for (std::size_t j = 0; j < w; j++)
+        x_i[j] /= li[i];
+    }
+    for (std::size_t i = n; i-- > 0;) {
+      const T *li = a + i * (i + 1) / 2;
+      T *x_i = X + i * ldb;
+      for (std::size_t j = 0; j < w; j++)
+        x_i[j] /= li[i];
+      for (std::size_t l = 0; l < i; l++) {
+        T tau = li[l];
+        T *x_l = X + l * ldb;
+        for (std::size_t j = 0; j < w; j++)
+          x_l[j] -= tau * x_i[j];
+      }
+    }
+  });
+}
+
+} // namespace internal
+
+/**
+ *  Factor-once, solve-many Cholesky factorization A = L L^T of a symmetric
+ *  positive definite matrix: half the flops of LU, and no pivoting.
+ *
+ *  The constructor throws std::domain_error if A is not positive definite.
+ *  A Matrix or an expression is factored by the blocked CholeskyTiled,
+ *  reading its lower triangle, and L is kept in a dense n x n matrix; the
+ *  solve with L^T reads it by rows through trsm_lower_trans_.
+ *
+ *  A packed SymmetricMatrix is factored in its own layout instead, by
+ *  cholesky_packed_, so L takes n (n + 1) / 2 entries. Passed as an rvalue,
+ *  it is factored in place and nothing else is allocated. The packed
+ *  factorization is not blocked for GEMM, so for large n it is slower than
+ *  factoring Matrix<T>{S}: it trades speed for half the memory.
+ */
+
+template <typename T> class CholeskyFactorization {
+  Matrix<T> M;
+  // L for a packed input, in the same layout; M is then empty.
+  SymmetricMatrix<T> P{0};
+  bool packed = false;
+
+public:
+  explicit CholeskyFactorization(const Matrix<T> &A)
+      : CholeskyFactorization(A.view()) {}
+  template <typename E>
+  explicit CholeskyFactorization(const MatrixExpr<E> &A);
+  explicit CholeskyFactorization(SymmetricMatrix<T> A);
+
+  std::size_t size() const { return packed ? P.rows : M.rows; }
+
+  // The lower triangular factor.
+  Matrix<T> L() const;
+
+  // Overwrite b, a matrix or a view into one, with the solution x of Ax = b.
+  void solve_in_place(MatrixView<T> b) const;
+
+  Matrix<T> solve(const Matrix<T> &b) const;
+  Vector<T> solve(const Vector<T> &b) const;
+};
+
+/**
+ *  Factor-once, solve-many LDL^T factorization with Bunch-Kaufman pivoting
+ *  (LDLTBunchKaufman in factorizations.hpp), for symmetric matrices that
+ *  may be indefinite. Takes the same inputs as CholeskyFactorization.
+ */
+
+template <typename T> class LDLTFactorization {
+  Matrix<T> M;
+  Matrix<int> p;
+
+  void check_nonsingular_() const;
+  void solve_cols_(T *y, std::size_t ld, std::size_t k) const;
+
+public:
+  explicit LDLTFactorization(const Matrix<T> &A)
+      : LDLTFactorization(A.view()) {}
+  template <typename E> explicit LDLTFactorization(const MatrixExpr<E> &A);
+
+  std::size_t size() const { return M.rows; }
+  bool singular() const;
+
+  void solve_in_place(MatrixView<T> b) const;
+
+  Matrix<T> solve(const Matrix<T> &b) const;
+  Vector<T> solve(const Vector<T> &b) const;
+};
+
+/* ---- CholeskyFactorization implementation. ---- */
+
+template <typename T>
+template <typename E>
+CholeskyFactorization<T>::CholeskyFactorization(const MatrixExpr<E> &A)
+    : M{CholeskyTiled(A)} {}
+
+template <typename T>
+CholeskyFactorization<T>::CholeskyFactorization(SymmetricMatrix<T> A)
+    : M{0, 0}, P{std::move(A)}, packed{true} {
+  if (!internal::cholesky_packed_(P.packed(), P.rows))
+    throw std::domain_error("Matrix is not positive definite.");
+}
+
+template <typename T> Matrix<T> CholeskyFactorization<T>::L() const {
+  if (!packed)
+    return M;
+  Matrix<T> L{P.rows, P.rows};
+  for (std::size_t i = 0; i < P.rows; i++)
+    for (std::size_t j = 0; j <= i; j++)
+      L(i, j) = P(i, j);
+  return L;
+}
+
+template <typename T>
+void CholeskyFactorization<T>::solve_in_place(MatrixView<T> b) const {
+  assert(b.rows == size());
+  if (!b.unit_rows()) {
+    ArenaScope scope;
+    Matrix<T, ArenaAllocator<T>> x{b};
+    solve_in_place(x);
+    b = x;
+    return;
+  }
+  if (packed) {
+    internal::cholesky_packed_solve_(P.rows, b.cols, P.packed(), b.ptr(),
+                                     b.row_stride());
+    return;
+  }
+
+  // Solve Ly = b, then L^T x = y.
+  std::size_t n = M.rows;
+  internal::trsm_lower_(n, b.cols, M.ptr(), n, false, b.ptr(),
+                        b.row_stride());
+  internal::trsm_lower_trans_(n, b.cols, M.ptr(), n, false, b.ptr(),
+                              b.row_stride());
+}
+
+template <typename T>
+Matrix<T> CholeskyFactorization<T>::solve(const Matrix<T> &b) const {
+  Matrix<T> x{b};
+  solve_in_place(x);
+  return x;
+}
+
+template <typename T>
+Vector<T> CholeskyFactorization<T>::solve(const Vector<T> &b) const {
+  Vector<T> x{b};
+  solve_in_place(x);
+  return x;
+}
+
+/* ---- LDLTFactorization implementation. ---- */
+
+template <typename T>
+template <typename E>
+LDLTFactorization<T>::LDLTFactorization(const MatrixExpr<E> &A)
+    : M{A.self()}, p{A.self().rows, 1} {
+  assert(M.rows == M.cols);
+  internal::ldlt_in_place_(M, p);
+}
+
+template <typename T> bool LDLTFactorization<T>::singular() const {
+  for (std::size_t k = 0; k < M.rows; k++)
+    if (p(k, 0) >= 0 && M(k, k) == T{})
+      return true;
+  return false;
+}
+
+template <typename T> void LDLTFactorization<T>::check_nonsingular_() const {
+  if (singular())
+    throw std::domain_error(
+        "Matrix is A singular; cannot guarantee solution exists.");
+}
+
+// Columns of the row-major n x k block y, as in LAPACK's dsytrs: the row
+// swaps are applied step by step, interleaved with the columns of L.
+template <typename T>
+void LDLTFactorization<T>::solve_cols_(T *y, std::size_t ld,
+                                       std::size_t k) const {
+  std::size_t n = M.rows;
+  const T *a = M.ptr();
+  auto row = [&](std::size_t i) { return y + i * ld; };
+  auto swap_rows = [&](std::size_t i, std::size_t l) {
+    if (i != l)
+      std::swap_ranges(row(i), row(i) + k, row(l));
+  };
+
+  // Solve L D z = P b.
+  for (std::size_t s = 0; s < n;) {
+    if (p(s, 0) >= 0) {
+      swap_rows(s, p(s, 0));
+      const T *ys = row(s);
+      for (std::size_t i = s + 1; i < n; i++) {
+        T l = a[i * n + s];
+        T *yi = row(i);
+        for (std::size_t c = 0; c < k; c++)
+          yi[c] -= l * ys[c];
+      }
+      T d = a[s * n + s];
+      for (std::size_t c = 0; c < k; c++)
+        row(s)[c] /= d;
+      s++;
+    } else {
+      swap_rows(s + 1, -p(s, 0) - 1);
+      const T *y0 = row(s), *y1 = row(s + 1);
+      for (std::size_t i = s + 2; i < n; i++) {
+        T l0 = a[i * n + s], l1 = a[i * n + s + 1];
+        T *yi = row(i);
+        for (std::size_t c = 0; c < k; c++)
+          yi[c] -= l0 * y0[c] + l1 * y1[c];
+      }
+      T d21 = a[(s + 1) * n + s];
+      T d11 = a[s * n + s] / d21, d22 = a[(s + 1) * n + s + 1] / d21;
+      T denom = d11 * d22 - 1;
+      T *z0 = row(s), *z1 = row(s + 1);
+      for (std::size_t c = 0; c < k; c++) {
+        T b0 = z0[c] / d21, b1 = z1[c] / d21;
+        z0[c] = (d22 * b0 - b1) / denom;
+        z1[c] = (d11 * b1 - b0) / denom;
+      }
+      s += 2;
+    }
+  }
+
+  // Solve L^T P x = z, from the last block up.
+  for (std::size_t s = n; s > 0;) {
+    std::size_t j = s - 1;
+    bool two = p(j, 0) < 0;
+    std::size_t first = two ? j - 1 : j;
+    for (std::size_t t = first; t <= j; t++) {
+      T *yt = row(t);
+      for (std::size_t i = j + 1; i < n; i++) {
+        T l = a[i * n + t];
+        const T *yi = row(i);
+        for (std::size_t c = 0; c < k; c++)
+          yt[c] -= l * yi[c];
+      }
+    }
+    swap_rows(j, two ? -p(j, 0) - 1 : p(j, 0));
+    s = first;
+  }
+}
+
+template <typename T>
+void LDLTFactorization<T>::solve_in_place(MatrixView<T> b) const {
+  assert(b.rows == M.rows);
+  check_nonsingular_();
+  if (!b.unit_rows()) {
+    ArenaScope scope;
+    Matrix<T, ArenaAllocator<T>> x{b};
+    solve_in_place(x);
+    b = x;
+    return;
+  }
+
+  T *y = b.ptr();
+  std::size_t ld = b.row_stride();
+  parallel_for(0, b.cols, internal::trsm_col_grain_,
+               [&](std::size_t c0, std::size_t c1) {
+                 solve_cols_(y + c0, ld, c1 - c0);
+               });
+}
+
+template <typename T>
+Matrix<T> LDLTFactorization<T>::solve(const Matrix<T> &b) const {
+  Matrix<T> x{b};
+  solve_in_place(x);
+  return x;
+}
+
+template <typename T>
+Vector<T> LDLTFactorization<T>::solve(const Vector<T> &b) const {
+  Vector<T> x{b};
+  solve_in_place(x);
   return x;
 }
 
+// Factor and solve in one call, like solve_partial_pivot.
+
+template <typename E, typename B, typename T = typename E::value_type>
+Matrix<T> solve_cholesky(const MatrixExpr<E> &A, const MatrixExpr<B> &b) {
+  return CholeskyFactorization<T>{A}.solve(Matrix<T>{b.self()});
+}
+
+template <typename E, typename B, typename T = typename E::value_type>
+Matrix<T> solve_ldlt(const MatrixExpr<E> &A, const MatrixExpr<B> &b) {
+  return LDLTFactorization<T>{A}.solve(Matrix<T>{b.self()});
+}
+
 } // namespace matrix
+
+#endif
@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+#include "thread_pool.hpp"
+#include "vector.hpp"
+#include "view.hpp"
+
+#ifndef SPARSE_H
+#define SPARSE_H
+
+namespace matrix {
+
+namespace internal {
+
+// Indices are stored as unsigned, so a sparse dimension must fit in one.
+inline unsigned sparse_dim_(std::size_t n) {
+  if (n > std::numeric_limits<unsigned>::max())
+    throw std::domain_error(
+        "Sparse matrix dimension does not fit in unsigned.");
+  return static_cast<unsigned>(n);
+}
+
+} // namespace internal
+
+/**
+ *  Sparse matrices in compressed sparse row (CSR) form.
+ *
+ *  Row i owns the entries row_ptr()[i] to row_ptr()[i + 1] - 1 of
+ *  col_idx() and values(), sorted by column, with no duplicates. Storage
+ *  and products cost O(nnz) instead of O(rows * cols), e.g. 5 nonzeros per
+ *  row for a finite-difference Laplacian.
+ *
+ *  The easiest way to build one is from (row, col, value) triplets with a
+ *  SparseBuilder, which may receive them in any order and sums duplicates.
+ *  transpose() returns the CSR form of A^T, which is the compressed sparse
+ *  column (CSC) form of A.
+ *
+ *  A SparseMatrix is not an expression: there is no implicit conversion to
+ *  dense, so it can't end up in an O(rows * cols) loop by accident. Use
+ *  to_dense() for that.
+ */
+
+template <typename T> class SparseMatrix {
+  std::vector<std::size_t> row_ptrs;
+  std::vector<unsigned> col_ids;
+  std::vector<T> vals;
+
+public:
+  typedef T value_type;
+
+  const unsigned rows;
+  const unsigned cols;
+
+  // The constructors throw std::domain_error if a dimension does not fit
+  // in unsigned.
+
+  // Empty (all zero) matrix.
+  SparseMatrix(std::size_t rows, std::size_t cols);
+  // Takes CSR arrays as described above; throws if they are inconsistent.
+  SparseMatrix(std::size_t rows, std::size_t cols,
+               std::vector<std::size_t> row_ptr, std::vector<unsigned> col_idx,
+               std::vector<T> values);
+  // Keep the nonzero entries of a dense matrix.
+  explicit SparseMatrix(const Matrix<T> &);
+
+  std::size_t nnz() const { return vals.size(); }
+
+  const std::size_t *row_ptr() const { return row_ptrs.data(); }
+  const unsigned *col_idx() const { return col_ids.data(); }
+  const T *values() const { return vals.data(); }
+  T *values() { return vals.data(); }
+
+  // Entry lookup, by binary search within the row.
+  T operator()(unsigned row, unsigned col) const;
+
+  SparseMatrix<T> transpose() const;
+  Matrix<T> to_dense() const;
+};
+
+/**
+ *  Collects (row, col, value) triplets, i.e. coordinate (COO) form, and
+ *  compresses them into a SparseMatrix. Duplicate entries are summed, as in
+ *  finite element assembly.
+ */
+
+template <typename T> class SparseBuilder {
+  struct Triplet {
+    unsigned row;
+    unsigned col;
+    T value;
+  };
+
+  std::vector<Triplet> triplets;
+
+public:
+  const unsigned rows;
+  const unsigned cols;
+
+  // Throws std::domain_error if a dimension does not fit in unsigned.
+  SparseBuilder(std::size_t rows, std::size_t cols)
+      : rows{internal::sparse_dim_(rows)}, cols{internal::sparse_dim_(cols)} {}
+
+  void reserve(std::size_t n) { triplets.reserve(n); }
+  void add(unsigned row, unsigned col, const T &value);
+
+  SparseMatrix<T> build() const;
+};
+
+/* ---- SparseMatrix implementation. ---- */
+
+template <typename T>
+SparseMatrix<T>::SparseMatrix(std::size_t rows, std::size_t cols)
+    : row_ptrs(std::size_t{internal::sparse_dim_(rows)} + 1, 0),
+      rows{static_cast<unsigned>(rows)}, cols{internal::sparse_dim_(cols)} {}
+
+template <typename T>
+SparseMatrix<T>::SparseMatrix(std::size_t rows, std::size_t cols,
+                              std::vector<std::size_t> row_ptr,
+                              std::vector<unsigned> col_idx,
+                              std::vector<T> values)
+    : row_ptrs{std::move(row_ptr)}, col_ids{std::move(col_idx)},
+      vals{std::move(values)}, rows{internal::sparse_dim_(rows)},
+      cols{internal::sparse_dim_(cols)} {
+  if (row_ptrs.size() != rows + 1 || row_ptrs[0] != 0 ||
+      row_ptrs[rows] != vals.size() || col_ids.size() != vals.size())
+    throw std::invalid_argument("Inconsistent CSR array sizes.");
+
+  for (unsigned i = 0; i < rows; i++) {
+    if (row_ptrs[i] > row_ptrs[i + 1])
+      throw std::invalid_argument("CSR row pointers must be nondecreasing.");
+    for (std::size_t k = row_ptrs[i]; k < row_ptrs[i + 1]; k++)
+      if (col_ids[k] >= cols ||
+          (k > row_ptrs[i] && col_ids[k] <= col_ids[k - 1]))
+        throw std::invalid_argument(
+            "CSR column indices must be in range and increasing in a row.");
+  }
+}
+
+template <typename T>
+SparseMatrix<T>::SparseMatrix(const Matrix<T> &m)
+    : row_ptrs(std::size_t{internal::sparse_dim_(m.rows)} + 1, 0),
+      rows{static_cast<unsigned>(m.rows)}, cols{internal::sparse_dim_(m.cols)} {
+  for (unsigned i = 0; i < rows; i++) {
+    for (unsigned j = 0; j < cols; j++)
+      if (m(i, j) != T{}) {
+        col_ids.push_back(j);
+        vals.push_back(m(i, j));
+      }
+    row_ptrs[i + 1] = vals.size();
+  }
+}
+
+template <typename T>
+T SparseMatrix<T>::operator()(unsigned row, unsigned col) const {
+  const unsigned *first = col_ids.data() + row_ptrs[row];
+  const unsigned *last = col_ids.data() + row_ptrs[row + 1];
+  const unsigned *it = std::lower_bound(first, last, col);
+  return (it != last && *it == col) ? vals[it - col_ids.data()] : T{};
+}
+
+template <typename T> SparseMatrix<T> SparseMatrix<T>::transpose() const {
+  // Counting sort of the entries by column. Rows are visited in order, so
+  // each transposed row comes out sorted.
+  std::vector<std::size_t> t_ptr(std::size_t{cols} + 1, 0);
+  for (unsigned j : col_ids)
+    t_ptr[j + 1]++;
+  std::partial_sum(t_ptr.begin(), t_ptr.end(), t_ptr.begin());
+
+  std::vector<unsigned> t_idx(nnz());
+  std::vector<T> t_vals(nnz());
+  std::vector<std::size_t> next(t_ptr.begin(), t_ptr.end() - 1);
+  for (unsigned i = 0; i < rows; i++)
+    for (std::size_t k = row_ptrs[i]; k < row_ptrs[i + 1]; k++) {
+      std::size_t dst = next[col_ids[k]]++;
+      t_idx[dst] = i;
+      t_vals[dst] = vals[k];
+    }
+
+  return SparseMatrix<T>{cols, rows, std::move(t_ptr), std::move(t_idx),
+                         std::move(t_vals)};
+}
+
+template <typename T> Matrix<T> SparseMatrix<T>::to_dense() const {
+  Matrix<T> m{rows, cols};
+  for (unsigned i = 0; i < rows; i++)
+    for (std::size_t k = row_ptrs[i]; k < row_ptrs[i + 1]; k++)
+      m(i, col_ids[k]) = vals[k];
+  return m;
+}
+
+/* ---- SparseBuilder implementation. ---- */
+
+template <typename T>
+void SparseBuilder<T>::add(unsigned row, unsigned col, const T &value) {
+  if (row >= rows || col >= cols)
+    throw std::out_of_range("Sparse entry index out of range.");
+  triplets.push_back({row, col, value});
+}
+
+template <typename T> SparseMatrix<T> SparseBuilder<T>::build() const {
+  // Bucket the triplets by row, then sort each row by column and merge
+  // duplicates in place.
+  std::vector<std::size_t> row_ptr(std::size_t{rows} + 1, 0);
+  for (const Triplet &t : triplets)
+    row_ptr[t.row + 1]++;
+  std::partial_sum(row_ptr.begin(), row_ptr.end(), row_ptr.begin());
+
+  std::vector<std::pair<unsigned, T>> entries(triplets.size());
+  std::vector<std::size_t> next(row_ptr.begin(), row_ptr.end() - 1);
+  for (const Triplet &t : triplets)
+    entries[next[t.row]++] = {t.col, t.value};
+
+  std::vector<unsigned> col_idx;
+  std::vector<T> values;
+  col_idx.reserve(entries.size());
+  values.reserve(entries.size());
+
+  for (unsigned i = 0; i < rows; i++) {
+    auto first = entries.begin() + row_ptr[i];
+    auto last = entries.begin() + row_ptr[i + 1];
+    std::stable_sort(first, last, [](const auto &a, const auto &b) {
+      return a.first < b.first;
+    });
+
+    // Row i has been read, so its start can now be compressed.
+    std::size_t row_begin = values.size();
+    for (auto it = first; it != last; ++it) {
+      if (values.size() > row_begin && col_idx.back() == it->first) {
+        values.back() += it->second;
+      } else {
+        col_idx.push_back(it->first);
+        values.push_back(it->second);
+      }
+    }
+    row_ptr[i] = row_begin;
+  }
+  row_ptr[rows] = values.size();
+
+  return SparseMatrix<T>{rows, cols, std::move(row_ptr), std::move(col_idx),
+                         std::move(values)};
+}
+
+/* ---- Sparse products. ---- */
+
+namespace internal {
+
+// SpMV on rows [r0, r1): one sparse dot product per row. The arrays are
+// plain arguments so the compiler keeps them in registers.
+template <typename T>
+void spmv_rows_(const std::size_t *ptr, const unsigned *idx, const T *val,
+                const T *x, T *y, std::size_t ldy, std::size_t r0,
+                std::size_t r1) {
+  for (std::size_t i = r0; i < r1; i++) {
+    T sum{};
+    for (std::size_t p = ptr[i]; p < ptr[i + 1]; p++)
+      sum += val[p] * x[idx[p]];
+    y[i * ldy] = sum;
+  }
+}
+
+/**
+ *  Y = A X for a k-column, row-major block X (SpMM; SpMV for k = 1).
+ *
+ *  Threads get contiguous row ranges holding about equal numbers of
+ *  nonzeros, so uneven rows don't leave threads idle. For k > 1 each
+ *  nonzero scales a contiguous row of X, which vectorizes.
+ */
+
+template <typename T>
+void spmm_(const SparseMatrix<T> &A, const T *X, std::size_t ldx,
+           std::size_t k, T *Y, std::size_t ldy) {
+  const std::size_t *ptr = A.row_ptr();
+  const unsigned *idx = A.col_idx();
+  const T *val = A.values();
+
+  auto rows_ = [=](std::size_t r0, std::size_t r1) {
+    if (k == 1 && ldx == 1) {
+      spmv_rows_(ptr, idx, val, X, Y, ldy, r0, r1);
+      return;
+    }
+    for (std::size_t i = r0; i < r1; i++) {
+      T *y = Y + i * ldy;
+      std::fill(y, y + k, T{});
+      for (std::size_t p = ptr[i]; p < ptr[i + 1]; p++) {
+        T a = val[p];
+        const T *x = X + idx[p] * ldx;
+        for (std::size_t j = 0; j < k; j++)
+          y[j] += a * x[j];
+      }
+    }
+  };
+
+  // Split the nonzeros evenly, then hand each thread the rows whose first
+  // nonzero falls in its share; the last thread also takes trailing empty
+  // rows.
+  std::size_t nnz = A.nnz(), rows = A.rows;
+  std::size_t grain = parallel_grain_ / std::max<std::size_t>(k, 1) + 1;
+  parallel_for(0, std::max<std::size_t>(nnz, 1), grain,
+               [&](std::size_t lo, std::size_t hi) {
+                 std::size_t r0 = lo == 0 ? 0
+                                          : std::lower_bound(ptr, ptr + rows,
+                                                             lo) - ptr;
+                 std::size_t r1 = hi >= nnz ? rows
+                                            : std::lower_bound(ptr, ptr + rows,
+                                                               hi) - ptr;
+                 rows_(r0, r1);
+               });
+}
+
+} // namespace internal
+
+// Overwrite y with A x; x and y are matrices or views whose k columns are
+// separate vectors, with unit column stride. T is deduced from A only, so
+// matrices convert to views here.
+template <typename T>
+void multiply_into(MatrixView<typename SparseMatrix<T>::value_type> y,
+                   const SparseMatrix<T> &A,
+                   ConstMatrixView<typename SparseMatrix<T>::value_type> x) {
+  if (A.cols != x.rows || A.rows != y.rows || x.cols != y.cols)
+    throw std::domain_error("Dimensions of sparse product don't match.");
+  assert(x.col_stride() == 1 && y.col_stride() == 1);
+  internal::spmm_(A, x.ptr(), x.row_stride(), x.cols, y.ptr(),
+                  y.row_stride());
+}
+
+template <typename T>
+Vector<T> operator*(const SparseMatrix<T> &lhs, const Vector<T> &rhs) {
+  if (lhs.cols != rhs.rows)
+    throw std::domain_error("Matrix #cols must match Vector #rows.");
+  Vector<T> result(lhs.rows);
+  internal::spmm_(lhs, rhs.ptr(), 1, 1, result.ptr(), 1);
+  return result;
+}
+
+template <typename T>
+Matrix<T> operator*(const SparseMatrix<T> &lhs, const Matrix<T> &rhs) {
+  if (lhs.cols != rhs.rows)
+    throw std::domain_error("LHS #cols must match RHS #rows.");
+  Matrix<T> result{lhs.rows, rhs.cols};
+  internal::spmm_(lhs, rhs.ptr(), rhs.cols, rhs.cols, result.ptr(),
+                  result.cols);
+  return result;
+}
+
+} // namespace matrix
+
+#endif
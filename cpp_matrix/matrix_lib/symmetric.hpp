@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "expressions.hpp"
+#include "matrix.hpp"
+#include "vector.hpp"
+
+#ifndef SYMMETRIC_H
+#define SYMMETRIC_H
+
+namespace matrix {
+
+/**
+ *  Symmetric matrices in packed storage.
+ *
+ *  Only the lower triangle is stored, row by row: A(i, j) for j <= i is at
+ *  packed()[i (i + 1) / 2 + j], so an n x n matrix takes n (n + 1) / 2
+ *  entries. Both A(i, j) and A(j, i) refer to that one entry.
+ *
+ *  A SymmetricMatrix is a read-only expression: it can be added to other
+ *  matrices, converted with Matrix<T>{S}, or passed to any factorization
+ *  that takes an expression, e.g. CholeskyFactorization and
+ *  LDLTFactorization in solvers.hpp. Products with a vector or matrix use
+ *  the packed storage directly, and so does CholeskyFactorization, whose
+ *  factor of a SymmetricMatrix keeps its packed layout.
+ */
+
+template <typename T>
+class SymmetricMatrix : public MatrixExpr<SymmetricMatrix<T>> {
+  std::vector<T> data;
+
+  static std::size_t index_(std::size_t row, std::size_t col) {
+    if (col > row)
+      std::swap(row, col);
+    return row * (row + 1) / 2 + col;
+  }
+
+public:
+  typedef T value_type;
+
+  const std::size_t rows;
+  const std::size_t cols;
+
+  // All zero n x n matrix.
+  explicit SymmetricMatrix(std::size_t n);
+  // The lower triangle of a square matrix or expression; the upper
+  // triangle is not read.
+  template <typename E> explicit SymmetricMatrix(const MatrixExpr<E> &);
+
+  T &operator()(std::size_t row, std::size_t col) {
+    return data[index_(row, col)];
+  }
+  T operator()(std::size_t row, std::size_t col) const {
+    return data[index_(row, col)];
+  }
+
+  T *packed() { return data.data(); }
+  const T *packed() const { return data.data(); }
+  std::size_t packed_size() const { return data.size(); }
+};
+
+namespace internal {
+
+// Hold a SymmetricMatrix by reference in expression nodes, like a Matrix.
+template <typename T> struct expr_ref_<SymmetricMatrix<T>> {
+  typedef const SymmetricMatrix<T> &type;
+};
+
+} // namespace internal
+
+/* ---- SymmetricMatrix implementation. ---- */
+
+template <typename T>
+SymmetricMatrix<T>::SymmetricMatrix(std::size_t n)
+    : data(std::size_t(n) * (n + 1) / 2), rows{n}, cols{n} {}
+
+template <typename T>
+template <typename E>
+SymmetricMatrix<T>::SymmetricMatrix(const MatrixExpr<E> &expr)
+    : SymmetricMatrix(expr.self().rows) {
+  const E &e = expr.self();
+  if (e.rows != e.cols)
+    throw std::domain_error("Symmetric matrix must be square.");
+  T *out = data.data();
+  for (std::size_t i = 0; i < rows; i++)
+    for (std::size_t j = 0; j <= i; j++)
+      *out++ = e(i, j);
+}
+
+/* ---- Products. ---- */
+
+namespace internal {
+
+// Y = A X, for X and Y with k columns and row strides ldx and ldy. Row i of
+// the packed triangle is used twice: as row i of A (entries left of the
+// diagonal), and as column i (entries above it).
+template <typename T>
+void spmm_packed_(const SymmetricMatrix<T> &A, const T *x, std::size_t ldx,
+                  std::size_t k, T *y, std::size_t ldy) {
+  std::size_t n = A.rows;
+  const T *a = A.packed();
+  for (std::size_t i = 0; i < n; i++)
+    std::fill(y + i * ldy, y + i * ldy + k, T{});
+
+  for (std::size_t i = 0; i < n; i++) {
+    const T *row = a + i * (i + 1) / 2;
+    const T *xi = x + i * ldx;
+    T *yi = y + i * ldy;
+    if (k == 1) {
+      T t = row[i] * xi[0];
+      for (std::size_t j = 0; j < i; j++) {
+        t += row[j] * x[j * ldx];
+        y[j * ldy] += row[j] * xi[0];
+      }
+      yi[0] += t;
+      continue;
+    }
+    for (std::size_t j = 0; j < i; j++) {
+      T s = row[j];
+      const T *xj = x + j * ldx;
+      T *yj = y + j * ldy;
+      for (std::size_t c = 0; c < k; c++) {
+        yi[c] += s * xj[c];
+        yj[c] += s * xi[c];
+      }
+    }
+    for (std::size_t c = 0; c < k; c++)
+      yi[c] += row[i] * xi[c];
+  }
+}
+
+} // namespace internal
+
+template <typename T>
+Vector<T> operator*(const SymmetricMatrix<T> &lhs, const Vector<T> &rhs) {
+  if (lhs.cols != rhs.rows)
+    throw std::domain_error("Matrix and vector shapes do not match.");
+  Vector<T> result(lhs.rows);
+  internal::spmm_packed_(lhs, rhs.ptr(), 1, 1, result.ptr(), 1);
+  return result;
+}
+
+template <typename T>
+Matrix<T> operator*(const SymmetricMatrix<T> &lhs, const Matrix<T> &rhs) {
+  if (lhs.cols != rhs.rows)
+    throw std::domain_error("Matrix shapes do not match.");
+  Matrix<T> result{lhs.rows, rhs.cols};
+  internal::spmm_packed_(lhs, rhs.ptr(), rhs.cols, rhs.cols, result.ptr(),
+                         result.cols);
+  return result;
+}
+
+} // namespace matrix
+
+#endif
@@ -0,0 +1,225 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+namespace matrix {
+
+/**
+ *  A task-dependency (DAG) scheduler for tiled algorithms.
+ *
+ *  Tasks are added in program order, each declaring the data it reads and
+ *  the data it writes as integer keys (e.g. tile indices). Edges are derived
+ *  the way a superscalar processor would: a task waits for the last writer
+ *  of everything it touches, and a writer also waits for the readers since
+ *  that last write. So the graph runs the same computation as the serial
+ *  program, with independent tasks free to overlap.
+ *
+ *  run() executes the graph on the library thread pool. Every thread owns a
+ *  deque of ready tasks: it pops its newest task (good locality, and the
+ *  task that just became ready is usually on the critical path) and, when
+ *  out of work, steals the oldest task of another thread.
+ */
+
+class TaskGraph {
+public:
+  typedef std::size_t key_t;
+
+private:
+  struct Task {
+    std::function<void()> fn;
+    std::vector<std::size_t> successors;
+    unsigned num_deps = 0;
+    std::atomic<unsigned> pending{0};
+  };
+
+  struct Access {
+    std::size_t last_writer = npos_;
+    std::vector<std::size_t> readers;
+  };
+
+  struct Worker {
+    std::mutex mtx;
+    std::deque<std::size_t> ready;
+  };
+
+  static constexpr std::size_t npos_ = static_cast<std::size_t>(-1);
+
+  std::deque<Task> tasks;
+  std::map<key_t, Access> accesses;
+
+  // Scheduling state, only used during run().
+  std::deque<Worker> workers;
+  std::atomic<std::size_t> num_done{0};
+  std::atomic<std::size_t> num_ready{0};
+  std::atomic<bool> failed{false};
+  std::exception_ptr error;
+  std::mutex idle_mtx;
+  std::condition_variable idle_cv;
+
+  void add_edge_(std::size_t from, std::size_t to);
+  void push_(unsigned w, std::size_t task);
+  bool pop_(unsigned w, std::size_t &task);
+  bool steal_(unsigned w, std::size_t &task);
+  void work_(unsigned w);
+
+public:
+  TaskGraph() = default;
+  TaskGraph(const TaskGraph &) = delete;
+  TaskGraph &operator=(const TaskGraph &) = delete;
+
+  std::size_t add(std::function<void()> fn, const std::vector<key_t> &reads,
+                  const std::vector<key_t> &writes);
+
+  std::size_t size() const { return tasks.size(); }
+
+  // Execute every task; rethrows the first exception a task threw.
+  void run();
+};
+
+/* ---- TaskGraph implementation. ---- */
+
+inline void TaskGraph::add_edge_(std::size_t from, std::size_t to) {
+  if (from == npos_ || from == to)
+    return;
+  std::vector<std::size_t> &succ = tasks[from].successors;
+  if (!succ.empty() && succ.back() == to)
+    return; // Already recorded for another key of the same task.
+  succ.push_back(to);
+  tasks[to].num_deps++;
+}
+
+inline std::size_t TaskGraph::add(std::function<void()> fn,
+                                  const std::vector<key_t> &reads,
+                                  const std::vector<key_t> &writes) {
+  std::size_t id = tasks.size();
+  tasks.emplace_back();
+  tasks.back().fn = std::move(fn);
+
+  for (key_t key : reads) {
+    Access &acc = accesses[key];
+    add_edge_(acc.last_writer, id); // Read after write.
+    acc.readers.push_back(id);
+  }
+  for (key_t key : writes) {
+    Access &acc = accesses[key];
+    add_edge_(acc.last_writer, id); // Write after write.
+    for (std::size_t reader : acc.readers)
+      add_edge_(reader, id); // Write after read.
+    acc.readers.clear();
+    acc.last_writer = id;
+  }
+  return id;
+}
+
+inline void TaskGraph::push_(unsigned w, std::size_t task) {
+  {
+    std::lock_guard<std::mutex> lock{workers[w].mtx};
+    workers[w].ready.push_back(task);
+  }
+  // Under idle_mtx, or a worker that has just seen num_ready == 0 could
+  // miss the wakeup and sleep with work to do.
+  std::lock_guard<std::mutex> lock{idle_mtx};
+  num_ready++;
+  idle_cv.notify_one();
+}
+
+inline bool TaskGraph::pop_(unsigned w, std::size_t &task) {
+  std::lock_guard<std::mutex> lock{workers[w].mtx};
+  if (workers[w].ready.empty())
+    return false;
+  task = workers[w].ready.back();
+  workers[w].ready.pop_back();
+  num_ready--;
+  return true;
+}
+
+inline bool TaskGraph::steal_(unsigned w, std::size_t &task) {
+  for (std::size_t i = 1; i < workers.size(); i++) {
+    Worker &victim = workers[(w + i) % workers.size()];
+    std::lock_guard<std::mutex> lock{victim.mtx};
+    if (!victim.ready.empty()) {
+      task = victim.ready.front();
+      victim.ready.pop_front();
+      num_ready--;
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void TaskGraph::work_(unsigned w) {
+  std::size_t total = tasks.size();
+  while (num_done.load() < total && !failed.load()) {
+    std::size_t id;
+    if (!pop_(w, id) && !steal_(w, id)) {
+      std::unique_lock<std::mutex> lock{idle_mtx};
+      idle_cv.wait(lock, [&] {
+        return num_ready.load() > 0 || num_done.load() == total ||
+               failed.load();
+      });
+      continue;
+    }
+
+    try {
+      tasks[id].fn();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock{idle_mtx};
+      if (!error)
+        error = std::current_exception();
+      failed = true;
+      idle_cv.notify_all();
+      return;
+    }
+
+    for (std::size_t succ : tasks[id].successors)
+      if (--tasks[succ].pending == 0)
+        push_(w, succ);
+
+    if (++num_done == total) {
+      std::lock_guard<std::mutex> lock{idle_mtx};
+      idle_cv.notify_all();
+    }
+  }
+}
+
+inline void TaskGraph::run() {
+  if (tasks.empty())
+    return;
+
+  unsigned num_workers = internal::in_parallel_region_() ? 1 : num_threads();
+  workers.clear();
+  workers.resize(num_workers);
+  num_done = 0;
+  num_ready = 0;
+  failed = false;
+  error = nullptr;
+
+  unsigned w = 0;
+  for (std::size_t id = 0; id < tasks.size(); id++) {
+    tasks[id].pending = tasks[id].num_deps;
+    if (tasks[id].num_deps == 0) {
+      push_(w, id);
+      w = (w + 1) % num_workers;
+    }
+  }
+
+  thread_pool().run(num_workers, [this](unsigned w) { work_(w); });
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+} // namespace matrix
+
+#endif
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+namespace matrix {
+
+/**
+ *  A small fork-join thread pool shared by the whole library.
+ *
+ *  run(n, job) calls job(0), ..., job(n - 1) and returns once all of them
+ *  have finished. The calling thread works on the batch too, so a pool of
+ *  size p starts p - 1 worker threads. Batches from different threads
+ *  outside the pool take turns. Work submitted from inside a running
+ *  job is executed serially on the current thread, which keeps nested
+ *  parallel kernels (e.g. a GEMM called from a parallel factorization)
+ *  from oversubscribing the machine or deadlocking.
+ *
+ *  The size defaults to the MATRIX_NUM_THREADS environment variable if set,
+ *  and to std::thread::hardware_concurrency() otherwise. It can be changed
+ *  at runtime with set_num_threads(), but not while work is in flight.
+ */
+
+namespace internal {
+
+inline bool &in_parallel_region_() {
+  thread_local bool flag = false;
+  return flag;
+}
+
+// Elementwise and matrix-vector kernels only fan out to the thread pool
+// once a chunk carries at least this many entries.
+constexpr std::size_t parallel_grain_ = 1 << 15;
+
+inline unsigned default_num_threads_() {
+  if (const char *env = std::getenv("MATRIX_NUM_THREADS")) {
+    int n = std::atoi(env);
+    if (n > 0)
+      return static_cast<unsigned>(n);
+  }
+  unsigned n = std::thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+} // namespace internal
+
+class ThreadPool {
+  std::vector<std::thread> workers;
+  std::mutex mtx;
+  std::condition_variable cv;      // Workers wait here for a batch.
+  std::condition_variable done_cv; // run() waits here for its helpers.
+  std::mutex run_mtx;              // Serializes batches from outside the pool.
+  bool stopping = false;
+
+  // The batch slot, reused by every call to run(), so dispatching a batch
+  // allocates nothing. Guarded by mtx.
+  void (*call)(void *, unsigned) = nullptr;
+  void *job = nullptr;
+  unsigned num_jobs = 0;
+  unsigned num_participants = 0;
+  unsigned helpers_left = 0;
+  std::uint64_t generation = 0;
+  std::exception_ptr error;
+
+  static std::exception_ptr work_on_(unsigned thread, unsigned stride,
+                                     unsigned num_jobs,
+                                     void (*call)(void *, unsigned),
+                                     void *job);
+  void run_(unsigned num_jobs, void (*call)(void *, unsigned), void *job);
+  void start_(unsigned num_workers);
+  void stop_();
+  void worker_loop_(unsigned thread, std::uint64_t seen);
+
+public:
+  explicit ThreadPool(unsigned num_threads = internal::default_num_threads_());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Number of threads that work on a batch, including the caller.
+  unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+  void resize(unsigned num_threads);
+
+  template <typename F> void run(unsigned num_jobs, F &&job);
+};
+
+/* ---- ThreadPool implementation. ---- */
+
+inline ThreadPool::ThreadPool(unsigned num_threads) {
+  start_(num_threads > 0 ? num_threads - 1 : 0);
+}
+
+inline ThreadPool::~ThreadPool() { stop_(); }
+
+inline void ThreadPool::resize(unsigned num_threads) {
+  stop_();
+  start_(num_threads > 0 ? num_threads - 1 : 0);
+}
+
+inline void ThreadPool::start_(unsigned num_workers) {
+  stopping = false;
+  // No batch is in flight, so the workers start from the current one.
+  std::uint64_t seen = generation;
+  for (unsigned i = 0; i < num_workers; i++)
+    workers.emplace_back([this, i, seen] { worker_loop_(i + 1, seen); });
+}
+
+inline void ThreadPool::stop_() {
+  {
+    std::lock_guard<std::mutex> lock{mtx};
+    stopping = true;
+  }
+  cv.notify_all();
+  for (std::thread &t : workers)
+    t.join();
+  workers.clear();
+}
+
+// Worker `thread` (the caller of run() being thread 0) takes part in every
+// batch with more than `thread` jobs.
+inline void ThreadPool::worker_loop_(unsigned thread, std::uint64_t seen) {
+  internal::in_parallel_region_() = true;
+  for (;;) {
+    void (*batch_call)(void *, unsigned);
+    void *batch_job;
+    unsigned stride, count;
+    {
+      std::unique_lock<std::mutex> lock{mtx};
+      cv.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+      if (thread >= num_participants)
+        continue;
+      batch_call = call;
+      batch_job = job;
+      stride = num_participants;
+      count = num_jobs;
+    }
+
+    std::exception_ptr e =
+        work_on_(thread, stride, count, batch_call, batch_job);
+
+    std::lock_guard<std::mutex> lock{mtx};
+    if (e && !error)
+      error = e;
+    if (--helpers_left == 0)
+      done_cv.notify_one();
+  }
+}
+
+// Run jobs thread, thread + stride, ... of a batch.
+inline std::exception_ptr
+ThreadPool::work_on_(unsigned thread, unsigned stride, unsigned num_jobs,
+                     void (*call)(void *, unsigned), void *job) {
+  std::exception_ptr e;
+  for (unsigned i = thread; i < num_jobs; i += stride) {
+    try {
+      call(job, i);
+    } catch (...) {
+      if (!e)
+        e = std::current_exception();
+    }
+  }
+  return e;
+}
+
+inline void ThreadPool::run_(unsigned num_jobs,
+                             void (*call)(void *, unsigned), void *job) {
+  // Helpers finish with the slot before run_ returns, so the next batch
+  // can reuse it.
+  std::lock_guard<std::mutex> serial{run_mtx};
+  unsigned participants = std::min(size(), num_jobs);
+  {
+    std::lock_guard<std::mutex> lock{mtx};
+    this->call = call;
+    this->job = job;
+    this->num_jobs = num_jobs;
+    num_participants = participants;
+    helpers_left = participants - 1;
+    error = nullptr;
+    generation++;
+  }
+  cv.notify_all();
+
+  bool &in_region = internal::in_parallel_region_();
+  in_region = true;
+  std::exception_ptr e = work_on_(0, participants, num_jobs, call, job);
+  in_region = false;
+
+  std::unique_lock<std::mutex> lock{mtx};
+  done_cv.wait(lock, [this] { return helpers_left == 0; });
+  if (!e)
+    e = error;
+  error = nullptr;
+  lock.unlock();
+  if (e)
+    std::rethrow_exception(e);
+}
+
+/**
+ *  Job i runs on thread i mod p of the pool, where p = min(size(), num_jobs)
+ *  and the caller is thread 0. The schedule is static, so every batch of p
+ *  or more jobs reaches every thread, and per-thread work space such as
+ *  GEMM's packing buffers has grown to fit after the first one. Two
+ *  batches split alike run each job on the same thread, which keeps the
+ *  memory a job touched first on that thread's NUMA node. The job is
+ *  called through a pointer, not copied, so a batch allocates nothing.
+ */
+
+template <typename F> void ThreadPool::run(unsigned num_jobs, F &&job) {
+  if (num_jobs == 0)
+    return;
+
+  if (internal::in_parallel_region_() || workers.empty() || num_jobs == 1) {
+    for (unsigned i = 0; i < num_jobs; i++)
+      job(i);
+    return;
+  }
+
+  typedef std::remove_reference_t<F> job_t;
+  run_(
+      num_jobs,
+      [](void *f, unsigned i) { (*static_cast<job_t *>(f))(i); },
+      const_cast<void *>(static_cast<const void *>(std::addressof(job))));
+}
+
+/* ---- Library-wide pool. ---- */
+
+inline ThreadPool &thread_pool() {
+  static ThreadPool pool;
+  return pool;
+}
+
+inline void set_num_threads(unsigned num_threads) {
+  thread_pool().resize(num_threads);
+}
+
+inline unsigned num_threads() { return thread_pool().size(); }
+
+namespace internal {
+
+// parallel_reduce splits a range into at most this many chunks, however
+// many threads the pool has.
+constexpr unsigned reduce_chunks_ = 64;
+
+// Number of chunks parallel_for splits n items into.
+inline unsigned num_chunks_(std::size_t n, std::size_t grain) {
+  if (n <= grain || in_parallel_region_())
+    return 1;
+  std::size_t max_chunks = (n + grain - 1) / grain;
+  return static_cast<unsigned>(
+      std::min<std::size_t>(max_chunks, thread_pool().size()));
+}
+
+} // namespace internal
+
+/**
+ *  Split [begin, end) into at most one contiguous chunk per thread, each at
+ *  least `grain` long, and call f(lo, hi) on every chunk. Chunk c runs on
+ *  thread c of the pool, so loops that split the same range alike visit
+ *  each part of it from the same thread. Ranges no longer than `grain` run
+ *  directly on the calling thread.
+ */
+
+template <typename F>
+void parallel_for(std::size_t begin, std::size_t end, std::size_t grain,
+                  F &&f) {
+  if (end <= begin)
+    return;
+
+  std::size_t n = end - begin;
+  unsigned num_chunks =
+      internal::num_chunks_(n, std::max<std::size_t>(grain, 1));
+  if (num_chunks <= 1) {
+    f(begin, end);
+    return;
+  }
+
+  std::size_t chunk = n / num_chunks, extra = n % num_chunks;
+  thread_pool().run(num_chunks, [&](unsigned c) {
+    std::size_t lo = begin + c * chunk + std::min<std::size_t>(c, extra);
+    std::size_t hi = lo + chunk + (c < extra ? 1 : 0);
+    f(lo, hi);
+  });
+}
+
+/**
+ *  Split [begin, end) into chunks at least `grain` long, and have f(lo, hi)
+ *  return a partial result for each chunk. The partial results are folded
+ *  into `init` with combine(acc, partial) in chunk order. How the range is
+ *  chunked depends only on its length and `grain`, never on the number of
+ *  threads, so the result is the same bit for bit on any pool size, and
+ *  inside a parallel region. Each thread takes a contiguous run of chunks,
+ *  covering about the part of the range parallel_for would give it.
+ */
+
+template <typename R, typename F, typename Combine>
+R parallel_reduce(std::size_t begin, std::size_t end, std::size_t grain,
+                  R init, F &&f, Combine &&combine) {
+  if (end <= begin)
+    return init;
+
+  std::size_t n = end - begin;
+  std::size_t g = std::max<std::size_t>(grain, 1);
+  unsigned num_chunks = static_cast<unsigned>(
+      std::min<std::size_t>((n + g - 1) / g, internal::reduce_chunks_));
+  if (num_chunks <= 1)
+    return combine(init, f(begin, end));
+
+  // Partial results live on the stack, so a reduction allocates nothing of
+  // its own.
+  std::optional<R> partial[internal::reduce_chunks_];
+  std::size_t chunk = n / num_chunks, extra = n % num_chunks;
+  unsigned num_jobs = internal::in_parallel_region_()
+                          ? 1
+                          : std::min(thread_pool().size(), num_chunks);
+  thread_pool().run(num_jobs, [&](unsigned t) {
+    for (unsigned c = t * num_chunks / num_jobs;
+         c < (t + 1) * num_chunks / num_jobs; c++) {
+      std::size_t lo = begin + c * chunk + std::min<std::size_t>(c, extra);
+      std::size_t hi = lo + chunk + (c < extra ? 1 : 0);
+      partial[c] = f(lo, hi);
+    }
+  });
+
+  for (unsigned c = 0; c < num_chunks; c++)
+    init = combine(init, *partial[c]);
+  return init;
+}
+
+} // namespace matrix
+
+#endif
@@ -1,5 +1,10 @@
+#include <cstddef>
+
+#include "expressions.hpp"
 #include "matrix.hpp"
+#include "thread_pool.hpp"
 #include "vector.hpp"
+#include "view.hpp"
 
 #ifndef UTILS_H
 #define UTILS_H
@@ -8,11 +13,14 @@ namespace matrix {
 
 /* ---- Norms ---- */
 
-template <typename T> double infNorm(const Matrix<T> &m) {
+// Also accepts an unevaluated expression, which is then reduced in a single
+// pass without forming a temporary matrix.
+template <typename E> double infNorm(const MatrixExpr<E> &expr) {
+  const E &m = expr.self();
   double norm = 0.0;
-  for (unsigned i = 0; i < m.rows; i++) {
+  for (std::size_t i = 0; i < m.rows; i++) {
     double row_sum = 0;
-    for (unsigned j = 0; j < m.cols; j++) {
+    for (std::size_t j = 0; j < m.cols; j++) {
       double d_val = static_cast<double>(m(i, j));
       row_sum += std::abs(d_val);
     }
@@ -22,6 +30,81 @@ template <typename T> double infNorm(const Matrix<T> &m) {
   return norm;
 }
 
+/* ---- Elementwise map, zip and reduce. ---- */
+
+/**
+ *  These take any callable: a lambda, a function object or a function
+ *  pointer. The callable's type is part of the expression type, so a lambda
+ *  is inlined into the evaluation loop, which the compiler then vectorizes
+ *  for float and double. Large matrices are split over the thread pool.
+ *
+ *  map() and zip() are lazy, like the arithmetic operators. map_into() and
+ *  map_in_place() write into existing storage (a matrix or a view) without
+ *  allocating. All take the callable first and any destination last.
+ */
+
+// f(m(i, j)) for every entry.
+template <typename F, typename E>
+MapExpr<E, F> map(F f, const MatrixExpr<E> &m) {
+  return MapExpr<E, F>{m.self(), f};
+}
+
+// f(a(i, j), b(i, j)) for every entry.
+template <typename F, typename L, typename R>
+ZipExpr<L, R, F> zip(F f, const MatrixExpr<L> &a, const MatrixExpr<R> &b) {
+  return ZipExpr<L, R, F>{a.self(), b.self(), f};
+}
+
+template <typename F, typename E, typename T>
+void map_into(F f, const MatrixExpr<E> &src, MatrixView<T> dst) {
+  dst = map(f, src);
+}
+
+template <typename F, typename E, typename T, typename Alloc>
+void map_into(F f, const MatrixExpr<E> &src, Matrix<T, Alloc> &dst) {
+  map_into(f, src, dst.view());
+}
+
+template <typename T, typename F> void map_in_place(F f, MatrixView<T> m) {
+  m = map(f, ConstMatrixView<T>{m});
+}
+
+template <typename T, typename Alloc, typename F>
+void map_in_place(F f, Matrix<T, Alloc> &m) {
+  map_in_place(f, m.view());
+}
+
+/**
+ *  Fold all entries with op, which must be associative: contiguous ranges
+ *  of rows are folded in parallel, and the partial results are then folded
+ *  into init in order. The ranges don't depend on the number of threads,
+ *  so neither does the result.
+ */
+
+template <typename E, typename Op>
+typename E::value_type reduce(const MatrixExpr<E> &expr,
+                              typename E::value_type init, Op op) {
+  typedef typename E::value_type T;
+  const E &e = expr.self();
+  std::size_t cols = e.cols;
+  if (cols == 0)
+    return init;
+
+  std::size_t grain = internal::parallel_grain_ / cols + 1;
+  return parallel_reduce(
+      0, e.rows, grain, init,
+      [&](std::size_t lo, std::size_t hi) {
+        T acc = e(lo, 0);
+        for (std::size_t j = 1; j < cols; j++)
+          acc = op(acc, e(lo, j));
+        for (std::size_t i = lo + 1; i < hi; i++)
+          for (std::size_t j = 0; j < cols; j++)
+            acc = op(acc, e(i, j));
+        return acc;
+      },
+      op);
+}
+
 /* ---- Utility classes. ---- */
 
 namespace internal {
@@ -30,27 +113,26 @@ template <typename T> using f_ptr_t = T (*)(const T &);
 
 }
 
-template <typename T> class MatrixFunctor {
-  internal::f_ptr_t<T> func;
+// Applies f to every entry. F defaults to a plain function pointer; give a
+// lambda or function object type to have it inlined, or use map().
+template <typename T, typename F = internal::f_ptr_t<T>> class MatrixFunctor {
+  F func;
 
 public:
-  MatrixFunctor(internal::f_ptr_t<T> func) : func{func} {};
-
-  Matrix<T> operator()(const Matrix<T> &m) {
-    Matrix<T> result{m.rows, m.cols};
-    for (unsigned i = 0; i < m.rows; i++)
-      for (unsigned j = 0; j < m.cols; j++)
-        result(i, j) = func(m(i, j));
+  MatrixFunctor(F func) : func{func} {};
 
-    return result;
+  // Lazy: the result is evaluated when assigned; see expressions.hpp.
+  template <typename E>
+  MapExpr<E, F> operator()(const MatrixExpr<E> &m) const {
+    return MapExpr<E, F>{m.self(), func};
   }
 };
 
 /* ---- Special Matrix constructors. ---- */
 
-template <typename T> Matrix<T> ident(const unsigned int &n) {
+template <typename T> Matrix<T> ident(std::size_t n) {
   Matrix<T> I{n, n};
-  for (unsigned i = 0; i < n; i++) {
+  for (std::size_t i = 0; i < n; i++) {
     I(i, i) = 1;
   }
   return I;
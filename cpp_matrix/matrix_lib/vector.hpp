@@ -1,69 +1,100 @@
+#include <cassert>
+#include <utility>
+
+#include "allocator.hpp"
 #include "matrix.hpp"
 
 namespace matrix {
 
-/* ---- Forward declaration. ---- */
-
-template <typename T> class Vector;
-
-template <typename T> Vector<T> operator*(const T &, const Vector<T> &);
-
 #ifndef VECTOR_IMPL
 #define VECTOR_IMPL
 
 /* ---- Vector declaration. ---- */
 
-template <typename T> class Vector : public Matrix<T> {
+template <typename T, typename Alloc>
+class Vector : public Matrix<T, Alloc> {
+  typedef Matrix<T, Alloc> Base;
+
 public:
-  Vector(const unsigned &);
-  Vector(const Matrix<T> &);
-  Vector(const Vector<T> &);
-  Vector(Matrix<T> &&);
-  Vector(Vector<T> &&);
+  Vector(std::size_t);
+  Vector(std::size_t, Uninitialized);
+  Vector(const Base &);
+  Vector(const Vector &);
+  // Take over the storage of a single-column matrix or vector.
+  Vector(Base &&) noexcept;
+  Vector(Vector &&) noexcept;
 
   Vector(std::initializer_list<T>);
 
-  T &operator[](const unsigned &i);
-  T operator[](const unsigned &i) const;
+  // Evaluate a single-column elementwise expression.
+  template <typename E> Vector(const MatrixExpr<E> &);
+
+  // Same as for Matrix: lengths must match, and nothing is allocated.
+  Vector &operator=(const Vector &other) {
+    Base::operator=(other);
+    return *this;
+  }
+  Vector &operator=(Vector &&other) {
+    Base::operator=(std::move(other));
+    return *this;
+  }
+  using Base::operator=;
 
-  template <typename _>
-  friend Vector<T> operator*(const T &a, const Vector<T> &m);
+  T &operator[](std::size_t i);
+  T operator[](std::size_t i) const;
 };
 
 /* ---- Vector implementation. ---- */
 
 // Operators.
 
-template <typename T> T &Vector<T>::operator[](const unsigned &i) {
+template <typename T, typename Alloc>
+T &Vector<T, Alloc>::operator[](std::size_t i) {
   return (*this)(i, 0);
 }
 
-template <typename T> T Vector<T>::operator[](const unsigned &i) const {
+template <typename T, typename Alloc>
+T Vector<T, Alloc>::operator[](std::size_t i) const {
   return (*this)(i, 0);
 }
 
 // Constructors. (Base desctructor is used.)
 
-template <typename T>
-Vector<T>::Vector(std::initializer_list<T> init) : Matrix<T>(init.size(), 1) {
-  unsigned cols = init.size();
-  for (unsigned i = 0; i < cols; i++) {
+template <typename T, typename Alloc>
+Vector<T, Alloc>::Vector(std::initializer_list<T> init)
+    : Base(init.size(), 1, uninitialized) {
+  std::size_t cols = init.size();
+  for (std::size_t i = 0; i < cols; i++) {
     this->data[i] = (init.begin())[i];
   }
 };
 
-template <typename T>
-Vector<T>::Vector(const unsigned &rows) : Matrix<T>(rows, 1){};
+template <typename T, typename Alloc>
+Vector<T, Alloc>::Vector(std::size_t rows) : Base(rows, 1){};
+
+template <typename T, typename Alloc>
+Vector<T, Alloc>::Vector(std::size_t rows, Uninitialized)
+    : Base(rows, 1, uninitialized){};
 
-template <typename T>
-Vector<T>::Vector(const Matrix<T> &mat) : Matrix<T>(mat){};
+template <typename T, typename Alloc>
+Vector<T, Alloc>::Vector(const Base &mat) : Base(mat){};
 
-template <typename T>
-Vector<T>::Vector(const Vector<T> &other) : Matrix<T>(other){};
+template <typename T, typename Alloc>
+Vector<T, Alloc>::Vector(const Vector &other) : Base(other){};
 
-template <typename T> Vector<T>::Vector(Matrix<T> &&other) : Matrix<T>(other){};
+template <typename T, typename Alloc>
+template <typename E>
+Vector<T, Alloc>::Vector(const MatrixExpr<E> &expr) : Base(expr) {
+  assert(this->cols == 1);
+};
+
+template <typename T, typename Alloc>
+Vector<T, Alloc>::Vector(Base &&other) noexcept : Base(std::move(other)) {
+  assert(this->cols == 1);
+};
 
-template <typename T> Vector<T>::Vector(Vector<T> &&other) : Matrix<T>(other){};
+template <typename T, typename Alloc>
+Vector<T, Alloc>::Vector(Vector &&other) noexcept : Base(std::move(other)){};
 
 #endif
 
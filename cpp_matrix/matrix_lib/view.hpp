@@ -0,0 +1,151 @@
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+
+#include "allocator.hpp"
+#include "expressions.hpp"
+
+#ifndef VIEW_H
+#define VIEW_H
+
+namespace matrix {
+
+/**
+ *  Non-owning, strided views of matrix storage.
+ *
+ *  A view is a pointer to its (0, 0) entry plus a row stride and a column
+ *  stride, so a block, a single row or column, and the transpose of a
+ *  matrix (strides swapped) are all views of the same buffer, made in O(1)
+ *  without copying. Views are expressions, so they work with the elementwise
+ *  operators, the products, the factorizations and the solvers.
+ *
+ *  MatrixView allows writing through to the viewed entries; assigning to a
+ *  MatrixView writes into the viewed matrix, it doesn't rebind the view.
+ *  ConstMatrixView is read-only. A view must not outlive its matrix.
+ *
+ *  Expressions are evaluated entry by entry, so an expression assigned to a
+ *  view may only read the destination's entries at the same position: e.g.
+ *  `A.block(0, 0, 2, 2) = A.block(0, 0, 2, 2) + B` is fine, but
+ *  `A = A.transpose()` is not.
+ */
+
+template <typename T> class MatrixView;
+
+template <typename T>
+class ConstMatrixView : public MatrixExpr<ConstMatrixView<T>> {
+  const T *data;
+  std::ptrdiff_t rs;
+  std::ptrdiff_t cs;
+
+public:
+  typedef T value_type;
+
+  const std::size_t rows;
+  const std::size_t cols;
+
+  ConstMatrixView(const T *data, std::size_t rows, std::size_t cols,
+                  std::ptrdiff_t row_stride, std::ptrdiff_t col_stride = 1)
+      : data{data}, rs{row_stride}, cs{col_stride}, rows{rows}, cols{cols} {}
+
+  template <typename A>
+  ConstMatrixView(const Matrix<T, A> &m)
+      : ConstMatrixView(m.ptr(), m.rows, m.cols, m.cols) {}
+
+  ConstMatrixView(const MatrixView<T> &v)
+      : ConstMatrixView(v.ptr(), v.rows, v.cols, v.row_stride(),
+                        v.col_stride()) {}
+
+  T operator()(std::size_t row, std::size_t col) const {
+    return data[row * rs + col * cs];
+  }
+
+  const T *ptr() const { return data; }
+  std::ptrdiff_t row_stride() const { return rs; }
+  std::ptrdiff_t col_stride() const { return cs; }
+
+  ConstMatrixView<T> block(std::size_t row, std::size_t col,
+                           std::size_t num_rows, std::size_t num_cols) const {
+    assert(row + num_rows <= rows && col + num_cols <= cols);
+    return {data + row * rs + col * cs, num_rows, num_cols, rs, cs};
+  }
+  ConstMatrixView<T> row(std::size_t i) const { return block(i, 0, 1, cols); }
+  ConstMatrixView<T> col(std::size_t j) const { return block(0, j, rows, 1); }
+  ConstMatrixView<T> transpose() const { return {data, cols, rows, cs, rs}; }
+};
+
+template <typename T> class MatrixView : public MatrixExpr<MatrixView<T>> {
+  T *data;
+  std::ptrdiff_t rs;
+  std::ptrdiff_t cs;
+
+public:
+  typedef T value_type;
+
+  const std::size_t rows;
+  const std::size_t cols;
+
+  MatrixView(T *data, std::size_t rows, std::size_t cols,
+             std::ptrdiff_t row_stride, std::ptrdiff_t col_stride = 1)
+      : data{data}, rs{row_stride}, cs{col_stride}, rows{rows}, cols{cols} {}
+
+  template <typename A>
+  MatrixView(Matrix<T, A> &m) : MatrixView(m.ptr(), m.rows, m.cols, m.cols) {}
+
+  MatrixView(const MatrixView<T> &) = default;
+
+  // Copy the entries of another view or expression into the viewed entries.
+  // As for Matrix, expr may read the entry it is assigned to, but no other
+  // entry under this view: `v = v.transpose()` is wrong.
+  MatrixView<T> &operator=(const MatrixView<T> &other) {
+    return *this = static_cast<const MatrixExpr<MatrixView<T>> &>(other);
+  }
+  template <typename E> MatrixView<T> &operator=(const MatrixExpr<E> &expr) {
+    const E &e = expr.self();
+    if (e.rows != rows || e.cols != cols)
+      throw std::domain_error("Dimensions of assigned matrix must match "
+                              "dimensions of destination matrix.");
+    internal::evaluate_(data, rs, cs, e);
+    return *this;
+  }
+
+  // Update the viewed entries in place.
+  template <typename E>
+  MatrixView<T> &operator+=(const MatrixExpr<E> &expr) {
+    return *this = BinaryExpr<MatrixView<T>, E, internal::add_op_>{
+               *this, expr.self()};
+  }
+  template <typename E>
+  MatrixView<T> &operator-=(const MatrixExpr<E> &expr) {
+    return *this = BinaryExpr<MatrixView<T>, E, internal::sub_op_>{
+               *this, expr.self()};
+  }
+  MatrixView<T> &operator*=(const T &a) {
+    return *this = ScaledExpr<MatrixView<T>>{a, *this};
+  }
+
+  T &operator()(std::size_t row, std::size_t col) const {
+    return data[row * rs + col * cs];
+  }
+
+  T *ptr() const { return data; }
+  std::ptrdiff_t row_stride() const { return rs; }
+  std::ptrdiff_t col_stride() const { return cs; }
+  // Whether each row is contiguous and rows don't overlap, as the dense
+  // kernels need.
+  bool unit_rows() const {
+    return cs == 1 && rs >= static_cast<std::ptrdiff_t>(cols);
+  }
+
+  MatrixView<T> block(std::size_t row, std::size_t col,
+                      std::size_t num_rows, std::size_t num_cols) const {
+    assert(row + num_rows <= rows && col + num_cols <= cols);
+    return {data + row * rs + col * cs, num_rows, num_cols, rs, cs};
+  }
+  MatrixView<T> row(std::size_t i) const { return block(i, 0, 1, cols); }
+  MatrixView<T> col(std::size_t j) const { return block(0, j, rows, 1); }
+  MatrixView<T> transpose() const { return {data, cols, rows, cs, rs}; }
+};
+
+} // namespace matrix
+
+#endif
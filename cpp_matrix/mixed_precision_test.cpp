@@ -0,0 +1,59 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <iostream>
+
+/**
+ *  Mixed-precision solves: LU in float, refined to double accuracy. A
+ *  well-conditioned system converges in a few steps; the Hilbert matrix is
+ *  too ill-conditioned for float, so refinement stalls and the solver falls
+ *  back to LU in double.
+ */
+
+void report(const matrix::Matrix<double> &A, const matrix::Matrix<double> &b,
+            const matrix::RefinementResult<double> &result) {
+  matrix::Matrix<double> x = matrix::solve_partial_pivot(A, b);
+  std::cout << "  refinement steps: " << result.iterations << std::endl
+            << "  fell back to double: " << (result.fell_back ? "yes" : "no")
+            << std::endl
+            << "  relative difference from double LU: "
+            << test::below(matrix::infNorm(result.x - x) / matrix::infNorm(x))
+            << std::endl;
+}
+
+int main() {
+  // Diagonally dominant, so well conditioned.
+  unsigned n = 300;
+  matrix::Matrix<double> A{n, n};
+  matrix::Matrix<double> b{n, 2};
+  for (unsigned i = 0; i < n; i++) {
+    for (unsigned j = 0; j < n; j++)
+      A(i, j) = 1.0 / (1 + (i * 7 + j * 3) % 11) / n;
+    A(i, i) += 1;
+    b(i, 0) = 1;
+    b(i, 1) = i % 2 ? -1.0 : 1.0;
+  }
+
+  std::cout << "Diagonally dominant, n = " << n << ":" << std::endl;
+  matrix::MixedPrecisionLU<double> lu{A};
+  matrix::RefinementResult<double> refined = lu.solve(b);
+  report(A, b, refined);
+  test::expect(!refined.fell_back);
+
+  // The Hilbert matrix, with a condition number near 1e13.
+  unsigned m = 10;
+  matrix::Matrix<double> H{m, m};
+  matrix::Matrix<double> c{m, 1};
+  for (unsigned i = 0; i < m; i++) {
+    for (unsigned j = 0; j < m; j++)
+      H(i, j) = 1.0 / (i + j + 1);
+    c(i, 0) = 1;
+  }
+
+  std::cout << "Hilbert, n = " << m << ":" << std::endl;
+  matrix::RefinementResult<double> result = matrix::solve_mixed_precision(H, c);
+  std::cout << "  refinement steps: " << result.iterations << std::endl
+            << "  fell back to double: " << (result.fell_back ? "yes" : "no")
+            << std::endl;
+  test::expect(result.fell_back);
+  return test::exit_status();
+}
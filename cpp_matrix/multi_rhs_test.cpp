@@ -0,0 +1,104 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <cmath>
+#include <iostream>
+
+/**
+ *  Many right-hand sides at once through the blocked triangular solves
+ *  (TRSM) of solvers.hpp. A is larger than a TRSM row block, and b has
+ *  one column (the dot-product path), two (a single chunk that already
+ *  uses GEMM off the diagonal blocks) and more than a column chunk (split
+ *  over threads). b is a plain matrix, a block of a wider matrix (row
+ *  stride larger than its width) and a transpose (solved in a copy). Every
+ *  solution is compared with one-column solves and checked by its
+ *  residual, for LU, solve_partial_pivot and dense and packed Cholesky.
+ */
+
+using matrix::Matrix;
+using matrix::Vector;
+
+// Relative residual of A X = B.
+double residual(const Matrix<double> &A, const Matrix<double> &X,
+                const Matrix<double> &B) {
+  return matrix::infNorm(A * X - B) /
+         (matrix::infNorm(A) * matrix::infNorm(X) + matrix::infNorm(B));
+}
+
+// Solve B with `solve_in_place`, held in three layouts, and compare with
+// its columns solved one at a time by `solve_column`.
+template <typename SolveInPlace, typename SolveColumn>
+void check(const char *name, const Matrix<double> &A, const Matrix<double> &B,
+           SolveInPlace solve_in_place, SolveColumn solve_column) {
+  std::size_t n = B.rows, k = B.cols;
+  Matrix<double> columns{n, k};
+  for (std::size_t j = 0; j < k; j++) {
+    Vector<double> x = solve_column(Vector<double>{B.col(j)});
+    columns.col(j) = x;
+  }
+
+  // A plain matrix, a block of a wider one, and a transpose.
+  Matrix<double> plain{B};
+  solve_in_place(plain.view());
+  Matrix<double> wide{n + 2, k + 13};
+  wide.block(1, 5, n, k) = B;
+  solve_in_place(wide.block(1, 5, n, k));
+  Matrix<double> bt{k, n};
+  bt.transpose() = B;
+  solve_in_place(bt.transpose());
+
+  std::cout << "  " << name << ", k = " << k << ": residual "
+            << test::below(residual(A, plain, B))
+            << ", difference from one-column solves "
+            << test::close(plain, columns) << ", block "
+            << test::close(Matrix<double>{wide.block(1, 5, n, k)}, plain)
+            << ", transpose "
+            << test::close(Matrix<double>{bt.transpose()}, plain) << std::endl;
+}
+
+int main() {
+  matrix::set_num_threads(4);
+  std::size_t n = 300;
+  Matrix<double> A{n, n}, S{n, n};
+  for (std::size_t i = 0; i < n; i++)
+    for (std::size_t j = 0; j < n; j++) {
+      A(i, j) = std::sin(0.37 * i * j + i + 2.0 * j);
+      S(i, j) = 1.0 / (1 + (i > j ? i - j : j - i));
+    }
+  for (std::size_t i = 0; i < n; i++) {
+    A(i, (7 * i + 3) % n) += 10;
+    S(i, i) += 2;
+  }
+
+  matrix::LUFactorization<double> lu{A};
+  matrix::CholeskyFactorization<double> chol{S},
+      packed{matrix::SymmetricMatrix<double>{S}};
+  std::cout << "n = " << n << ", " << matrix::num_threads() << " threads:"
+            << std::endl;
+  for (std::size_t k : {1, 2, 100}) {
+    Matrix<double> B{n, k};
+    for (std::size_t i = 0; i < n; i++)
+      for (std::size_t j = 0; j < k; j++)
+        B(i, j) = std::cos(0.1 * i * (j + 1));
+
+    check(
+        "LU", A, B, [&](matrix::MatrixView<double> b) { lu.solve_in_place(b); },
+        [&](const Vector<double> &b) { return lu.solve(b); });
+    check(
+        "solve_partial_pivot", A, B,
+        [&](matrix::MatrixView<double> b) {
+          b = matrix::solve_partial_pivot(A, Matrix<double>{b});
+        },
+        [&](const Vector<double> &b) {
+          return Vector<double>{matrix::solve_partial_pivot(A, b)};
+        });
+    check(
+        "Cholesky", S, B,
+        [&](matrix::MatrixView<double> b) { chol.solve_in_place(b); },
+        [&](const Vector<double> &b) { return chol.solve(b); });
+    check(
+        "packed Cholesky", S, B,
+        [&](matrix::MatrixView<double> b) { packed.solve_in_place(b); },
+        [&](const Vector<double> &b) { return packed.solve(b); });
+  }
+  return test::exit_status();
+}
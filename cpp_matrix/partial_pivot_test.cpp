@@ -1,4 +1,5 @@
 #include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
 #include <iostream>
 
 /**
@@ -62,6 +63,35 @@ int main() {
             << std::string(Ax) << std::endl
             << std::endl;
 
+  // Reuse one factorization for several right-hand sides.
+
+  matrix::LUFactorization<double> lu{A};
+
+  matrix::Vector<double> c{1, 2, 3};
+  matrix::Vector<double> y = lu.solve(c);
+  std::cout << "Reusing the factorization, solution y to Ay = (1, 2, 3) is:"
+            << std::endl
+            << std::string(y) << std::endl;
+  std::cout << "Residual of Ay - (1, 2, 3): "
+            << test::below(matrix::infNorm(A * y - c)) << std::endl
+            << std::endl;
+
+  // A negative diagonal entry must still win the pivot search against a
+  // tiny entry below it, or the multipliers blow up.
+
+  // clang-format off
+  Matrix<double> N{
+    {-1,    1, 0   },
+    {1e-17, 1, 1   },
+    {0,     1, 1e-3}
+  };
+  // clang-format on
+  matrix::Vector<double> d{1, 2, 3};
+  matrix::Vector<double> z = matrix::solve_partial_pivot(N, d);
+  std::cout << "With a negative diagonal entry, ||Nz - d|| is "
+            << test::below(matrix::infNorm(N * z - d)) << std::endl
+            << std::endl;
+
   // Compute matrix rank.
 
   std::cout << "------" << std::endl << std::endl;
@@ -79,4 +109,6 @@ int main() {
             << std::endl;
 
   std::cout << "Rank of A is: " << matrix::rank(A) << std::endl << std::endl;
+
+  return test::exit_status();
 }
@@ -0,0 +1,138 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <cmath>
+#include <cstdio>
+
+/**
+ *  Red-black SOR and multigrid on Laplacian(u) = f over the unit square,
+ *  with the exact solution u = sin(pi x) sin(pi y). The discretization
+ *  error should fall by about 4 each time h is halved, while the number of
+ *  multigrid cycles stays the same. As a preconditioner, multigrid should
+ *  cut CG's iterations more than tenfold.
+ */
+
+const double pi = std::acos(-1.0);
+
+void setup(unsigned M, matrix::Matrix<double> &f,
+           matrix::Matrix<double> &exact) {
+  double h = 1.0 / (M - 1);
+  for (unsigned i = 0; i < M; i++)
+    for (unsigned j = 0; j < M; j++) {
+      exact(i, j) = std::sin(pi * i * h) * std::sin(pi * j * h);
+      f(i, j) = -2 * pi * pi * exact(i, j);
+    }
+}
+
+double max_error(const matrix::Matrix<double> &u,
+                 const matrix::Matrix<double> &exact) {
+  return matrix::reduce(
+      matrix::zip([](double x, double y) { return std::abs(x - y); }, u,
+                  exact),
+      0.0, [](double x, double y) { return std::max(x, y); });
+}
+
+int main() {
+  std::printf("Red-black SOR:\n");
+  double prev_error = 0;
+  for (unsigned M : {17u, 33u, 65u}) {
+    double h = 1.0 / (M - 1);
+    matrix::Matrix<double> u{M, M}, f{M, M}, exact{M, M};
+    setup(M, f, exact);
+
+    matrix::SOROptions opts;
+    opts.tol = 1e-9;
+    opts.check_every = 5;
+    matrix::SORResult r = matrix::sor_poisson(u, f, h, opts);
+
+    double error = max_error(u, exact);
+    std::printf("M = %3u: %s after %3u sweeps, max error %.2e", M,
+                r.converged ? "converged" : "stopped", r.sweeps, error);
+    test::expect(r.converged);
+    // h is halved from one grid to the next.
+    if (prev_error > 0) {
+      double ratio = prev_error / error;
+      std::printf(", %.2f times smaller", ratio);
+      test::expect(3.5 < ratio && ratio < 4.5);
+    }
+    std::printf("\n");
+    prev_error = error;
+  }
+
+  for (matrix::Cycle cycle : {matrix::Cycle::V, matrix::Cycle::F}) {
+    std::printf("\nMultigrid %s-cycles:\n", cycle == matrix::Cycle::V ? "V"
+                                                                      : "F");
+    unsigned first_cycles = 0;
+    for (unsigned M : {33u, 129u, 513u}) {
+      double h = 1.0 / (M - 1);
+      matrix::Matrix<double> u{M, M}, f{M, M}, exact{M, M};
+      setup(M, f, exact);
+
+      // Relative to ||f||; the residual can't get much below
+      // eps ||u|| / h^2 on fine grids.
+      matrix::MultigridOptions opts;
+      opts.cycle = cycle;
+      opts.tol = 1e-10 * matrix::poisson_residual(u, f, h);
+      matrix::PoissonMultigrid<double> mg{M, M, h, opts};
+      matrix::MultigridResult r = mg.solve(u, f);
+      std::printf("M = %3u, %u levels: %s after %u cycles, max error %.2e\n",
+                  M, mg.num_levels(), r.converged ? "converged" : "stopped",
+                  r.cycles, max_error(u, exact));
+      test::expect(r.converged);
+      // The grids grow 16-fold, but the cycles needed should not.
+      if (first_cycles == 0)
+        first_cycles = r.cycles;
+      test::expect(r.cycles <= first_cycles + 2);
+    }
+  }
+
+  // 99 intervals can't be halved, so this grid has a single level, which
+  // each cycle solves by SOR.
+  {
+    unsigned M = 100;
+    double h = 1.0 / (M - 1);
+    matrix::Matrix<double> u{M, M}, f{M, M}, exact{M, M};
+    setup(M, f, exact);
+    matrix::MultigridOptions opts;
+    opts.tol = 1e-10 * matrix::poisson_residual(u, f, h);
+    matrix::PoissonMultigrid<double> mg{M, M, h, opts};
+    matrix::MultigridResult r = mg.solve(u, f);
+    std::printf("\nM = %3u, %u level: %s after %u cycles, max error %.2e\n",
+                M, mg.num_levels(), r.converged ? "converged" : "stopped",
+                r.cycles, max_error(u, exact));
+    test::expect(r.converged);
+  }
+
+  // As a preconditioner for CG on the (negated) 5-point matrix, applied
+  // matrix-free.
+  unsigned M = 129, m = M - 2;
+  auto A = [m](const matrix::Vector<double> &x, matrix::Vector<double> &y) {
+    for (unsigned i = 0; i < m; i++)
+      for (unsigned j = 0; j < m; j++) {
+        unsigned k = i * m + j;
+        double s = 4 * x[k];
+        if (i > 0)
+          s -= x[k - m];
+        if (i + 1 < m)
+          s -= x[k + m];
+        if (j > 0)
+          s -= x[k - 1];
+        if (j + 1 < m)
+          s -= x[k + 1];
+        y[k] = s;
+      }
+  };
+  matrix::Vector<double> b(m * m);
+  for (unsigned k = 0; k < b.rows; k++)
+    b[k] = 1;
+
+  matrix::IterativeOptions opts;
+  opts.tol = 1e-10;
+  matrix::PoissonMultigrid<double> mg{M, M, 1.0 / (M - 1)};
+  matrix::IterativeResult<double> plain = matrix::cg(A, b, opts);
+  matrix::IterativeResult<double> preconditioned = matrix::cg(A, b, mg, opts);
+  std::printf("\nCG on %zu unknowns: %u iterations, with multigrid: %u\n",
+              b.rows, plain.iterations, preconditioned.iterations);
+  test::expect(plain.converged && preconditioned.converged);
+  test::expect(10 * preconditioned.iterations < plain.iterations);
+  return test::exit_status();
+}
@@ -0,0 +1,125 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <cmath>
+#include <iostream>
+
+/**
+ *  Householder QR: a least squares line fit, the numerical rank of a matrix
+ *  with dependent columns, and the basic solution of a rank-deficient
+ *  system by QR with column pivoting. Then the same on matrices wider than
+ *  a block of reflectors, and taller than a block of rows.
+ */
+
+int main() {
+  // Fit y = c0 + c1 t to points that lie exactly on y = 1 + 2t, but one.
+  // clang-format off
+  matrix::Matrix<double> A{
+    {1, 0},
+    {1, 1},
+    {1, 2},
+    {1, 3},
+    {1, 4}
+  };
+  // clang-format on
+  matrix::Vector<double> y(5);
+  for (unsigned i = 0; i < 5; i++)
+    y[i] = 1 + 2 * i;
+  y[2] += 1;
+
+  matrix::Matrix<double> c = matrix::least_squares(A, y);
+  std::cout << "Least squares line through the points:" << std::endl
+            << std::string(c) << std::endl;
+  matrix::Matrix<double> normal = A.transpose() * (A * c - y);
+  std::cout << "Residual of the normal equations: "
+            << test::below(matrix::infNorm(normal)) << std::endl
+            << std::endl;
+
+  // Q^T y, whose last three entries hold the part of y off the line.
+  matrix::QRFactorization<double> qr{A};
+  matrix::Matrix<double> qty{y};
+  qr.apply_qt(qty);
+  std::cout << "R =" << std::endl << std::string(qr.R()) << std::endl;
+  double off = 0;
+  for (unsigned i = 2; i < 5; i++)
+    off += qty(i, 0) * qty(i, 0);
+  std::cout << "Squared residual from Q^T y: " << off << std::endl << std::endl;
+  matrix::Vector<double> fit = A * c - y;
+  for (unsigned i = 0; i < 5; i++)
+    off -= fit[i] * fit[i];
+  test::expect(std::abs(off) < 1e-12);
+
+  // The third column is the sum of the first two.
+  // clang-format off
+  matrix::Matrix<double> B{
+    {1, 0, 1},
+    {0, 1, 1},
+    {1, 1, 2},
+    {2, 1, 3}
+  };
+  // clang-format on
+  std::cout << "rank(B) = " << matrix::rank(B) << std::endl;
+  std::cout << "rank(B + 1e-8 in one entry) with the default tolerance = ";
+  test::expect(matrix::rank(B) == 2);
+  B(0, 0) += 1e-8;
+  std::cout << matrix::rank(B) << ", and with tolerance 1e-6 = "
+            << matrix::rank(B, 1e-6) << std::endl;
+  test::expect(matrix::rank(B) == 3 && matrix::rank(B, 1e-6) == 2);
+  B(0, 0) -= 1e-8;
+
+  matrix::QRFactorization<double> qrp{B, true};
+  std::cout << "Pivot order of B's columns:" << std::endl
+            << std::string(matrix::Matrix<unsigned>{qrp.permutation()
+                                                         .transpose()})
+            << std::endl;
+
+  // b is in the range of B, so the basic solution solves Bx = b exactly.
+  matrix::Vector<double> b{2, 3, 5, 7};
+  matrix::Vector<double> x = qrp.solve(b);
+  std::cout << "Basic solution of Bx = b:" << std::endl
+            << std::string(x) << std::endl;
+  std::cout << "Residual of Bx - b: " << test::below(matrix::infNorm(B * x - b))
+            << std::endl;
+
+  try {
+    matrix::QRFactorization<double>{B}.solve(b);
+    test::expect(false);
+  } catch (const std::domain_error &e) {
+    std::cout << "Unpivoted solve: " << e.what() << std::endl;
+  }
+  std::cout << std::endl;
+
+  // 100 columns span several blocks of 32 reflectors, and 5000 rows more
+  // than one block of rows of a tall panel. Columns 60 on are sums of two
+  // earlier ones, so the rank is 60.
+  for (std::size_t m : {300, 5000}) {
+    std::size_t n = 100, r = 60;
+    matrix::Matrix<double> C{m, n};
+    matrix::Vector<double> d(m);
+    for (std::size_t i = 0; i < m; i++) {
+      for (std::size_t j = 0; j < r; j++)
+        C(i, j) = static_cast<double>((i * 7 + j * 13) % 23) / 23 +
+                  (i == j ? 1 : 0);
+      for (std::size_t j = r; j < n; j++)
+        C(i, j) = C(i, j - r) + C(i, (j * 3) % r);
+      d[i] = static_cast<double>(i % 3);
+    }
+
+    matrix::Matrix<double> C1 = C.block(0, 0, m, r);
+    matrix::Matrix<double> z = matrix::least_squares(C1, d);
+    std::cout << m << " x " << r << " least squares, residual of the normal "
+              << "equations: "
+              << test::below(matrix::infNorm(C1.transpose() * (C1 * z - d)) /
+                       (matrix::infNorm(C1) * matrix::infNorm(d)))
+              << std::endl;
+
+    matrix::QRFactorization<double> qrc{C, true};
+    matrix::Vector<double> e = C * matrix::Vector<double>{qrc.solve(d)};
+    std::cout << m << " x " << n << " with pivoting, rank " << qrc.rank()
+              << ", normal equations: "
+              << test::below(matrix::infNorm(C.transpose() * (e - d)) /
+                       (matrix::infNorm(C) * matrix::infNorm(d)))
+              << std::endl;
+    test::expect(qrc.rank() == r);
+  }
+  return test::exit_status();
+}
@@ -0,0 +1,104 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+/**
+ *  The 5-point finite-difference Laplacian of diff_eq/poisson_eqn as a
+ *  sparse matrix, built from triplets.
+ */
+
+using matrix::SparseMatrix;
+
+// Interior points of an M x M mesh, numbered row by row.
+SparseMatrix<double> laplacian(unsigned M) {
+  unsigned m = M - 2;
+  matrix::SparseBuilder<double> builder{m * m, m * m};
+  builder.reserve(5 * m * m);
+
+  for (unsigned i = 0; i < m; i++)
+    for (unsigned j = 0; j < m; j++) {
+      unsigned r = i * m + j;
+      builder.add(r, r, -4);
+      if (j > 0)
+        builder.add(r, r - 1, 1);
+      if (j + 1 < m)
+        builder.add(r, r + 1, 1);
+      if (i > 0)
+        builder.add(r, r - m, 1);
+      if (i + 1 < m)
+        builder.add(r, r + m, 1);
+    }
+
+  return builder.build();
+}
+
+int main() {
+  SparseMatrix<double> A = laplacian(5);
+  std::cout << "Laplacian for M = 5, " << A.nnz() << " nonzeros:" << std::endl
+            << std::string(A.to_dense()) << std::endl
+            << "33 nonzeros, as expected: "
+            << (test::expect(A.nnz() == 33) ? "yes" : "no") << std::endl
+            << std::endl;
+
+  matrix::Vector<double> u{1, 2, 3, 4, 5, 6, 7, 8, 9};
+  matrix::Vector<double> Au = A * u;
+  std::cout << "A * u for u = (1, ..., 9): " << std::endl
+            << std::string(Au) << std::endl
+            << std::endl;
+  std::cout << "Difference from the dense product: "
+            << test::close(Au, A.to_dense() * u)
+            << std::endl
+            << std::endl;
+
+  SparseMatrix<double> B = laplacian(201);
+  std::size_t n = B.rows;
+  std::cout << "Laplacian for M = 201: " << n << " x " << n << ", "
+            << B.nnz() << " nonzeros, "
+            << B.nnz() * (sizeof(double) + sizeof(unsigned)) / 1024
+            << " KiB of entries instead of "
+            << n * n * sizeof(double) / (1024 * 1024) << " MiB dense."
+            << std::endl;
+  unsigned m = 199; // Interior points per side.
+  std::cout << "5 m^2 - 4m = " << 5 * m * m - 4 * m
+            << " nonzeros: "
+            << (test::expect(B.nnz() == 5 * m * m - 4 * m) ? "yes" : "no")
+            << std::endl;
+
+  // Large enough for a multithreaded product; compare with the stencil.
+  matrix::Vector<double> v(n);
+  for (std::size_t r = 0; r < n; r++)
+    v[r] = static_cast<double>(r % 7);
+  matrix::Vector<double> Bv = B * v;
+  double difference = 0;
+  for (unsigned i = 0; i < m; i++)
+    for (unsigned j = 0; j < m; j++) {
+      unsigned r = i * m + j;
+      double stencil = -4 * v[r] + (j > 0 ? v[r - 1] : 0) +
+                       (j + 1 < m ? v[r + 1] : 0) + (i > 0 ? v[r - m] : 0) +
+                       (i + 1 < m ? v[r + m] : 0);
+      difference = std::max(difference, std::abs(Bv[r] - stencil));
+    }
+  std::cout << "Difference of B * v from the 5-point stencil: "
+            << test::below(difference) << std::endl;
+
+  // Indices are unsigned, so a larger dimension is refused, not wrapped.
+  std::size_t too_big = std::size_t{std::numeric_limits<unsigned>::max()} + 1;
+  bool refused = true;
+  try {
+    matrix::SparseBuilder<double> builder{too_big, 1};
+    refused = false;
+  } catch (const std::domain_error &) {
+  }
+  try {
+    SparseMatrix<double> empty{1, too_big};
+    refused = false;
+  } catch (const std::domain_error &) {
+  }
+  std::cout << "Dimensions past the unsigned range are refused: "
+            << (test::expect(refused) ? "yes" : "no") << std::endl;
+  return test::exit_status();
+}
@@ -0,0 +1,123 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+/**
+ *  Symmetric solves: Cholesky on a positive definite matrix, and LDL^T
+ *  with Bunch-Kaufman pivoting on an indefinite one, whose zero diagonal
+ *  forces 2 x 2 pivots. Both are checked against the dense LU solver, on
+ *  small matrices and on ones larger than a Cholesky tile, and the factor
+ *  of a packed matrix, computed in packed storage, against a dense one.
+ */
+
+int main() {
+  // The 1D Laplacian, stored packed: only 10 of its 16 entries are kept.
+  unsigned n = 4;
+  matrix::SymmetricMatrix<double> S{n};
+  for (unsigned i = 0; i < n; i++) {
+    S(i, i) = 2;
+    if (i > 0)
+      S(i, i - 1) = -1;
+  }
+  std::cout << "S, with " << S.packed_size() << " stored entries = "
+            << std::endl
+            << std::string(matrix::Matrix<double>{S}) << std::endl
+            << std::endl;
+
+  matrix::Matrix<double> b{{1, 0}, {0, 0}, {0, 0}, {0, 1}};
+  matrix::CholeskyFactorization<double> chol{S};
+  std::cout << "Cholesky factor L =" << std::endl
+            << std::string(chol.L()) << std::endl
+            << std::endl;
+
+  matrix::Matrix<double> x = chol.solve(b);
+  std::cout << "Solution of Sx = b:" << std::endl
+            << std::string(x) << std::endl;
+  std::cout << "Difference from dense LU: "
+            << test::close(x, matrix::solve_partial_pivot(
+                                  matrix::Matrix<double>{S}, b))
+            << std::endl;
+  std::cout << "Residual of S x - b: " << test::close(S * x, b) << std::endl
+            << std::endl;
+
+  // Symmetric but indefinite, with a zero diagonal.
+  // clang-format off
+  matrix::Matrix<double> A{
+    {0, 1, 2, 3},
+    {1, 0, 1, 2},
+    {2, 1, 0, 1},
+    {3, 2, 1, 0}
+  };
+  // clang-format on
+  try {
+    matrix::CholeskyFactorization<double>{A};
+    std::cout << "Cholesky of A: accepted" << std::endl;
+    test::expect(false);
+  } catch (const std::domain_error &e) {
+    std::cout << "Cholesky of A: " << e.what() << std::endl;
+  }
+
+  matrix::Matrix<int> p = matrix::LDLTBunchKaufman(A).second;
+  std::cout << "Bunch-Kaufman pivots of A:" << std::endl
+            << std::string(matrix::Matrix<int>{p.transpose()}) << std::endl;
+
+  matrix::LDLTFactorization<double> ldlt{A};
+  matrix::Matrix<double> y = ldlt.solve(b);
+  std::cout << "Solution of Ay = b:" << std::endl
+            << std::string(y) << std::endl;
+  std::cout << "Difference from dense LU: "
+            << test::close(y, matrix::solve_partial_pivot(A, b)) << std::endl
+            << std::endl;
+
+  // Larger than a tile of the blocked Cholesky: a packed 2D Laplacian,
+  // and an indefinite matrix with a zero diagonal.
+  n = 300;
+  matrix::SymmetricMatrix<double> S2{n};
+  matrix::Matrix<double> A2{n, n}, b2{n, 2};
+  for (unsigned i = 0; i < n; i++) {
+    S2(i, i) = 4;
+    if (i % 20 > 0)
+      S2(i, i - 1) = -1;
+    if (i >= 20)
+      S2(i, i - 20) = -1;
+    for (unsigned j = 0; j < n; j++)
+      A2(i, j) = i == j ? 0 : static_cast<double>((i + j) % 7) - 3 +
+                                  1.0 / (1 + (i > j ? i - j : j - i));
+    b2(i, 0) = 1;
+    b2(i, 1) = static_cast<double>(i % 5);
+  }
+  std::cout << "n = " << n << ", Cholesky difference from dense LU: "
+            << test::close(matrix::CholeskyFactorization<double>{S2}.solve(b2),
+                           matrix::solve_partial_pivot(
+                               matrix::Matrix<double>{S2}, b2))
+            << std::endl;
+  matrix::Matrix<double> dense_L =
+      matrix::CholeskyFactorization<double>{matrix::Matrix<double>{S2}}.L();
+  std::cout << "n = " << n << ", packed L difference from the dense one: "
+            << test::close(matrix::CholeskyFactorization<double>{S2}.L(),
+                           dense_L)
+            << std::endl;
+
+  // Factored in place, in the packed storage of S3.
+  matrix::SymmetricMatrix<double> S3{S2};
+  matrix::CholeskyFactorization<double> in_place{std::move(S3)};
+  std::cout << "n = " << n
+            << ", in place: " << test::close(in_place.L(), dense_L)
+            << std::endl;
+  S2(n - 1, n - 1) = -1;
+  bool refused = false;
+  try {
+    matrix::CholeskyFactorization<double>{S2};
+  } catch (const std::domain_error &) {
+    refused = true;
+  }
+  std::cout << "Packed Cholesky refuses an indefinite matrix: "
+            << (test::expect(refused) ? "yes" : "no") << std::endl;
+  std::cout << "n = " << n << ", LDL^T difference from dense LU: "
+            << test::close(matrix::LDLTFactorization<double>{A2}.solve(b2),
+                           matrix::solve_partial_pivot(A2, b2))
+            << std::endl;
+  return test::exit_status();
+}
@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "matrix_lib/matrix_lib.hpp"
+
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+/**
+ *  Checks shared by the test programs.
+ *
+ *  Every check records whether it passed, and main returns
+ *  test::exit_status(), so a test program fails on any wrong result while
+ *  still printing the rest of its report. below() and close() return the
+ *  outcome as text for that report.
+ */
+
+namespace test {
+
+inline bool &all_passed_() {
+  static bool passed = true;
+  return passed;
+}
+
+// Record a check, and return whether it passed.
+inline bool expect(bool passed) {
+  all_passed_() = all_passed_() && passed;
+  return passed;
+}
+
+// Record that error < tol, and return "< tol" or "too large".
+inline std::string below(double error, double tol = 1e-12) {
+  if (!expect(error < tol))
+    return "too large";
+  std::ostringstream s;
+  s << tol;
+  std::string t = s.str();
+  std::size_t e = t.find("e-0"); // 1e-08 as 1e-8.
+  if (e != std::string::npos)
+    t.erase(e + 2, 1);
+  return "< " + t;
+}
+
+// below() for the inf norm of x - expected, relative to that of expected
+// once it exceeds 1. x and expected may be any matrices or vectors of the
+// same shape.
+template <typename X, typename E>
+std::string close(const X &x, const E &expected, double tol = 1e-12) {
+  return below(matrix::infNorm(x - expected) /
+                   std::max(1.0, matrix::infNorm(expected)),
+               tol);
+}
+
+inline int exit_status() { return all_passed_() ? 0 : 1; }
+
+} // namespace test
+
+#endif
@@ -0,0 +1,161 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/**
+ *  The thread pool: parallel_for and parallel_reduce against serial loops,
+ *  from empty ranges and ranges shorter than one chunk to ones split over
+ *  every thread; parallel loops nested in a parallel region, which must run
+ *  serially on the calling thread; products and sums that are the same bit
+ *  for bit on one thread and on four; and the MATRIX_NUM_THREADS default.
+ */
+
+using matrix::Matrix;
+
+const std::size_t grain = matrix::internal::parallel_grain_;
+
+// Every index of [0, n) written exactly once, and a sum against a serial
+// loop, on the current pool.
+void loops(std::size_t n) {
+  std::vector<unsigned> hits(n);
+  matrix::parallel_for(0, n, grain, [&](std::size_t lo, std::size_t hi) {
+    for (std::size_t i = lo; i < hi; i++)
+      hits[i]++;
+  });
+  bool once = true;
+  for (std::size_t i = 0; i < n; i++)
+    once = once && hits[i] == 1;
+
+  double serial = 1;
+  for (std::size_t i = 0; i < n; i++)
+    serial += std::sin(0.001 * i);
+  double sum = matrix::parallel_reduce(
+      0, n, grain, 1.0,
+      [](std::size_t lo, std::size_t hi) {
+        double s = 0;
+        for (std::size_t i = lo; i < hi; i++)
+          s += std::sin(0.001 * i);
+        return s;
+      },
+      [](double a, double b) { return a + b; });
+
+  std::cout << "  n = " << n << ": parallel_for visits every index once: "
+            << (test::expect(once) ? "yes" : "no")
+            << ", parallel_reduce difference from a serial sum: "
+            << test::below(std::abs(sum - serial) / std::max(1.0, n * 1.0))
+            << std::endl;
+}
+
+int main() {
+  // The library pool takes its size from MATRIX_NUM_THREADS, read here
+  // before anything resizes it.
+  unsigned initial = matrix::num_threads();
+  std::cout << "Default pool size matches MATRIX_NUM_THREADS or the "
+               "hardware: "
+            << (test::expect(initial ==
+                             matrix::internal::default_num_threads_())
+                    ? "yes"
+                    : "no")
+            << std::endl;
+  setenv("MATRIX_NUM_THREADS", "3", 1);
+  bool from_env = matrix::internal::default_num_threads_() == 3 &&
+                  matrix::ThreadPool{}.size() == 3;
+  setenv("MATRIX_NUM_THREADS", "none", 1);
+  unsigned hardware = std::max(std::thread::hardware_concurrency(), 1u);
+  bool fallback = matrix::internal::default_num_threads_() == hardware;
+  unsetenv("MATRIX_NUM_THREADS");
+  std::cout << "MATRIX_NUM_THREADS=3 gives 3 threads: "
+            << (test::expect(from_env) ? "yes" : "no")
+            << ", an invalid value falls back to the hardware's: "
+            << (test::expect(fallback) ? "yes" : "no") << std::endl
+            << std::endl;
+
+  const std::size_t sizes[] = {0, 1, 100, grain, grain + 1, 5 * grain + 3,
+                               1 << 22};
+  for (unsigned threads : {1, 4}) {
+    matrix::set_num_threads(threads);
+    std::cout << threads << (threads == 1 ? " thread:" : " threads:")
+              << std::endl;
+    for (std::size_t n : sizes)
+      loops(n);
+  }
+  std::cout << std::endl;
+
+  // Loops and products nested in a parallel region run on the thread that
+  // reached them, and give the same results as at the top level.
+  std::size_t n = 1 << 20;
+  auto sum = [n] {
+    return matrix::parallel_reduce(
+        0, n, grain, 0.0,
+        [](std::size_t lo, std::size_t hi) {
+          double s = 0;
+          for (std::size_t i = lo; i < hi; i++)
+            s += 1.0 / (1 + i);
+          return s;
+        },
+        [](double a, double b) { return a + b; });
+  };
+  Matrix<double> A{200, 200}, B{200, 200};
+  for (unsigned i = 0; i < 200; i++)
+    for (unsigned j = 0; j < 200; j++) {
+      A(i, j) = std::sin(0.3 * i + j);
+      B(i, j) = std::cos(i + 0.7 * j);
+    }
+  double top_sum = sum();
+  Matrix<double> top_product = A * B;
+
+  const unsigned outer = 8;
+  std::vector<int> same_thread(outer), same_results(outer);
+  matrix::parallel_for(0, outer, 1, [&](std::size_t lo, std::size_t hi) {
+    for (std::size_t c = lo; c < hi; c++) {
+      std::thread::id self = std::this_thread::get_id();
+      bool here = true;
+      matrix::parallel_for(0, 4 * grain, grain, [&](std::size_t, std::size_t) {
+        here = here && std::this_thread::get_id() == self;
+      });
+      same_thread[c] = here;
+      same_results[c] = sum() == top_sum &&
+                        matrix::infNorm(A * B - top_product) == 0;
+    }
+  });
+  bool serial = true, same = true;
+  for (unsigned c = 0; c < outer; c++) {
+    serial = serial && same_thread[c];
+    same = same && same_results[c];
+  }
+  std::cout << "Nested loops run on the calling thread: "
+            << (test::expect(serial) ? "yes" : "no")
+            << ", nested sums and products equal the top-level ones: "
+            << (test::expect(same) ? "yes" : "no") << std::endl;
+
+  // The same sums and products on one thread as on four.
+  Matrix<double> C{700, 600}, D{600, 500};
+  for (unsigned i = 0; i < 700; i++)
+    for (unsigned j = 0; j < 600; j++)
+      C(i, j) = std::sin(0.01 * i * j + i);
+  for (unsigned i = 0; i < 600; i++)
+    for (unsigned j = 0; j < 500; j++)
+      D(i, j) = std::cos(0.02 * i * j + j);
+  auto plus = [](double a, double b) { return a + b; };
+  matrix::set_num_threads(1);
+  Matrix<double> product_1 = C * D;
+  double sum_1 = sum(), reduced_1 = matrix::reduce(C, 0.0, plus);
+  matrix::set_num_threads(4);
+  Matrix<double> product_4 = C * D;
+  double sum_4 = sum(), reduced_4 = matrix::reduce(C, 0.0, plus);
+  std::cout << "1 and 4 threads give identical products: "
+            << (test::expect(matrix::infNorm(product_1 - product_4) == 0)
+                    ? "yes"
+                    : "no")
+            << ", sums: "
+            << (test::expect(sum_1 == sum_4 && reduced_1 == reduced_4)
+                    ? "yes"
+                    : "no")
+            << std::endl;
+  return test::exit_status();
+}
@@ -0,0 +1,117 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <cmath>
+#include <iostream>
+
+/**
+ *  Tiled LU and Cholesky factorizations run on the task-graph scheduler.
+ *  A tiny tile size is used so the 4 x 4 examples span several tiles; the
+ *  600 x 600 ones use the default tiles, on four threads, so that tile
+ *  tasks are stolen between threads. LU is checked against LUPartialPivot
+ *  and Cholesky by multiplying L L^T back out.
+ */
+
+using matrix::Matrix;
+
+std::string check_pivots(const Matrix<unsigned> &p,
+                         const Matrix<unsigned> &expected) {
+  bool same = p.rows == expected.rows;
+  for (unsigned i = 0; same && i < p.rows; i++)
+    same = p(i, 0) == expected(i, 0);
+  return test::expect(same) ? "same" : "different";
+}
+
+// L * L^T, for a lower triangular L, with its upper triangle checked to be
+// zero.
+Matrix<double> times_transpose(const Matrix<double> &L) {
+  Matrix<double> Lt{L.cols, L.rows};
+  for (unsigned i = 0; i < L.rows; i++)
+    for (unsigned j = 0; j < L.cols; j++) {
+      Lt(j, i) = L(i, j);
+      test::expect(j <= i || L(i, j) == 0);
+    }
+  return L * Lt;
+}
+
+int main() {
+  // clang-format off
+  Matrix<double> A{
+    {0.1, 5,   4,   1  },
+    {1,   3,   2.3, 0  },
+    {23,  0.1, 2,   7  },
+    {4,   -2,  0.5, 1.5}
+  };
+  // clang-format on
+
+  std::cout << "Matrix A = " << std::endl
+            << std::string(A) << std::endl
+            << std::endl;
+
+  std::pair<Matrix<double>, Matrix<unsigned>> tiled =
+      matrix::LUPartialPivotTiled(A, 2);
+  std::pair<Matrix<double>, Matrix<unsigned>> blocked =
+      matrix::LUPartialPivot(A);
+
+  std::cout << "Tiled LU w/ partial pivoting, M = " << std::endl
+            << std::string(tiled.first) << std::endl
+            << std::endl;
+  std::cout << "Difference from LUPartialPivot: "
+            << test::close(tiled.first, blocked.first) << ", pivots "
+            << check_pivots(tiled.second, blocked.second) << std::endl
+            << std::endl;
+
+  // clang-format off
+  Matrix<double> S{
+    {4,  2,  0.4, 1  },
+    {2,  5,  1,   0.5},
+    {0.4, 1, 3,   0.2},
+    {1,  0.5, 0.2, 2 }
+  };
+  // clang-format on
+
+  std::cout << "Symmetric positive definite matrix S = " << std::endl
+            << std::string(S) << std::endl
+            << std::endl;
+
+  Matrix<double> L = matrix::CholeskyTiled(S, 2);
+  std::cout << "Tiled Cholesky factor L = " << std::endl
+            << std::string(L) << std::endl
+            << std::endl;
+
+  Matrix<double> LLt = times_transpose(L);
+  std::cout << "Verify, L * L^T = " << std::endl
+            << std::string(LLt) << std::endl;
+  std::cout << "Difference from S: " << test::close(LLt, S) << std::endl
+            << std::endl;
+
+  // Several tiles of the default size in each direction. A2 has one large
+  // entry in every row and column, so it is well conditioned, and pivoting
+  // picks those entries, moving every row.
+  matrix::set_num_threads(4);
+  unsigned n = 600;
+  Matrix<double> A2{n, n}, B{n, n};
+  for (unsigned i = 0; i < n; i++)
+    for (unsigned j = 0; j < n; j++) {
+      A2(i, j) = std::sin(0.37 * i * j + i + 2.0 * j);
+      B(i, j) = std::cos(0.53 * i * j + 3.0 * i + j);
+    }
+  Matrix<double> S2 = B * B.transpose();
+  for (unsigned i = 0; i < n; i++) {
+    A2(i, (7 * i + 3) % n) += n;
+    S2(i, i) += n;
+  }
+
+  std::pair<Matrix<double>, Matrix<unsigned>> tiled2 =
+      matrix::LUPartialPivotTiled(A2);
+  std::pair<Matrix<double>, Matrix<unsigned>> blocked2 =
+      matrix::LUPartialPivot(A2);
+  std::cout << "n = " << n << ", " << matrix::num_threads()
+            << " threads, tiled LU difference from LUPartialPivot: "
+            << test::close(tiled2.first, blocked2.first) << ", pivots "
+            << check_pivots(tiled2.second, blocked2.second) << std::endl;
+  std::cout << "n = " << n << ", " << matrix::num_threads()
+            << " threads, tiled Cholesky L * L^T difference from S: "
+            << test::close(times_transpose(matrix::CholeskyTiled(S2)), S2)
+            << std::endl;
+  return test::exit_status();
+}
@@ -0,0 +1,92 @@
+#include "matrix_lib/matrix_lib.hpp"
+#include "test_check.hpp"
+#include <iostream>
+
+/**
+ *  Blocks, rows, columns and transposes as views of a matrix's storage.
+ */
+
+using matrix::Matrix;
+
+int main() {
+  // clang-format off
+  Matrix<double> A{
+    {1,  2,  3,  4 },
+    {5,  6,  7,  8 },
+    {9,  10, 11, 12},
+    {13, 14, 15, 16}
+  };
+  // clang-format on
+
+  std::cout << "Matrix A = " << std::endl
+            << std::string(A) << std::endl
+            << std::endl;
+
+  Matrix<double> At = A.transpose();
+  std::cout << "A^T = " << std::endl
+            << std::string(At) << std::endl
+            << "Difference from expected: "
+            << test::close(At, Matrix<double>{{1, 5, 9, 13},
+                                              {2, 6, 10, 14},
+                                              {3, 7, 11, 15},
+                                              {4, 8, 12, 16}})
+            << std::endl
+            << std::endl;
+
+  Matrix<double> B = A.block(1, 1, 2, 3);
+  std::cout << "Block of A at (1, 1), 2 x 3 = " << std::endl
+            << std::string(B) << std::endl
+            << "Difference from expected: "
+            << test::close(B, Matrix<double>{{6, 7, 8}, {10, 11, 12}})
+            << std::endl
+            << std::endl;
+
+  // Products read views in place, so A^T * A needs no copy of A^T.
+  Matrix<double> AtA = A.transpose() * A;
+  std::cout << "A^T * A = " << std::endl
+            << std::string(AtA) << std::endl
+            << "Difference from expected: "
+            << test::close(AtA, Matrix<double>{{276, 304, 332, 360},
+                                               {304, 336, 368, 400},
+                                               {332, 368, 404, 440},
+                                               {360, 400, 440, 480}})
+            << std::endl
+            << std::endl;
+
+  // Writing through views changes A.
+  A.row(0) = A.row(3);
+  A.block(2, 2, 2, 2) = 2.0 * A.block(2, 2, 2, 2);
+  std::cout << "A after copying row 3 to row 0 and doubling the lower right "
+               "2 x 2 block = "
+            << std::endl
+            << std::string(A) << std::endl
+            << "Difference from expected: "
+            << test::close(A, Matrix<double>{{13, 14, 15, 16},
+                                             {5, 6, 7, 8},
+                                             {9, 10, 22, 24},
+                                             {13, 14, 30, 32}})
+            << std::endl
+            << std::endl;
+
+  // Solve a system whose matrix and right-hand side are blocks of A.
+  // clang-format off
+  Matrix<double> C{
+    {4,  1,  0, 1},
+    {1,  4,  1, 2},
+    {0,  1,  4, 3},
+    {0,  0,  0, 0}
+  };
+  // clang-format on
+  matrix::LUFactorization<double> lu{C.block(0, 0, 3, 3)};
+  lu.solve_in_place(C.block(0, 3, 3, 1));
+  std::cout << "Solution of C[0:3, 0:3] x = C[0:3, 3], written over the "
+               "last column of C = "
+            << std::endl
+            << std::string(C) << std::endl;
+  std::cout << "Difference of C[0:3, 0:3] x from the old C[0:3, 3]: "
+            << test::close(Matrix<double>{C.block(0, 0, 3, 3)} *
+                               Matrix<double>{C.block(0, 3, 3, 1)},
+                           Matrix<double>{{1}, {2}, {3}})
+            << std::endl;
+  return test::exit_status();
+}
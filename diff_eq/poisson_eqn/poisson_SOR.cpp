@@ -0,0 +1,63 @@
+// Solve Poisson's equation using red-black successive over-relaxation.
+//
+// Same problem as poisson_SOR.py (see poisson_setup.py), solved with the
+// matrix-free SOR engine in cpp_matrix/matrix_lib/poisson.hpp.
+//
+// Usage: poisson_SOR [M] [output file]
+//
+// M is the number of grid points on a side (default 201). The solution
+// grid is written as M lines of M numbers, which np.loadtxt() reads back.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include "matrix_lib/matrix_lib.hpp"
+#include "poisson_setup.hpp"
+
+int main(int argc, char *argv[]) {
+  unsigned M = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : 201;
+  std::string out_file = argc > 2 ? argv[2] : "poisson_SOR.txt";
+  if (M < 3) {
+    std::cerr << "Grid must have at least 3 points on a side." << std::endl;
+    return 1;
+  }
+
+  // Spacing of mesh points.
+  double h = 1.0 / (M - 1);
+  matrix::Matrix<double> f = plate_rhs(M);
+
+  // poisson_SOR.py stops when ||Ax - b|| < 2 eps; its A and b are the
+  // equation here scaled by h^2.
+  double mach_eps = std::numeric_limits<double>::epsilon();
+  matrix::SOROptions opts;
+  opts.omega = matrix::sor_omega(M, M);
+  opts.tol = 2 * mach_eps / (h * h);
+
+  std::cout << "Grid size M = " << M << ", omega = " << opts.omega
+            << ", threads = " << matrix::num_threads() << std::endl;
+  std::cout << "Setting convergence threshold to 2 * machine epsilon."
+            << std::endl;
+
+  matrix::Matrix<double> u{M, M};
+  auto start = std::chrono::steady_clock::now();
+  matrix::SORResult result = matrix::sor_poisson(u, f, h, opts);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::printf("Performed %u SOR sweeps %s in %.2f seconds.\n", result.sweeps,
+              result.converged ? "to convergence" : "without converging",
+              elapsed.count());
+  std::printf("Final residual ||Ax - b|| = %.3e\n", result.residual * h * h);
+
+  if (!write_grid(u, out_file)) {
+    std::cerr << "Could not open " << out_file << std::endl;
+    return 1;
+  }
+  std::cout << "Wrote solution grid to " << out_file << std::endl;
+
+  return result.converged ? 0 : 2;
+}
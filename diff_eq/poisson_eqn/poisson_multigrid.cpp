@@ -0,0 +1,61 @@
+// Solve Poisson's equation using geometric multigrid.
+//
+// Same problem and stopping threshold as poisson_SOR.py and poisson_SOR.cpp,
+// solved with PoissonMultigrid from cpp_matrix/matrix_lib/poisson.hpp.
+//
+// Usage: poisson_multigrid [M] [V|F] [output file]
+//
+// M is the number of grid points on a side (default 201). Multigrid works
+// best when M - 1 is divisible by a large power of two, e.g. M = 2049.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include "matrix_lib/matrix_lib.hpp"
+#include "poisson_setup.hpp"
+
+int main(int argc, char *argv[]) {
+  unsigned M = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : 201;
+  std::string cycle = argc > 2 ? argv[2] : "V";
+  std::string out_file = argc > 3 ? argv[3] : "poisson_multigrid.txt";
+  if (M < 3) {
+    std::cerr << "Grid must have at least 3 points on a side." << std::endl;
+    return 1;
+  }
+
+  double h = 1.0 / (M - 1);
+  matrix::Matrix<double> f = plate_rhs(M);
+
+  // Same threshold as poisson_SOR.py: ||Ax - b|| < 2 eps, with A and b the
+  // equation here scaled by h^2.
+  matrix::MultigridOptions opts;
+  opts.cycle = cycle == "F" ? matrix::Cycle::F : matrix::Cycle::V;
+  opts.tol = 2 * std::numeric_limits<double>::epsilon() / (h * h);
+
+  auto start = std::chrono::steady_clock::now();
+  matrix::PoissonMultigrid<double> mg{M, M, h, opts};
+  matrix::Matrix<double> u{M, M};
+  matrix::MultigridResult result = mg.solve(u, f);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << "Grid size M = " << M << ", " << mg.num_levels()
+            << " levels, threads = " << matrix::num_threads() << std::endl;
+  std::printf("Performed %u %s-cycles %s in %.2f seconds.\n", result.cycles,
+              cycle == "F" ? "F" : "V",
+              result.converged ? "to convergence" : "without converging",
+              elapsed.count());
+  std::printf("Final residual ||Ax - b|| = %.3e\n", result.residual * h * h);
+
+  if (!write_grid(u, out_file)) {
+    std::cerr << "Could not open " << out_file << std::endl;
+    return 1;
+  }
+  std::cout << "Wrote solution grid to " << out_file << std::endl;
+
+  return result.converged ? 0 : 2;
+}
@@ -0,0 +1,58 @@
+// Setup for discrete Poisson equation solution; C++ counterpart of
+// poisson_setup.py for the programs in this folder.
+//
+// We solve Lu = g on [0, 1] x [0, 1] w/ Dirichlet condition u = 0 on
+// boundary, using a finite-difference approximation.
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "matrix_lib/matrix_lib.hpp"
+
+#ifndef POISSON_SETUP_H
+#define POISSON_SETUP_H
+
+// Charge distribution g on an M x M grid: two vertical plates with
+// opposite charge.
+inline matrix::Matrix<double> plate_charge(unsigned M) {
+  const double L_RAT = 7.0 / 16, R_RAT = 9.0 / 16, H_RAT = 1.0 / 2;
+  const unsigned PLATE_WIDTH = 1;
+
+  unsigned l_coord = static_cast<unsigned>(M * L_RAT);
+  unsigned r_coord = static_cast<unsigned>(M * R_RAT);
+  unsigned t_cord = static_cast<unsigned>(M * (1 - H_RAT) / 2.0);
+  unsigned b_cord = t_cord + static_cast<unsigned>(M * H_RAT);
+
+  matrix::Matrix<double> g{M, M};
+  double normalizer = std::pow(2.0 / (b_cord - t_cord), 4);
+  for (unsigned i = t_cord; i <= b_cord; i++)
+    for (unsigned w = 0; w < PLATE_WIDTH; w++) {
+      g(i, l_coord + w) = 0.3 + normalizer * std::pow(i - (M - 1) / 2.0, 4);
+      g(i, r_coord + w) = -g(i, l_coord + w);
+    }
+  return g;
+}
+
+// Right-hand side f of Laplacian(u) = f whose solution is the grid the
+// Python scripts report: they solve Ax = h^2 g and print u = -x.
+inline matrix::Matrix<double> plate_rhs(unsigned M) {
+  matrix::Matrix<double> g = plate_charge(M);
+  return matrix::map([](double x) { return -x; }, g);
+}
+
+// Write u as one line of numbers per grid row, the format np.loadtxt()
+// reads. Returns false if the file can't be opened.
+inline bool write_grid(const matrix::Matrix<double> &u,
+                       const std::string &filename) {
+  std::FILE *out = std::fopen(filename.c_str(), "w");
+  if (!out)
+    return false;
+  for (unsigned i = 0; i < u.rows; i++)
+    for (unsigned j = 0; j < u.cols; j++)
+      std::fprintf(out, "%.18e%c", u(i, j), j + 1 < u.cols ? ' ' : '\n');
+  std::fclose(out);
+  return true;
+}
+
+#endif